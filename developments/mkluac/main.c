@@ -0,0 +1,201 @@
+/*
+ * developments/mkluac/main.c
+ *
+ * Host tool precompiling the lua scripts of romdisk directories, each
+ * 'foo.lua' gets a 'foo.luac' sibling loaded in its place by the vm.
+ *
+ * Layout, all fields little endian:
+ *   header  : magic "XLUC", lua version, source size, source crc32
+ *   chunk   : lua_dump of the compiled source, with debug information
+ *
+ * The chunk name is the path relative to the given directory, the same
+ * name the vm uses when it compiles the source itself.
+ *
+ * Copyright(c) 2007-2018 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <lua.h>
+#include <lauxlib.h>
+
+#define LUAC_HEADER_SIZE	(16)
+
+static void put32(uint8_t * p, uint32_t v)
+{
+	p[0] = (v >> 0) & 0xff;
+	p[1] = (v >> 8) & 0xff;
+	p[2] = (v >> 16) & 0xff;
+	p[3] = (v >> 24) & 0xff;
+}
+
+static uint32_t crc32(uint32_t crc, const uint8_t * buf, size_t len)
+{
+	int i;
+
+	crc = crc ^ 0xffffffff;
+	while(len--)
+	{
+		crc ^= *buf++;
+		for(i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+	}
+	return crc ^ 0xffffffff;
+}
+
+static int writer(lua_State * L, const void * p, size_t sz, void * ud)
+{
+	return (fwrite(p, 1, sz, (FILE *)ud) == sz) ? 0 : 1;
+}
+
+static int compile(lua_State * L, const char * path, const char * name)
+{
+	uint8_t hdr[LUAC_HEADER_SIZE];
+	char * luac, * buf;
+	FILE * fp;
+	long len;
+	int ret = -1;
+
+	fp = fopen(path, "rb");
+	if(!fp)
+		return -1;
+	fseek(fp, 0, SEEK_END);
+	len = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	buf = malloc(len + 1);
+	if(!buf || (fread(buf, 1, len, fp) != len))
+	{
+		fclose(fp);
+		free(buf);
+		return -1;
+	}
+	fclose(fp);
+
+	if(luaL_loadbuffer(L, buf, len, name) != LUA_OK)
+	{
+		fprintf(stderr, "mkluac: %s\r\n", lua_tostring(L, -1));
+		lua_pop(L, 1);
+		free(buf);
+		return -1;
+	}
+
+	luac = malloc(strlen(path) + 2);
+	if(luac)
+	{
+		strcpy(luac, path);
+		strcat(luac, "c");
+		fp = fopen(luac, "wb");
+		if(fp)
+		{
+			memcpy(&hdr[0], "XLUC", 4);
+			put32(&hdr[4], LUA_VERSION_NUM);
+			put32(&hdr[8], len);
+			put32(&hdr[12], crc32(0, (const uint8_t *)buf, len));
+			if((fwrite(hdr, 1, LUAC_HEADER_SIZE, fp) == LUAC_HEADER_SIZE) && (lua_dump(L, writer, fp, 0) == 0))
+				ret = 0;
+			if(fclose(fp) != 0)
+				ret = -1;
+			if(ret != 0)
+				remove(luac);
+		}
+		free(luac);
+	}
+	lua_pop(L, 1);
+	free(buf);
+	return ret;
+}
+
+static int walk(lua_State * L, const char * root, const char * rel)
+{
+	char path[8192], name[4096];
+	struct dirent * d;
+	struct stat st;
+	DIR * dir;
+	size_t len;
+	int ret = 0;
+
+	snprintf(path, sizeof(path), "%s%s%s", root, rel[0] ? "/" : "", rel);
+	dir = opendir(path);
+	if(!dir)
+		return -1;
+	while((d = readdir(dir)) != NULL)
+	{
+		if(!strcmp(d->d_name, ".") || !strcmp(d->d_name, ".."))
+			continue;
+		snprintf(name, sizeof(name), "%s%s%s", rel, rel[0] ? "/" : "", d->d_name);
+		snprintf(path, sizeof(path), "%s/%s", root, name);
+		if(stat(path, &st) != 0)
+			continue;
+		if(S_ISDIR(st.st_mode))
+		{
+			if(walk(L, root, name) != 0)
+				ret = -1;
+		}
+		else if(S_ISREG(st.st_mode))
+		{
+			len = strlen(name);
+			if((len > 4) && !strcmp(&name[len - 4], ".lua") && (compile(L, path, name) != 0))
+				ret = -1;
+		}
+	}
+	closedir(dir);
+	return ret;
+}
+
+static void usage(void)
+{
+	printf("usage:\r\n");
+	printf("    mkluac <directory> ...\r\n");
+}
+
+int main(int argc, char * argv[])
+{
+	lua_State * L;
+	int i, ret = 0;
+
+	if(argc < 2)
+	{
+		usage();
+		return -1;
+	}
+
+	L = luaL_newstate();
+	if(!L)
+		return -1;
+	for(i = 1; i < argc; i++)
+	{
+		if(walk(L, argv[i], "") != 0)
+		{
+			fprintf(stderr, "mkluac: failed to compile '%s'\r\n", argv[i]);
+			ret = -1;
+		}
+	}
+	lua_close(L);
+	return ret;
+}
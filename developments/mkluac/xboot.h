@@ -0,0 +1,4 @@
+/*
+ * Empty stand-in for the xboot header pulled in by luaconf.h, the lua core
+ * builds on the host with its stock configuration.
+ */
@@ -0,0 +1,226 @@
+/*
+ * developments/mkromdisk/main.c
+ *
+ * Host tool converting a romdisk image into the chunked lz4 romdisk format.
+ *
+ * Layout, all fields little endian:
+ *   header  : magic "RDZ4", chunk size, chunk count, reserved, image size (u64)
+ *   index   : chunk count + 1 offsets (u32) from the start of the image,
+ *             bit 31 set when the chunk is stored without compression
+ *   data    : chunks, each independently compressed with lz4
+ *
+ * When the input is a newc cpio archive, chunks holding the data of files
+ * whose name ends with one of the -x suffixes are always stored raw, so the
+ * romdisk can map those files in place.
+ *
+ * Copyright(c) 2007-2018 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <lz4.h>
+#include <lz4hc.h>
+
+#define ROMDISK_LZ4_RAW		(1U << 31)
+#define MAX_SUFFIX			(16)
+
+static void put32(uint8_t * p, uint32_t v)
+{
+	p[0] = (v >> 0) & 0xff;
+	p[1] = (v >> 8) & 0xff;
+	p[2] = (v >> 16) & 0xff;
+	p[3] = (v >> 24) & 0xff;
+}
+
+static uint32_t hex32(const char * p)
+{
+	char buf[9];
+
+	memcpy(buf, p, 8);
+	buf[8] = 0;
+	return strtoul(buf, NULL, 16);
+}
+
+static int has_suffix(const char * name, char ** suffix, int nsuffix)
+{
+	size_t l = strlen(name), k;
+	int i;
+
+	for(i = 0; i < nsuffix; i++)
+	{
+		k = strlen(suffix[i]);
+		if((l >= k) && !strcmp(name + l - k, suffix[i]))
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Walk the newc headers and flag the chunks covering the data of matching
+ * regular files, anything that is not a newc archive flags nothing
+ */
+static void mark_raw(FILE * fp, uint64_t size, uint32_t chunk, uint8_t * raw, char ** suffix, int nsuffix)
+{
+	char hdr[110], name[4096];
+	uint64_t pos = 0, data;
+	uint32_t mode, fsize, nsize, i;
+
+	while(pos + sizeof(hdr) <= size)
+	{
+		fseek(fp, pos, SEEK_SET);
+		if((fread(hdr, 1, sizeof(hdr), fp) != sizeof(hdr)) || memcmp(hdr, "070701", 6))
+			break;
+		mode = hex32(&hdr[14]);
+		fsize = hex32(&hdr[54]);
+		nsize = hex32(&hdr[94]);
+		if((nsize == 0) || (nsize > sizeof(name)) || (fread(name, 1, nsize, fp) != nsize))
+			break;
+		name[nsize - 1] = 0;
+		if(!strcmp(name, "TRAILER!!!"))
+			break;
+		data = (pos + sizeof(hdr) + nsize + 3) & ~3ULL;
+		if(((mode & 0170000) == 0100000) && (fsize > 0) && has_suffix(name, suffix, nsuffix))
+		{
+			for(i = data / chunk; i <= (data + fsize - 1) / chunk; i++)
+				raw[i] = 1;
+		}
+		pos = (data + fsize + 3) & ~3ULL;
+	}
+	fseek(fp, 0, SEEK_SET);
+}
+
+static void usage(void)
+{
+	printf("usage:\r\n");
+	printf("    mkromdisk [-c chunk] [-x suffix]... <input> <output>\r\n");
+}
+
+int main(int argc, char * argv[])
+{
+	FILE * ifp, * ofp;
+	uint8_t hdr[24];
+	uint8_t * in, * out, * idx, * raw;
+	uint32_t chunk = 32768, count, i, len, off, nraw = 0;
+	uint64_t size, total;
+	char * iname = NULL, * oname = NULL;
+	char * suffix[MAX_SUFFIX];
+	int nsuffix = 0;
+	int n;
+
+	for(n = 1; n < argc; n++)
+	{
+		if(!strcmp(argv[n], "-c") && (argc > n + 1))
+			chunk = strtoul(argv[++n], NULL, 0);
+		else if(!strcmp(argv[n], "-x") && (argc > n + 1) && (nsuffix < MAX_SUFFIX))
+			suffix[nsuffix++] = argv[++n];
+		else if(!iname)
+			iname = argv[n];
+		else if(!oname)
+			oname = argv[n];
+		else
+		{
+			usage();
+			return -1;
+		}
+	}
+	if(!iname || !oname || (chunk < 512) || (chunk & (chunk - 1)))
+	{
+		usage();
+		return -1;
+	}
+
+	ifp = fopen(iname, "rb");
+	if(!ifp)
+	{
+		printf("can't open input file '%s'\r\n", iname);
+		return -1;
+	}
+	fseek(ifp, 0, SEEK_END);
+	size = ftell(ifp);
+	fseek(ifp, 0, SEEK_SET);
+	count = (size + chunk - 1) / chunk;
+
+	in = malloc(chunk);
+	out = malloc(LZ4_compressBound(chunk));
+	idx = malloc((count + 1) * 4);
+	raw = calloc(count + 1, 1);
+	ofp = fopen(oname, "wb");
+	if(!in || !out || !idx || !raw || !ofp)
+	{
+		printf("can't create output file '%s'\r\n", oname);
+		fclose(ifp);
+		return -1;
+	}
+	if(nsuffix > 0)
+		mark_raw(ifp, size, chunk, raw, suffix, nsuffix);
+
+	memcpy(&hdr[0], "RDZ4", 4);
+	put32(&hdr[4], chunk);
+	put32(&hdr[8], count);
+	put32(&hdr[12], 0);
+	put32(&hdr[16], (uint32_t)(size >> 0));
+	put32(&hdr[20], (uint32_t)(size >> 32));
+	fwrite(hdr, 1, sizeof(hdr), ofp);
+	fwrite(idx, 1, (count + 1) * 4, ofp);
+
+	off = sizeof(hdr) + (count + 1) * 4;
+	total = off;
+	for(i = 0; i < count; i++)
+	{
+		memset(in, 0, chunk);
+		len = fread(in, 1, chunk, ifp);
+		n = raw[i] ? 0 : LZ4_compress_HC((const char *)in, (char *)out, chunk, LZ4_compressBound(chunk), LZ4HC_CLEVEL_MAX);
+		if((n > 0) && (n < chunk))
+		{
+			put32(&idx[i * 4], off);
+			fwrite(out, 1, n, ofp);
+			off += n;
+		}
+		else
+		{
+			put32(&idx[i * 4], off | ROMDISK_LZ4_RAW);
+			fwrite(in, 1, chunk, ofp);
+			off += chunk;
+			nraw++;
+		}
+		(void)len;
+	}
+	put32(&idx[count * 4], off);
+	total = off;
+
+	fseek(ofp, sizeof(hdr), SEEK_SET);
+	fwrite(idx, 1, (count + 1) * 4, ofp);
+	fclose(ofp);
+	fclose(ifp);
+	free(in);
+	free(out);
+	free(idx);
+	free(raw);
+
+	printf("romdisk: %llu bytes -> %llu bytes, %u chunks of %u, %u raw\r\n", (unsigned long long)size, (unsigned long long)total, count, chunk, nraw);
+	return 0;
+}
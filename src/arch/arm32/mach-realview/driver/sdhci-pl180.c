@@ -318,6 +318,7 @@ static struct device_t * sdhci_pl180_probe(struct driver_t * drv, struct dtnode_
 	sdhci->width = MMC_BUS_WIDTH_4;
 	sdhci->clock = 26 * 1000 * 1000;
 	sdhci->removeable = TRUE;
+	sdhci->caps = 0;
 	sdhci->detect = sdhci_pl180_detect;
 	sdhci->setwidth = sdhci_pl180_setwidth;
 	sdhci->setclock = sdhci_pl180_setclock;
@@ -271,24 +271,46 @@ static struct device_t * fb_rk3128_probe(struct driver_t * drv, struct dtnode_t
 	struct device_t * dev;
 	virtual_addr_t virt = phys_to_virt(dt_read_address(n));
 	char * clk = dt_read_string(n, "clock-name", NULL);
+	char * regulator = dt_read_string(n, "regulator-name", NULL);
+	char * backlight = dt_read_string(n, "backlight", NULL);
+	int delay = dt_read_int(n, "power-on-delay", 0);
 
 	if(!search_clk(clk))
 		return NULL;
 
+	if(regulator && !search_regulator(regulator))
+		return PROBE_DEFER;
+	if(backlight && !search_led(backlight))
+		return PROBE_DEFER;
+
+	/*
+	 * power up the panel first and let it settle before it is taken out of reset
+	 */
+	if(probe_stage() == 0)
+	{
+		regulator_enable(regulator);
+		if(delay > 0)
+			return probe_defer(delay);
+	}
+
 	pdat = malloc(sizeof(struct fb_rk3128_pdata_t));
 	if(!pdat)
+	{
+		regulator_disable(regulator);
 		return NULL;
+	}
 
 	fb = malloc(sizeof(struct framebuffer_t));
 	if(!fb)
 	{
+		regulator_disable(regulator);
 		free(pdat);
 		return NULL;
 	}
 
 	pdat->virtlcd = virt;
 	pdat->virtgrf = phys_to_virt(RK3128_GRF_BASE);
-	pdat->regulator = strdup(dt_read_string(n, "regulator-name", NULL));
+	pdat->regulator = strdup(regulator);
 	pdat->lcdrst = dt_read_int(n, "lcd-reset-gpio", -1);
 	pdat->lcdrstcfg = dt_read_int(n, "lcd-reset-gpio-config", -1);
 	pdat->lcden = dt_read_int(n, "lcd-enable-gpio", -1);
@@ -315,7 +337,7 @@ static struct device_t * fb_rk3128_probe(struct driver_t * drv, struct dtnode_t
 	pdat->timing.v_sync_active = dt_read_bool(n, "vsync-active", 0);
 	pdat->timing.den_active = dt_read_bool(n, "den-active", 0);
 	pdat->timing.clk_active = dt_read_bool(n, "clk-active", 0);
-	pdat->backlight = search_led(dt_read_string(n, "backlight", NULL));
+	pdat->backlight = search_led(backlight);
 
 	fb->name = alloc_device_name(dt_read_name(n), -1);
 	fb->width = pdat->width;
@@ -330,7 +352,6 @@ static struct device_t * fb_rk3128_probe(struct driver_t * drv, struct dtnode_t
 	fb->present = fb_present;
 	fb->priv = pdat;
 
-	regulator_enable(pdat->regulator);
 	clk_enable(pdat->clk);
 	if(pdat->lcdrst >= 0)
 	{
@@ -367,6 +388,11 @@ static struct device_t * fb_rk3128_probe(struct driver_t * drv, struct dtnode_t
 	return dev;
 }
 
+static void fb_rk3128_cancel(struct driver_t * drv, struct dtnode_t * n)
+{
+	regulator_disable(dt_read_string(n, "regulator-name", NULL));
+}
+
 static void fb_rk3128_remove(struct device_t * dev)
 {
 	struct framebuffer_t * fb = (struct framebuffer_t *)dev->priv;
@@ -407,6 +433,7 @@ static void fb_rk3128_resume(struct device_t * dev)
 static struct driver_t fb_rk3128 = {
 	.name		= "fb-rk3128",
 	.probe		= fb_rk3128_probe,
+	.cancel		= fb_rk3128_cancel,
 	.remove		= fb_rk3128_remove,
 	.suspend	= fb_rk3128_suspend,
 	.resume		= fb_rk3128_resume,
@@ -382,6 +382,9 @@ static struct device_t * regulator_rk816_probe(struct driver_t * drv, struct dtn
 	if(channel < 0 || channel > 13)
 		return NULL;
 
+	if(!search_i2c(dt_read_string(n, "i2c-bus", NULL)))
+		return dt_read_string(n, "i2c-bus", NULL) ? PROBE_DEFER : NULL;
+
 	i2cdev = i2c_device_alloc(dt_read_string(n, "i2c-bus", NULL), dt_read_int(n, "slave-address", 0x1c), 0);
 	if(!i2cdev)
 		return NULL;
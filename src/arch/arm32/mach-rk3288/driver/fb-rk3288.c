@@ -397,6 +397,38 @@ void fb_present(struct framebuffer_t * fb, struct render_t * render)
 	}
 }
 
+static const char * fb_rk3288_supply[] = {
+	"regulator-lcd-avdd-3v3",
+	"regulator-lcd-avdd-1v8",
+	"regulator-lcd-avdd-1v0",
+};
+
+static const int fb_rk3288_voltage[] = {
+	3300000,
+	1800000,
+	1000000,
+};
+
+static void fb_rk3288_power(struct dtnode_t * n, bool_t on)
+{
+	char * name;
+	int i;
+
+	for(i = 0; i < ARRAY_SIZE(fb_rk3288_supply); i++)
+	{
+		name = dt_read_string(n, fb_rk3288_supply[i], NULL);
+		if(on)
+		{
+			regulator_set_voltage(name, fb_rk3288_voltage[i]);
+			regulator_enable(name);
+		}
+		else
+		{
+			regulator_disable(name);
+		}
+	}
+}
+
 static struct device_t * fb_rk3288_probe(struct driver_t * drv, struct dtnode_t * n)
 {
 	struct fb_rk3288_pdata_t * pdat;
@@ -404,17 +436,43 @@ static struct device_t * fb_rk3288_probe(struct driver_t * drv, struct dtnode_t
 	struct device_t * dev;
 	virtual_addr_t virt = phys_to_virt(dt_read_address(n));
 	char * clk = dt_read_string(n, "clock-name", NULL);
+	char * backlight = dt_read_string(n, "backlight", NULL);
+	int delay = dt_read_int(n, "power-on-delay", 0);
+	char * name;
+	int i;
 
 	if(!search_clk(clk))
 		return NULL;
 
+	for(i = 0; i < ARRAY_SIZE(fb_rk3288_supply); i++)
+	{
+		if((name = dt_read_string(n, fb_rk3288_supply[i], NULL)) && !search_regulator(name))
+			return PROBE_DEFER;
+	}
+	if(backlight && !search_led(backlight))
+		return PROBE_DEFER;
+
+	/*
+	 * power up the panel first and let it settle before the controller is set up
+	 */
+	if(probe_stage() == 0)
+	{
+		fb_rk3288_power(n, TRUE);
+		if(delay > 0)
+			return probe_defer(delay);
+	}
+
 	pdat = malloc(sizeof(struct fb_rk3288_pdata_t));
 	if(!pdat)
+	{
+		fb_rk3288_power(n, FALSE);
 		return NULL;
+	}
 
 	fb = malloc(sizeof(struct framebuffer_t));
 	if(!fb)
 	{
+		fb_rk3288_power(n, FALSE);
 		free(pdat);
 		return NULL;
 	}
@@ -457,7 +515,7 @@ static struct device_t * fb_rk3288_probe(struct driver_t * drv, struct dtnode_t
 	pdat->timing.v_sync_active = dt_read_bool(n, "vsync-active", 0);
 	pdat->timing.den_active = dt_read_bool(n, "den-active", 0);
 	pdat->timing.clk_active = dt_read_bool(n, "clk-active", 0);
-	pdat->backlight = search_led(dt_read_string(n, "backlight", NULL));
+	pdat->backlight = search_led(backlight);
 
 	fb->name = alloc_device_name(dt_read_name(n), -1);
 	fb->width = pdat->width;
@@ -472,12 +530,6 @@ static struct device_t * fb_rk3288_probe(struct driver_t * drv, struct dtnode_t
 	fb->present = fb_present;
 	fb->priv = pdat;
 
-	regulator_set_voltage(pdat->lcd_avdd_3v3, 3300000);
-	regulator_enable(pdat->lcd_avdd_3v3);
-	regulator_set_voltage(pdat->lcd_avdd_1v8, 1800000);
-	regulator_enable(pdat->lcd_avdd_1v8);
-	regulator_set_voltage(pdat->lcd_avdd_1v0, 1000000);
-	regulator_enable(pdat->lcd_avdd_1v0);
 	clk_enable(pdat->clk);
 	rk3288_fb_init(pdat);
 
@@ -504,6 +556,11 @@ static struct device_t * fb_rk3288_probe(struct driver_t * drv, struct dtnode_t
 	return dev;
 }
 
+static void fb_rk3288_cancel(struct driver_t * drv, struct dtnode_t * n)
+{
+	fb_rk3288_power(n, FALSE);
+}
+
 static void fb_rk3288_remove(struct device_t * dev)
 {
 	struct framebuffer_t * fb = (struct framebuffer_t *)dev->priv;
@@ -548,6 +605,7 @@ static void fb_rk3288_resume(struct device_t * dev)
 static struct driver_t fb_rk3288 = {
 	.name		= "fb-rk3288",
 	.probe		= fb_rk3288_probe,
+	.cancel		= fb_rk3288_cancel,
 	.remove		= fb_rk3288_remove,
 	.suspend	= fb_rk3288_suspend,
 	.resume		= fb_rk3288_resume,
@@ -480,6 +480,9 @@ static struct device_t * regulator_act8846_probe(struct driver_t * drv, struct d
 	if(channel < 0 || channel > 16)
 		return NULL;
 
+	if(!search_i2c(dt_read_string(n, "i2c-bus", NULL)))
+		return dt_read_string(n, "i2c-bus", NULL) ? PROBE_DEFER : NULL;
+
 	i2cdev = i2c_device_alloc(dt_read_string(n, "i2c-bus", NULL), dt_read_int(n, "slave-address", 0x5a), 0);
 	if(!i2cdev)
 		return NULL;
@@ -147,6 +147,7 @@ static struct device_t * sdhci_v3s_probe(struct driver_t * drv, struct dtnode_t
 	sdhci->width = MMC_BUS_WIDTH_4;
 	sdhci->clock = 26 * 1000 * 1000;
 	sdhci->removeable = TRUE;
+	sdhci->caps = 0;
 	sdhci->detect = sdhci_v3s_detect;
 	sdhci->setwidth = sdhci_v3s_setwidth;
 	sdhci->setclock = sdhci_v3s_setclock;
@@ -511,6 +511,9 @@ static struct device_t * regulator_axp228_probe(struct driver_t * drv, struct dt
 	if(channel < 0 || channel > 15)
 		return NULL;
 
+	if(!search_i2c(dt_read_string(n, "i2c-bus", NULL)))
+		return dt_read_string(n, "i2c-bus", NULL) ? PROBE_DEFER : NULL;
+
 	i2cdev = i2c_device_alloc(dt_read_string(n, "i2c-bus", NULL), 0x34, 0);
 	if(!i2cdev)
 		return NULL;
@@ -195,6 +195,9 @@ static struct device_t * regulator_syr83x_probe(struct driver_t * drv, struct dt
 	if(parent && !search_regulator(parent))
 		parent = NULL;
 
+	if(!search_i2c(dt_read_string(n, "i2c-bus", NULL)))
+		return dt_read_string(n, "i2c-bus", NULL) ? PROBE_DEFER : NULL;
+
 	i2cdev = i2c_device_alloc(dt_read_string(n, "i2c-bus", NULL), dt_read_int(n, "slave-address", 0x40), 0);
 	if(!i2cdev)
 		return NULL;
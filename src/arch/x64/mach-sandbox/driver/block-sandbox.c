@@ -0,0 +1,257 @@
+/*
+ * driver/block-sandbox.c
+ *
+ * Copyright(c) 2007-2018 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <xboot.h>
+#include <block/block.h>
+#include <sandbox.h>
+
+/*
+ * Block device backed by a host file
+ *
+ * Example:
+ *   "block-sandbox@0": {
+ *       "file": "disk.img",
+ *       "size": 67108864,
+ *       "block-size": 512,
+ *       "read-latency": 100,
+ *       "write-latency": 500,
+ *       "bandwidth": 0
+ *   }
+ *
+ * The image is created with the given size when it does not exist. Latencies
+ * are in microseconds per request and the bandwidth in bytes per second, zero
+ * for unlimited. The default sandbox.json has no such node, so no host file is
+ * created unless one is added in a device tree given with --json.
+ */
+
+struct block_sandbox_pdata_t
+{
+	int fd;
+	u32_t rlatency;
+	u32_t wlatency;
+	u64_t bandwidth;
+};
+
+static void block_sandbox_delay(struct block_sandbox_pdata_t * pdat, u32_t latency, u64_t length)
+{
+	u64_t us = latency;
+
+	if(pdat->bandwidth > 0)
+		us += length * 1000000ULL / pdat->bandwidth;
+	if(us > 0)
+		udelay(us);
+}
+
+static u64_t block_sandbox_read(struct block_t * blk, u8_t * buf, u64_t blkno, u64_t blkcnt)
+{
+	struct block_sandbox_pdata_t * pdat = (struct block_sandbox_pdata_t *)(blk->priv);
+	u64_t count = block_available_count(blk, blkno, blkcnt);
+	u64_t length = block_available_length(blk, blkno, blkcnt);
+
+	sandbox_file_seek(pdat->fd, block_offset(blk, blkno));
+	if(sandbox_file_read(pdat->fd, buf, length) != length)
+		return 0;
+	block_sandbox_delay(pdat, pdat->rlatency, length);
+	return count;
+}
+
+static u64_t block_sandbox_write(struct block_t * blk, u8_t * buf, u64_t blkno, u64_t blkcnt)
+{
+	struct block_sandbox_pdata_t * pdat = (struct block_sandbox_pdata_t *)(blk->priv);
+	u64_t count = block_available_count(blk, blkno, blkcnt);
+	u64_t length = block_available_length(blk, blkno, blkcnt);
+
+	sandbox_file_seek(pdat->fd, block_offset(blk, blkno));
+	if(sandbox_file_write(pdat->fd, buf, length) != length)
+		return 0;
+	block_sandbox_delay(pdat, pdat->wlatency, length);
+	return count;
+}
+
+static u64_t block_sandbox_fetch(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
+{
+	struct block_sandbox_pdata_t * pdat = (struct block_sandbox_pdata_t *)(blk->priv);
+
+	if(offset + count > block_capacity(blk))
+		return 0;
+	sandbox_file_seek(pdat->fd, offset);
+	if(sandbox_file_read(pdat->fd, buf, count) != count)
+		return 0;
+	block_sandbox_delay(pdat, pdat->rlatency, count);
+	return count;
+}
+
+static u64_t block_sandbox_program(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
+{
+	struct block_sandbox_pdata_t * pdat = (struct block_sandbox_pdata_t *)(blk->priv);
+
+	if(offset + count > block_capacity(blk))
+		return 0;
+	sandbox_file_seek(pdat->fd, offset);
+	if(sandbox_file_write(pdat->fd, buf, count) != count)
+		return 0;
+	block_sandbox_delay(pdat, pdat->wlatency, count);
+	return count;
+}
+
+static void block_sandbox_sync(struct block_t * blk)
+{
+}
+
+static struct device_t * block_sandbox_probe(struct driver_t * drv, struct dtnode_t * n)
+{
+	struct block_sandbox_pdata_t * pdat;
+	struct block_t * blk;
+	struct device_t * dev;
+	char * file = dt_read_string(n, "file", NULL);
+	u64_t size = dt_read_long(n, "size", 0);
+	u64_t blksz = dt_read_int(n, "block-size", 512);
+	u64_t length;
+	u8_t c = 0;
+	int fd;
+
+	if(!file || (blksz == 0))
+		return NULL;
+
+	if(sandbox_file_isfile(file))
+	{
+		fd = sandbox_file_open(file, "r+");
+		if(fd <= 0)
+			return NULL;
+	}
+	else
+	{
+		if(size < blksz)
+			return NULL;
+		fd = sandbox_file_open(file, "w+");
+		if(fd <= 0)
+			return NULL;
+		sandbox_file_seek(fd, size - 1);
+		sandbox_file_write(fd, &c, 1);
+	}
+
+	length = sandbox_file_length(fd);
+	if(length < blksz)
+	{
+		sandbox_file_close(fd);
+		return NULL;
+	}
+
+	pdat = malloc(sizeof(struct block_sandbox_pdata_t));
+	if(!pdat)
+	{
+		sandbox_file_close(fd);
+		return NULL;
+	}
+
+	blk = malloc(sizeof(struct block_t));
+	if(!blk)
+	{
+		sandbox_file_close(fd);
+		free(pdat);
+		return NULL;
+	}
+
+	pdat->fd = fd;
+	pdat->rlatency = dt_read_int(n, "read-latency", 0);
+	pdat->wlatency = dt_read_int(n, "write-latency", 0);
+	pdat->bandwidth = dt_read_long(n, "bandwidth", 0);
+
+	blk->name = alloc_device_name(dt_read_name(n), dt_read_id(n));
+	blk->blksz = blksz;
+	blk->blkcnt = length / blksz;
+	blk->read = block_sandbox_read;
+	blk->write = block_sandbox_write;
+	blk->readv = NULL;
+	blk->writev = NULL;
+	blk->fetch = block_sandbox_fetch;
+	blk->program = block_sandbox_program;
+	blk->sync = block_sandbox_sync;
+	blk->mmap = NULL;
+	blk->backing = NULL;
+	blk->backing_offset = 0;
+	blk->priv = pdat;
+
+	if(!register_block(&dev, blk))
+	{
+		sandbox_file_close(pdat->fd);
+
+		free_device_name(blk->name);
+		free(blk->priv);
+		free(blk);
+		return NULL;
+	}
+	dev->driver = drv;
+
+	return dev;
+}
+
+static void block_sandbox_remove(struct device_t * dev)
+{
+	struct block_t * blk = (struct block_t *)dev->priv;
+	struct block_sandbox_pdata_t * pdat;
+
+	if(blk && unregister_block(blk))
+	{
+		pdat = (struct block_sandbox_pdata_t *)blk->priv;
+		sandbox_file_close(pdat->fd);
+
+		free_device_name(blk->name);
+		free(blk->priv);
+		free(blk);
+	}
+}
+
+static void block_sandbox_suspend(struct device_t * dev)
+{
+}
+
+static void block_sandbox_resume(struct device_t * dev)
+{
+}
+
+static struct driver_t block_sandbox = {
+	.name		= "block-sandbox",
+	.probe		= block_sandbox_probe,
+	.remove		= block_sandbox_remove,
+	.suspend	= block_sandbox_suspend,
+	.resume		= block_sandbox_resume,
+};
+
+static __init void block_sandbox_driver_init(void)
+{
+	register_driver(&block_sandbox);
+}
+
+static __exit void block_sandbox_driver_exit(void)
+{
+	unregister_driver(&block_sandbox);
+}
+
+driver_initcall(block_sandbox_driver_init);
+driver_exitcall(block_sandbox_driver_exit);
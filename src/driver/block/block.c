@@ -28,6 +28,620 @@
 
 #include <block/block.h>
 
+struct block_buffer_t
+{
+	struct hlist_node node;
+	struct list_head lru;
+	struct list_head entry;
+	struct block_t * blk;
+	u64_t blkno;
+	int dirty;
+	int ahead;
+	u8_t * data;
+};
+
+static struct hlist_head __block_cache_hash[CONFIG_BLOCK_CACHE_HASH_SIZE];
+static struct list_head __block_cache_lru = {
+	.next = &__block_cache_lru,
+	.prev = &__block_cache_lru,
+};
+static u64_t __block_cache_used = 0;
+static spinlock_t __block_cache_lock = SPIN_LOCK_INIT();
+
+static inline u64_t block_buffer_sector(struct block_buffer_t * b)
+{
+	return b->blk->backing_offset + b->blkno;
+}
+
+static inline struct hlist_head * block_cache_hash(void * backing, u64_t sector)
+{
+	unsigned long hash = ((unsigned long)backing >> 4) ^ (unsigned long)(sector * 0x9e3779b1);
+	return &__block_cache_hash[hash % ARRAY_SIZE(__block_cache_hash)];
+}
+
+static struct block_buffer_t * block_cache_lookup(struct block_t * blk, u64_t blkno)
+{
+	struct block_buffer_t * b;
+	struct hlist_node * n;
+	u64_t sector = blk->backing_offset + blkno;
+	irq_flags_t flags;
+
+	spin_lock_irqsave(&__block_cache_lock, flags);
+	hlist_for_each_entry_safe(b, n, block_cache_hash(blk->backing, sector), node)
+	{
+		if((b->blk->backing == blk->backing) && (block_buffer_sector(b) == sector) && (block_size(b->blk) == block_size(blk)))
+		{
+			list_move(&b->lru, &__block_cache_lru);
+			spin_unlock_irqrestore(&__block_cache_lock, flags);
+			return b;
+		}
+	}
+	spin_unlock_irqrestore(&__block_cache_lock, flags);
+	return NULL;
+}
+
+static inline void block_buffer_hit(struct block_t * blk, struct block_buffer_t * b)
+{
+	blk->cache_hit++;
+	if(b->ahead)
+	{
+		b->ahead = 0;
+		blk->ra_hit++;
+	}
+}
+
+static bool_t block_buffer_writeback(struct block_buffer_t * b)
+{
+	struct block_t * blk = b->blk;
+
+	if(b->dirty)
+	{
+		if(blk->write(blk, b->data, b->blkno, 1) != 1)
+			return FALSE;
+		b->dirty = 0;
+	}
+	return TRUE;
+}
+
+static void block_buffer_release(struct block_buffer_t * b)
+{
+	irq_flags_t flags;
+
+	spin_lock_irqsave(&__block_cache_lock, flags);
+	hlist_del(&b->node);
+	list_del(&b->lru);
+	list_del(&b->entry);
+	__block_cache_used -= block_size(b->blk);
+	spin_unlock_irqrestore(&__block_cache_lock, flags);
+	free(b);
+}
+
+static bool_t block_cache_shrink(u64_t size)
+{
+	struct block_buffer_t * b, * n;
+
+	list_for_each_entry_safe_reverse(b, n, &__block_cache_lru, lru)
+	{
+		if(__block_cache_used + size <= CONFIG_BLOCK_CACHE_SIZE)
+			break;
+		if(!block_buffer_writeback(b))
+		{
+			LOG("Block '%s' writeback failed at %lld, keep it dirty", b->blk->name, b->blkno);
+			continue;
+		}
+		b->blk->cache_evict++;
+		block_buffer_release(b);
+	}
+	return (__block_cache_used + size <= CONFIG_BLOCK_CACHE_SIZE) ? TRUE : FALSE;
+}
+
+static struct block_buffer_t * block_buffer_alloc(struct block_t * blk, u64_t blkno)
+{
+	struct block_buffer_t * b;
+	u64_t blksz = block_size(blk);
+
+	if(!block_cache_shrink(blksz))
+		return NULL;
+
+	b = malloc(sizeof(struct block_buffer_t) + blksz);
+	if(!b)
+		return NULL;
+
+	init_hlist_node(&b->node);
+	init_list_head(&b->lru);
+	init_list_head(&b->entry);
+	b->blk = blk;
+	b->blkno = blkno;
+	b->dirty = 0;
+	b->ahead = 0;
+	b->data = (u8_t *)(b + 1);
+	return b;
+}
+
+static void block_buffer_insert(struct block_buffer_t * b)
+{
+	struct block_t * blk = b->blk;
+	irq_flags_t flags;
+
+	spin_lock_irqsave(&__block_cache_lock, flags);
+	hlist_add_head(&b->node, block_cache_hash(blk->backing, block_buffer_sector(b)));
+	list_add(&b->lru, &__block_cache_lru);
+	list_add_tail(&b->entry, &blk->buffers);
+	__block_cache_used += block_size(blk);
+	spin_unlock_irqrestore(&__block_cache_lock, flags);
+}
+
+/*
+ * Per request bookkeeping of a batch, applied when the batch completes
+ */
+struct block_batch_entry_t
+{
+	/* Position of the request data in the caller segments */
+	u64_t pos;
+	/* Cache buffer filled by a single block request, and the part of it seen by caller */
+	struct block_buffer_t * b;
+	u64_t skip;
+	u64_t len;
+	/* Temporary buffer of readahead request */
+	u8_t * tmp;
+	/* Copy the transferred blocks into cache */
+	int cache;
+};
+
+struct block_batch_queue_t
+{
+	int n;
+	struct block_request_t req[CONFIG_BLOCK_BATCH_SIZE];
+	struct block_batch_entry_t ent[CONFIG_BLOCK_BATCH_SIZE];
+};
+
+struct block_batch_t
+{
+	struct block_t * blk;
+	const struct block_segment_t * seg;
+	int nseg;
+	int modify;
+	u64_t fail;
+	struct block_batch_queue_t rq;
+	struct block_batch_queue_t wq;
+};
+
+static void block_batch_copy(struct block_batch_t * bt, u64_t pos, u8_t * p, u64_t len, int get)
+{
+	const struct block_segment_t * seg = bt->seg;
+	u64_t l;
+	int i;
+
+	for(i = 0; (i < bt->nseg) && (len > 0); i++, seg++)
+	{
+		if(pos >= seg->count)
+		{
+			pos -= seg->count;
+			continue;
+		}
+		l = seg->count - pos;
+		if(l > len)
+			l = len;
+		if(get)
+			memcpy((void *)p, (const void *)(seg->buf + pos), l);
+		else
+			memcpy((void *)(seg->buf + pos), (const void *)p, l);
+		p += l;
+		len -= l;
+		pos = 0;
+	}
+}
+
+static u8_t * block_batch_pointer(struct block_batch_t * bt, u64_t pos, u64_t len)
+{
+	const struct block_segment_t * seg = bt->seg;
+	int i;
+
+	for(i = 0; i < bt->nseg; i++, seg++)
+	{
+		if(pos < seg->count)
+			return (len <= seg->count - pos) ? seg->buf + pos : NULL;
+		pos -= seg->count;
+	}
+	return NULL;
+}
+
+static inline void block_batch_fail(struct block_batch_t * bt, u64_t pos)
+{
+	if(pos < bt->fail)
+		bt->fail = pos;
+}
+
+static void block_batch_transfer(struct block_batch_t * bt, int write)
+{
+	struct block_t * blk = bt->blk;
+	struct block_batch_queue_t * q = write ? &bt->wq : &bt->rq;
+	struct block_request_t * req;
+	struct block_batch_entry_t * e;
+	struct block_buffer_t * b;
+	u64_t blksz = block_size(blk);
+	u64_t j;
+	int i;
+
+	if(q->n == 0)
+		return;
+
+	if(write && blk->writev)
+		blk->writev(blk, q->req, q->n);
+	else if(!write && blk->readv)
+		blk->readv(blk, q->req, q->n);
+	else
+	{
+		for(i = 0; i < q->n; i++)
+		{
+			req = &q->req[i];
+			req->done = write ? blk->write(blk, req->buf, req->blkno, req->blkcnt) : blk->read(blk, req->buf, req->blkno, req->blkcnt);
+		}
+	}
+
+	for(i = 0; i < q->n; i++)
+	{
+		req = &q->req[i];
+		e = &q->ent[i];
+		if(e->b)
+		{
+			if(req->done != 1)
+			{
+				free(e->b);
+				block_batch_fail(bt, e->pos);
+				continue;
+			}
+			if(bt->modify)
+			{
+				block_batch_copy(bt, e->pos, &e->b->data[e->skip], e->len, 1);
+				e->b->dirty = 1;
+			}
+			else
+			{
+				block_batch_copy(bt, e->pos, &e->b->data[e->skip], e->len, 0);
+			}
+			block_buffer_insert(e->b);
+		}
+		else if(e->tmp)
+		{
+			for(j = 0; j < req->done; j++)
+			{
+				b = block_buffer_alloc(blk, req->blkno + j);
+				if(!b)
+					break;
+				memcpy((void *)b->data, (const void *)(e->tmp + j * blksz), blksz);
+				b->ahead = 1;
+				block_buffer_insert(b);
+				blk->ra_count++;
+			}
+			free(e->tmp);
+		}
+		else
+		{
+			if(req->done != req->blkcnt)
+				block_batch_fail(bt, e->pos + req->done * blksz);
+			if(e->cache)
+			{
+				for(j = 0; j < req->done; j++)
+				{
+					b = block_buffer_alloc(blk, req->blkno + j);
+					if(!b)
+						break;
+					memcpy((void *)b->data, (const void *)(req->buf + j * blksz), blksz);
+					block_buffer_insert(b);
+				}
+			}
+		}
+	}
+	q->n = 0;
+}
+
+static inline void block_batch_flush(struct block_batch_t * bt)
+{
+	block_batch_transfer(bt, 0);
+	block_batch_transfer(bt, 1);
+}
+
+static struct block_batch_entry_t * block_batch_add(struct block_batch_t * bt, int write, u8_t * buf, u64_t blkno, u64_t blkcnt)
+{
+	struct block_batch_queue_t * q = write ? &bt->wq : &bt->rq;
+	struct block_batch_entry_t * e;
+
+	if(q->n >= CONFIG_BLOCK_BATCH_SIZE)
+		block_batch_transfer(bt, write);
+
+	q->req[q->n].blkno = blkno;
+	q->req[q->n].blkcnt = blkcnt;
+	q->req[q->n].buf = buf;
+	q->req[q->n].done = 0;
+	e = &q->ent[q->n++];
+	memset(e, 0, sizeof(struct block_batch_entry_t));
+	return e;
+}
+
+/*
+ * Queue the byte range [off, end) of device, seen by caller at position pos.
+ * Cached blocks are served at once, missing whole blocks inside one caller
+ * buffer are transferred in place, others go through a new cache buffer.
+ */
+static bool_t block_batch_extent(struct block_batch_t * bt, u64_t pos, u64_t off, u64_t end)
+{
+	struct block_t * blk = bt->blk;
+	struct block_batch_entry_t * e;
+	struct block_buffer_t * b;
+	u64_t blksz = block_size(blk);
+	u64_t k = off / blksz, kend = (end + blksz - 1) / blksz;
+	u64_t from, to, s, n, i;
+	u8_t * p;
+
+	while(k < kend)
+	{
+		from = (off > k * blksz) ? off : k * blksz;
+		to = (end < (k + 1) * blksz) ? end : (k + 1) * blksz;
+		s = pos + (from - off);
+
+		b = block_cache_lookup(blk, k);
+		if(b)
+		{
+			block_buffer_hit(blk, b);
+			block_batch_copy(bt, s, &b->data[from - k * blksz], to - from, bt->modify);
+			if(bt->modify)
+				b->dirty = 1;
+			k++;
+			continue;
+		}
+
+		if((to - from == blksz) && (p = block_batch_pointer(bt, s, blksz)))
+		{
+			for(n = 1; (k + n < kend) && ((k + n + 1) * blksz <= end) && (block_batch_pointer(bt, s + n * blksz, blksz) == p + n * blksz) && !block_cache_lookup(blk, k + n); n++);
+			blk->cache_miss += n;
+			i = 0;
+			if(bt->modify && (n * blksz <= CONFIG_BLOCK_CACHE_BYPASS_SIZE))
+			{
+				for(; i < n; i++)
+				{
+					b = block_buffer_alloc(blk, k + i);
+					if(!b)
+						break;
+					memcpy((void *)b->data, (const void *)(p + i * blksz), blksz);
+					b->dirty = 1;
+					block_buffer_insert(b);
+				}
+			}
+			if(i < n)
+			{
+				e = block_batch_add(bt, bt->modify, p + i * blksz, k + i, n - i);
+				e->pos = s + i * blksz;
+				e->cache = (!bt->modify && (n * blksz <= CONFIG_BLOCK_CACHE_BYPASS_SIZE)) ? 1 : 0;
+			}
+			k += n;
+			continue;
+		}
+
+		blk->cache_miss++;
+		b = block_buffer_alloc(blk, k);
+		if(!b)
+		{
+			block_batch_fail(bt, s);
+			return FALSE;
+		}
+		if(bt->modify && (to - from == blksz))
+		{
+			block_batch_copy(bt, s, b->data, blksz, 1);
+			b->dirty = 1;
+			block_buffer_insert(b);
+		}
+		else
+		{
+			e = block_batch_add(bt, 0, b->data, k, 1);
+			e->pos = s;
+			e->b = b;
+			e->skip = from - k * blksz;
+			e->len = to - from;
+		}
+		k++;
+	}
+	return TRUE;
+}
+
+static void block_batch_prefetch(struct block_batch_t * bt, u64_t blkno, u64_t blkcnt)
+{
+	struct block_t * blk = bt->blk;
+	struct block_batch_entry_t * e;
+	u64_t blksz = block_size(blk);
+	u64_t i = 0, n;
+	u8_t * p;
+
+	blkcnt = block_available_count(blk, blkno, blkcnt);
+	while(i < blkcnt)
+	{
+		if(block_cache_lookup(blk, blkno + i))
+		{
+			i++;
+			continue;
+		}
+
+		for(n = 1; (i + n < blkcnt) && !block_cache_lookup(blk, blkno + i + n); n++);
+		p = malloc(n * blksz);
+		if(!p)
+			break;
+		e = block_batch_add(bt, 0, p, blkno + i, n);
+		e->tmp = p;
+		i += n;
+	}
+}
+
+/*
+ * Transfer the caller segments through block cache, all the requests they
+ * need, including readahead, are handed to the block device as one batch.
+ */
+static u64_t block_batch_run(struct block_t * blk, struct block_readahead_t * ra, const struct block_segment_t * seg, int nseg, int modify)
+{
+	struct block_batch_t * bt;
+	u64_t blksz, capacity, start, pos = 0, total = 0, last = 0;
+	u64_t off, end, len, ret;
+	int x, y, clip = 0;
+
+	if(!blk || !seg || (nseg <= 0))
+		return 0;
+
+	blksz = block_size(blk);
+	capacity = block_capacity(blk);
+	if(!blksz || !capacity)
+		return 0;
+
+	bt = malloc(sizeof(struct block_batch_t));
+	if(!bt)
+		return 0;
+	bt->blk = blk;
+	bt->seg = seg;
+	bt->nseg = nseg;
+	bt->modify = modify;
+	bt->fail = ~(u64_t)0;
+	bt->rq.n = 0;
+	bt->wq.n = 0;
+
+	for(x = 0, end = seg[0].offset; (x < nseg) && !clip; x = y)
+	{
+		off = seg[x].offset;
+		for(y = x, len = 0; (y < nseg) && (seg[y].offset == off + len); y++)
+			len += seg[y].count;
+		if(off >= capacity)
+			break;
+		end = off + len;
+		if((len > capacity - off))
+		{
+			end = capacity;
+			clip = 1;
+		}
+		if(end > off)
+		{
+			if(off / blksz < last)
+				block_batch_flush(bt);
+			if(!block_batch_extent(bt, pos, off, end))
+				break;
+			if(last < (end + blksz - 1) / blksz)
+				last = (end + blksz - 1) / blksz;
+			total += end - off;
+		}
+		pos += len;
+	}
+
+	if(ra && (total > 0) && (blk->ra_max >= blksz))
+	{
+		if((seg[0].offset == ra->next) && (ra->next != 0))
+		{
+			if(ra->size == 0)
+				ra->size = (total * 4 > CONFIG_BLOCK_READAHEAD_MIN) ? total * 4 : CONFIG_BLOCK_READAHEAD_MIN;
+			else
+				ra->size <<= 1;
+			if(ra->size > blk->ra_max)
+				ra->size = blk->ra_max;
+
+			/*
+			 * Only the blocks past the current request are read ahead, so that
+			 * a readahead hit means the prefetch really saved a transfer.
+			 */
+			if(end + (ra->size >> 1) > ra->end)
+			{
+				start = (ra->end > end) ? ra->end : end;
+				ra->end = end + ra->size;
+				block_batch_prefetch(bt, (start + blksz - 1) / blksz, (ra->end + blksz - 1) / blksz - (start + blksz - 1) / blksz);
+			}
+		}
+		else
+		{
+			ra->size = 0;
+			ra->end = 0;
+		}
+		ra->next = end;
+	}
+
+	block_batch_flush(bt);
+	ret = (bt->fail < total) ? bt->fail : total;
+	free(bt);
+
+	return ret;
+}
+
+static int block_buffer_cmp(const void * a, const void * b)
+{
+	struct block_buffer_t * ba = *((struct block_buffer_t **)a);
+	struct block_buffer_t * bb = *((struct block_buffer_t **)b);
+
+	if(block_buffer_sector(ba) < block_buffer_sector(bb))
+		return -1;
+	else if(block_buffer_sector(ba) > block_buffer_sector(bb))
+		return 1;
+	return 0;
+}
+
+static void block_cache_flush(struct block_t * blk)
+{
+	struct block_buffer_t ** v, * b, * n;
+	u64_t blksz = block_size(blk);
+	u64_t cnt = 0, i, j, k;
+	u8_t * p;
+
+	list_for_each_entry_safe(b, n, &__block_cache_lru, lru)
+	{
+		if(b->dirty && (b->blk->backing == blk->backing))
+			cnt++;
+	}
+	if(cnt == 0)
+		return;
+
+	v = malloc(sizeof(struct block_buffer_t *) * cnt);
+	if(!v)
+	{
+		list_for_each_entry_safe(b, n, &__block_cache_lru, lru)
+		{
+			if(b->dirty && (b->blk->backing == blk->backing))
+				block_buffer_writeback(b);
+		}
+		return;
+	}
+
+	i = 0;
+	list_for_each_entry_safe(b, n, &__block_cache_lru, lru)
+	{
+		if(b->dirty && (b->blk->backing == blk->backing))
+			v[i++] = b;
+	}
+	qsort(v, cnt, sizeof(struct block_buffer_t *), block_buffer_cmp);
+
+	p = malloc(CONFIG_BLOCK_CACHE_BYPASS_SIZE);
+	for(i = 0; i < cnt; i = j)
+	{
+		for(j = i + 1; p && (j < cnt) && (v[j]->blk == v[i]->blk) && (v[j]->blkno == v[j - 1]->blkno + 1) && ((j - i + 1) * blksz <= CONFIG_BLOCK_CACHE_BYPASS_SIZE); j++);
+		if(j - i > 1)
+		{
+			for(k = i; k < j; k++)
+				memcpy((void *)(p + (k - i) * blksz), (const void *)v[k]->data, blksz);
+			if(v[i]->blk->write(v[i]->blk, p, v[i]->blkno, j - i) == j - i)
+			{
+				for(k = i; k < j; k++)
+					v[k]->dirty = 0;
+			}
+		}
+		else
+		{
+			block_buffer_writeback(v[i]);
+		}
+	}
+	free(p);
+	free(v);
+}
+
+static void block_cache_purge(struct block_t * blk)
+{
+	struct block_buffer_t * b, * n;
+
+	block_cache_flush(blk);
+	list_for_each_entry_safe(b, n, &blk->buffers, entry)
+		block_buffer_release(b);
+}
+
 static ssize_t block_read_size(struct kobj_t * kobj, void * buf, size_t size)
 {
 	struct block_t * blk = (struct block_t *)kobj->priv;
@@ -46,6 +660,53 @@ static ssize_t block_read_capacity(struct kobj_t * kobj, void * buf, size_t size
 	return sprintf(buf, "%lld", block_capacity(blk));
 }
 
+static ssize_t block_read_cache_hit(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct block_t * blk = (struct block_t *)kobj->priv;
+	return sprintf(buf, "%lld", blk->cache_hit);
+}
+
+static ssize_t block_read_cache_miss(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct block_t * blk = (struct block_t *)kobj->priv;
+	return sprintf(buf, "%lld", blk->cache_miss);
+}
+
+static ssize_t block_read_cache_evict(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct block_t * blk = (struct block_t *)kobj->priv;
+	return sprintf(buf, "%lld", blk->cache_evict);
+}
+
+static ssize_t block_read_readahead(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct block_t * blk = (struct block_t *)kobj->priv;
+	return sprintf(buf, "%lld", blk->ra_max);
+}
+
+static ssize_t block_write_readahead(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct block_t * blk = (struct block_t *)kobj->priv;
+	u64_t max = strtoull(buf, NULL, 0);
+
+	if(max > CONFIG_BLOCK_CACHE_SIZE / 2)
+		max = CONFIG_BLOCK_CACHE_SIZE / 2;
+	blk->ra_max = max;
+	return size;
+}
+
+static ssize_t block_read_readahead_count(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct block_t * blk = (struct block_t *)kobj->priv;
+	return sprintf(buf, "%lld", blk->ra_count);
+}
+
+static ssize_t block_read_readahead_hit(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct block_t * blk = (struct block_t *)kobj->priv;
+	return sprintf(buf, "%lld", blk->ra_hit);
+}
+
 struct block_t * search_block(const char * name)
 {
 	struct device_t * dev;
@@ -67,6 +728,19 @@ bool_t register_block(struct device_t ** device, struct block_t * blk)
 	if(!dev)
 		return FALSE;
 
+	if(!blk->backing)
+	{
+		blk->backing = blk;
+		blk->backing_offset = 0;
+	}
+	init_list_head(&blk->buffers);
+	blk->cache_hit = 0;
+	blk->cache_miss = 0;
+	blk->cache_evict = 0;
+	blk->ra_max = CONFIG_BLOCK_READAHEAD_SIZE;
+	blk->ra_count = 0;
+	blk->ra_hit = 0;
+
 	dev->name = strdup(blk->name);
 	dev->type = DEVICE_TYPE_BLOCK;
 	dev->driver = NULL;
@@ -75,6 +749,12 @@ bool_t register_block(struct device_t ** device, struct block_t * blk)
 	kobj_add_regular(dev->kobj, "size", block_read_size, NULL, blk);
 	kobj_add_regular(dev->kobj, "count", block_read_count, NULL, blk);
 	kobj_add_regular(dev->kobj, "capacity", block_read_capacity, NULL, blk);
+	kobj_add_regular(dev->kobj, "cache-hit", block_read_cache_hit, NULL, blk);
+	kobj_add_regular(dev->kobj, "cache-miss", block_read_cache_miss, NULL, blk);
+	kobj_add_regular(dev->kobj, "cache-evict", block_read_cache_evict, NULL, blk);
+	kobj_add_regular(dev->kobj, "readahead", block_read_readahead, block_write_readahead, blk);
+	kobj_add_regular(dev->kobj, "readahead-count", block_read_readahead_count, NULL, blk);
+	kobj_add_regular(dev->kobj, "readahead-hit", block_read_readahead_hit, NULL, blk);
 
 	if(!register_device(dev))
 	{
@@ -103,6 +783,7 @@ bool_t unregister_block(struct block_t * blk)
 	if(!unregister_device(dev))
 		return FALSE;
 
+	block_cache_purge(blk);
 	kobj_remove_self(dev->kobj);
 	free(dev->name);
 	free(dev);
@@ -111,186 +792,206 @@ bool_t unregister_block(struct block_t * blk)
 
 u64_t block_read(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 {
-	u64_t blkno, blksz, blkcnt, capacity;
-	u64_t len, tmp;
-	u64_t ret = 0;
-	u8_t * p;
+	struct block_segment_t seg;
 
-	if(!blk || !buf || !count)
+	if(!buf || !count)
 		return 0;
 
-	blksz = block_size(blk);
-	blkcnt = block_count(blk);
-	if(!blksz || !blkcnt)
-		return 0;
-
-	capacity = block_capacity(blk);
-	if(offset >= capacity)
-		return 0;
+	seg.buf = buf;
+	seg.offset = offset;
+	seg.count = count;
+	return block_batch_run(blk, NULL, &seg, 1, 0);
+}
 
-	tmp = capacity - offset;
-	if(count > tmp)
-		count = tmp;
+u64_t block_write(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
+{
+	struct block_segment_t seg;
 
-	p = malloc(blksz);
-	if(!p)
+	if(!buf || !count)
 		return 0;
 
-	blkno = offset / blksz;
-	tmp = offset % blksz;
-	if(tmp > 0)
-	{
-		len = blksz - tmp;
-		if(count < len)
-			len = count;
+	seg.buf = buf;
+	seg.offset = offset;
+	seg.count = count;
+	return block_batch_run(blk, NULL, &seg, 1, 1);
+}
 
-		if(blk->read(blk, p, blkno, 1) != 1)
-		{
-			free(p);
-			return ret;
-		}
+u64_t block_read_batch(struct block_t * blk, struct block_readahead_t * ra, const struct block_segment_t * seg, int nseg)
+{
+	return block_batch_run(blk, ra, seg, nseg, 0);
+}
 
-		memcpy((void *)buf, (const void *)(&p[tmp]), len);
-		buf += len;
-		count -= len;
-		ret += len;
-		blkno += 1;
-	}
+u64_t block_write_batch(struct block_t * blk, const struct block_segment_t * seg, int nseg)
+{
+	return block_batch_run(blk, NULL, seg, nseg, 1);
+}
 
-	tmp = count / blksz;
-	if(tmp > 0)
-	{
-		len = tmp * blksz;
+static u64_t block_iov_run(struct block_t * blk, const struct iovec * iov, int iovcnt, u64_t offset, int modify)
+{
+	struct block_segment_t * seg;
+	u64_t ret;
+	int i;
 
-		if(blk->read(blk, buf, blkno, tmp) != tmp)
-		{
-			free(p);
-			return ret;
-		}
+	if(!iov || (iovcnt <= 0))
+		return 0;
 
-		buf += len;
-		count -= len;
-		ret += len;
-		blkno += tmp;
-	}
+	seg = malloc(sizeof(struct block_segment_t) * iovcnt);
+	if(!seg)
+		return 0;
 
-	if(count > 0)
+	for(i = 0; i < iovcnt; i++)
 	{
-		len = count;
-
-		if(blk->read(blk, p, blkno, 1) != 1)
-		{
-			free(p);
-			return ret;
-		}
-
-		memcpy((void *)buf, (const void *)(&p[0]), len);
-		ret += len;
+		seg[i].buf = (u8_t *)iov[i].iov_base;
+		seg[i].offset = offset;
+		seg[i].count = iov[i].iov_len;
+		offset += iov[i].iov_len;
 	}
+	ret = block_batch_run(blk, NULL, seg, iovcnt, modify);
+	free(seg);
 
-	free(p);
 	return ret;
 }
 
-u64_t block_write(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
+u64_t block_readv(struct block_t * blk, const struct iovec * iov, int iovcnt, u64_t offset)
 {
-	u64_t blkno, blksz, blkcnt, capacity;
-	u64_t len, tmp;
-	u64_t ret = 0;
-	u8_t * p;
+	return block_iov_run(blk, iov, iovcnt, offset, 0);
+}
 
-	if(!blk || !buf || !count)
-		return 0;
+u64_t block_writev(struct block_t * blk, const struct iovec * iov, int iovcnt, u64_t offset)
+{
+	return block_iov_run(blk, iov, iovcnt, offset, 1);
+}
 
-	blksz = block_size(blk);
-	blkcnt = block_count(blk);
-	if(!blksz || !blkcnt)
-		return 0;
+u64_t block_read_ahead(struct block_t * blk, struct block_readahead_t * ra, u8_t * buf, u64_t offset, u64_t count)
+{
+	struct block_segment_t seg;
 
-	capacity = block_capacity(blk);
-	if(offset >= capacity)
+	if(!ra || !buf || !count)
 		return 0;
 
-	tmp = capacity - offset;
-	if(count > tmp)
-		count = tmp;
+	seg.buf = buf;
+	seg.offset = offset;
+	seg.count = count;
+	return block_batch_run(blk, ra, &seg, 1, 0);
+}
 
-	p = malloc(blksz);
-	if(!p)
+/*
+ * Program into erased space, bypassing the buffer cache. Dirty buffers of the
+ * range are written back first and cached buffers take the programmed bytes,
+ * or are dropped if the program failed.
+ */
+u64_t block_program(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
+{
+	struct block_buffer_t * b;
+	u64_t blksz, blkno, first, last, s, e, ret;
+
+	if(!blk || !blk->program || !buf || !count)
+		return 0;
+	if((offset > block_capacity(blk)) || (count > block_capacity(blk) - offset))
 		return 0;
 
-	blkno = offset / blksz;
-	tmp = offset % blksz;
-	if(tmp > 0)
+	blksz = block_size(blk);
+	first = offset / blksz;
+	last = (offset + count - 1) / blksz;
+	for(blkno = first; blkno <= last; blkno++)
 	{
-		len = blksz - tmp;
-		if(count < len)
-			len = count;
-
-		if(blk->read(blk, p, blkno, 1) != 1)
-		{
-			free(p);
-			return ret;
-		}
+		if((b = block_cache_lookup(blk, blkno)) && !block_buffer_writeback(b))
+			return 0;
+	}
 
-		memcpy((void *)(&p[tmp]), (const void *)buf, len);
+	ret = blk->program(blk, buf, offset, count);
 
-		if(blk->write(blk, p, blkno, 1) != 1)
+	for(blkno = first; blkno <= last; blkno++)
+	{
+		if(!(b = block_cache_lookup(blk, blkno)))
+			continue;
+		if(ret != count)
 		{
-			free(p);
-			return ret;
+			block_buffer_release(b);
+			continue;
 		}
-
-		buf += len;
-		count -= len;
-		ret += len;
-		blkno += 1;
+		s = (blkno * blksz > offset) ? blkno * blksz : offset;
+		e = ((blkno + 1) * blksz < offset + count) ? (blkno + 1) * blksz : offset + count;
+		memcpy(b->data + (s - blkno * blksz), buf + (s - offset), e - s);
 	}
+	return ret;
+}
 
-	tmp = count / blksz;
-	if(tmp > 0)
+void block_sync(struct block_t * blk)
+{
+	if(blk)
 	{
-		len = tmp * blksz;
+		block_cache_flush(blk);
+		if(blk->sync)
+			blk->sync(blk);
+	}
+}
 
-		if(blk->write(blk, buf, blkno, tmp) != tmp)
-		{
-			free(p);
-			return ret;
-		}
+const void * block_mmap(struct block_t * blk, u64_t offset, u64_t count)
+{
+	u64_t capacity;
 
-		buf += len;
-		count -= len;
-		ret += len;
-		blkno += tmp;
-	}
+	if(!blk || !blk->mmap)
+		return NULL;
 
-	if(count > 0)
-	{
-		len = count;
+	capacity = block_capacity(blk);
+	if((offset > capacity) || (count > capacity - offset))
+		return NULL;
+	return blk->mmap(blk, offset, count);
+}
 
-		if(blk->read(blk, p, blkno, 1) != 1)
-		{
-			free(p);
-			return ret;
-		}
+u64_t block_copy(struct block_t * dst, u64_t doffset, struct block_t * src, u64_t soffset, u64_t count)
+{
+	const void * p;
+	u8_t * buf;
+	u64_t size, len, n, capacity;
+	u64_t ret = 0;
 
-		memcpy((void *)(&p[0]), (const void *)buf, len);
+	if(!dst || !src || !count)
+		return 0;
 
-		if(blk->write(blk, p, blkno, 1) != 1)
-		{
-			free(p);
-			return ret;
-		}
+	capacity = block_capacity(src);
+	if(soffset >= capacity)
+		return 0;
+	if(count > capacity - soffset)
+		count = capacity - soffset;
+	capacity = block_capacity(dst);
+	if(doffset >= capacity)
+		return 0;
+	if(count > capacity - doffset)
+		count = capacity - doffset;
+
+	/*
+	 * memory addressable source is written straight to destination
+	 */
+	if((p = block_mmap(src, soffset, count)))
+		return block_write(dst, (u8_t *)p, doffset, count);
+
+	/*
+	 * otherwise bounce through a buffer of whole blocks, the largest
+	 * the heap can give, so that the transfers bypass block cache
+	 */
+	size = CONFIG_BLOCK_COPY_SIZE;
+	n = (block_size(src) > block_size(dst)) ? block_size(src) : block_size(dst);
+	while(!(buf = malloc(size)))
+	{
+		if((size >>= 1) < n)
+			return 0;
+	}
 
-		ret += len;
+	while(ret < count)
+	{
+		len = size - ((soffset + ret) % size);
+		if(len > count - ret)
+			len = count - ret;
+		n = block_read(src, buf, soffset + ret, len);
+		if(n > 0)
+			n = block_write(dst, buf, doffset + ret, n);
+		ret += n;
+		if(n != len)
+			break;
 	}
+	free(buf);
 
-	free(p);
 	return ret;
 }
-
-void block_sync(struct block_t * blk)
-{
-	if(blk && blk->sync)
-		blk->sync(blk);
-}
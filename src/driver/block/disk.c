@@ -36,18 +36,214 @@ struct disk_block_t
 	struct disk_t * disk;
 };
 
+static spinlock_t __disk_queue_lock = SPIN_LOCK_INIT();
+
+static inline bool_t disk_request_overlap(struct disk_request_t * a, struct disk_request_t * b)
+{
+	return ((a->sector < b->sector + b->count) && (b->sector < a->sector + a->count)) ? TRUE : FALSE;
+}
+
+static void disk_request_finish(struct disk_request_t * req, u64_t done)
+{
+	req->done = done;
+	if(req->complete)
+		req->complete(req);
+}
+
+static u64_t disk_request_execute(struct disk_t * disk, enum disk_request_dir_t dir, u8_t * buf, u64_t sector, u64_t count)
+{
+	disk->ndispatch++;
+	if(dir == DISK_REQUEST_WRITE)
+		return disk->write(disk, buf, sector, count);
+	return disk->read(disk, buf, sector, count);
+}
+
+static u64_t disk_request_executev(struct disk_t * disk, struct disk_request_t * first, struct disk_request_t * last, int n, u64_t count)
+{
+	struct disk_request_t * req;
+	struct iovec * iov;
+	u64_t ret = 0, cnt;
+	int i = 0;
+
+	iov = malloc(sizeof(struct iovec) * n);
+	if(!iov)
+	{
+		for(req = first; ; req = list_next_entry(req, entry))
+		{
+			cnt = disk_request_execute(disk, req->dir, req->buf, req->sector, req->count);
+			ret += cnt;
+			if((cnt != req->count) || (req == last))
+				break;
+		}
+		return ret;
+	}
+
+	for(req = first; ; req = list_next_entry(req, entry))
+	{
+		iov[i].iov_base = req->buf;
+		iov[i].iov_len = req->count * disk->size;
+		i++;
+		if(req == last)
+			break;
+	}
+
+	disk->ndispatch++;
+	if(first->dir == DISK_REQUEST_WRITE)
+		ret = disk->writev(disk, iov, n, first->sector, count);
+	else
+		ret = disk->readv(disk, iov, n, first->sector, count);
+	free(iov);
+
+	return ret;
+}
+
+static void disk_dispatch(struct disk_t * disk, struct list_head * head)
+{
+	struct disk_request_t * first, * last, * req, * n;
+	u64_t cnt, ret, off;
+	bool_t contiguous, bounce;
+	u8_t * p = NULL;
+	int nreq;
+
+	while(!list_empty(head))
+	{
+		first = last = list_first_entry(head, struct disk_request_t, entry);
+		cnt = first->count;
+		nreq = 1;
+		contiguous = TRUE;
+
+		for(req = list_next_entry(first, entry); &req->entry != head; req = list_next_entry(req, entry))
+		{
+			if((req->dir != first->dir) || (req->sector != last->sector + last->count))
+				break;
+			if((cnt + req->count) * disk->size > CONFIG_DISK_MERGE_SIZE)
+				break;
+			if(req->buf != last->buf + last->count * disk->size)
+				contiguous = FALSE;
+			cnt += req->count;
+			nreq++;
+			last = req;
+			disk->nmerge++;
+		}
+
+		if(first == last)
+		{
+			list_del(&first->entry);
+			disk_request_finish(first, disk_request_execute(disk, first->dir, first->buf, first->sector, first->count));
+			continue;
+		}
+
+		/*
+		 * Scattered buffers go to the driver as they are when it can take
+		 * them, otherwise the merged request bounces through one buffer.
+		 */
+		bounce = FALSE;
+		if(contiguous)
+			ret = disk_request_execute(disk, first->dir, first->buf, first->sector, cnt);
+		else if((first->dir == DISK_REQUEST_WRITE) ? (disk->writev != NULL) : (disk->readv != NULL))
+			ret = disk_request_executev(disk, first, last, nreq, cnt);
+		else
+		{
+			p = malloc(cnt * disk->size);
+			if(!p)
+			{
+				list_del(&first->entry);
+				disk_request_finish(first, disk_request_execute(disk, first->dir, first->buf, first->sector, first->count));
+				continue;
+			}
+			bounce = TRUE;
+
+			if(first->dir == DISK_REQUEST_WRITE)
+			{
+				off = 0;
+				for(req = first; ; req = list_next_entry(req, entry))
+				{
+					memcpy(p + off * disk->size, req->buf, req->count * disk->size);
+					off += req->count;
+					if(req == last)
+						break;
+				}
+			}
+			ret = disk_request_execute(disk, first->dir, p, first->sector, cnt);
+		}
+
+		off = 0;
+		list_for_each_entry_safe(req, n, head, entry)
+		{
+			if(bounce && (req->dir == DISK_REQUEST_READ) && (ret > off))
+				memcpy(req->buf, p + off * disk->size, ((ret - off) < req->count ? (ret - off) : req->count) * disk->size);
+			list_del(&req->entry);
+			disk_request_finish(req, (ret > off) ? ((ret - off) < req->count ? (ret - off) : req->count) : 0);
+			off += req->count;
+			if(req == last)
+				break;
+		}
+
+		if(bounce)
+			free(p);
+	}
+}
+
+static u64_t disk_transfer(struct disk_t * disk, enum disk_request_dir_t dir, u8_t * buf, u64_t sector, u64_t count)
+{
+	struct disk_request_t req;
+
+	disk_request_init(&req, dir, buf, sector, count, NULL, NULL);
+	if(!disk_submit(disk, &req))
+		return 0;
+	disk_unplug(disk);
+	return req.done;
+}
+
 static u64_t disk_block_read(struct block_t * blk, u8_t * buf, u64_t blkno, u64_t blkcnt)
 {
 	struct disk_block_t * dblk = (struct disk_block_t *)(blk->priv);
 	struct disk_t * disk = dblk->disk;
-	return (disk->read(disk, buf, blkno + dblk->offset, blkcnt));
+	return (disk_transfer(disk, DISK_REQUEST_READ, buf, blkno + dblk->offset, blkcnt));
 }
 
 static u64_t disk_block_write(struct block_t * blk, u8_t * buf, u64_t blkno, u64_t blkcnt)
 {
 	struct disk_block_t * dblk = (struct disk_block_t *)(blk->priv);
 	struct disk_t * disk = dblk->disk;
-	return (disk->write(disk, buf, blkno + dblk->offset, blkcnt));
+	return (disk_transfer(disk, DISK_REQUEST_WRITE, buf, blkno + dblk->offset, blkcnt));
+}
+
+static void disk_block_transfer(struct block_t * blk, enum disk_request_dir_t dir, struct block_request_t * req, int n)
+{
+	struct disk_block_t * dblk = (struct disk_block_t *)(blk->priv);
+	struct disk_t * disk = dblk->disk;
+	struct disk_request_t * r;
+	int i;
+
+	r = malloc(sizeof(struct disk_request_t) * n);
+	if(!r)
+	{
+		for(i = 0; i < n; i++)
+			req[i].done = disk_transfer(disk, dir, req[i].buf, req[i].blkno + dblk->offset, req[i].blkcnt);
+		return;
+	}
+
+	for(i = 0; i < n; i++)
+	{
+		disk_request_init(&r[i], dir, req[i].buf, req[i].blkno + dblk->offset, req[i].blkcnt, NULL, NULL);
+		disk_submit(disk, &r[i]);
+	}
+	disk_unplug(disk);
+
+	for(i = 0; i < n; i++)
+		req[i].done = r[i].done;
+	free(r);
+}
+
+static void disk_block_readv(struct block_t * blk, struct block_request_t * req, int n)
+{
+	disk_block_transfer(blk, DISK_REQUEST_READ, req, n);
+}
+
+static void disk_block_writev(struct block_t * blk, struct block_request_t * req, int n)
+{
+	disk_block_transfer(blk, DISK_REQUEST_WRITE, req, n);
 }
 
 static void disk_block_sync(struct block_t * blk)
@@ -78,6 +274,24 @@ static ssize_t partition_read_capacity(struct kobj_t * kobj, void * buf, size_t
 	return sprintf(buf, "%lld", (part->to - part->from + 1) * part->size);
 }
 
+static ssize_t disk_read_requests(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct disk_t * disk = (struct disk_t *)kobj->priv;
+	return sprintf(buf, "%lld", disk->nrequest);
+}
+
+static ssize_t disk_read_merges(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct disk_t * disk = (struct disk_t *)kobj->priv;
+	return sprintf(buf, "%lld", disk->nmerge);
+}
+
+static ssize_t disk_read_dispatches(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct disk_t * disk = (struct disk_t *)kobj->priv;
+	return sprintf(buf, "%lld", disk->ndispatch);
+}
+
 struct disk_t * search_disk(const char * name)
 {
 	struct device_t * dev;
@@ -104,6 +318,12 @@ bool_t register_disk(struct device_t ** device, struct disk_t * disk)
 	if(!disk || !disk->name)
 		return FALSE;
 
+	init_list_head(&disk->queue);
+	disk->depth = 0;
+	disk->nrequest = 0;
+	disk->nmerge = 0;
+	disk->ndispatch = 0;
+
 	if(!partition_map(disk))
 		return FALSE;
 
@@ -119,6 +339,9 @@ bool_t register_disk(struct device_t ** device, struct disk_t * disk)
 	dev->driver = NULL;
 	dev->priv = (void *)disk;
 	dev->kobj = kobj_alloc_directory(dev->name);
+	kobj_add_regular(dev->kobj, "requests", disk_read_requests, NULL, disk);
+	kobj_add_regular(dev->kobj, "merges", disk_read_merges, NULL, disk);
+	kobj_add_regular(dev->kobj, "dispatches", disk_read_dispatches, NULL, disk);
 	list_for_each_entry_safe(ppos, pn, &(disk->part.entry), entry)
 	{
 		kobj = kobj_search_directory_with_create(dev->kobj, ppos->name);
@@ -159,7 +382,14 @@ bool_t register_disk(struct device_t ** device, struct disk_t * disk)
 		blk->blkcnt = ppos->to - ppos->from + 1;
 		blk->read = disk_block_read;
 		blk->write = disk_block_write;
+		blk->readv = disk_block_readv;
+		blk->writev = disk_block_writev;
+		blk->fetch = NULL;
+		blk->program = NULL;
 		blk->sync = disk_block_sync;
+		blk->mmap = NULL;
+		blk->backing = disk;
+		blk->backing_offset = ppos->from;
 		blk->priv	= dblk;
 
 		if(!register_block(NULL, blk))
@@ -186,6 +416,7 @@ bool_t unregister_disk(struct disk_t * disk)
 	if(!disk || !disk->name)
 		return FALSE;
 
+	disk_unplug(disk);
 	list_for_each_entry_safe(ppos, pn, &(disk->part.entry), entry)
 	{
 		blk = ppos->blk;
@@ -211,6 +442,82 @@ bool_t unregister_disk(struct disk_t * disk)
 	return TRUE;
 }
 
+void disk_request_init(struct disk_request_t * req, enum disk_request_dir_t dir, u8_t * buf, u64_t sector, u64_t count, void (*complete)(struct disk_request_t *), void * priv)
+{
+	if(req)
+	{
+		init_list_head(&req->entry);
+		req->dir = dir;
+		req->sector = sector;
+		req->count = count;
+		req->buf = buf;
+		req->done = 0;
+		req->complete = complete;
+		req->priv = priv;
+	}
+}
+
+bool_t disk_submit(struct disk_t * disk, struct disk_request_t * req)
+{
+	struct disk_request_t * pos, * n;
+	struct list_head * prev;
+	irq_flags_t flags;
+
+	if(!disk || !req || !req->buf || !req->count)
+		return FALSE;
+
+	if((req->sector >= disk->count) || (req->count > disk->count - req->sector))
+		return FALSE;
+
+	list_for_each_entry_safe(pos, n, &disk->queue, entry)
+	{
+		if(((pos->dir == DISK_REQUEST_WRITE) || (req->dir == DISK_REQUEST_WRITE)) && disk_request_overlap(pos, req))
+		{
+			disk_unplug(disk);
+			break;
+		}
+	}
+	if(disk->depth >= CONFIG_DISK_QUEUE_DEPTH)
+		disk_unplug(disk);
+
+	spin_lock_irqsave(&__disk_queue_lock, flags);
+	prev = &disk->queue;
+	list_for_each_entry_safe(pos, n, &disk->queue, entry)
+	{
+		if(pos->sector > req->sector)
+			break;
+		prev = &pos->entry;
+	}
+	list_add(&req->entry, prev);
+	disk->depth++;
+	disk->nrequest++;
+	spin_unlock_irqrestore(&__disk_queue_lock, flags);
+
+	return TRUE;
+}
+
+/*
+ * Dispatches the queue and completes every request before returning. The
+ * queue only merges requests into fewer driver calls, the transfers are not
+ * overlapped with the caller since drivers are blocking.
+ */
+void disk_unplug(struct disk_t * disk)
+{
+	struct list_head head;
+	irq_flags_t flags;
+
+	if(!disk)
+		return;
+
+	init_list_head(&head);
+	spin_lock_irqsave(&__disk_queue_lock, flags);
+	list_splice_init(&disk->queue, &head);
+	disk->depth = 0;
+	spin_unlock_irqrestore(&__disk_queue_lock, flags);
+
+	disk_dispatch(disk, &head);
+}
+
 u64_t disk_read(struct disk_t * disk, u8_t * buf, u64_t offset, u64_t count)
 {
 	u64_t no, sz, cnt, capacity;
@@ -226,7 +533,8 @@ u64_t disk_read(struct disk_t * disk, u8_t * buf, u64_t offset, u64_t count)
 	if(!sz || !cnt)
 		return 0;
 
-	capacity = sz * count;
+	/* the whole disk, not the request length */
+	capacity = sz * cnt;
 	if(offset >= capacity)
 		return 0;
 
@@ -246,7 +554,7 @@ u64_t disk_read(struct disk_t * disk, u8_t * buf, u64_t offset, u64_t count)
 		if(count < len)
 			len = count;
 
-		if(disk->read(disk, p, no, 1) != 1)
+		if(disk_transfer(disk, DISK_REQUEST_READ, p, no, 1) != 1)
 		{
 			free(p);
 			return ret;
@@ -264,7 +572,7 @@ u64_t disk_read(struct disk_t * disk, u8_t * buf, u64_t offset, u64_t count)
 	{
 		len = tmp * sz;
 
-		if(disk->read(disk, buf, no, tmp) != tmp)
+		if(disk_transfer(disk, DISK_REQUEST_READ, buf, no, tmp) != tmp)
 		{
 			free(p);
 			return ret;
@@ -280,7 +588,7 @@ u64_t disk_read(struct disk_t * disk, u8_t * buf, u64_t offset, u64_t count)
 	{
 		len = count;
 
-		if(disk->read(disk, p, no, 1) != 1)
+		if(disk_transfer(disk, DISK_REQUEST_READ, p, no, 1) != 1)
 		{
 			free(p);
 			return ret;
@@ -309,7 +617,8 @@ u64_t disk_write(struct disk_t * disk, u8_t * buf, u64_t offset, u64_t count)
 	if(!sz || !cnt)
 		return 0;
 
-	capacity = sz * count;
+	/* the whole disk, not the request length */
+	capacity = sz * cnt;
 	if(offset >= capacity)
 		return 0;
 
@@ -329,7 +638,7 @@ u64_t disk_write(struct disk_t * disk, u8_t * buf, u64_t offset, u64_t count)
 		if(count < len)
 			len = count;
 
-		if(disk->read(disk, p, no, 1) != 1)
+		if(disk_transfer(disk, DISK_REQUEST_READ, p, no, 1) != 1)
 		{
 			free(p);
 			return ret;
@@ -337,7 +646,7 @@ u64_t disk_write(struct disk_t * disk, u8_t * buf, u64_t offset, u64_t count)
 
 		memcpy((void *)(&p[tmp]), (const void *)buf, len);
 
-		if(disk->write(disk, p, no, 1) != 1)
+		if(disk_transfer(disk, DISK_REQUEST_WRITE, p, no, 1) != 1)
 		{
 			free(p);
 			return ret;
@@ -354,7 +663,7 @@ u64_t disk_write(struct disk_t * disk, u8_t * buf, u64_t offset, u64_t count)
 	{
 		len = tmp * sz;
 
-		if(disk->write(disk, buf, no, tmp) != tmp)
+		if(disk_transfer(disk, DISK_REQUEST_WRITE, buf, no, tmp) != tmp)
 		{
 			free(p);
 			return ret;
@@ -370,7 +679,7 @@ u64_t disk_write(struct disk_t * disk, u8_t * buf, u64_t offset, u64_t count)
 	{
 		len = count;
 
-		if(disk->read(disk, p, no, 1) != 1)
+		if(disk_transfer(disk, DISK_REQUEST_READ, p, no, 1) != 1)
 		{
 			free(p);
 			return ret;
@@ -378,7 +687,7 @@ u64_t disk_write(struct disk_t * disk, u8_t * buf, u64_t offset, u64_t count)
 
 		memcpy((void *)(&p[0]), (const void *)buf, len);
 
-		if(disk->write(disk, p, no, 1) != 1)
+		if(disk_transfer(disk, DISK_REQUEST_WRITE, p, no, 1) != 1)
 		{
 			free(p);
 			return ret;
@@ -0,0 +1,770 @@
+/*
+ * driver/block/ftl.c
+ *
+ * Copyright(c) 2007-2018 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <xboot.h>
+#include <crc32.h>
+#include <block/block.h>
+
+/*
+ * FTL - Log Structured Flash Translation Layer
+ *
+ * Every erase block of the lower device is a segment. A segment begins with
+ * a header (magic, sequence, erase count and one tag per data slot) and is
+ * filled by appending sectors, so a rewrite of a logical sector never erases
+ * in place. The newest copy of a sector is found by segment sequence and slot
+ * order, and a per slot crc drops torn writes when scanning at mount. Reused
+ * segments are picked by lowest erase count, and cold segments are migrated
+ * when the erase count spread exceeds the wear threshold.
+ *
+ * A segment is erased and written whole when it is flushed the first time,
+ * later flushes program only the appended slots and then their tags into the
+ * erased space, so a power loss never touches sectors already on flash. The
+ * lower device must therefore be able to program without erase.
+ *
+ * Example:
+ *   "ftl@0": {
+ *       "block": "spi-flash.0",
+ *       "start-block": 16,
+ *       "block-count": -1,
+ *       "sector-size": 512,
+ *       "reserved-segments": 4,
+ *       "wear-threshold": 128
+ *   }
+ */
+
+#define FTL_MAGIC			(0x314c5446)
+#define FTL_UNMAPPED		(0xffffffff)
+
+enum ftl_segment_state_t {
+	FTL_SEGMENT_FREE	= 0,
+	FTL_SEGMENT_OPEN	= 1,
+	FTL_SEGMENT_USED	= 2,
+};
+
+struct ftl_header_t {
+	u32_t magic;
+	u32_t seq;
+	u32_t erase;
+	u32_t secsz;
+	u32_t crc;
+};
+
+struct ftl_tag_t {
+	u32_t lsn;
+	u32_t crc;
+};
+
+struct ftl_segment_t {
+	enum ftl_segment_state_t state;
+	u32_t seq;
+	u32_t erase;
+	u32_t used;
+	u32_t valid;
+};
+
+struct ftl_pdata_t {
+	struct block_t * lower;
+	u64_t start;
+	u32_t nseg;
+	u32_t segsz;
+	u32_t secsz;
+	u32_t hslots;
+	u32_t dslots;
+	u32_t nsec;
+	u32_t wear;
+	u32_t seq;
+	u32_t nfree;
+	struct ftl_segment_t * segs;
+	u32_t * map;
+	u32_t * rmap;
+	int open;
+	int fresh;
+	u32_t synced;
+	u8_t * wbuf;
+	int rseg;
+	u8_t * rbuf;
+
+	u64_t host_writes;
+	u64_t flash_writes;
+	u64_t gc_count;
+};
+
+static inline u8_t * ftl_slot(struct ftl_pdata_t * pdat, u8_t * seg, u32_t slot)
+{
+	return seg + (pdat->hslots + slot) * pdat->secsz;
+}
+
+static inline struct ftl_tag_t * ftl_tag(u8_t * seg, u32_t slot)
+{
+	return (struct ftl_tag_t *)(seg + sizeof(struct ftl_header_t)) + slot;
+}
+
+static inline u32_t ftl_header_crc(struct ftl_header_t * h)
+{
+	return crc32_sum(0, (const uint8_t *)h, offsetof(struct ftl_header_t, crc));
+}
+
+static inline bool_t ftl_blank(u8_t * buf, u32_t len)
+{
+	while(len--)
+	{
+		if(*buf++ != 0xff)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/*
+ * Slot data goes before the tags, a slot without a tag is skipped at mount
+ * and a tag without its data fails the crc check.
+ */
+static bool_t ftl_flush(struct ftl_pdata_t * pdat)
+{
+	u64_t base;
+	u32_t used, o, l;
+
+	if(pdat->open < 0)
+		return TRUE;
+	used = pdat->segs[pdat->open].used;
+	if(pdat->fresh)
+	{
+		if(used == 0)
+			return TRUE;
+		if(pdat->lower->write(pdat->lower, pdat->wbuf, pdat->start + pdat->open, 1) != 1)
+			return FALSE;
+		pdat->fresh = 0;
+	}
+	else if(pdat->synced < used)
+	{
+		base = block_offset(pdat->lower, pdat->start + pdat->open);
+		o = (pdat->hslots + pdat->synced) * pdat->secsz;
+		l = (used - pdat->synced) * pdat->secsz;
+		if(pdat->lower->program(pdat->lower, pdat->wbuf + o, base + o, l) != l)
+			return FALSE;
+		o = (u8_t *)ftl_tag(pdat->wbuf, pdat->synced) - pdat->wbuf;
+		l = (used - pdat->synced) * sizeof(struct ftl_tag_t);
+		if(pdat->lower->program(pdat->lower, pdat->wbuf + o, base + o, l) != l)
+			return FALSE;
+	}
+	pdat->synced = used;
+	return TRUE;
+}
+
+static bool_t ftl_close(struct ftl_pdata_t * pdat)
+{
+	if(!ftl_flush(pdat))
+		return FALSE;
+	pdat->segs[pdat->open].state = FTL_SEGMENT_USED;
+	pdat->open = -1;
+	return TRUE;
+}
+
+static bool_t ftl_open(struct ftl_pdata_t * pdat)
+{
+	struct ftl_segment_t * seg;
+	struct ftl_header_t h;
+	int i, s = -1;
+
+	for(i = 0; i < pdat->nseg; i++)
+	{
+		if((pdat->segs[i].state == FTL_SEGMENT_FREE) && ((s < 0) || (pdat->segs[i].erase < pdat->segs[s].erase)))
+			s = i;
+	}
+	if(s < 0)
+		return FALSE;
+
+	seg = &pdat->segs[s];
+	seg->state = FTL_SEGMENT_OPEN;
+	seg->seq = ++pdat->seq;
+	seg->erase++;
+	seg->used = 0;
+	seg->valid = 0;
+	pdat->nfree--;
+	pdat->open = s;
+	pdat->fresh = 1;
+	pdat->synced = 0;
+	if(pdat->rseg == s)
+		pdat->rseg = -1;
+
+	h.magic = FTL_MAGIC;
+	h.seq = seg->seq;
+	h.erase = seg->erase;
+	h.secsz = pdat->secsz;
+	h.crc = ftl_header_crc(&h);
+	memset(pdat->wbuf, 0xff, pdat->segsz);
+	memcpy(pdat->wbuf, &h, sizeof(struct ftl_header_t));
+	return TRUE;
+}
+
+static void ftl_put(struct ftl_pdata_t * pdat, u32_t lsn, u8_t * buf)
+{
+	struct ftl_segment_t * seg = &pdat->segs[pdat->open];
+	struct ftl_tag_t * tag = ftl_tag(pdat->wbuf, seg->used);
+	u32_t p = pdat->open * pdat->dslots + seg->used;
+	u32_t o = pdat->map[lsn];
+
+	memcpy(ftl_slot(pdat, pdat->wbuf, seg->used), buf, pdat->secsz);
+	tag->lsn = lsn;
+	tag->crc = crc32_sum(0, (const uint8_t *)buf, pdat->secsz);
+	seg->used++;
+	seg->valid++;
+	if(o != FTL_UNMAPPED)
+	{
+		pdat->segs[o / pdat->dslots].valid--;
+		pdat->rmap[o] = FTL_UNMAPPED;
+	}
+	pdat->map[lsn] = p;
+	pdat->rmap[p] = lsn;
+	pdat->flash_writes++;
+}
+
+static bool_t ftl_gc(struct ftl_pdata_t * pdat, int wear);
+
+/*
+ * Make sure the open segment has a free slot. User writes keep one free
+ * segment in reserve so that garbage collection can always relocate, and
+ * collect before using the room left in the open segment, which is what
+ * finishes a collection interrupted by power loss. Each closed segment
+ * gives wear leveling a chance to move one cold segment.
+ */
+static bool_t ftl_reserve(struct ftl_pdata_t * pdat, int gc)
+{
+	while(1)
+	{
+		if(gc && (pdat->nfree <= 1) && ftl_gc(pdat, 0))
+			continue;
+		if((pdat->open >= 0) && (pdat->segs[pdat->open].used < pdat->dslots))
+			return TRUE;
+		if(pdat->open >= 0)
+		{
+			if(!ftl_close(pdat))
+				return FALSE;
+			if(gc && ftl_gc(pdat, 1))
+				continue;
+		}
+		if(gc && (pdat->nfree <= 1))
+			return FALSE;
+		return ftl_open(pdat);
+	}
+}
+
+/*
+ * Free one segment. The greedy policy picks the segment with the fewest
+ * live sectors, the wear policy picks the least erased one when the erase
+ * count spread exceeds the threshold, so that cold data stops pinning it.
+ */
+static bool_t ftl_gc(struct ftl_pdata_t * pdat, int wear)
+{
+	struct ftl_segment_t * seg;
+	u32_t hi = 0, room;
+	u32_t i, p, lsn;
+	int s, victim = -1;
+
+	if(wear)
+	{
+		for(s = 0; s < pdat->nseg; s++)
+		{
+			seg = &pdat->segs[s];
+			if(seg->erase > hi)
+				hi = seg->erase;
+			if((seg->state == FTL_SEGMENT_USED) && ((victim < 0) || (seg->erase < pdat->segs[victim].erase)))
+				victim = s;
+		}
+		if((victim < 0) || (hi - pdat->segs[victim].erase <= pdat->wear))
+			return FALSE;
+		room = pdat->nfree * pdat->dslots;
+		if(pdat->open >= 0)
+			room += pdat->dslots - pdat->segs[pdat->open].used;
+		if(pdat->segs[victim].valid > room)
+			return FALSE;
+	}
+	else
+	{
+		for(s = 0; s < pdat->nseg; s++)
+		{
+			seg = &pdat->segs[s];
+			if((seg->state == FTL_SEGMENT_USED) && ((victim < 0) || (seg->valid < pdat->segs[victim].valid)))
+				victim = s;
+		}
+		if((victim < 0) || (pdat->segs[victim].valid >= pdat->dslots))
+			return FALSE;
+	}
+
+	seg = &pdat->segs[victim];
+	if(seg->valid > 0)
+	{
+		if(pdat->lower->read(pdat->lower, pdat->rbuf, pdat->start + victim, 1) != 1)
+			return FALSE;
+		pdat->rseg = victim;
+		for(i = 0; i < seg->used; i++)
+		{
+			p = victim * pdat->dslots + i;
+			lsn = pdat->rmap[p];
+			if((lsn != FTL_UNMAPPED) && (pdat->map[lsn] == p))
+			{
+				if(!ftl_reserve(pdat, 0))
+					return FALSE;
+				ftl_put(pdat, lsn, ftl_slot(pdat, pdat->rbuf, i));
+			}
+		}
+	}
+
+	/*
+	 * The victim may be reused only once the newer copies of its sectors
+	 * are on flash, otherwise a power loss would leave it still referenced.
+	 */
+	if(!ftl_flush(pdat))
+		return FALSE;
+
+	for(i = 0; i < pdat->dslots; i++)
+		pdat->rmap[victim * pdat->dslots + i] = FTL_UNMAPPED;
+	seg->state = FTL_SEGMENT_FREE;
+	seg->used = 0;
+	seg->valid = 0;
+	pdat->nfree++;
+	pdat->gc_count++;
+	return TRUE;
+}
+
+static bool_t ftl_get(struct ftl_pdata_t * pdat, u32_t lsn, u8_t * buf)
+{
+	u32_t p = pdat->map[lsn];
+	u64_t o;
+	int s;
+
+	if(p == FTL_UNMAPPED)
+	{
+		memset(buf, 0xff, pdat->secsz);
+		return TRUE;
+	}
+
+	s = p / pdat->dslots;
+	if(s == pdat->open)
+	{
+		memcpy(buf, ftl_slot(pdat, pdat->wbuf, p % pdat->dslots), pdat->secsz);
+		return TRUE;
+	}
+	if(s == pdat->rseg)
+	{
+		memcpy(buf, ftl_slot(pdat, pdat->rbuf, p % pdat->dslots), pdat->secsz);
+		return TRUE;
+	}
+
+	/*
+	 * Read just the slot when the lower device allows it, rather than the
+	 * whole segment for one sector
+	 */
+	if(pdat->lower->fetch)
+	{
+		o = block_offset(pdat->lower, pdat->start + s) + (pdat->hslots + p % pdat->dslots) * pdat->secsz;
+		return (pdat->lower->fetch(pdat->lower, buf, o, pdat->secsz) == pdat->secsz) ? TRUE : FALSE;
+	}
+	if(pdat->lower->read(pdat->lower, pdat->rbuf, pdat->start + s, 1) != 1)
+	{
+		pdat->rseg = -1;
+		return FALSE;
+	}
+	pdat->rseg = s;
+	memcpy(buf, ftl_slot(pdat, pdat->rbuf, p % pdat->dslots), pdat->secsz);
+	return TRUE;
+}
+
+static inline bool_t ftl_newer(struct ftl_pdata_t * pdat, u32_t p, u32_t o)
+{
+	if(o == FTL_UNMAPPED)
+		return TRUE;
+	if(p / pdat->dslots == o / pdat->dslots)
+		return (p > o) ? TRUE : FALSE;
+	return (pdat->segs[p / pdat->dslots].seq > pdat->segs[o / pdat->dslots].seq) ? TRUE : FALSE;
+}
+
+/*
+ * Rebuild the mapping table from segment headers. Segments without a valid
+ * header are free, slots whose data fails the crc check are ignored.
+ */
+static bool_t ftl_mount(struct ftl_pdata_t * pdat)
+{
+	struct ftl_segment_t * seg;
+	struct ftl_header_t h;
+	struct ftl_tag_t * tag;
+	u32_t i, p, lsn;
+	int s, last = -1;
+
+	for(s = 0; s < pdat->nseg; s++)
+	{
+		seg = &pdat->segs[s];
+		seg->state = FTL_SEGMENT_FREE;
+		seg->seq = 0;
+		seg->erase = 0;
+		seg->used = 0;
+		seg->valid = 0;
+
+		if(pdat->lower->read(pdat->lower, pdat->rbuf, pdat->start + s, 1) != 1)
+			return FALSE;
+		memcpy(&h, pdat->rbuf, sizeof(struct ftl_header_t));
+		if((h.magic != FTL_MAGIC) || (h.secsz != pdat->secsz) || (h.crc != ftl_header_crc(&h)))
+			continue;
+
+		seg->state = FTL_SEGMENT_USED;
+		seg->seq = h.seq;
+		seg->erase = h.erase;
+		if(h.seq > pdat->seq)
+			pdat->seq = h.seq;
+		for(i = 0; i < pdat->dslots; i++)
+		{
+			tag = ftl_tag(pdat->rbuf, i);
+			if((tag->lsn == FTL_UNMAPPED) && (tag->crc == 0xffffffff))
+				break;
+			p = s * pdat->dslots + i;
+			if((tag->lsn < pdat->nsec) && (tag->crc == crc32_sum(0, (const uint8_t *)ftl_slot(pdat, pdat->rbuf, i), pdat->secsz)))
+				pdat->rmap[p] = tag->lsn;
+		}
+		seg->used = i;
+	}
+
+	for(p = 0; p < pdat->nseg * pdat->dslots; p++)
+	{
+		lsn = pdat->rmap[p];
+		if((lsn != FTL_UNMAPPED) && ftl_newer(pdat, p, pdat->map[lsn]))
+			pdat->map[lsn] = p;
+	}
+	for(lsn = 0; lsn < pdat->nsec; lsn++)
+	{
+		if(pdat->map[lsn] != FTL_UNMAPPED)
+			pdat->segs[pdat->map[lsn] / pdat->dslots].valid++;
+	}
+
+	pdat->nfree = 0;
+	for(s = 0; s < pdat->nseg; s++)
+	{
+		seg = &pdat->segs[s];
+		if((seg->state == FTL_SEGMENT_USED) && (seg->valid == 0))
+		{
+			for(i = 0; i < seg->used; i++)
+				pdat->rmap[s * pdat->dslots + i] = FTL_UNMAPPED;
+			seg->state = FTL_SEGMENT_FREE;
+			seg->used = 0;
+		}
+		if(seg->state == FTL_SEGMENT_FREE)
+			pdat->nfree++;
+		else if((last < 0) || (seg->seq > pdat->segs[last].seq))
+			last = s;
+	}
+
+	/*
+	 * Keep appending to the newest segment only if the space after its last
+	 * slot is still erased, a slot torn before its tag was programmed is not.
+	 */
+	if((last >= 0) && (pdat->segs[last].used < pdat->dslots))
+	{
+		seg = &pdat->segs[last];
+		if(pdat->lower->read(pdat->lower, pdat->wbuf, pdat->start + last, 1) != 1)
+			return FALSE;
+		if(ftl_blank((u8_t *)ftl_tag(pdat->wbuf, seg->used), (pdat->dslots - seg->used) * sizeof(struct ftl_tag_t))
+			&& ftl_blank(ftl_slot(pdat, pdat->wbuf, seg->used), (pdat->dslots - seg->used) * pdat->secsz))
+		{
+			seg->state = FTL_SEGMENT_OPEN;
+			pdat->open = last;
+			pdat->fresh = 0;
+			pdat->synced = seg->used;
+		}
+	}
+	return TRUE;
+}
+
+static u64_t ftl_read(struct block_t * blk, u8_t * buf, u64_t blkno, u64_t blkcnt)
+{
+	struct ftl_pdata_t * pdat = (struct ftl_pdata_t *)(blk->priv);
+	u64_t count = block_available_count(blk, blkno, blkcnt);
+	u64_t i;
+
+	for(i = 0; i < count; i++)
+	{
+		if(!ftl_get(pdat, blkno + i, buf + i * pdat->secsz))
+			break;
+	}
+	return i;
+}
+
+static u64_t ftl_write(struct block_t * blk, u8_t * buf, u64_t blkno, u64_t blkcnt)
+{
+	struct ftl_pdata_t * pdat = (struct ftl_pdata_t *)(blk->priv);
+	u64_t count = block_available_count(blk, blkno, blkcnt);
+	u64_t i;
+
+	for(i = 0; i < count; i++)
+	{
+		if(!ftl_reserve(pdat, 1))
+			break;
+		ftl_put(pdat, blkno + i, buf + i * pdat->secsz);
+		pdat->host_writes++;
+	}
+	return i;
+}
+
+static void ftl_sync(struct block_t * blk)
+{
+	struct ftl_pdata_t * pdat = (struct ftl_pdata_t *)(blk->priv);
+	int s;
+
+	if(!ftl_flush(pdat))
+		return;
+
+	/*
+	 * Collect one segment while idle, a cold one for wear leveling or else a
+	 * fully stale one, so that foreground writes rarely have to relocate.
+	 */
+	if(!ftl_gc(pdat, 1))
+	{
+		for(s = 0; s < pdat->nseg; s++)
+		{
+			if((pdat->segs[s].state == FTL_SEGMENT_USED) && (pdat->segs[s].valid == 0))
+			{
+				ftl_gc(pdat, 0);
+				break;
+			}
+		}
+	}
+	if(pdat->lower->sync)
+		pdat->lower->sync(pdat->lower);
+}
+
+static ssize_t ftl_read_free_segments(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct ftl_pdata_t * pdat = (struct ftl_pdata_t *)kobj->priv;
+	return sprintf(buf, "%d", pdat->nfree);
+}
+
+static ssize_t ftl_read_erase_count(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct ftl_pdata_t * pdat = (struct ftl_pdata_t *)kobj->priv;
+	u32_t lo = 0xffffffff, hi = 0;
+	u64_t total = 0;
+	int s;
+
+	for(s = 0; s < pdat->nseg; s++)
+	{
+		if(pdat->segs[s].erase < lo)
+			lo = pdat->segs[s].erase;
+		if(pdat->segs[s].erase > hi)
+			hi = pdat->segs[s].erase;
+		total += pdat->segs[s].erase;
+	}
+	return sprintf(buf, "min:%d max:%d avg:%lld", lo, hi, total / pdat->nseg);
+}
+
+static ssize_t ftl_read_gc_count(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct ftl_pdata_t * pdat = (struct ftl_pdata_t *)kobj->priv;
+	return sprintf(buf, "%lld", pdat->gc_count);
+}
+
+static ssize_t ftl_read_host_writes(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct ftl_pdata_t * pdat = (struct ftl_pdata_t *)kobj->priv;
+	return sprintf(buf, "%lld", pdat->host_writes);
+}
+
+static ssize_t ftl_read_flash_writes(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct ftl_pdata_t * pdat = (struct ftl_pdata_t *)kobj->priv;
+	return sprintf(buf, "%lld", pdat->flash_writes);
+}
+
+static void ftl_pdata_free(struct ftl_pdata_t * pdat)
+{
+	if(pdat->segs)
+		free(pdat->segs);
+	if(pdat->map)
+		free(pdat->map);
+	if(pdat->rmap)
+		free(pdat->rmap);
+	if(pdat->wbuf)
+		free(pdat->wbuf);
+	if(pdat->rbuf)
+		free(pdat->rbuf);
+	free(pdat);
+}
+
+static struct device_t * ftl_probe(struct driver_t * drv, struct dtnode_t * n)
+{
+	struct ftl_pdata_t * pdat;
+	struct block_t * lower;
+	struct block_t * blk;
+	struct device_t * dev;
+	s64_t start = dt_read_long(n, "start-block", 0);
+	s64_t count = dt_read_long(n, "block-count", -1);
+	int secsz = dt_read_int(n, "sector-size", 512);
+	int reserved = dt_read_int(n, "reserved-segments", 4);
+	u32_t slots, h, i;
+
+	lower = search_block(dt_read_string(n, "block", NULL));
+	if(!lower || !lower->program)
+		return NULL;
+
+	if((start < 0) || (start >= block_count(lower)))
+		return NULL;
+	if((count <= 0) || (start + count > block_count(lower)))
+		count = block_count(lower) - start;
+	if(reserved < 3)
+		reserved = 3;
+	if(count <= reserved)
+		return NULL;
+	if((secsz < 64) || (secsz & (secsz - 1)) || (block_size(lower) % secsz) || (block_size(lower) / secsz < 2))
+		return NULL;
+
+	slots = block_size(lower) / secsz;
+	for(h = 1; h < slots; h++)
+	{
+		if(sizeof(struct ftl_header_t) + (slots - h) * sizeof(struct ftl_tag_t) <= h * secsz)
+			break;
+	}
+	if(h >= slots)
+		return NULL;
+
+	pdat = malloc(sizeof(struct ftl_pdata_t));
+	if(!pdat)
+		return NULL;
+	memset(pdat, 0, sizeof(struct ftl_pdata_t));
+
+	pdat->lower = lower;
+	pdat->start = start;
+	pdat->nseg = count;
+	pdat->segsz = block_size(lower);
+	pdat->secsz = secsz;
+	pdat->hslots = h;
+	pdat->dslots = slots - h;
+	pdat->nsec = (count - reserved) * pdat->dslots;
+	pdat->wear = dt_read_int(n, "wear-threshold", 128);
+	pdat->open = -1;
+	pdat->rseg = -1;
+	pdat->segs = malloc(sizeof(struct ftl_segment_t) * pdat->nseg);
+	pdat->map = malloc(sizeof(u32_t) * pdat->nsec);
+	pdat->rmap = malloc(sizeof(u32_t) * pdat->nseg * pdat->dslots);
+	pdat->wbuf = malloc(pdat->segsz);
+	pdat->rbuf = malloc(pdat->segsz);
+	if(!pdat->segs || !pdat->map || !pdat->rmap || !pdat->wbuf || !pdat->rbuf)
+	{
+		ftl_pdata_free(pdat);
+		return NULL;
+	}
+	for(i = 0; i < pdat->nsec; i++)
+		pdat->map[i] = FTL_UNMAPPED;
+	for(i = 0; i < pdat->nseg * pdat->dslots; i++)
+		pdat->rmap[i] = FTL_UNMAPPED;
+
+	if(!ftl_mount(pdat))
+	{
+		ftl_pdata_free(pdat);
+		return NULL;
+	}
+
+	blk = malloc(sizeof(struct block_t));
+	if(!blk)
+	{
+		ftl_pdata_free(pdat);
+		return NULL;
+	}
+
+	blk->name = alloc_device_name(dt_read_name(n), dt_read_id(n));
+	blk->blksz = pdat->secsz;
+	blk->blkcnt = pdat->nsec;
+	blk->read = ftl_read;
+	blk->write = ftl_write;
+	blk->readv = NULL;
+	blk->writev = NULL;
+	blk->fetch = NULL;
+	blk->program = NULL;
+	blk->sync = ftl_sync;
+	blk->mmap = NULL;
+	blk->backing = NULL;
+	blk->backing_offset = 0;
+	blk->priv = pdat;
+
+	if(!register_block(&dev, blk))
+	{
+		free_device_name(blk->name);
+		ftl_pdata_free(pdat);
+		free(blk);
+		return NULL;
+	}
+	dev->driver = drv;
+	kobj_add_regular(dev->kobj, "free-segments", ftl_read_free_segments, NULL, pdat);
+	kobj_add_regular(dev->kobj, "erase-count", ftl_read_erase_count, NULL, pdat);
+	kobj_add_regular(dev->kobj, "gc-count", ftl_read_gc_count, NULL, pdat);
+	kobj_add_regular(dev->kobj, "host-writes", ftl_read_host_writes, NULL, pdat);
+	kobj_add_regular(dev->kobj, "flash-writes", ftl_read_flash_writes, NULL, pdat);
+
+	return dev;
+}
+
+static void ftl_remove(struct device_t * dev)
+{
+	struct block_t * blk = (struct block_t *)dev->priv;
+
+	if(blk && unregister_block(blk))
+	{
+		ftl_flush((struct ftl_pdata_t *)blk->priv);
+		free_device_name(blk->name);
+		ftl_pdata_free((struct ftl_pdata_t *)blk->priv);
+		free(blk);
+	}
+}
+
+static void ftl_suspend(struct device_t * dev)
+{
+	struct block_t * blk = (struct block_t *)dev->priv;
+
+	if(blk)
+		block_sync(blk);
+}
+
+static void ftl_resume(struct device_t * dev)
+{
+}
+
+static struct driver_t ftl = {
+	.name		= "ftl",
+	.probe		= ftl_probe,
+	.remove		= ftl_remove,
+	.suspend	= ftl_suspend,
+	.resume		= ftl_resume,
+};
+
+static __init void ftl_driver_init(void)
+{
+	register_driver(&ftl);
+}
+
+static __exit void ftl_driver_exit(void)
+{
+	unregister_driver(&ftl);
+}
+
+driver_initcall(ftl_driver_init);
+driver_exitcall(ftl_driver_exit);
@@ -27,22 +27,107 @@
  */
 
 #include <xboot.h>
+#include <lz4.h>
 #include <block/block.h>
 
+/*
+ * The romdisk image is either raw or the chunked lz4 format produced by
+ * developments/mkromdisk, a header with the magic "RDZ4", an index of chunk
+ * offsets and independently compressed chunks. Chunks are decompressed on
+ * demand into a small cache, so only the data actually read is paid for.
+ * Chunks stored raw are used in place and can be mapped without a copy.
+ */
+#define ROMDISK_LZ4_HEADER	(24)
+#define ROMDISK_LZ4_RAW		(1U << 31)
+
+struct romdisk_chunk_t
+{
+	s64_t id;
+	u64_t stamp;
+	u8_t * data;
+};
+
 struct romdisk_pdata_t
 {
 	virtual_addr_t addr;
 	virtual_size_t size;
+	u32_t chunk;
+	u32_t count;
+	u64_t stamp;
+	struct romdisk_chunk_t cache[CONFIG_ROMDISK_CACHE_CHUNKS];
 };
 
+static inline u32_t romdisk_get32(virtual_addr_t addr)
+{
+	const u8_t * p = (const u8_t *)addr;
+	return (u32_t)p[0] | ((u32_t)p[1] << 8) | ((u32_t)p[2] << 16) | ((u32_t)p[3] << 24);
+}
+
+static u8_t * romdisk_chunk(struct romdisk_pdata_t * pdat, u32_t id)
+{
+	struct romdisk_chunk_t * c = &pdat->cache[0];
+	virtual_addr_t index = pdat->addr + ROMDISK_LZ4_HEADER;
+	u32_t start, end;
+	int i;
+
+	for(i = 0; i < CONFIG_ROMDISK_CACHE_CHUNKS; i++)
+	{
+		if(pdat->cache[i].id == id)
+		{
+			pdat->cache[i].stamp = ++pdat->stamp;
+			return pdat->cache[i].data;
+		}
+		if(pdat->cache[i].stamp < c->stamp)
+			c = &pdat->cache[i];
+	}
+
+	start = romdisk_get32(index + id * 4);
+	end = romdisk_get32(index + (id + 1) * 4) & ~ROMDISK_LZ4_RAW;
+	c->id = -1;
+	if(start & ROMDISK_LZ4_RAW)
+	{
+		memcpy(c->data, (const void *)(pdat->addr + (start & ~ROMDISK_LZ4_RAW)), pdat->chunk);
+	}
+	else
+	{
+		if(LZ4_decompress_safe((const char *)(pdat->addr + start), (char *)c->data, end - start, pdat->chunk) != pdat->chunk)
+			return NULL;
+	}
+	c->id = id;
+	c->stamp = ++pdat->stamp;
+	return c->data;
+}
+
 static u64_t romdisk_read(struct block_t * blk, u8_t * buf, u64_t blkno, u64_t blkcnt)
 {
 	struct romdisk_pdata_t * pdat = (struct romdisk_pdata_t *)(blk->priv);
 	virtual_addr_t offset = pdat->addr + block_offset(blk, blkno);
 	u64_t count = block_available_count(blk, blkno, blkcnt);
 	u64_t length = block_available_length(blk, blkno, blkcnt);
+	u64_t pos, o, n;
+	u8_t * p;
+
+	if(pdat->chunk == 0)
+	{
+		memcpy((void *)buf, (const void *)(offset), length);
+		return count;
+	}
 
-	memcpy((void *)buf, (const void *)(offset), length);
+	pos = block_offset(blk, blkno);
+	while(length > 0)
+	{
+		o = pos % pdat->chunk;
+		n = pdat->chunk - o;
+		if(n > length)
+			n = length;
+		p = romdisk_chunk(pdat, pos / pdat->chunk);
+		if(!p)
+			return (pos - block_offset(blk, blkno)) / block_size(blk);
+		memcpy((void *)buf, (const void *)(p + o), n);
+		buf += n;
+		pos += n;
+		length -= n;
+	}
 	return count;
 }
 
@@ -55,6 +140,35 @@ static void romdisk_sync(struct block_t * blk)
 {
 }
 
+static void * romdisk_mmap(struct block_t * blk, u64_t offset, u64_t count)
+{
+	struct romdisk_pdata_t * pdat = (struct romdisk_pdata_t *)(blk->priv);
+	virtual_addr_t index = pdat->addr + ROMDISK_LZ4_HEADER;
+	u32_t first, last, start, next, i;
+
+	if(pdat->chunk == 0)
+		return (void *)(pdat->addr + offset);
+
+	/*
+	 * Only a range whose chunks are all stored raw and back to back in the
+	 * image can be mapped, mkromdisk -x keeps the chunks of such files raw
+	 */
+	first = offset / pdat->chunk;
+	last = (count > 0) ? (offset + count - 1) / pdat->chunk : first;
+	if(last >= pdat->count)
+		return NULL;
+	start = romdisk_get32(index + first * 4);
+	if(!(start & ROMDISK_LZ4_RAW))
+		return NULL;
+	for(i = first; i < last; i++)
+	{
+		next = romdisk_get32(index + (i + 1) * 4);
+		if(!(next & ROMDISK_LZ4_RAW) || (next != romdisk_get32(index + i * 4) + pdat->chunk))
+			return NULL;
+	}
+	return (void *)(pdat->addr + (start & ~ROMDISK_LZ4_RAW) + offset % pdat->chunk);
+}
+
 static struct device_t * romdisk_probe(struct driver_t * drv, struct dtnode_t * n)
 {
 	struct romdisk_pdata_t * pdat;
@@ -62,36 +176,77 @@ static struct device_t * romdisk_probe(struct driver_t * drv, struct dtnode_t *
 	struct device_t * dev;
 	virtual_addr_t addr = strtoull(dt_read_string(n, "address", "0"), NULL, 0);
 	virtual_size_t size = strtoull(dt_read_string(n, "size", "0"), NULL, 0);
+	u64_t usize;
+	u32_t chunk = 0, count = 0;
+	u8_t * data = NULL;
+	int i;
 
 	if(size <= 0)
 		return NULL;
-	size = (size + SZ_512) / SZ_512;
+
+	if((size > ROMDISK_LZ4_HEADER) && (memcmp((const void *)addr, "RDZ4", 4) == 0))
+	{
+		chunk = romdisk_get32(addr + 4);
+		count = romdisk_get32(addr + 8);
+		usize = ((u64_t)romdisk_get32(addr + 20) << 32) | romdisk_get32(addr + 16);
+		if((chunk < SZ_512) || (chunk & (chunk - 1)) || ((u64_t)count * chunk < usize))
+			return NULL;
+		data = malloc(chunk * CONFIG_ROMDISK_CACHE_CHUNKS);
+		if(!data)
+			return NULL;
+		size = (usize + SZ_512 - 1) / SZ_512;
+	}
+	else
+	{
+		size = (size + SZ_512) / SZ_512;
+	}
 
 	pdat = malloc(sizeof(struct romdisk_pdata_t));
 	if(!pdat)
+	{
+		free(data);
 		return NULL;
+	}
 
 	blk = malloc(sizeof(struct block_t));
 	if(!blk)
 	{
+		free(data);
 		free(pdat);
 		return NULL;
 	}
 
 	pdat->addr = addr;
 	pdat->size = size;
+	pdat->chunk = chunk;
+	pdat->count = count;
+	pdat->stamp = 0;
+	for(i = 0; i < CONFIG_ROMDISK_CACHE_CHUNKS; i++)
+	{
+		pdat->cache[i].id = -1;
+		pdat->cache[i].stamp = 0;
+		pdat->cache[i].data = data ? data + chunk * i : NULL;
+	}
 
 	blk->name = alloc_device_name(dt_read_name(n), dt_read_id(n));
 	blk->blksz	= SZ_512;
 	blk->blkcnt	= (u64_t)size;
 	blk->read = romdisk_read;
 	blk->write = romdisk_write;
+	blk->readv = NULL;
+	blk->writev = NULL;
+	blk->fetch = NULL;
+	blk->program = NULL;
 	blk->sync = romdisk_sync;
+	blk->mmap = romdisk_mmap;
+	blk->backing = NULL;
+	blk->backing_offset = 0;
 	blk->priv = pdat;
 
 	if(!register_block(&dev, blk))
 	{
 		free_device_name(blk->name);
+		free(pdat->cache[0].data);
 		free(blk->priv);
 		free(blk);
 		return NULL;
@@ -108,6 +263,7 @@ static void romdisk_remove(struct device_t * dev)
 	if(blk && unregister_block(blk))
 	{
 		free_device_name(blk->name);
+		free(((struct romdisk_pdata_t *)blk->priv)->cache[0].data);
 		free(blk->priv);
 		free(blk);
 	}
@@ -95,6 +95,11 @@ struct spi_flash_info_t {
 struct spi_flash_pdata_t {
 	struct spi_device_t * dev;
 	struct spi_flash_info_t info;
+	u8_t * buf;
+	int differential;
+	u64_t skipped;
+	u64_t avoided;
+	u64_t programmed;
 };
 
 static bool_t spi_flash_read_sfdp(struct spi_device_t * dev, struct sfdp_t * sfdp)
@@ -595,12 +600,8 @@ static void spi_flash_init(struct spi_flash_pdata_t * pdat)
 	}
 }
 
-static u64_t spi_flash_read(struct block_t * blk, u8_t * buf, u64_t blkno, u64_t blkcnt)
+static void spi_flash_read_range(struct spi_flash_pdata_t * pdat, u64_t addr, u8_t * buf, s64_t cnt)
 {
-	struct spi_flash_pdata_t * pdat = (struct spi_flash_pdata_t *)blk->priv;
-	u64_t addr = blkno * blk->blksz;
-	s64_t cnt = blkcnt * blk->blksz;
-	u8_t * pbuf = buf;
 	u32_t len;
 
 	if(pdat->info.read_granularity == 1)
@@ -610,89 +611,277 @@ static u64_t spi_flash_read(struct block_t * blk, u8_t * buf, u64_t blkno, u64_t
 	while(cnt > 0)
 	{
 		spi_flash_wait_for_busy(pdat);
-		spi_flash_read_bytes(pdat, addr, pbuf, len);
+		spi_flash_read_bytes(pdat, addr, buf, len);
 		addr += len;
-		pbuf += len;
+		buf += len;
 		cnt -= len;
 	}
-
-	return blkcnt;
 }
 
-static u64_t spi_flash_write(struct block_t * blk, u8_t * buf, u64_t blkno, u64_t blkcnt)
+static void spi_flash_program_range(struct spi_flash_pdata_t * pdat, u64_t addr, u8_t * buf, s64_t cnt)
 {
-	struct spi_flash_pdata_t * pdat = (struct spi_flash_pdata_t *)blk->priv;
-	u64_t addr, baddr = blkno * blk->blksz;
-	s64_t cnt, count = blkcnt * blk->blksz;
 	u32_t len;
-	u8_t * pbuf;
 
-	addr = baddr;
-	cnt = count;
+	if(pdat->info.write_granularity == 1)
+		len = (cnt < 0x7fffffff) ? cnt : 0x7fffffff;
+	else
+		len = pdat->info.write_granularity;
 	spi_flash_wait_for_busy(pdat);
 	while(cnt > 0)
 	{
-		if((pdat->info.opcode_erase_256k != 0) && ((addr & 0x3ffff) == 0) && (cnt >= 262144))
-		{
-			len = 262144;
-			spi_flash_write_enable(pdat);
-			spi_flash_sector_erase_256k(pdat, addr);
-			spi_flash_wait_for_busy(pdat);
-		}
-		else if((pdat->info.opcode_erase_64k != 0) && ((addr & 0xffff) == 0) && (cnt >= 65536))
+		spi_flash_write_enable(pdat);
+		spi_flash_write_bytes(pdat, addr, buf, len);
+		spi_flash_wait_for_busy(pdat);
+		addr += len;
+		buf += len;
+		cnt -= len;
+	}
+}
+
+static u32_t spi_flash_erase_size(struct spi_flash_pdata_t * pdat, u64_t addr, s64_t cnt)
+{
+	if((pdat->info.opcode_erase_256k != 0) && ((addr & 0x3ffff) == 0) && (cnt >= 262144))
+		return 262144;
+	else if((pdat->info.opcode_erase_64k != 0) && ((addr & 0xffff) == 0) && (cnt >= 65536))
+		return 65536;
+	else if((pdat->info.opcode_erase_32k != 0) && ((addr & 0x7fff) == 0) && (cnt >= 32768))
+		return 32768;
+	else if((pdat->info.opcode_erase_4k != 0) && ((addr & 0xfff) == 0) && (cnt >= 4096))
+		return 4096;
+	return 0;
+}
+
+static void spi_flash_erase(struct spi_flash_pdata_t * pdat, u64_t addr, u32_t len)
+{
+	spi_flash_write_enable(pdat);
+	switch(len)
+	{
+	case 262144:
+		spi_flash_sector_erase_256k(pdat, addr);
+		break;
+	case 65536:
+		spi_flash_sector_erase_64k(pdat, addr);
+		break;
+	case 32768:
+		spi_flash_sector_erase_32k(pdat, addr);
+		break;
+	case 4096:
+		spi_flash_sector_erase_4k(pdat, addr);
+		break;
+	default:
+		break;
+	}
+	spi_flash_wait_for_busy(pdat);
+}
+
+static inline u32_t spi_flash_page_size(struct spi_flash_pdata_t * pdat)
+{
+	return (pdat->info.write_granularity > 1) ? pdat->info.write_granularity : 256;
+}
+
+static inline bool_t spi_flash_page_blank(u8_t * buf, u32_t len)
+{
+	while(len--)
+	{
+		if(*buf++ != 0xff)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/*
+ * Update one erase unit, reading it back first. Units that already hold the
+ * data are skipped, units that only need bits cleared are programmed without
+ * erase, and after an erase only non-blank pages are programmed.
+ */
+static void spi_flash_update_unit(struct spi_flash_pdata_t * pdat, u64_t addr, u8_t * buf, u32_t len)
+{
+	u32_t chunk = pdat->info.blksz;
+	u32_t page = spi_flash_page_size(pdat);
+	bool_t same = TRUE, erase = FALSE;
+	u32_t o, i;
+
+	for(o = 0; (o < len) && !erase; o += chunk)
+	{
+		spi_flash_read_range(pdat, addr + o, pdat->buf, chunk);
+		for(i = 0; i < chunk; i++)
 		{
-			len = 65536;
-			spi_flash_write_enable(pdat);
-			spi_flash_sector_erase_64k(pdat, addr);
-			spi_flash_wait_for_busy(pdat);
+			if(pdat->buf[i] != buf[o + i])
+			{
+				same = FALSE;
+				if((pdat->buf[i] & buf[o + i]) != buf[o + i])
+				{
+					erase = TRUE;
+					break;
+				}
+			}
 		}
-		else if((pdat->info.opcode_erase_32k != 0) && ((addr & 0x7fff) == 0) && (cnt >= 32768))
+	}
+
+	if(same)
+	{
+		pdat->skipped += len;
+		pdat->avoided++;
+	}
+	else if(erase)
+	{
+		spi_flash_erase(pdat, addr, len);
+		for(o = 0; o < len; o += page)
 		{
-			len = 32768;
-			spi_flash_write_enable(pdat);
-			spi_flash_sector_erase_32k(pdat, addr);
-			spi_flash_wait_for_busy(pdat);
+			if(spi_flash_page_blank(&buf[o], page))
+			{
+				pdat->skipped += page;
+			}
+			else
+			{
+				spi_flash_program_range(pdat, addr + o, &buf[o], page);
+				pdat->programmed++;
+			}
 		}
-		else if((pdat->info.opcode_erase_4k != 0) && ((addr & 0xfff) == 0) && (cnt >= 4096))
+	}
+	else
+	{
+		pdat->avoided++;
+		for(o = 0; o < len; o += chunk)
 		{
-			len = 4096;
-			spi_flash_write_enable(pdat);
-			spi_flash_sector_erase_4k(pdat, addr);
-			spi_flash_wait_for_busy(pdat);
+			spi_flash_read_range(pdat, addr + o, pdat->buf, chunk);
+			for(i = 0; i < chunk; i += page)
+			{
+				if(memcmp(&pdat->buf[i], &buf[o + i], page) == 0)
+				{
+					pdat->skipped += page;
+				}
+				else
+				{
+					spi_flash_program_range(pdat, addr + o + i, &buf[o + i], page);
+					pdat->programmed++;
+				}
+			}
 		}
-		else
+	}
+}
+
+static u64_t spi_flash_read(struct block_t * blk, u8_t * buf, u64_t blkno, u64_t blkcnt)
+{
+	struct spi_flash_pdata_t * pdat = (struct spi_flash_pdata_t *)blk->priv;
+
+	spi_flash_read_range(pdat, blkno * blk->blksz, buf, blkcnt * blk->blksz);
+	return blkcnt;
+}
+
+static u64_t spi_flash_write(struct block_t * blk, u8_t * buf, u64_t blkno, u64_t blkcnt)
+{
+	struct spi_flash_pdata_t * pdat = (struct spi_flash_pdata_t *)blk->priv;
+	u64_t addr, baddr = blkno * blk->blksz;
+	s64_t cnt, count = blkcnt * blk->blksz;
+	u32_t len;
+
+	if(pdat->differential && pdat->buf)
+	{
+		addr = baddr;
+		cnt = count;
+		while(cnt > 0)
 		{
-			return 0;
+			len = spi_flash_erase_size(pdat, addr, cnt);
+			if(len == 0)
+				return (addr - baddr) / blk->blksz;
+			spi_flash_update_unit(pdat, addr, buf + (addr - baddr), len);
+			addr += len;
+			cnt -= len;
 		}
-		addr += len;
-		cnt -= len;
+		return blkcnt;
 	}
 
 	addr = baddr;
 	cnt = count;
-	pbuf = buf;
-	if(pdat->info.write_granularity == 1)
-		len = (cnt < 0x7fffffff) ? cnt : 0x7fffffff;
-	else
-		len = pdat->info.write_granularity;
 	spi_flash_wait_for_busy(pdat);
 	while(cnt > 0)
 	{
-		spi_flash_write_enable(pdat);
-		spi_flash_write_bytes(pdat, addr, pbuf, len);
-		spi_flash_wait_for_busy(pdat);
+		len = spi_flash_erase_size(pdat, addr, cnt);
+		if(len == 0)
+			return 0;
+		spi_flash_erase(pdat, addr, len);
 		addr += len;
-		pbuf += len;
 		cnt -= len;
 	}
+	spi_flash_program_range(pdat, baddr, buf, count);
+	pdat->programmed += (count + spi_flash_page_size(pdat) - 1) / spi_flash_page_size(pdat);
 
 	return blkcnt;
 }
 
+/*
+ * Read any byte range, for chips without a read granularity only
+ */
+static u64_t spi_flash_fetch(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
+{
+	struct spi_flash_pdata_t * pdat = (struct spi_flash_pdata_t *)blk->priv;
+
+	if(offset + count > block_capacity(blk))
+		return 0;
+	spi_flash_read_range(pdat, offset, buf, count);
+	return count;
+}
+
+/*
+ * Program into erased space without erasing, for byte programmable chips
+ * only. A page program wraps at the page boundary, so split there.
+ */
+static u64_t spi_flash_program(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
+{
+	struct spi_flash_pdata_t * pdat = (struct spi_flash_pdata_t *)blk->priv;
+	u32_t page = spi_flash_page_size(pdat);
+	u64_t o = 0, len;
+
+	if(offset + count > block_capacity(blk))
+		return 0;
+	while(o < count)
+	{
+		len = page - ((offset + o) % page);
+		if(len > count - o)
+			len = count - o;
+		spi_flash_program_range(pdat, offset + o, buf + o, len);
+		pdat->programmed++;
+		o += len;
+	}
+	return count;
+}
+
 static void spi_flash_sync(struct block_t * blk)
 {
 }
 
+static ssize_t spi_flash_read_differential(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct spi_flash_pdata_t * pdat = (struct spi_flash_pdata_t *)kobj->priv;
+	return sprintf(buf, "%d", pdat->differential ? 1 : 0);
+}
+
+static ssize_t spi_flash_write_differential(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct spi_flash_pdata_t * pdat = (struct spi_flash_pdata_t *)kobj->priv;
+	pdat->differential = strtol(buf, NULL, 0) ? 1 : 0;
+	return size;
+}
+
+static ssize_t spi_flash_read_skipped_bytes(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct spi_flash_pdata_t * pdat = (struct spi_flash_pdata_t *)kobj->priv;
+	return sprintf(buf, "%lld", pdat->skipped);
+}
+
+static ssize_t spi_flash_read_avoided_erases(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct spi_flash_pdata_t * pdat = (struct spi_flash_pdata_t *)kobj->priv;
+	return sprintf(buf, "%lld", pdat->avoided);
+}
+
+static ssize_t spi_flash_read_programmed_pages(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct spi_flash_pdata_t * pdat = (struct spi_flash_pdata_t *)kobj->priv;
+	return sprintf(buf, "%lld", pdat->programmed);
+}
+
 static struct device_t * spi_flash_probe(struct driver_t * drv, struct dtnode_t * n)
 {
 	struct spi_flash_pdata_t * pdat;
@@ -728,13 +917,25 @@ static struct device_t * spi_flash_probe(struct driver_t * drv, struct dtnode_t
 
 	pdat->dev = spidev;
 	memcpy(&pdat->info, &info, sizeof(struct spi_flash_info_t));
+	pdat->buf = malloc(pdat->info.blksz);
+	pdat->differential = dt_read_bool(n, "differential", 1);
+	pdat->skipped = 0;
+	pdat->avoided = 0;
+	pdat->programmed = 0;
 
 	blk->name = alloc_device_name(dt_read_name(n), dt_read_id(n));
 	blk->blksz = pdat->info.blksz;
 	blk->blkcnt = pdat->info.capacity / pdat->info.blksz;
 	blk->read = spi_flash_read;
 	blk->write = spi_flash_write;
+	blk->readv = NULL;
+	blk->writev = NULL;
+	blk->fetch = (pdat->info.read_granularity == 1) ? spi_flash_fetch : NULL;
+	blk->program = (pdat->info.write_granularity == 1) ? spi_flash_program : NULL;
 	blk->sync = spi_flash_sync;
+	blk->mmap = NULL;
+	blk->backing = NULL;
+	blk->backing_offset = 0;
 	blk->priv = pdat;
 	spi_flash_init(pdat);
 
@@ -743,11 +944,16 @@ static struct device_t * spi_flash_probe(struct driver_t * drv, struct dtnode_t
 		spi_device_free(pdat->dev);
 
 		free_device_name(blk->name);
+		free(pdat->buf);
 		free(blk->priv);
 		free(blk);
 		return NULL;
 	}
 	dev->driver = drv;
+	kobj_add_regular(dev->kobj, "differential", spi_flash_read_differential, spi_flash_write_differential, pdat);
+	kobj_add_regular(dev->kobj, "skipped-bytes", spi_flash_read_skipped_bytes, NULL, pdat);
+	kobj_add_regular(dev->kobj, "avoided-erases", spi_flash_read_avoided_erases, NULL, pdat);
+	kobj_add_regular(dev->kobj, "programmed-pages", spi_flash_read_programmed_pages, NULL, pdat);
 
 	return dev;
 }
@@ -762,6 +968,7 @@ static void spi_flash_remove(struct device_t * dev)
 		spi_device_free(pdat->dev);
 
 		free_device_name(blk->name);
+		free(pdat->buf);
 		free(blk->priv);
 		free(blk);
 	}
@@ -109,8 +109,10 @@ static struct device_t * clk_divider_probe(struct driver_t * drv, struct dtnode_
 	if(!parent || !name || (shift < 0) || (width <= 0))
 		return NULL;
 
-	if(!search_clk(parent) || search_clk(name))
+	if(search_clk(name))
 		return NULL;
+	if(!search_clk(parent))
+		return PROBE_DEFER;
 
 	pdat = malloc(sizeof(struct clk_divider_pdata_t));
 	if(!pdat)
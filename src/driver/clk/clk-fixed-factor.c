@@ -78,8 +78,10 @@ static struct device_t * clk_fixed_factor_probe(struct driver_t * drv, struct dt
 	if(!name || !parent)
 		return NULL;
 
-	if(search_clk(name) || !search_clk(parent))
+	if(search_clk(name))
 		return NULL;
+	if(!search_clk(parent))
+		return PROBE_DEFER;
 
 	pdat = malloc(sizeof(struct clk_fixed_factor_pdata_t));
 	if(!pdat)
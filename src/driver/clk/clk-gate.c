@@ -88,8 +88,10 @@ static struct device_t * clk_gate_probe(struct driver_t * drv, struct dtnode_t *
 	if(!parent || !name || (shift < 0))
 		return NULL;
 
-	if(!search_clk(parent) || search_clk(name))
+	if(search_clk(name))
 		return NULL;
+	if(!search_clk(parent))
+		return PROBE_DEFER;
 
 	pdat = malloc(sizeof(struct clk_gate_pdata_t));
 	if(!pdat)
@@ -72,8 +72,10 @@ static struct device_t * clk_link_probe(struct driver_t * drv, struct dtnode_t *
 	if(!parent || !name)
 		return NULL;
 
-	if(!search_clk(parent) || search_clk(name))
+	if(search_clk(name))
 		return NULL;
+	if(!search_clk(parent))
+		return PROBE_DEFER;
 
 	pdat = malloc(sizeof(struct clk_link_pdata_t));
 	if(!pdat)
@@ -54,7 +54,7 @@ static struct device_t * console_uart_probe(struct driver_t * drv, struct dtnode
 	struct uart_t * uart = search_uart(dt_read_string(n, "uart-bus", NULL));
 
 	if(!uart)
-		return NULL;
+		return dt_read_string(n, "uart-bus", NULL) ? PROBE_DEFER : NULL;
 
 	pdat = malloc(sizeof(struct console_uart_pdata_t));
 	if(!pdat)
@@ -85,7 +85,7 @@ static struct device_t * led_pwm_bl_probe(struct driver_t * drv, struct dtnode_t
 	struct device_t * dev;
 
 	if(!(pwm = search_pwm(dt_read_string(n, "pwm-name", NULL))))
-		return NULL;
+		return dt_read_string(n, "pwm-name", NULL) ? PROBE_DEFER : NULL;
 
 	pdat = malloc(sizeof(struct led_pwm_bl_pdata_t));
 	if(!pdat)
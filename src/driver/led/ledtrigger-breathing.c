@@ -76,7 +76,7 @@ static struct device_t * ledtrigger_breathing_probe(struct driver_t * drv, struc
 
 	led = search_led(dt_read_string(n, "led-name", NULL));
 	if(!led)
-		return NULL;
+		return dt_read_string(n, "led-name", NULL) ? PROBE_DEFER : NULL;
 
 	pdat = malloc(sizeof(struct ledtrigger_breathing_pdata_t));
 	if(!pdat)
@@ -72,7 +72,7 @@ static struct device_t * ledtrigger_general_probe(struct driver_t * drv, struct
 
 	led = search_led(dt_read_string(n, "led-name", NULL));
 	if(!led)
-		return NULL;
+		return dt_read_string(n, "led-name", NULL) ? PROBE_DEFER : NULL;
 
 	pdat = malloc(sizeof(struct ledtrigger_general_pdata_t));
 	if(!pdat)
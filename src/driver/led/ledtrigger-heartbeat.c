@@ -91,7 +91,7 @@ static struct device_t * ledtrigger_heartbeat_probe(struct driver_t * drv, struc
 
 	led = search_led(dt_read_string(n, "led-name", NULL));
 	if(!led)
-		return NULL;
+		return dt_read_string(n, "led-name", NULL) ? PROBE_DEFER : NULL;
 
 	pdat = malloc(sizeof(struct ledtrigger_heartbeat_pdata_t));
 	if(!pdat)
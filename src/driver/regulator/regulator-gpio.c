@@ -41,6 +41,8 @@
  * - voltage: regulator's voltage in uV
  * - active-low: low level for active regulator
  * - default-enable: regulator default enable or disable
+ * - startup-delay: time in ms the output needs to settle after the default
+ *   enable, the regulator is registered once it has passed
  *
  * Example:
  *   "regulator-gpio@0": {
@@ -50,6 +52,7 @@
  *       "gpio": 74,
  *       "gpiocfg": -1,
  *       "active-low": false,
+ *       "startup-delay": 0,
  *       "default-enable": false
  *   }
  */
@@ -116,13 +119,39 @@ static struct device_t * regulator_gpio_probe(struct driver_t * drv, struct dtno
 	struct device_t * dev;
 	struct dtnode_t o;
 	char * name = dt_read_string(n, "name", NULL);
+	char * parent = dt_read_string(n, "parent", NULL);
+	int gpio = dt_read_int(n, "gpio", -1);
+	int gpiocfg = dt_read_int(n, "gpio-config", -1);
+	int active_low = dt_read_bool(n, "active-low", 0);
+	int delay = dt_read_int(n, "startup-delay", 0);
 
-	if(!gpio_is_valid(dt_read_int(n, "gpio", -1)))
+	if(!gpio_is_valid(gpio))
 		return NULL;
 
 	if(!name || search_regulator(name))
 		return NULL;
 
+	if(parent && !search_regulator(parent))
+		return PROBE_DEFER;
+
+	if(dt_read_object(n, "default", &o))
+	{
+		if((parent = dt_read_string(&o, "parent", NULL)) && !search_regulator(parent))
+			return PROBE_DEFER;
+
+		/*
+		 * switch the output on and come back once it has settled
+		 */
+		if((delay > 0) && (probe_stage() == 0) && (dt_read_bool(&o, "enable", 0) > 0))
+		{
+			if(gpiocfg >= 0)
+				gpio_set_cfg(gpio, gpiocfg);
+			gpio_set_pull(gpio, active_low ? GPIO_PULL_DOWN: GPIO_PULL_UP);
+			gpio_direction_output(gpio, active_low ? 0 : 1);
+			return probe_defer(delay);
+		}
+	}
+
 	pdat = malloc(sizeof(struct regulator_gpio_pdata_t));
 	if(!pdat)
 		return NULL;
@@ -136,9 +165,9 @@ static struct device_t * regulator_gpio_probe(struct driver_t * drv, struct dtno
 
 	pdat->parent = strdup(dt_read_string(n, "parent", NULL));
 	pdat->voltage = dt_read_int(n, "voltage", 0);
-	pdat->gpio = dt_read_int(n, "gpio", -1);
-	pdat->gpiocfg = dt_read_int(n, "gpio-config", -1);
-	pdat->active_low = dt_read_bool(n, "active-low", 0);
+	pdat->gpio = gpio;
+	pdat->gpiocfg = gpiocfg;
+	pdat->active_low = active_low;
 	pdat->enable = -1;
 
 	supply->name = strdup(name);
@@ -173,7 +202,7 @@ static struct device_t * regulator_gpio_probe(struct driver_t * drv, struct dtno
 		int v;
 		int e;
 
-		if((p = dt_read_string(&o, "parent", NULL)) && search_regulator(p))
+		if((p = dt_read_string(&o, "parent", NULL)))
 			regulator_set_parent(s, p);
 		if((v = dt_read_int(&o, "voltage", -1)) >= 0)
 			regulator_set_voltage(s, v);
@@ -188,6 +217,15 @@ static struct device_t * regulator_gpio_probe(struct driver_t * drv, struct dtno
 	return dev;
 }
 
+static void regulator_gpio_cancel(struct driver_t * drv, struct dtnode_t * n)
+{
+	int gpio = dt_read_int(n, "gpio", -1);
+	int active_low = dt_read_bool(n, "active-low", 0);
+
+	if(gpio_is_valid(gpio))
+		gpio_direction_output(gpio, active_low ? 1 : 0);
+}
+
 static void regulator_gpio_remove(struct device_t * dev)
 {
 	struct regulator_t * supply = (struct regulator_t *)dev->priv;
@@ -215,6 +253,7 @@ static void regulator_gpio_resume(struct device_t * dev)
 static struct driver_t regulator_gpio = {
 	.name		= "regulator-gpio",
 	.probe		= regulator_gpio_probe,
+	.cancel		= regulator_gpio_cancel,
 	.remove		= regulator_gpio_remove,
 	.suspend	= regulator_gpio_suspend,
 	.resume		= regulator_gpio_resume,
@@ -46,6 +46,20 @@ struct sdcard_t
 	u32_t read_bl_len;
 	u32_t write_bl_len;
 	u64_t capacity;
+
+	u32_t blklen;
+	bool_t cmd23;
+};
+
+enum sdcard_state_t {
+	SDCARD_STATE_OFFLINE		= 0,
+	SDCARD_STATE_RESET			= 1,
+	SDCARD_STATE_IDLE			= 2,
+	SDCARD_STATE_SD_OP_COND		= 3,
+	SDCARD_STATE_MMC_IDLE		= 4,
+	SDCARD_STATE_MMC_OP_COND	= 5,
+	SDCARD_STATE_IDENTIFY		= 6,
+	SDCARD_STATE_ONLINE			= 7,
 };
 
 struct sdcard_pdata_t
@@ -54,9 +68,14 @@ struct sdcard_pdata_t
 	struct sdcard_t sdcard;
 	struct timer_t timer;
 	struct sdhci_t * sdhci;
-	bool_t online;
+	struct sdhci_adma2_desc_t * adma;
+	u32_t nadma;
+	enum sdcard_state_t state;
+	int retry;
 };
 
+#define SDCARD_MAX_BLKCNT	(65535)
+
 #define UNSTUFF_BITS(resp, start, size)								\
 	({																\
 		const int __size = size;									\
@@ -105,9 +124,6 @@ static bool_t mmc_go_idle(struct sdhci_t * sdhci)
 	cmd.cmdarg = 0;
 	cmd.resptype = MMC_RSP_NONE;
 
-	if(sdhci_transfer(sdhci, &cmd, NULL))
-		return TRUE;
-	udelay(2000);
 	return sdhci_transfer(sdhci, &cmd, NULL);
 }
 
@@ -129,31 +145,30 @@ static bool_t sd_send_if_cond(struct sdhci_t * sdhci, struct sdcard_t * sdcard)
  	return FALSE;
 }
 
-static bool_t sd_send_op_cond(struct sdhci_t * sdhci, struct sdcard_t * sdcard)
+/*
+ * The op cond commands are sent once per call, they return a negative value
+ * on error, zero while the card is still powering up and positive once ready
+ */
+static int sd_send_op_cond(struct sdhci_t * sdhci, struct sdcard_t * sdcard)
 {
 	struct sdhci_cmd_t cmd;
-	int timeout = 100;
 
-	do {
-		cmd.cmdidx = MMC_APP_CMD;
-		cmd.cmdarg = 0;
-		cmd.resptype = MMC_RSP_R1;
-	 	if(!sdhci_transfer(sdhci, &cmd, NULL))
-	 		return FALSE;
-
-		cmd.cmdidx = SD_CMD_APP_SEND_OP_COND;
-		cmd.cmdarg = sdhci->voltages & 0xff8000;
-		if(sdcard->version == SD_VERSION_2)
-			cmd.cmdarg |= OCR_HCS;
-		cmd.resptype = MMC_RSP_R3;
-	 	if(!sdhci_transfer(sdhci, &cmd, NULL))
-	 		return FALSE;
+	cmd.cmdidx = MMC_APP_CMD;
+	cmd.cmdarg = 0;
+	cmd.resptype = MMC_RSP_R1;
+ 	if(!sdhci_transfer(sdhci, &cmd, NULL))
+ 		return -1;
 
-	 	udelay(1000);
-	} while (!(cmd.response[0] & OCR_BUSY) && timeout--);
+	cmd.cmdidx = SD_CMD_APP_SEND_OP_COND;
+	cmd.cmdarg = sdhci->voltages & 0xff8000;
+	if(sdcard->version == SD_VERSION_2)
+		cmd.cmdarg |= OCR_HCS;
+	cmd.resptype = MMC_RSP_R3;
+ 	if(!sdhci_transfer(sdhci, &cmd, NULL))
+ 		return -1;
 
-	if(timeout <= 0)
-		return FALSE;
+	if(!(cmd.response[0] & OCR_BUSY))
+		return 0;
 
 	if(sdcard->version != SD_VERSION_2)
 		sdcard->version = SD_VERSION_1_0;
@@ -161,98 +176,113 @@ static bool_t sd_send_op_cond(struct sdhci_t * sdhci, struct sdcard_t * sdcard)
 	sdcard->high_capacity = ((sdcard->ocr & OCR_HCS) == OCR_HCS);
 	sdcard->rca = 0;
 
-	return TRUE;
+	return 1;
 }
 
-static bool_t mmc_send_op_cond(struct sdhci_t * sdhci, struct sdcard_t * sdcard)
+static bool_t mmc_start_op_cond(struct sdhci_t * sdhci)
 {
 	struct sdhci_cmd_t cmd;
-	int timeout = 100;
-
-	if(!mmc_go_idle(sdhci))
-		return FALSE;
 
 	cmd.cmdidx = MMC_SEND_OP_COND;
 	cmd.cmdarg = 0;
 	cmd.resptype = MMC_RSP_R3;
- 	if(!sdhci_transfer(sdhci, &cmd, NULL))
- 		return FALSE;
+	return sdhci_transfer(sdhci, &cmd, NULL);
+}
 
-	do {
-		cmd.cmdidx = MMC_SEND_OP_COND;
-		cmd.cmdarg = OCR_HCS | (sdhci->voltages & (sdcard->ocr & OCR_VOLTAGE_MASK)) | (sdcard->ocr & OCR_ACCESS_MODE);
-		cmd.resptype = MMC_RSP_R3;
-	 	if(!sdhci_transfer(sdhci, &cmd, NULL))
-	 		return FALSE;
-	 	udelay(1000);
-	} while (!(cmd.response[0] & OCR_BUSY) && timeout--);
+static int mmc_send_op_cond(struct sdhci_t * sdhci, struct sdcard_t * sdcard)
+{
+	struct sdhci_cmd_t cmd;
 
-	if(timeout <= 0)
-		return FALSE;
+	cmd.cmdidx = MMC_SEND_OP_COND;
+	cmd.cmdarg = OCR_HCS | (sdhci->voltages & (sdcard->ocr & OCR_VOLTAGE_MASK)) | (sdcard->ocr & OCR_ACCESS_MODE);
+	cmd.resptype = MMC_RSP_R3;
+ 	if(!sdhci_transfer(sdhci, &cmd, NULL))
+ 		return -1;
+
+	if(!(cmd.response[0] & OCR_BUSY))
+		return 0;
 
 	sdcard->version = MMC_VERSION_UNKNOWN;
 	sdcard->ocr = cmd.response[0];
 	sdcard->high_capacity = ((sdcard->ocr & OCR_HCS) == OCR_HCS);
 	sdcard->rca = 0;
-	return TRUE;
+	return 1;
 }
 
-static u64_t mmc_read_blocks(struct sdhci_t * sdhci, struct sdcard_t * sdcard, u8_t * buf, u64_t start, u64_t blkcnt)
+static bool_t mmc_set_blocklen(struct sdhci_t * sdhci, struct sdcard_t * sdcard, u32_t len)
 {
 	struct sdhci_cmd_t cmd;
-	struct sdhci_data_t dat;
 
-	if(blkcnt > 1)
-		cmd.cmdidx = MMC_READ_MULTIPLE_BLOCK;
-	else
-		cmd.cmdidx = MMC_READ_SINGLE_BLOCK;
-	if(sdcard->high_capacity)
-		cmd.cmdarg = start;
-	else
-		cmd.cmdarg = start * sdcard->read_bl_len;
-	cmd.resptype = MMC_RSP_R1;
-	dat.buf = buf;
-	dat.flag = MMC_DATA_READ;
-	dat.blksz = sdcard->read_bl_len;
-	dat.blkcnt = blkcnt;
-	if(!sdhci_transfer(sdhci, &cmd, &dat))
-		return 0;
+	if(sdcard->blklen == len)
+		return TRUE;
 
-	if(blkcnt > 1)
+	cmd.cmdidx = MMC_SET_BLOCKLEN;
+	cmd.cmdarg = len;
+	cmd.resptype = MMC_RSP_R1;
+	if(!sdhci_transfer(sdhci, &cmd, NULL))
 	{
-		cmd.cmdidx = MMC_STOP_TRANSMISSION;
-		cmd.cmdarg = 0;
-		cmd.resptype = MMC_RSP_R1B;
-		if(!sdhci_transfer(sdhci, &cmd, NULL))
-			return 0;
+		sdcard->blklen = 0;
+		return FALSE;
 	}
-	return blkcnt;
+	sdcard->blklen = len;
+	return TRUE;
 }
 
-static u64_t mmc_write_blocks(struct sdhci_t * sdhci, struct sdcard_t * sdcard, u8_t * buf, u64_t start, u64_t blkcnt)
+/*
+ * Multi block transfers are pre-defined with CMD23 when the card supports
+ * it, otherwise they are open ended and closed with CMD12. Hosts with ADMA2
+ * get the whole buffer as one descriptor chain, unless the caller already
+ * built the chain.
+ */
+static u64_t mmc_transfer_blocks(struct sdcard_pdata_t * pdat, u32_t cmdidx, u32_t flag, u32_t blksz, u8_t * buf, u64_t start, u64_t blkcnt, u32_t nadma)
 {
+	struct sdhci_t * sdhci = pdat->sdhci;
+	struct sdcard_t * sdcard = &pdat->sdcard;
 	struct sdhci_cmd_t cmd;
 	struct sdhci_data_t dat;
+	bool_t stop = (blkcnt > 1) && !sdcard->cmd23;
 
-	if(blkcnt == 0)
-		return 0;
-	else if(blkcnt == 1)
-		cmd.cmdidx = MMC_WRITE_SINGLE_BLOCK;
-	else
-		cmd.cmdidx = MMC_WRITE_MULTIPLE_BLOCK;
+	if((blkcnt > 1) && sdcard->cmd23)
+	{
+		cmd.cmdidx = MMC_SET_BLOCK_COUNT;
+		cmd.cmdarg = blkcnt;
+		cmd.resptype = MMC_RSP_R1;
+		if(!sdhci_transfer(sdhci, &cmd, NULL))
+			return 0;
+	}
+
+	cmd.cmdidx = cmdidx;
 	if(sdcard->high_capacity)
 		cmd.cmdarg = start;
 	else
-		cmd.cmdarg = start * sdcard->write_bl_len;
+		cmd.cmdarg = start * blksz;
 	cmd.resptype = MMC_RSP_R1;
 	dat.buf = buf;
-	dat.flag = MMC_DATA_WRITE;
-	dat.blksz = sdcard->write_bl_len;
+	dat.flag = flag;
+	dat.blksz = blksz;
 	dat.blkcnt = blkcnt;
+	dat.adma = NULL;
+	dat.nadma = nadma;
+	if(pdat->adma)
+	{
+		if(dat.nadma == 0)
+			dat.nadma = sdhci_adma2_setup(pdat->adma, pdat->nadma, buf, blksz * blkcnt);
+		if(dat.nadma > 0)
+			dat.adma = pdat->adma;
+	}
 	if(!sdhci_transfer(sdhci, &cmd, &dat))
+	{
+		if(blkcnt > 1)
+		{
+			cmd.cmdidx = MMC_STOP_TRANSMISSION;
+			cmd.cmdarg = 0;
+			cmd.resptype = MMC_RSP_R1B;
+			sdhci_transfer(sdhci, &cmd, NULL);
+		}
 		return 0;
+	}
 
-	if(blkcnt > 1)
+	if(stop)
 	{
 		cmd.cmdidx = MMC_STOP_TRANSMISSION;
 		cmd.cmdarg = 0;
@@ -263,29 +293,50 @@ static u64_t mmc_write_blocks(struct sdhci_t * sdhci, struct sdcard_t * sdcard,
 	return blkcnt;
 }
 
-static bool_t sdcard_detect(struct sdhci_t * sdhci, struct sdcard_t * sdcard)
+static u64_t mmc_read_blocks(struct sdcard_pdata_t * pdat, u8_t * buf, u64_t start, u64_t blkcnt)
+{
+	if(blkcnt == 0)
+		return 0;
+	return mmc_transfer_blocks(pdat, (blkcnt > 1) ? MMC_READ_MULTIPLE_BLOCK : MMC_READ_SINGLE_BLOCK, MMC_DATA_READ, pdat->sdcard.read_bl_len, buf, start, blkcnt, 0);
+}
+
+static u64_t mmc_write_blocks(struct sdcard_pdata_t * pdat, u8_t * buf, u64_t start, u64_t blkcnt)
+{
+	if(blkcnt == 0)
+		return 0;
+	return mmc_transfer_blocks(pdat, (blkcnt > 1) ? MMC_WRITE_MULTIPLE_BLOCK : MMC_WRITE_SINGLE_BLOCK, MMC_DATA_WRITE, pdat->sdcard.write_bl_len, buf, start, blkcnt, 0);
+}
+
+static bool_t sd_send_scr(struct sdhci_t * sdhci, struct sdcard_t * sdcard, u8_t * scr)
 {
 	struct sdhci_cmd_t cmd;
 	struct sdhci_data_t dat;
-	u64_t csize, cmult;
-	u32_t unit, time;
-	bool_t ret;
 
-	if(!sdhci_detect(sdhci))
+	cmd.cmdidx = MMC_APP_CMD;
+	cmd.cmdarg = sdcard->rca << 16;
+	cmd.resptype = MMC_RSP_R1;
+	if(!sdhci_transfer(sdhci, &cmd, NULL))
 		return FALSE;
 
-	sdhci_set_width(sdhci, MMC_BUS_WIDTH_1);
-	sdhci_set_clock(sdhci, 400000);
-
-	if(!mmc_go_idle(sdhci))
-		return FALSE;
+	cmd.cmdidx = SD_CMD_APP_SEND_SCR;
+	cmd.cmdarg = 0;
+	cmd.resptype = MMC_RSP_R1;
+	dat.buf = scr;
+	dat.flag = MMC_DATA_READ;
+	dat.blksz = 8;
+	dat.blkcnt = 1;
+	dat.adma = NULL;
+	dat.nadma = 0;
+	return sdhci_transfer(sdhci, &cmd, &dat);
+}
 
-	ret = sd_send_if_cond(sdhci, sdcard);
-	ret = sd_send_op_cond(sdhci, sdcard);
-	if(!ret)
-		ret = mmc_send_op_cond(sdhci, sdcard);
-	if(!ret)
-		return FALSE;
+static bool_t sdcard_identify(struct sdhci_t * sdhci, struct sdcard_t * sdcard)
+{
+	struct sdhci_cmd_t cmd;
+	struct sdhci_data_t dat;
+	u64_t csize, cmult;
+	u32_t unit, time;
+	u8_t scr[8];
 
 	cmd.cmdidx = MMC_ALL_SEND_CID;
 	cmd.cmdarg = 0;
@@ -371,6 +422,8 @@ static bool_t sdcard_detect(struct sdhci_t * sdhci, struct sdcard_t * sdcard)
 		dat.flag = MMC_DATA_READ;
 		dat.blksz = 512;
 		dat.blkcnt = 1;
+		dat.adma = NULL;
+		dat.nadma = 0;
 
 	 	if(!sdhci_transfer(sdhci, &cmd, &dat))
 	 		return FALSE;
@@ -440,10 +493,17 @@ static bool_t sdcard_detect(struct sdhci_t * sdhci, struct sdcard_t * sdcard)
 	if(!ret)
 		return FALSE; */
 
-	cmd.cmdidx = MMC_SET_BLOCKLEN;
-	cmd.cmdarg = sdcard->read_bl_len;
-	cmd.resptype = MMC_RSP_R1;
-	if(!sdhci_transfer(sdhci, &cmd, NULL))
+	if(IS_SD(sdcard))
+	{
+		if(sd_send_scr(sdhci, sdcard, scr))
+			sdcard->cmd23 = (scr[3] & 0x2) ? TRUE : FALSE;
+	}
+	else
+	{
+		sdcard->cmd23 = (sdcard->version >= MMC_VERSION_3) ? TRUE : FALSE;
+	}
+
+	if(!mmc_set_blocklen(sdhci, sdcard, sdcard->read_bl_len))
 		return FALSE;
 
 	return TRUE;
@@ -452,23 +512,18 @@ static bool_t sdcard_detect(struct sdhci_t * sdhci, struct sdcard_t * sdcard)
 static u64_t sdcard_disk_read(struct disk_t * disk, u8_t * buf, u64_t sector, u64_t count)
 {
 	struct sdcard_pdata_t * pdat = (struct sdcard_pdata_t *)(disk->priv);
-	struct sdhci_t * sdhci = pdat->sdhci;
 	struct sdcard_t * sdcard = &pdat->sdcard;
-	struct sdhci_cmd_t cmd;
 	u64_t cnt, blks = count;
 
 	if(count == 0)
 		return 0;
 
-	cmd.cmdidx = MMC_SET_BLOCKLEN;
-	cmd.cmdarg = sdcard->read_bl_len;
-	cmd.resptype = MMC_RSP_R1;
-	if(!sdhci_transfer(sdhci, &cmd, NULL))
+	if(!mmc_set_blocklen(pdat->sdhci, sdcard, sdcard->read_bl_len))
 		return 0;
 
 	do {
-		cnt = (blks > 65535) ?  65535 : blks;
-		if(mmc_read_blocks(sdhci, sdcard, buf, sector, cnt) != cnt)
+		cnt = (blks > SDCARD_MAX_BLKCNT) ? SDCARD_MAX_BLKCNT : blks;
+		if(mmc_read_blocks(pdat, buf, sector, cnt) != cnt)
 			return 0;
 		blks -= cnt;
 		sector += cnt;
@@ -481,20 +536,18 @@ static u64_t sdcard_disk_read(struct disk_t * disk, u8_t * buf, u64_t sector, u6
 static u64_t sdcard_disk_write(struct disk_t * disk, u8_t * buf, u64_t sector, u64_t count)
 {
 	struct sdcard_pdata_t * pdat = (struct sdcard_pdata_t *)(disk->priv);
-	struct sdhci_t * sdhci = pdat->sdhci;
 	struct sdcard_t * sdcard = &pdat->sdcard;
-	struct sdhci_cmd_t cmd;
 	u64_t cnt, blks = count;
 
-	cmd.cmdidx = MMC_SET_BLOCKLEN;
-	cmd.cmdarg = sdcard->write_bl_len;
-	cmd.resptype = MMC_RSP_R1;
-	if(!sdhci_transfer(sdhci, &cmd, NULL))
+	if(count == 0)
+		return 0;
+
+	if(!mmc_set_blocklen(pdat->sdhci, sdcard, sdcard->write_bl_len))
 		return 0;
 
 	do {
-		cnt = (blks > 65535) ?  65535 : blks;
-		if(mmc_write_blocks(sdhci, sdcard, buf, sector, cnt) != cnt)
+		cnt = (blks > SDCARD_MAX_BLKCNT) ? SDCARD_MAX_BLKCNT : blks;
+		if(mmc_write_blocks(pdat, buf, sector, cnt) != cnt)
 			return 0;
 		blks -= cnt;
 		sector += cnt;
@@ -504,47 +557,199 @@ static u64_t sdcard_disk_write(struct disk_t * disk, u8_t * buf, u64_t sector, u
 	return count;
 }
 
+/*
+ * Scattered buffers of one merged request are described by a single ADMA2
+ * chain, so the card sees one multi block transfer and nothing is copied.
+ */
+static u64_t sdcard_disk_transferv(struct disk_t * disk, const struct iovec * iov, int iovcnt, u64_t sector, u64_t count, bool_t write)
+{
+	struct sdcard_pdata_t * pdat = (struct sdcard_pdata_t *)(disk->priv);
+	struct sdcard_t * sdcard = &pdat->sdcard;
+	u32_t blksz = write ? sdcard->write_bl_len : sdcard->read_bl_len;
+	u64_t cnt, len, skip = 0, done = 0;
+	u32_t n, used;
+	u8_t * buf;
+
+	if(!mmc_set_blocklen(pdat->sdhci, sdcard, blksz))
+		return 0;
+
+	while((done < count) && (iovcnt > 0))
+	{
+		buf = NULL;
+		used = 0;
+		cnt = 0;
+		while((iovcnt > 0) && (cnt < SDCARD_MAX_BLKCNT) && (done + cnt < count))
+		{
+			len = iov->iov_len - skip;
+			if(len == 0)
+			{
+				iov++;
+				iovcnt--;
+				skip = 0;
+				continue;
+			}
+			if(len > (SDCARD_MAX_BLKCNT - cnt) * blksz)
+				len = (SDCARD_MAX_BLKCNT - cnt) * blksz;
+			if(len > (count - done - cnt) * blksz)
+				len = (count - done - cnt) * blksz;
+			n = sdhci_adma2_setup(&pdat->adma[used], pdat->nadma - used, (u8_t *)iov->iov_base + skip, len);
+			if(n == 0)
+				break;
+			pdat->adma[used + n - 1].attr &= ~SDHCI_ADMA2_END;
+			if(!buf)
+				buf = (u8_t *)iov->iov_base + skip;
+			used += n;
+			cnt += len / blksz;
+			skip += len;
+		}
+		if(used == 0)
+			break;
+		pdat->adma[used - 1].attr |= SDHCI_ADMA2_END;
+
+		if(write)
+			n = mmc_transfer_blocks(pdat, (cnt > 1) ? MMC_WRITE_MULTIPLE_BLOCK : MMC_WRITE_SINGLE_BLOCK, MMC_DATA_WRITE, blksz, buf, sector, cnt, used);
+		else
+			n = mmc_transfer_blocks(pdat, (cnt > 1) ? MMC_READ_MULTIPLE_BLOCK : MMC_READ_SINGLE_BLOCK, MMC_DATA_READ, blksz, buf, sector, cnt, used);
+		if(n != cnt)
+			break;
+		done += cnt;
+		sector += cnt;
+	}
+
+	return done;
+}
+
+static u64_t sdcard_disk_readv(struct disk_t * disk, const struct iovec * iov, int iovcnt, u64_t sector, u64_t count)
+{
+	return sdcard_disk_transferv(disk, iov, iovcnt, sector, count, FALSE);
+}
+
+static u64_t sdcard_disk_writev(struct disk_t * disk, const struct iovec * iov, int iovcnt, u64_t sector, u64_t count)
+{
+	return sdcard_disk_transferv(disk, iov, iovcnt, sector, count, TRUE);
+}
+
 static void sdcard_disk_sync(struct disk_t * disk)
 {
 }
 
-static int sdcard_disk_timer_function(struct timer_t * timer, void * data)
+/*
+ * One step of the card power up, the timer comes back for the next one
+ * instead of spinning in its callback. Returns the delay in ms before the
+ * next step, zero to go on at once and negative when detection is over.
+ */
+static int sdcard_detect(struct sdcard_pdata_t * pdat)
 {
-	struct sdcard_pdata_t * pdat = (struct sdcard_pdata_t *)(data);
+	struct sdhci_t * sdhci = pdat->sdhci;
+	struct sdcard_t * sdcard = &pdat->sdcard;
 	char buf[256];
+	int ret;
 
-	if(!pdat->online)
+	switch(pdat->state)
 	{
-		if(sdhci_detect(pdat->sdhci))
+	case SDCARD_STATE_RESET:
+		sdcard->blklen = 0;
+		sdcard->cmd23 = FALSE;
+		sdhci_set_width(sdhci, MMC_BUS_WIDTH_1);
+		sdhci_set_clock(sdhci, 400000);
+		pdat->retry = 0;
+		pdat->state = SDCARD_STATE_IDLE;
+		return 0;
+
+	case SDCARD_STATE_IDLE:
+		if(!mmc_go_idle(sdhci))
+			return (pdat->retry++ < 1) ? 2 : -1;
+		sd_send_if_cond(sdhci, sdcard);
+		pdat->retry = 0;
+		pdat->state = SDCARD_STATE_SD_OP_COND;
+		return 0;
+
+	case SDCARD_STATE_SD_OP_COND:
+		ret = sd_send_op_cond(sdhci, sdcard);
+		if(ret > 0)
 		{
-			if(sdcard_detect(pdat->sdhci, &pdat->sdcard))
-			{
-				snprintf(buf, sizeof(buf), "sdcard.%s", pdat->sdhci->name);
-				pdat->disk.name = strdup(buf);
-				pdat->disk.size = pdat->sdcard.read_bl_len;
-				pdat->disk.count = pdat->sdcard.capacity / pdat->sdcard.read_bl_len;
-				pdat->disk.read = sdcard_disk_read;
-				pdat->disk.write = sdcard_disk_write;
-				pdat->disk.sync = sdcard_disk_sync;
-				pdat->disk.priv = pdat;
-				if(!register_disk(NULL, &pdat->disk))
-					free_device_name(pdat->disk.name);
-				else
-					pdat->online = TRUE;
-			}
+			pdat->state = SDCARD_STATE_IDENTIFY;
+			return 0;
 		}
+		if((ret == 0) && (pdat->retry++ < 100))
+			return 1;
+		pdat->retry = 0;
+		pdat->state = SDCARD_STATE_MMC_IDLE;
+		return 0;
+
+	case SDCARD_STATE_MMC_IDLE:
+		if(!mmc_go_idle(sdhci))
+			return (pdat->retry++ < 1) ? 2 : -1;
+		if(!mmc_start_op_cond(sdhci))
+			return -1;
+		pdat->retry = 0;
+		pdat->state = SDCARD_STATE_MMC_OP_COND;
+		return 0;
+
+	case SDCARD_STATE_MMC_OP_COND:
+		ret = mmc_send_op_cond(sdhci, sdcard);
+		if(ret > 0)
+		{
+			pdat->state = SDCARD_STATE_IDENTIFY;
+			return 0;
+		}
+		if((ret == 0) && (pdat->retry++ < 100))
+			return 1;
+		return -1;
+
+	case SDCARD_STATE_IDENTIFY:
+		if(!sdcard_identify(sdhci, sdcard))
+			return -1;
+		snprintf(buf, sizeof(buf), "sdcard.%s", sdhci->name);
+		pdat->disk.name = strdup(buf);
+		pdat->disk.size = sdcard->read_bl_len;
+		pdat->disk.count = sdcard->capacity / sdcard->read_bl_len;
+		pdat->disk.read = sdcard_disk_read;
+		pdat->disk.write = sdcard_disk_write;
+		pdat->disk.readv = pdat->adma ? sdcard_disk_readv : NULL;
+		pdat->disk.writev = pdat->adma ? sdcard_disk_writev : NULL;
+		pdat->disk.sync = sdcard_disk_sync;
+		pdat->disk.priv = pdat;
+		if(!register_disk(NULL, &pdat->disk))
+			free_device_name(pdat->disk.name);
+		else
+			pdat->state = SDCARD_STATE_ONLINE;
+		return -1;
+
+	default:
+		return -1;
 	}
-	else
+}
+
+static int sdcard_disk_timer_function(struct timer_t * timer, void * data)
+{
+	struct sdcard_pdata_t * pdat = (struct sdcard_pdata_t *)(data);
+	int ms;
+
+	if(pdat->state == SDCARD_STATE_ONLINE)
 	{
 		if(!sdhci_detect(pdat->sdhci))
 		{
 			if(unregister_disk(&pdat->disk))
 			{
 				free_device_name(pdat->disk.name);
-				pdat->online = FALSE;
+				pdat->state = SDCARD_STATE_OFFLINE;
 			}
 		}
 	}
+	else
+	{
+		if((pdat->state == SDCARD_STATE_OFFLINE) && sdhci_detect(pdat->sdhci))
+			pdat->state = SDCARD_STATE_RESET;
+		while((ms = sdcard_detect(pdat)) == 0);
+		if(ms > 0)
+		{
+			timer_forward_now(timer, ms_to_ktime(ms));
+			return 1;
+		}
+		if(pdat->state != SDCARD_STATE_ONLINE)
+			pdat->state = SDCARD_STATE_OFFLINE;
+	}
 	if(!pdat->sdhci->removeable)
 		return 0;
 	timer_forward_now(timer, ms_to_ktime(2000));
@@ -561,7 +766,14 @@ void * sdcard_probe(struct sdhci_t * sdhci)
 	memset(pdat, 0, sizeof(struct sdcard_pdata_t));
 
 	pdat->sdhci = sdhci;
-	pdat->online = FALSE;
+	if(sdhci->caps & SDHCI_CAP_ADMA2)
+	{
+		pdat->nadma = (SDCARD_MAX_BLKCNT * 512 + 65535) / 65536;
+		pdat->adma = malloc(sizeof(struct sdhci_adma2_desc_t) * pdat->nadma);
+		if(!pdat->adma)
+			pdat->nadma = 0;
+	}
+	pdat->state = SDCARD_STATE_OFFLINE;
 	timer_init(&pdat->timer, sdcard_disk_timer_function, pdat);
 	timer_start_now(&pdat->timer, ms_to_ktime(100));
 	return pdat;
@@ -574,8 +786,10 @@ void sdcard_remove(void * sdcard)
 	if(pdat)
 	{
 		timer_cancel(&pdat->timer);
-		if(pdat->online && unregister_disk(&pdat->disk))
+		if((pdat->state == SDCARD_STATE_ONLINE) && unregister_disk(&pdat->disk))
 			free_device_name(pdat->disk.name);
+		if(pdat->adma)
+			free(pdat->adma);
 		free(pdat);
 	}
 }
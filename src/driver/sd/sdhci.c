@@ -116,6 +116,30 @@ bool_t sdhci_set_clock(struct sdhci_t * sdhci, u32_t clock)
 bool_t sdhci_transfer(struct sdhci_t * sdhci, struct sdhci_cmd_t * cmd, struct sdhci_data_t * dat)
 {
 	if(sdhci && sdhci->transfer)
+	{
+		if(dat && dat->adma && !(sdhci->caps & SDHCI_CAP_ADMA2))
+			return FALSE;
 		return sdhci->transfer(sdhci, cmd, dat);
+	}
 	return FALSE;
 }
+
+u32_t sdhci_adma2_setup(struct sdhci_adma2_desc_t * desc, u32_t ndesc, u8_t * buf, u32_t len)
+{
+	physical_addr_t addr = virt_to_phys((virtual_addr_t)buf);
+	u32_t i, l;
+
+	for(i = 0; (i < ndesc) && (len > 0); i++)
+	{
+		l = (len > 65536) ? 65536 : len;
+		desc[i].attr = SDHCI_ADMA2_VALID | SDHCI_ADMA2_TRAN;
+		desc[i].len = l & 0xffff;
+		desc[i].addr = (u32_t)addr;
+		addr += l;
+		len -= l;
+	}
+	if((i == 0) || (len > 0))
+		return 0;
+	desc[i - 1].attr |= SDHCI_ADMA2_END;
+	return i;
+}
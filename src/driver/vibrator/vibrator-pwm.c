@@ -129,7 +129,7 @@ static struct device_t * vibrator_pwm_probe(struct driver_t * drv, struct dtnode
 	struct device_t * dev;
 
 	if(!(pwm = search_pwm(dt_read_string(n, "pwm-name", NULL))))
-		return NULL;
+		return dt_read_string(n, "pwm-name", NULL) ? PROBE_DEFER : NULL;
 
 	pdat = malloc(sizeof(struct vibrator_pwm_pdata_t));
 	if(!pdat)
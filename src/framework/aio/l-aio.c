@@ -0,0 +1,234 @@
+/*
+ * framework/aio/l-aio.c
+ *
+ * Copyright(c) 2007-2018 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <fs/aio.h>
+#include <framework/aio/l-aio.h>
+
+struct laio_t {
+	struct aio_t * aio[2];
+	int fd;
+	char * buf;
+	loff_t count;
+	int error;
+	u32_t id;
+	int done;
+};
+
+static void laio_complete(struct aio_t * aio, void * data)
+{
+	struct laio_t * laio = data;
+
+	if(aio->type != AIO_TYPE_FSYNC)
+		laio->count = aio->count;
+	if(aio->error && !laio->error)
+		laio->error = aio->error;
+	if(laio->aio[0] == aio)
+		laio->aio[0] = NULL;
+	else if(laio->aio[1] == aio)
+		laio->aio[1] = NULL;
+
+	if(!laio->aio[0] && !laio->aio[1])
+	{
+		close(laio->fd);
+		laio->fd = -1;
+		laio->done = 1;
+	}
+}
+
+static struct laio_t * laio_new(lua_State * L)
+{
+	struct laio_t * laio = lua_newuserdata(L, sizeof(struct laio_t));
+	memset(laio, 0, sizeof(struct laio_t));
+	laio->fd = -1;
+	luaL_setmetatable(L, MT_AIO);
+	return laio;
+}
+
+static void laio_release(struct laio_t * laio)
+{
+	int i;
+
+	for(i = 0; i < 2; i++)
+	{
+		if(laio->aio[i])
+		{
+			aio_cancel(laio->aio[i]);
+			laio->aio[i] = NULL;
+		}
+	}
+	if(laio->fd >= 0)
+	{
+		close(laio->fd);
+		laio->fd = -1;
+	}
+	if(laio->buf)
+	{
+		free(laio->buf);
+		laio->buf = NULL;
+	}
+}
+
+static int l_aio_read(lua_State * L)
+{
+	const char * path = luaL_checkstring(L, 1);
+	loff_t offset = luaL_optinteger(L, 2, 0);
+	loff_t size = luaL_optinteger(L, 3, -1);
+	struct laio_t * laio;
+	struct stat st;
+
+	laio = laio_new(L);
+	if(((laio->fd = open(path, O_RDONLY, (S_IRUSR|S_IRGRP|S_IROTH))) < 0) || (fstat(laio->fd, &st) != 0))
+		return luaL_error(L, "can't open file '%s'", path);
+	if((offset < 0) || (offset > st.st_size))
+		offset = st.st_size;
+	if((size < 0) || (size > st.st_size - offset))
+		size = st.st_size - offset;
+
+	laio->buf = malloc(size > 0 ? size : 1);
+	if(!laio->buf)
+		return luaL_error(L, "out of memory");
+	laio->aio[0] = aio_submit(AIO_TYPE_READ, laio->fd, laio->buf, offset, size, laio_complete, laio);
+	if(!laio->aio[0])
+		return luaL_error(L, "can't submit read of '%s'", path);
+	laio->id = laio->aio[0]->id;
+	return 1;
+}
+
+static int l_aio_write(lua_State * L)
+{
+	size_t size;
+	const char * path = luaL_checkstring(L, 1);
+	const char * data = luaL_checklstring(L, 2, &size);
+	int append = lua_toboolean(L, 3);
+	int sync = lua_toboolean(L, 4);
+	struct laio_t * laio;
+
+	laio = laio_new(L);
+	laio->fd = open(path, O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC), (S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH|S_IWOTH));
+	if(laio->fd < 0)
+		return luaL_error(L, "can't open file '%s'", path);
+
+	/*
+	 * the string may be collected before the request completes
+	 */
+	laio->buf = malloc(size > 0 ? size : 1);
+	if(!laio->buf)
+		return luaL_error(L, "out of memory");
+	memcpy(laio->buf, data, size);
+	laio->aio[0] = aio_submit(AIO_TYPE_WRITE, laio->fd, laio->buf, -1, size, laio_complete, laio);
+	if(!laio->aio[0])
+		return luaL_error(L, "can't submit write of '%s'", path);
+	laio->id = laio->aio[0]->id;
+	if(sync)
+	{
+		laio->aio[1] = aio_submit(AIO_TYPE_FSYNC, laio->fd, NULL, -1, 0, laio_complete, laio);
+		if(laio->aio[1])
+			laio->id = laio->aio[1]->id;
+	}
+	return 1;
+}
+
+static const luaL_Reg l_aio[] = {
+	{"read",	l_aio_read},
+	{"write",	l_aio_write},
+	{NULL, NULL}
+};
+
+static int m_aio_gc(lua_State * L)
+{
+	struct laio_t * laio = luaL_checkudata(L, 1, MT_AIO);
+	laio_release(laio);
+	return 0;
+}
+
+static int m_aio_get_id(lua_State * L)
+{
+	struct laio_t * laio = luaL_checkudata(L, 1, MT_AIO);
+	lua_pushinteger(L, laio->id);
+	return 1;
+}
+
+static int m_aio_is_done(lua_State * L)
+{
+	struct laio_t * laio = luaL_checkudata(L, 1, MT_AIO);
+	lua_pushboolean(L, laio->done);
+	return 1;
+}
+
+static int m_aio_get_error(lua_State * L)
+{
+	struct laio_t * laio = luaL_checkudata(L, 1, MT_AIO);
+	lua_pushinteger(L, laio->error);
+	return 1;
+}
+
+static int m_aio_get_count(lua_State * L)
+{
+	struct laio_t * laio = luaL_checkudata(L, 1, MT_AIO);
+	lua_pushinteger(L, laio->count);
+	return 1;
+}
+
+static int m_aio_get_data(lua_State * L)
+{
+	struct laio_t * laio = luaL_checkudata(L, 1, MT_AIO);
+	if(!laio->done || !laio->buf)
+		return 0;
+	lua_pushlstring(L, laio->buf, laio->count);
+	return 1;
+}
+
+static int m_aio_cancel(lua_State * L)
+{
+	struct laio_t * laio = luaL_checkudata(L, 1, MT_AIO);
+	if(!laio->done)
+	{
+		laio_release(laio);
+		laio->error = EINTR;
+		laio->done = 1;
+	}
+	return 0;
+}
+
+static const luaL_Reg m_aio[] = {
+	{"__gc",		m_aio_gc},
+	{"getId",		m_aio_get_id},
+	{"isDone",		m_aio_is_done},
+	{"getError",	m_aio_get_error},
+	{"getCount",	m_aio_get_count},
+	{"getData",		m_aio_get_data},
+	{"cancel",		m_aio_cancel},
+	{NULL,			NULL}
+};
+
+int luaopen_aio(lua_State * L)
+{
+	luaL_newlib(L, l_aio);
+	luahelper_create_metatable(L, MT_AIO, m_aio);
+	return 1;
+}
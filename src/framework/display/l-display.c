@@ -29,6 +29,7 @@
 #include <cairo.h>
 #include <cairo-xboot.h>
 #include <framework/display/l-display.h>
+#include <framework/vm.h>
 
 extern cairo_scaled_font_t * luaL_checkudata_scaled_font(lua_State * L, int ud, const char * tname);
 
@@ -313,6 +314,7 @@ static int m_display_present(lua_State * L)
 		cairo_restore(cr);
 	}
 	cairo_xboot_surface_present(display->cs);
+	vm_first_frame();
 	cairo_save(cr);
 	cairo_set_source_rgb(cr, 1, 1, 1);
 	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
@@ -97,9 +97,15 @@ static FT_Stream FT_New_Xfs_Stream(lua_State * L, const char * pathname)
 
 	stream->descriptor.pointer = file;
 	stream->pathname.pointer = (char *)pathname;
-	stream->read = ft_xfs_stream_io;
 	stream->close = ft_xfs_stream_close;
 
+	/* a memory based stream, freetype reads the mapped file in place */
+	stream->base = (unsigned char *)xfs_map(file);
+	if(stream->base)
+		stream->read = NULL;
+	else
+		stream->read = ft_xfs_stream_io;
+
     return stream;
 }
 
@@ -50,16 +50,44 @@ static cairo_status_t xfs_read_func(void * closure, unsigned char * data, unsign
 	return _cairo_error(CAIRO_STATUS_READ_ERROR);
 }
 
+struct xfs_map_stream_t {
+	const unsigned char * data;
+	size_t length;
+	size_t offset;
+};
+
+static cairo_status_t xfs_map_read_func(void * closure, unsigned char * data, unsigned int size)
+{
+	struct xfs_map_stream_t * stream = closure;
+
+	if(size > stream->length - stream->offset)
+		return _cairo_error(CAIRO_STATUS_READ_ERROR);
+	memcpy(data, stream->data + stream->offset, size);
+	stream->offset += size;
+	return CAIRO_STATUS_SUCCESS;
+}
+
 static cairo_surface_t * cairo_image_surface_create_from_png_xfs(lua_State * L, const char * filename)
 {
 	struct xfs_context_t * ctx = luahelper_runtime(L)->__xfs_ctx;
+	struct xfs_map_stream_t stream;
 	struct xfs_file_t * file;
 	cairo_surface_t * surface;
 
 	file = xfs_open_read(ctx, filename);
 	if(!file)
 		return _cairo_surface_create_in_error(_cairo_error(CAIRO_STATUS_FILE_NOT_FOUND));
-	surface = cairo_image_surface_create_from_png_stream(xfs_read_func, file);
+	stream.data = xfs_map(file);
+	if(stream.data)
+	{
+		stream.length = xfs_length(file);
+		stream.offset = 0;
+		surface = cairo_image_surface_create_from_png_stream(xfs_map_read_func, &stream);
+	}
+	else
+	{
+		surface = cairo_image_surface_create_from_png_stream(xfs_read_func, file);
+	}
 	xfs_close(file);
     return surface;
 }
@@ -48,6 +48,7 @@
 #define EVT_JOYSTICK_BUTTONUP		"JoystickButtonUp"
 #define EVT_ENTER_FRAME				"EnterFrame"
 #define EVT_ANIMATE_COMPLETE		"AnimateComplete"
+#define EVT_AIO_COMPLETE			"AioComplete"
 
 static int l_event_new(lua_State * L)
 {
@@ -313,6 +314,22 @@ static int l_event_pump(lua_State * L)
 		lua_setfield(L, -2, "button");
 		return 1;
 
+	case EVENT_TYPE_AIO_COMPLETE:
+		lua_newtable(L);
+		lua_pushstring(L, "aio");
+		lua_setfield(L, -2, "device");
+		lua_pushstring(L, EVT_AIO_COMPLETE);
+		lua_setfield(L, -2, "type");
+		lua_pushnumber(L, ktime_to_ns(event.timestamp));
+		lua_setfield(L, -2, "time");
+		lua_pushinteger(L, event.e.aio_complete.id);
+		lua_setfield(L, -2, "id");
+		lua_pushinteger(L, event.e.aio_complete.error);
+		lua_setfield(L, -2, "error");
+		lua_pushinteger(L, event.e.aio_complete.count);
+		lua_setfield(L, -2, "count");
+		return 1;
+
 	default:
 		return 0;
 	}
@@ -348,5 +365,6 @@ int luaopen_event(lua_State * L)
 	luahelper_set_strfield(L, "JOYSTICK_BUTTONUP",		EVT_JOYSTICK_BUTTONUP);
 	luahelper_set_strfield(L, "ENTER_FRAME",			EVT_ENTER_FRAME);
 	luahelper_set_strfield(L, "ANIMATE_COMPLETE",		EVT_ANIMATE_COMPLETE);
+	luahelper_set_strfield(L, "AIO_COMPLETE",			EVT_AIO_COMPLETE);
 	return 1;
 }
@@ -26,6 +26,7 @@
  *
  */
 
+#include <crc32.h>
 #include <xfs/xfs.h>
 #include <shell/readline.h>
 #include <framework/luahelper.h>
@@ -34,6 +35,7 @@
 #include <framework/event/l-event.h>
 #include <framework/event/l-event-dispatcher.h>
 #include <framework/stopwatch/l-stopwatch.h>
+#include <framework/aio/l-aio.h>
 #include <framework/base64/l-base64.h>
 #include <framework/display/l-display.h>
 #include <framework/hardware/l-hardware.h>
@@ -66,6 +68,7 @@ static void luaopen_prelibs(lua_State * L)
 		{ "builtin.base64",			luaopen_base64 },
 
 		{ "builtin.stopwatch",		luaopen_stopwatch },
+		{ "builtin.aio",			luaopen_aio },
 		{ "builtin.matrix",			luaopen_matrix },
 		{ "builtin.easing",			luaopen_easing },
 		{ "builtin.object",			luaopen_object },
@@ -120,12 +123,36 @@ static int luaopen_boot(lua_State * L)
 	return 1;
 }
 
+/*
+ * compiled chunk cached in a 'luac' file next to the 'lua' source, with a
+ * little endian header of magic "XLUC", lua version, source size and source
+ * crc32. the chunk is used only if the source is gone or still matches. the
+ * header must match developments/mkluac, runtime saving needs
+ * CONFIG_VM_LUAC_CACHE.
+ */
+#define LUAC_HEADER_SIZE	(16)
+
 struct __reader_data_t
 {
 	struct xfs_file_t * file;
+	uint32_t size;
+	uint32_t crc;
 	char buffer[LUAL_BUFFERSIZE];
 };
 
+static inline uint32_t __get32(const uint8_t * p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void __put32(uint8_t * p, uint32_t v)
+{
+	p[0] = (v >> 0) & 0xff;
+	p[1] = (v >> 8) & 0xff;
+	p[2] = (v >> 16) & 0xff;
+	p[3] = (v >> 24) & 0xff;
+}
+
 static const char * __reader(lua_State * L, void * data, size_t * size)
 {
 	struct __reader_data_t * rd = (struct __reader_data_t *)data;
@@ -137,35 +164,217 @@ static const char * __reader(lua_State * L, void * data, size_t * size)
 		lua_error(L);
 		return NULL;
 	}
+	rd->size += ret;
+	rd->crc = crc32_sum(rd->crc, (const uint8_t *)rd->buffer, ret);
 
 	*size = (size_t)ret;
 	return rd->buffer;
 }
 
+/*
+ * size and crc32 of the source, summed in place if it is memory mapped
+ */
+static bool_t __checksum(struct xfs_context_t * ctx, const char * filename, uint32_t * size, uint32_t * crc)
+{
+	struct __reader_data_t * rd;
+	const char * map;
+	s64_t len;
+
+	rd = malloc(sizeof(struct __reader_data_t));
+	if(!rd)
+		return FALSE;
+	rd->file = xfs_open_read(ctx, filename);
+	if(!rd->file)
+	{
+		free(rd);
+		return FALSE;
+	}
+	rd->size = 0;
+	rd->crc = 0;
+
+	map = xfs_map(rd->file);
+	if(map)
+	{
+		rd->size = xfs_length(rd->file);
+		rd->crc = crc32_sum(0, (const uint8_t *)map, rd->size);
+	}
+	else
+	{
+		while((len = xfs_read(rd->file, rd->buffer, LUAL_BUFFERSIZE)) > 0)
+		{
+			rd->size += len;
+			rd->crc = crc32_sum(rd->crc, (const uint8_t *)rd->buffer, len);
+		}
+	}
+	*size = rd->size;
+	*crc = rd->crc;
+
+	xfs_close(rd->file);
+	free(rd);
+	return TRUE;
+}
+
+/*
+ * push the cached chunk of filename, stale or foreign bytecode is ignored
+ */
+static bool_t __loadcache(lua_State * L, struct xfs_context_t * ctx, const char * luac, const char * filename)
+{
+	struct __reader_data_t * rd;
+	uint8_t hdr[LUAC_HEADER_SIZE];
+	uint32_t size, crc;
+	const char * map;
+	int status;
+
+	rd = malloc(sizeof(struct __reader_data_t));
+	if(!rd)
+		return FALSE;
+	rd->file = xfs_open_read(ctx, luac);
+	if(!rd->file)
+	{
+		free(rd);
+		return FALSE;
+	}
+	rd->size = 0;
+	rd->crc = 0;
+
+	if((xfs_read(rd->file, hdr, LUAC_HEADER_SIZE) != LUAC_HEADER_SIZE) || (memcmp(&hdr[0], "XLUC", 4) != 0) || (__get32(&hdr[4]) != LUA_VERSION_NUM))
+		goto fail;
+	if(xfs_isfile(ctx, filename))
+	{
+		if(!__checksum(ctx, filename, &size, &crc) || (size != __get32(&hdr[8])) || (crc != __get32(&hdr[12])))
+			goto fail;
+	}
+
+	/* lua itself rejects bytecode of another word size or number format */
+	map = xfs_map(rd->file);
+	if(map)
+		status = luaL_loadbufferx(L, map + LUAC_HEADER_SIZE, xfs_length(rd->file) - LUAC_HEADER_SIZE, filename, "b");
+	else
+		status = lua_load(L, __reader, rd, filename, "b");
+	if(status)
+	{
+		lua_pop(L, 1);
+		goto fail;
+	}
+
+	xfs_close(rd->file);
+	free(rd);
+	return TRUE;
+
+fail:
+	xfs_close(rd->file);
+	free(rd);
+	return FALSE;
+}
+
+#if (CONFIG_VM_LUAC_CACHE > 0)
+static int __writer(lua_State * L, const void * p, size_t sz, void * ud)
+{
+	return (xfs_write((struct xfs_file_t *)ud, (void *)p, sz) == sz) ? 0 : 1;
+}
+
+/*
+ * dump the chunk on the top of stack into the writable mount, if any
+ */
+static void __savecache(lua_State * L, struct xfs_context_t * ctx, const char * luac, uint32_t size, uint32_t crc)
+{
+	struct xfs_file_t * file;
+	uint8_t hdr[LUAC_HEADER_SIZE];
+	char * path, * p;
+	int status;
+
+	path = strdup(luac);
+	if(!path)
+		return;
+	for(p = strchr(path, '/'); p; p = strchr(p + 1, '/'))
+	{
+		*p = '\0';
+		xfs_mkdir(ctx, path);
+		*p = '/';
+	}
+	free(path);
+
+	file = xfs_open_write(ctx, luac);
+	if(!file)
+		return;
+	memcpy(&hdr[0], "XLUC", 4);
+	__put32(&hdr[4], LUA_VERSION_NUM);
+	__put32(&hdr[8], size);
+	__put32(&hdr[12], crc);
+	status = (xfs_write(file, hdr, LUAC_HEADER_SIZE) == LUAC_HEADER_SIZE) ? lua_dump(L, __writer, file, 0) : 1;
+	xfs_close(file);
+	if(status)
+		xfs_remove(ctx, luac);
+}
+#endif
+
 static int __loadfile(lua_State * L)
 {
 	struct xfs_context_t * ctx = luahelper_runtime(L)->__xfs_ctx;
 	const char * filename = luaL_checkstring(L, 1);
 	struct __reader_data_t * rd;
+	const char * map;
+	char * luac = NULL;
+	size_t len;
+	int status;
+
+	len = strlen(filename);
+	if((len > 4) && (strcmp(&filename[len - 4], ".lua") == 0))
+	{
+		luac = malloc(len + 2);
+		if(luac)
+		{
+			strcpy(luac, filename);
+			strcat(luac, "c");
+			if(__loadcache(L, ctx, luac, filename))
+			{
+				free(luac);
+				return 1;
+			}
+		}
+	}
 
 	rd = malloc(sizeof(struct __reader_data_t));
 	if(!rd)
+	{
+		free(luac);
 		return lua_error(L);
+	}
 
 	rd->file = xfs_open_read(ctx, filename);
 	if(!rd->file)
 	{
+		free(luac);
 		free(rd);
 		return lua_error(L);
 	}
+	rd->size = 0;
+	rd->crc = 0;
 
-	if(lua_load(L, __reader, rd, filename, NULL))
+	/* scripts on memory mapped storage are parsed in place */
+	map = xfs_map(rd->file);
+	if(map)
+	{
+		rd->size = xfs_length(rd->file);
+		rd->crc = crc32_sum(0, (const uint8_t *)map, rd->size);
+		status = luaL_loadbuffer(L, map, rd->size, filename);
+	}
+	else
+		status = lua_load(L, __reader, rd, filename, NULL);
+	if(status)
 	{
+		xfs_close(rd->file);
+		free(luac);
 		free(rd);
 		return lua_error(L);
 	}
-
 	xfs_close(rd->file);
+
+#if (CONFIG_VM_LUAC_CACHE > 0)
+	if(luac)
+		__savecache(L, ctx, luac, rd->size, rd->crc);
+#endif
+	free(luac);
 	free(rd);
 
 	return 1;
@@ -195,7 +404,14 @@ static int l_search_package_lua(lua_State * L)
 	else
 		strcat(buf, ".lua");
 
-	if(xfs_isfile(ctx, buf))
+	/* a package may ship the compiled chunk alone */
+	len = strlen(buf);
+	buf[len] = 'c';
+	buf[len + 1] = '\0';
+	i = xfs_isfile(ctx, buf);
+	buf[len] = '\0';
+
+	if(i || xfs_isfile(ctx, buf))
 	{
 		lua_pop(L, 1);
 		lua_pushcfunction(L, __loadfile);
@@ -299,12 +515,32 @@ static lua_State * l_newstate(void * ud)
 	return L;
 }
 
+/*
+ * boot trace span from the start of the first vm to its first frame
+ */
+static int __trace_frame = -1;
+static bool_t __trace_first = TRUE;
+
+void vm_first_frame(void)
+{
+	if(__trace_frame >= 0)
+	{
+		tracer_end(__trace_frame);
+		__trace_frame = -1;
+	}
+}
+
 int vmexec(int argc, char ** argv)
 {
 	struct runtime_t rt, *r;
 	lua_State * L;
 	int status = LUA_ERRRUN, result;
 
+	if(__trace_first)
+	{
+		__trace_first = FALSE;
+		__trace_frame = tracer_begin(TRACE_TYPE_LUA, "first frame of %s", argv[0]);
+	}
 	runtime_create_save(&rt, argv[0], &r);
 	L = l_newstate(&rt);
 	if(L)
@@ -323,6 +559,7 @@ int vmexec(int argc, char ** argv)
 		}
 		lua_close(L);
 	}
+	vm_first_frame();
 	runtime_destroy_restore(&rt, r);
 	return (result && (status == LUA_OK)) ? 0 : -1;
 }
@@ -6,6 +6,36 @@ extern "C" {
 #endif
 
 #include <xboot.h>
+#include <block/readahead.h>
+
+struct iovec;
+
+struct block_request_t
+{
+	/* The block number of the start */
+	u64_t blkno;
+
+	/* The count of block */
+	u64_t blkcnt;
+
+	/* Data buffer */
+	u8_t * buf;
+
+	/* The block counts of transferred, valid after completion */
+	u64_t done;
+};
+
+struct block_segment_t
+{
+	/* Data buffer */
+	u8_t * buf;
+
+	/* Byte offset of block device */
+	u64_t offset;
+
+	/* Byte count of data buffer */
+	u64_t count;
+};
 
 struct block_t
 {
@@ -24,11 +54,45 @@ struct block_t
 	/* Write block device, return the block counts of writing */
 	u64_t (*write)(struct block_t * blk, u8_t * buf, u64_t blkno, u64_t blkcnt);
 
+	/* Read a batch of requests in one go, NULL for calling read on each */
+	void (*readv)(struct block_t * blk, struct block_request_t * req, int n);
+
+	/* Write a batch of requests in one go, NULL for calling write on each */
+	void (*writev)(struct block_t * blk, struct block_request_t * req, int n);
+
+	/* Read bytes at any offset, NULL if the block device can only read whole blocks */
+	u64_t (*fetch)(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count);
+
+	/* Program bytes into erased space without erasing, NULL if the block device can only rewrite whole blocks */
+	u64_t (*program)(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count);
+
 	/* Sync cache to block device */
 	void (*sync)(struct block_t * blk);
 
+	/* Memory address of the byte offset, NULL if the block device is not memory addressable */
+	void * (*mmap)(struct block_t * blk, u64_t offset, u64_t count);
+
+	/* Backing device shared by aliased block devices and the block offset on it, NULL if the block device is not aliased */
+	void * backing;
+	u64_t backing_offset;
+
 	/* Private data */
 	void * priv;
+
+	/* Buffer cache list, maintained by block core */
+	struct list_head buffers;
+
+	/* Buffer cache statistics */
+	u64_t cache_hit;
+	u64_t cache_miss;
+	u64_t cache_evict;
+
+	/* Maximum readahead window in bytes, zero for disabled */
+	u64_t ra_max;
+
+	/* Readahead statistics */
+	u64_t ra_count;
+	u64_t ra_hit;
 };
 
 static inline u64_t block_size(struct block_t * blk)
@@ -75,7 +139,15 @@ bool_t unregister_block(struct block_t * blk);
 
 u64_t block_read(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count);
 u64_t block_write(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count);
+u64_t block_read_batch(struct block_t * blk, struct block_readahead_t * ra, const struct block_segment_t * seg, int nseg);
+u64_t block_write_batch(struct block_t * blk, const struct block_segment_t * seg, int nseg);
+u64_t block_readv(struct block_t * blk, const struct iovec * iov, int iovcnt, u64_t offset);
+u64_t block_writev(struct block_t * blk, const struct iovec * iov, int iovcnt, u64_t offset);
+u64_t block_read_ahead(struct block_t * blk, struct block_readahead_t * ra, u8_t * buf, u64_t offset, u64_t count);
+u64_t block_program(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count);
 void block_sync(struct block_t * blk);
+const void * block_mmap(struct block_t * blk, u64_t offset, u64_t count);
+u64_t block_copy(struct block_t * dst, u64_t doffset, struct block_t * src, u64_t soffset, u64_t count);
 
 #ifdef __cplusplus
 }
@@ -29,6 +29,38 @@ struct partition_t
 	struct list_head entry;
 };
 
+enum disk_request_dir_t {
+	DISK_REQUEST_READ	= 0,
+	DISK_REQUEST_WRITE	= 1,
+};
+
+struct disk_request_t
+{
+	/* Link to the request queue */
+	struct list_head entry;
+
+	/* Transfer direction */
+	enum disk_request_dir_t dir;
+
+	/* The sector number of the start */
+	u64_t sector;
+
+	/* The count of sector */
+	u64_t count;
+
+	/* Data buffer */
+	u8_t * buf;
+
+	/* The sector counts of transferred, valid after completion */
+	u64_t done;
+
+	/* Completion callback, can be null */
+	void (*complete)(struct disk_request_t * req);
+
+	/* Private data for completion callback */
+	void * priv;
+};
+
 struct disk_t
 {
 	/* The disk name */
@@ -49,17 +81,36 @@ struct disk_t
 	/* Write disk device, return the sector counts of writing */
 	u64_t (*write)(struct disk_t * disk, u8_t * buf, u64_t sector, u64_t count);
 
+	/* Read contiguous sectors into scattered buffers in one go, can be NULL */
+	u64_t (*readv)(struct disk_t * disk, const struct iovec * iov, int iovcnt, u64_t sector, u64_t count);
+
+	/* Write contiguous sectors from scattered buffers in one go, can be NULL */
+	u64_t (*writev)(struct disk_t * disk, const struct iovec * iov, int iovcnt, u64_t sector, u64_t count);
+
 	/* Sync cache to disk device */
 	void (*sync)(struct disk_t * disk);
 
 	/* Private data */
 	void * priv;
+
+	/* Request queue sorted by sector, maintained by disk core */
+	struct list_head queue;
+	u64_t depth;
+
+	/* Request queue statistics */
+	u64_t nrequest;
+	u64_t nmerge;
+	u64_t ndispatch;
 };
 
 struct disk_t * search_disk(const char * name);
 bool_t register_disk(struct device_t ** device, struct disk_t * disk);
 bool_t unregister_disk(struct disk_t * disk);
 
+void disk_request_init(struct disk_request_t * req, enum disk_request_dir_t dir, u8_t * buf, u64_t sector, u64_t count, void (*complete)(struct disk_request_t *), void * priv);
+bool_t disk_submit(struct disk_t * disk, struct disk_request_t * req);
+void disk_unplug(struct disk_t * disk);
+
 u64_t disk_read(struct disk_t * disk, u8_t * buf, u64_t offset, u64_t count);
 u64_t disk_write(struct disk_t * disk, u8_t * buf, u64_t offset, u64_t count);
 void disk_sync(struct disk_t * disk);
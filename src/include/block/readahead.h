@@ -0,0 +1,26 @@
+#ifndef __READAHEAD_H__
+#define __READAHEAD_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <types.h>
+
+struct block_readahead_t
+{
+	/* Expected offset of the next sequential read */
+	u64_t next;
+
+	/* End offset of the issued readahead window */
+	u64_t end;
+
+	/* Current readahead window size in bytes */
+	u64_t size;
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __READAHEAD_H__ */
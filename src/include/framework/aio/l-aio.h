@@ -0,0 +1,18 @@
+#ifndef __FRAMEWORK_L_AIO_H__
+#define __FRAMEWORK_L_AIO_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <framework/luahelper.h>
+
+#define	MT_AIO	"mt_aio"
+
+int luaopen_aio(lua_State * L);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FRAMEWORK_L_AIO_H__ */
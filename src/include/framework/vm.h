@@ -6,6 +6,7 @@ extern "C" {
 #endif
 
 int vmexec(int argc, char ** argv);
+void vm_first_frame(void);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,40 @@
+#ifndef __AIO_H__
+#define __AIO_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <xboot.h>
+#include <fs/fileio.h>
+
+enum aio_type_t {
+	AIO_TYPE_READ	= 0,
+	AIO_TYPE_WRITE	= 1,
+	AIO_TYPE_FSYNC	= 2,
+};
+
+struct aio_t {
+	struct list_head entry;
+	u32_t id;
+	enum aio_type_t type;
+	int fd;
+	void * buf;
+	loff_t offset;
+	loff_t size;
+	loff_t count;
+	int error;
+	void (*complete)(struct aio_t * aio, void * data);
+	void * data;
+};
+
+struct aio_t * aio_submit(enum aio_type_t type, int fd, void * buf, loff_t offset, loff_t size, void (*complete)(struct aio_t *, void *), void * data);
+bool_t aio_cancel(struct aio_t * aio);
+bool_t aio_pending(void);
+void aio_schedule(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __AIO_H__ */
@@ -48,6 +48,7 @@ int truncate(const char * path, loff_t length);
 
 ssize_t readv(int fd, const struct iovec * iov, int iovcnt);
 ssize_t writev(int fd, const struct iovec * iov, int iovcnt);
+loff_t copy_range(int ifd, loff_t * ioff, int ofd, loff_t * ooff, loff_t len);
 
 #ifdef __cplusplus
 }
@@ -8,6 +8,11 @@ extern "C" {
 #include <xboot.h>
 #include <fs/vfs/vfs.h>
 
+/*
+ * filesystem flags
+ */
+#define FILESYSTEM_NOCACHE		(1 << 0)	/* names change behind vfs, never cache vnodes */
+
 /*
  * filesystem structure
  */
@@ -18,6 +23,9 @@ struct filesystem_t
 
 	/* pointer to vfs operation */
 	struct vfsops_t * vfsops;
+
+	/* filesystem flags */
+	u32_t flags;
 };
 
 /*
@@ -7,6 +7,7 @@ extern "C" {
 
 #include <xboot.h>
 #include <block/block.h>
+#include <block/readahead.h>
 #include <fs/vfs/stat.h>
 #include <fs/vfs/fcntl.h>
 #include <fs/fs.h>
@@ -23,6 +24,7 @@ struct vnode_t;
 struct vnops_t;
 struct mount_t;
 struct vfsops_t;
+struct iovec;
 
 /*
  * file structure
@@ -32,6 +34,7 @@ struct file_t {
 	s32_t f_count;				/* reference count */
 	loff_t f_offset;			/* current position in file */
 	struct vnode_t * f_vnode;	/* vnode */
+	struct block_readahead_t f_ra;	/* readahead state */
 };
 
 /*
@@ -94,6 +97,11 @@ struct vattr_t {
  */
 struct vnode_t {
 	struct list_head v_link;	/* link for hash list */
+	struct list_head v_lru;		/* link for unused vnode list */
+	struct list_head v_names;	/* name cache entries in this directory */
+	struct list_head v_aliases;	/* name cache entries pointing to this vnode */
+	struct list_head v_pages;	/* page cache of regular file */
+	bool_t v_cached;			/* keep on unused list after last reference */
 	struct mount_t * v_mount;	/* mounted vfs pointer */
 	struct vnops_t * v_op;		/* vnode operations */
 	loff_t v_size;				/* file size */
@@ -106,6 +114,13 @@ struct vnode_t {
 	void * v_data;				/* private data for fs */
 };
 
+/*
+ * vnode ioctl commands
+ */
+enum {
+	VFS_IOCTL_MMAP	= 0x00000001,	/* arg is a 'const void **', set to the whole file in memory */
+};
+
 /*
  * vnode operations
  */
@@ -128,6 +143,8 @@ struct vnops_t {
 	s32_t (*vop_setattr)(struct vnode_t *, struct vattr_t *);
 	s32_t (*vop_inactive)(struct vnode_t *);
 	s32_t (*vop_truncate)(struct vnode_t *, loff_t);
+	s32_t (*vop_readv)(struct vnode_t *, struct file_t *, const struct iovec *, int, loff_t *);
+	s32_t (*vop_writev)(struct vnode_t *, struct file_t *, const struct iovec *, int, loff_t *);
 };
 
 /*
@@ -159,6 +176,7 @@ struct statfs {
 	s32_t f_ffree;				/* free file nodes in fs */
 	struct fsid f_fsid;			/* file system id */
 	s32_t f_namelen;			/* maximum filename length */
+	u32_t f_memory;				/* bytes of memory held by in-core index */
 };
 
 /*
@@ -212,9 +230,28 @@ void vref(struct vnode_t * vp);
 void vrele(struct vnode_t * vp);
 void vgone(struct vnode_t * vp);
 void vflush(struct mount_t * mp);
+void vn_invalidate(struct mount_t * mp, char * path);
 s32_t vn_stat(struct vnode_t * vp, struct stat * st);
 s32_t vn_access(struct vnode_t * vp, u32_t mode);
 
+/*
+ * declare for vfs_cache
+ */
+s32_t cache_lookup(struct vnode_t * dvp, char * name, struct vnode_t ** vpp);
+void cache_enter(struct vnode_t * dvp, char * name, struct vnode_t * vp);
+void cache_remove(struct vnode_t * dvp, char * name);
+void cache_purge(struct vnode_t * vp);
+
+/*
+ * declare for vfs_page
+ */
+bool_t page_cache_enabled(struct vnode_t * vp);
+s32_t page_cache_read(struct vnode_t * vp, struct file_t * fp, void * buf, loff_t size, loff_t * result);
+s32_t page_cache_write(struct vnode_t * vp, struct file_t * fp, void * buf, loff_t size, loff_t * result);
+s32_t page_cache_sync(struct vnode_t * vp);
+s32_t page_cache_copy(struct vnode_t * vp, struct file_t * fp, loff_t off, struct file_t * ofp, loff_t len, loff_t * result);
+void page_cache_purge(struct vnode_t * vp);
+
 /*
  * declare for vfs_path
  */
@@ -244,6 +281,9 @@ s32_t sys_open(char * path, u32_t flags, u32_t mode, struct file_t ** pfp);
 s32_t sys_close(struct file_t * fp);
 s32_t sys_read(struct file_t * fp, void * buf, loff_t size, loff_t * count);
 s32_t sys_write(struct file_t * fp, void * buf, loff_t size, loff_t * count);
+s32_t sys_readv(struct file_t * fp, const struct iovec * iov, int iovcnt, loff_t * count);
+s32_t sys_writev(struct file_t * fp, const struct iovec * iov, int iovcnt, loff_t * count);
+s32_t sys_copy_range(struct file_t * ifp, loff_t * ioff, struct file_t * ofp, loff_t * ooff, loff_t len, loff_t * count);
 s32_t sys_lseek(struct file_t * fp, loff_t off, u32_t type, loff_t * origin);
 s32_t sys_ioctl(struct file_t * fp, int cmd, void * arg);
 s32_t sys_fsync(struct file_t * fp);
@@ -8,6 +8,7 @@ extern "C" {
 #include <xboot.h>
 
 void do_showlogo(void);
+void do_showlogo_device(struct device_t * dev);
 void do_autoboot(void);
 
 #ifdef __cplusplus
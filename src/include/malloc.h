@@ -24,6 +24,7 @@ void * memalign(size_t align, size_t size);
 void * realloc(void * ptr, size_t size);
 void * calloc(size_t nmemb, size_t size);
 void free(void * ptr);
+void meminfo(size_t * mused, size_t * mfree);
 
 void do_init_mem_pool(void);
 
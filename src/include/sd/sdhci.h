@@ -15,11 +15,37 @@ struct sdhci_cmd_t {
 	u32_t response[4];
 };
 
+enum {
+	SDHCI_ADMA2_VALID	= (1 << 0),
+	SDHCI_ADMA2_END		= (1 << 1),
+	SDHCI_ADMA2_INT		= (1 << 2),
+	SDHCI_ADMA2_NOP		= (0x0 << 4),
+	SDHCI_ADMA2_TRAN	= (0x2 << 4),
+	SDHCI_ADMA2_LINK	= (0x3 << 4),
+};
+
+/*
+ * ADMA2 32-bit descriptor, a length of zero means 65536 bytes
+ */
+struct sdhci_adma2_desc_t {
+	u16_t attr;
+	u16_t len;
+	u32_t addr;
+};
+
 struct sdhci_data_t {
 	u8_t * buf;
 	u32_t flag;
 	u32_t blksz;
 	u32_t blkcnt;
+
+	/* Optional descriptor chain describing buf, needs SDHCI_CAP_ADMA2 */
+	struct sdhci_adma2_desc_t * adma;
+	u32_t nadma;
+};
+
+enum {
+	SDHCI_CAP_ADMA2		= (1 << 0),
 };
 
 struct sdhci_t
@@ -29,6 +55,7 @@ struct sdhci_t
 	u32_t width;
 	u32_t clock;
 	bool_t removeable;
+	u32_t caps;
 	void * sdcard;
 
 	bool_t (*detect)(struct sdhci_t * sdhci);
@@ -46,6 +73,7 @@ bool_t sdhci_detect(struct sdhci_t * sdhci);
 bool_t sdhci_set_width(struct sdhci_t * sdhci, u32_t width);
 bool_t sdhci_set_clock(struct sdhci_t * sdhci, u32_t clock);
 bool_t sdhci_transfer(struct sdhci_t * sdhci, struct sdhci_cmd_t * cmd, struct sdhci_data_t * dat);
+u32_t sdhci_adma2_setup(struct sdhci_adma2_desc_t * desc, u32_t ndesc, u8_t * buf, u32_t len);
 
 #ifdef __cplusplus
 }
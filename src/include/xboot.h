@@ -48,6 +48,7 @@ extern "C" {
 #include <xboot/seqlock.h>
 #include <xboot/event.h>
 #include <xboot/profiler.h>
+#include <xboot/tracer.h>
 #include <xboot/notifier.h>
 #include <xboot/initcall.h>
 #include <xboot/module.h>
@@ -9,6 +9,16 @@ extern "C" {
 
 struct device_t;
 
+/*
+ * Returned by probe when a dependency is not registered yet, or from
+ * probe_defer() when the hardware needs time, the node is probed again later.
+ * probe_stage() counts the delays taken, so that a slow probe can continue
+ * where it left off instead of waiting in place. A node given up on after
+ * it has taken a delay is passed to cancel, to undo what the earlier stages
+ * switched on.
+ */
+#define PROBE_DEFER		((struct device_t *)(-1))
+
 struct driver_t
 {
 	struct kobj_t * kobj;
@@ -16,6 +26,7 @@ struct driver_t
 
 	char * name;
 	struct device_t * (*probe)(struct driver_t * drv, struct dtnode_t * dt);
+	void (*cancel)(struct driver_t * drv, struct dtnode_t * dt);
 	void (*remove)(struct device_t * dev);
 	void (*suspend)(struct device_t * dev);
 	void (*resume)(struct device_t * dev);
@@ -24,6 +35,9 @@ struct driver_t
 struct driver_t * search_driver(const char * name);
 bool_t register_driver(struct driver_t * drv);
 bool_t unregister_driver(struct driver_t * drv);
+struct device_t * probe_defer(int ms);
+int probe_stage(void);
+void probe_schedule(void);
 void probe_device(const char * json, int length);
 
 #ifdef __cplusplus
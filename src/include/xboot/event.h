@@ -29,6 +29,8 @@ enum event_type_t {
 	EVENT_TYPE_JOYSTICK_RIGHTTRIGGER	= 0x0503,
 	EVENT_TYPE_JOYSTICK_BUTTONDOWN		= 0x0504,
 	EVENT_TYPE_JOYSTICK_BUTTONUP		= 0x0505,
+
+	EVENT_TYPE_AIO_COMPLETE				= 0x0600,
 };
 
 enum {
@@ -140,6 +142,13 @@ struct event_t {
 		struct {
 			u32_t button;
 		} joystick_button_up;
+
+		/* Aio */
+		struct {
+			u32_t id;
+			s32_t error;
+			s64_t count;
+		} aio_complete;
 	} e;
 };
 
@@ -169,6 +178,7 @@ void push_event_joystick_left_trigger(void * device, s32_t v);
 void push_event_joystick_right_trigger(void * device, s32_t v);
 void push_event_joystick_button_down(void * device, u32_t button);
 void push_event_joystick_button_up(void * device, u32_t button);
+void push_event_aio_complete(void * device, u32_t id, s32_t error, s64_t count);
 bool_t pump_event(struct event_base_t * eb, struct event_t * event);
 
 #ifdef __cplusplus
@@ -0,0 +1,37 @@
+#ifndef __TRACER_H__
+#define __TRACER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <types.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum trace_type_t {
+	TRACE_TYPE_BOOT		= 0,
+	TRACE_TYPE_INITCALL	= 1,
+	TRACE_TYPE_PROBE	= 2,
+	TRACE_TYPE_MOUNT	= 3,
+	TRACE_TYPE_LUA		= 4,
+};
+
+struct trace_span_t
+{
+	enum trace_type_t type;
+	int id;
+	uint64_t begin;
+	uint64_t end;
+	char name[CONFIG_TRACER_NAME_SIZE];
+};
+
+int tracer_begin(enum trace_type_t type, const char * fmt, ...);
+void tracer_end(int id);
+int tracer_format(char * buf, size_t size, bool_t json);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TRACER_H__ */
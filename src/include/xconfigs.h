@@ -24,6 +24,10 @@ extern "C" {
 #define CONFIG_DRIVER_HASH_SIZE				(257)
 #endif
 
+#if !defined(CONFIG_DRIVER_PROBE_TIMEOUT)
+#define CONFIG_DRIVER_PROBE_TIMEOUT			(3000)
+#endif
+
 #if !defined(CONFIG_DEVICE_HASH_SIZE)
 #define CONFIG_DEVICE_HASH_SIZE				(257)
 #endif
@@ -32,10 +36,110 @@ extern "C" {
 #define CONFIG_PROFILER_HASH_SIZE			(257)
 #endif
 
+#if !defined(CONFIG_TRACER_SPAN_COUNT)
+#define CONFIG_TRACER_SPAN_COUNT			(512)
+#endif
+
+#if !defined(CONFIG_TRACER_NAME_SIZE)
+#define CONFIG_TRACER_NAME_SIZE				(48)
+#endif
+
 #if !defined(CONFIG_KVDB_MAX_HASH_SIZE)
 #define CONFIG_KVDB_MAX_HASH_SIZE			(4099)
 #endif
 
+#if !defined(CONFIG_BLOCK_CACHE_SIZE)
+#define CONFIG_BLOCK_CACHE_SIZE				(SZ_1M)
+#endif
+
+#if !defined(CONFIG_BLOCK_CACHE_HASH_SIZE)
+#define CONFIG_BLOCK_CACHE_HASH_SIZE		(1021)
+#endif
+
+#if !defined(CONFIG_BLOCK_CACHE_BYPASS_SIZE)
+#define CONFIG_BLOCK_CACHE_BYPASS_SIZE		(SZ_32K)
+#endif
+
+#if !defined(CONFIG_BLOCK_BATCH_SIZE)
+#define CONFIG_BLOCK_BATCH_SIZE				(16)
+#endif
+
+#if !defined(CONFIG_BLOCK_READAHEAD_SIZE)
+#define CONFIG_BLOCK_READAHEAD_SIZE			(SZ_128K)
+#endif
+
+#if !defined(CONFIG_BLOCK_READAHEAD_MIN)
+#define CONFIG_BLOCK_READAHEAD_MIN			(SZ_16K)
+#endif
+
+#if !defined(CONFIG_BLOCK_COPY_SIZE)
+#define CONFIG_BLOCK_COPY_SIZE				(SZ_256K)
+#endif
+
+#if !defined(CONFIG_VFS_VNODE_CACHE_COUNT)
+#define CONFIG_VFS_VNODE_CACHE_COUNT		(64)
+#endif
+
+#if !defined(CONFIG_VFS_NAME_CACHE_COUNT)
+#define CONFIG_VFS_NAME_CACHE_COUNT			(256)
+#endif
+
+#if !defined(CONFIG_VFS_PAGE_SIZE)
+#define CONFIG_VFS_PAGE_SIZE				(4096)
+#endif
+
+#if !defined(CONFIG_VFS_PAGE_CACHE_PERCENT)
+#define CONFIG_VFS_PAGE_CACHE_PERCENT		(25)
+#endif
+
+#if !defined(CONFIG_VFS_COPY_SIZE)
+#define CONFIG_VFS_COPY_SIZE				(SZ_256K)
+#endif
+
+#if !defined(CONFIG_AIO_CHUNK_SIZE)
+#define CONFIG_AIO_CHUNK_SIZE				(SZ_64K)
+#endif
+
+#if !defined(CONFIG_ROMDISK_CACHE_CHUNKS)
+#define CONFIG_ROMDISK_CACHE_CHUNKS			(4)
+#endif
+
+#if !defined(CONFIG_FATFS_FAT_CACHE_COUNT)
+#define CONFIG_FATFS_FAT_CACHE_COUNT		(16)
+#endif
+
+#if !defined(CONFIG_FATFS_FAT_CACHE_SIZE)
+#define CONFIG_FATFS_FAT_CACHE_SIZE			(SZ_4K)
+#endif
+
+#if !defined(CONFIG_FATFS_DIR_INDEX_COUNT)
+#define CONFIG_FATFS_DIR_INDEX_COUNT		(8)
+#endif
+
+#if !defined(CONFIG_NORFS_BLOCK_CYCLES)
+#define CONFIG_NORFS_BLOCK_CYCLES			(512)
+#endif
+
+#if !defined(CONFIG_NORFS_LOOKAHEAD)
+#define CONFIG_NORFS_LOOKAHEAD				(512)
+#endif
+
+#if !defined(CONFIG_XFS_INDEX_COUNT)
+#define CONFIG_XFS_INDEX_COUNT				(512)
+#endif
+
+#if !defined(CONFIG_XFS_ZIP_WINDOW_SIZE)
+#define CONFIG_XFS_ZIP_WINDOW_SIZE			(SZ_32K)
+#endif
+
+#if !defined(CONFIG_DISK_QUEUE_DEPTH)
+#define CONFIG_DISK_QUEUE_DEPTH				(32)
+#endif
+
+#if !defined(CONFIG_DISK_MERGE_SIZE)
+#define CONFIG_DISK_MERGE_SIZE				(SZ_256K)
+#endif
+
 #if !defined(CONFIG_MAX_BRIGHTNESS)
 #define CONFIG_MAX_BRIGHTNESS				(1000)
 #endif
@@ -44,6 +148,10 @@ extern "C" {
 #define CONFIG_EVENT_FIFO_LENGTH			(8)
 #endif
 
+#if !defined(CONFIG_VM_LUAC_CACHE)
+#define CONFIG_VM_LUAC_CACHE				(0)
+#endif
+
 #ifdef __cplusplus
 }
 #endif
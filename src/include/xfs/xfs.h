@@ -15,8 +15,28 @@ struct xfs_path_t {
 	struct list_head list;
 };
 
+/* size of path index hash table, must power 2 */
+#define XFS_INDEX_HASH_SIZE		(64)
+
+/*
+ * merged result of the lookups of a path across all mounts, an entry
+ * with nothing found is a negative one.
+ */
+struct xfs_index_t {
+	struct hlist_node node;		/* link for hash list */
+	struct list_head lru;		/* link for lru list */
+	u32_t hash;					/* hash value of path */
+	int isdir;					/* directory in any mount, -1 if not known yet */
+	int isfile;					/* file in any mount, -1 if not known yet */
+	struct xfs_path_t * file;	/* top most mount holding the file */
+	char * path;				/* normalized path */
+};
+
 struct xfs_context_t {
 	struct xfs_path_t mounts;
+	struct hlist_head index[XFS_INDEX_HASH_SIZE];
+	struct list_head index_lru;
+	int index_count;
 	spinlock_t lock;
 };
 
@@ -40,6 +60,7 @@ s64_t xfs_read(struct xfs_file_t * file, void * buf, s64_t size);
 s64_t xfs_write(struct xfs_file_t * file, void * buf, s64_t size);
 s64_t xfs_seek(struct xfs_file_t * file, s64_t offset);
 s64_t xfs_length(struct xfs_file_t * file);
+const void * xfs_map(struct xfs_file_t * file);
 void xfs_close(struct xfs_file_t * file);
 
 struct xfs_context_t * __xfs_alloc(const char * path);
@@ -33,14 +33,39 @@
 #include <framebuffer/framebuffer.h>
 #include <init.h>
 
+static bool_t __logo_shown = FALSE;
+
+static void showlogo(struct framebuffer_t * fb, cairo_surface_t * logo)
+{
+	cairo_surface_t * cs;
+	cairo_t * cr;
+	int x, y;
+
+	cs = cairo_xboot_surface_create(fb, fb->alone);
+	cr = cairo_create(cs);
+
+	cairo_save(cr);
+	cairo_set_source_rgb(cr, 0.2, 0.6, 0.8);
+	cairo_paint(cr);
+	cairo_restore(cr);
+
+	x = (cairo_image_surface_get_width(cs) - cairo_image_surface_get_width(logo)) / 2;
+	y = (cairo_image_surface_get_height(cs) - cairo_image_surface_get_height(logo)) / 2;
+	cairo_set_source_surface(cr, logo, x, y);
+	cairo_paint(cr);
+
+	cairo_destroy(cr);
+	cairo_xboot_surface_present(cs);
+	cairo_surface_destroy(cs);
+
+	framebuffer_set_backlight(fb, CONFIG_MAX_BRIGHTNESS);
+}
+
 void do_showlogo(void)
 {
 	struct device_t * pos, * n;
 	cairo_surface_t * logo;
-	cairo_surface_t * cs;
-	cairo_t * cr;
 	struct framebuffer_t * fb;
-	int x, y;
 
 	if(!list_empty_careful(&__device_head[DEVICE_TYPE_FRAMEBUFFER]))
 	{
@@ -48,29 +73,31 @@ void do_showlogo(void)
 		list_for_each_entry_safe(pos, n, &__device_head[DEVICE_TYPE_FRAMEBUFFER], head)
 		{
 			if((fb = (struct framebuffer_t *)(pos->priv)))
-			{
-				cs = cairo_xboot_surface_create(fb, fb->alone);
-				cr = cairo_create(cs);
-
-				cairo_save(cr);
-				cairo_set_source_rgb(cr, 0.2, 0.6, 0.8);
-				cairo_paint(cr);
-				cairo_restore(cr);
-
-				x = (cairo_image_surface_get_width(cs) - cairo_image_surface_get_width(logo)) / 2;
-				y = (cairo_image_surface_get_height(cs) - cairo_image_surface_get_height(logo)) / 2;
-				cairo_set_source_surface(cr, logo, x, y);
-				cairo_paint(cr);
-
-				cairo_destroy(cr);
-				cairo_xboot_surface_present(cs);
-				cairo_surface_destroy(cs);
-
-				framebuffer_set_backlight(fb, CONFIG_MAX_BRIGHTNESS);
-			}
+				showlogo(fb, logo);
 		}
 		cairo_surface_destroy(logo);
 	}
+	__logo_shown = TRUE;
+}
+
+/*
+ * A framebuffer whose probe was deferred past do_showlogo() gets the logo
+ * once it registers
+ */
+void do_showlogo_device(struct device_t * dev)
+{
+	cairo_surface_t * logo;
+	struct framebuffer_t * fb;
+
+	if(!__logo_shown || !dev || (dev->type != DEVICE_TYPE_FRAMEBUFFER))
+		return;
+
+	if((fb = (struct framebuffer_t *)(dev->priv)))
+	{
+		logo = cairo_image_surface_create_from_png("/framework/assets/images/logo.png");
+		showlogo(fb, logo);
+		cairo_surface_destroy(logo);
+	}
 }
 
 static void __do_autoboot(void)
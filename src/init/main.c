@@ -34,27 +34,40 @@
 int xboot_main(int argc, char * argv[])
 {
 	struct runtime_t rt;
+	int id;
 
 	/* Do initial mem pool */
+	id = tracer_begin(TRACE_TYPE_BOOT, "init-mem-pool");
 	do_init_mem_pool();
+	tracer_end(id);
 
 	/* Do initial dma pool */
+	id = tracer_begin(TRACE_TYPE_BOOT, "init-dma-pool");
 	do_init_dma_pool();
+	tracer_end(id);
 
 	/* Do initial vfs */
+	id = tracer_begin(TRACE_TYPE_BOOT, "init-vfs");
 	do_init_vfs();
+	tracer_end(id);
 
 	/* Create runtime */
 	runtime_create_save(&rt, 0, 0);
 
 	/* Do all initial calls */
+	id = tracer_begin(TRACE_TYPE_BOOT, "initcalls");
 	do_initcalls();
+	tracer_end(id);
 
 	/* Do show logo */
+	id = tracer_begin(TRACE_TYPE_BOOT, "showlogo");
 	do_showlogo();
+	tracer_end(id);
 
 	/* Do auto boot */
+	id = tracer_begin(TRACE_TYPE_BOOT, "autoboot");
 	do_autoboot();
+	tracer_end(id);
 
 	/* Run loop */
 	while(1)
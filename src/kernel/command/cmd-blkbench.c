@@ -0,0 +1,280 @@
+/*
+ * kernel/command/cmd-blkbench.c
+ *
+ * Copyright(c) 2007-2018 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <shell/ctrlc.h>
+#include <block/block.h>
+#include <command/command.h>
+
+enum blkbench_pattern_t {
+	BLKBENCH_SEQREAD	= 0,
+	BLKBENCH_SEQWRITE	= 1,
+	BLKBENCH_RANDREAD	= 2,
+	BLKBENCH_RANDWRITE	= 3,
+	BLKBENCH_MAX		= 4,
+};
+
+static const char * pattern_name[BLKBENCH_MAX] = {
+	"seqread",
+	"seqwrite",
+	"randread",
+	"randwrite",
+};
+
+static void usage(void)
+{
+	printf("usage:\r\n");
+	printf("    blkbench <block> [-d] [-p pattern] [-s size[,size...]] [-t total]\r\n");
+	printf("    pattern: seqread, seqwrite, randread, randwrite or all\r\n");
+	printf("    -d bypass the buffer cache, write patterns keep device data unchanged\r\n");
+}
+
+static u64_t blkbench_number(const char * s, char ** e)
+{
+	u64_t n = strtoull(s, e, 0);
+
+	switch(**e)
+	{
+	case 'k':
+	case 'K':
+		n *= SZ_1K;
+		(*e)++;
+		break;
+	case 'm':
+	case 'M':
+		n *= SZ_1M;
+		(*e)++;
+		break;
+	default:
+		break;
+	}
+	return n;
+}
+
+static u64_t blkbench_io(struct block_t * blk, int direct, int write, u8_t * buf, u64_t offset, u64_t size)
+{
+	u64_t blkno, blkcnt;
+
+	if(!direct)
+		return write ? block_write(blk, buf, offset, size) : block_read(blk, buf, offset, size);
+
+	blkno = offset / block_size(blk);
+	blkcnt = size / block_size(blk);
+	if(write)
+		return blk->write(blk, buf, blkno, blkcnt) * block_size(blk);
+	return blk->read(blk, buf, blkno, blkcnt) * block_size(blk);
+}
+
+static int blkbench_cmp(const void * a, const void * b)
+{
+	u32_t x = *((const u32_t *)a);
+	u32_t y = *((const u32_t *)b);
+	return (x > y) - (x < y);
+}
+
+static int blkbench_run(struct block_t * blk, enum blkbench_pattern_t pattern, int direct, u8_t * buf, u32_t * lat, u64_t size, u64_t total)
+{
+	int write = (pattern == BLKBENCH_SEQWRITE) || (pattern == BLKBENCH_RANDWRITE);
+	int random = (pattern == BLKBENCH_RANDREAD) || (pattern == BLKBENCH_RANDWRITE);
+	u64_t slots = block_capacity(blk) / size;
+	u64_t count = total / size;
+	u64_t i, slot, offset, us = 0;
+	ktime_t t;
+
+	if(slots == 0)
+		return 0;
+	if(count == 0)
+		count = 1;
+
+	for(i = 0; i < count; i++)
+	{
+		if(ctrlc())
+			return -1;
+		if(random)
+			slot = (((u64_t)rand() << 31) | rand()) % slots;
+		else
+			slot = i % slots;
+		offset = slot * size;
+
+		if(write && (blkbench_io(blk, direct, 0, buf, offset, size) != size))
+			return -1;
+		t = ktime_get();
+		if(blkbench_io(blk, direct, write, buf, offset, size) != size)
+		{
+			printf("%s failed at offset 0x%llx\r\n", pattern_name[pattern], offset);
+			return -1;
+		}
+		lat[i] = ktime_us_delta(ktime_get(), t);
+		us += lat[i];
+	}
+	if(write && !direct)
+	{
+		t = ktime_get();
+		block_sync(blk);
+		us += ktime_us_delta(ktime_get(), t);
+	}
+	if(us == 0)
+		us = 1;
+
+	qsort(lat, count, sizeof(u32_t), blkbench_cmp);
+	printf("%-10s %8lld %10lld %8lld %8d %8d %8d %8d\r\n", pattern_name[pattern], size,
+		(count * size * 1000000ULL / us) / SZ_1K, count * 1000000ULL / us,
+		lat[count * 50 / 100], lat[count * 90 / 100], lat[count * 99 / 100], lat[count - 1]);
+	return 0;
+}
+
+static int do_blkbench(int argc, char ** argv)
+{
+	struct block_t * blk;
+	u64_t sizes[16] = { SZ_512, SZ_4K, SZ_64K };
+	int nsize = 3, direct = 0, pattern = -1;
+	u64_t total = SZ_4M, size, min, max = 0;
+	u8_t * buf;
+	u32_t * lat;
+	char * p, * e;
+	int i, j, ret = 0;
+
+	if(argc < 2)
+	{
+		usage();
+		return -1;
+	}
+
+	blk = search_block(argv[1]);
+	if(!blk)
+	{
+		printf("can't find block device '%s'\r\n", argv[1]);
+		return -1;
+	}
+
+	for(i = 2; i < argc; i++)
+	{
+		if(!strcmp(argv[i], "-d"))
+		{
+			direct = 1;
+		}
+		else if(!strcmp(argv[i], "-p") && (argc > i + 1))
+		{
+			pattern = -1;
+			for(j = 0; j < BLKBENCH_MAX; j++)
+			{
+				if(!strcmp(argv[i + 1], pattern_name[j]))
+					pattern = j;
+			}
+			if((pattern < 0) && strcmp(argv[i + 1], "all"))
+			{
+				usage();
+				return -1;
+			}
+			i++;
+		}
+		else if(!strcmp(argv[i], "-s") && (argc > i + 1))
+		{
+			nsize = 0;
+			p = argv[i + 1];
+			while(*p && (nsize < ARRAY_SIZE(sizes)))
+			{
+				size = blkbench_number(p, &e);
+				if(e == p)
+					break;
+				if(size > 0)
+					sizes[nsize++] = size;
+				p = (*e == ',') ? e + 1 : e;
+			}
+			i++;
+		}
+		else if(!strcmp(argv[i], "-t") && (argc > i + 1))
+		{
+			total = blkbench_number(argv[i + 1], &e);
+			i++;
+		}
+		else
+		{
+			usage();
+			return -1;
+		}
+	}
+	if(nsize == 0 || total == 0)
+	{
+		usage();
+		return -1;
+	}
+
+	min = ~0ULL;
+	for(i = 0; i < nsize; i++)
+	{
+		if(direct)
+			sizes[i] = (sizes[i] + block_size(blk) - 1) / block_size(blk) * block_size(blk);
+		if(sizes[i] > max)
+			max = sizes[i];
+		if(sizes[i] < min)
+			min = sizes[i];
+	}
+	buf = malloc(max);
+	lat = malloc(sizeof(u32_t) * (total / min + 1));
+	if(!buf || !lat)
+	{
+		free(buf);
+		free(lat);
+		return -1;
+	}
+
+	printf("%s: %lld bytes, block size %lld, %s\r\n", blk->name, block_capacity(blk), block_size(blk), direct ? "direct" : "cached");
+	printf("%-10s %8s %10s %8s %8s %8s %8s %8s\r\n", "pattern", "size", "KB/s", "IOPS", "p50(us)", "p90(us)", "p99(us)", "max(us)");
+	block_sync(blk);
+	for(j = 0; (j < BLKBENCH_MAX) && (ret == 0); j++)
+	{
+		if((pattern >= 0) && (pattern != j))
+			continue;
+		for(i = 0; (i < nsize) && (ret == 0); i++)
+			ret = blkbench_run(blk, j, direct, buf, lat, sizes[i], total);
+	}
+
+	free(buf);
+	free(lat);
+	return ret;
+}
+
+static struct command_t cmd_blkbench = {
+	.name	= "blkbench",
+	.desc	= "benchmark block device throughput and latency",
+	.usage	= usage,
+	.exec	= do_blkbench,
+};
+
+static __init void blkbench_cmd_init(void)
+{
+	register_command(&cmd_blkbench);
+}
+
+static __exit void blkbench_cmd_exit(void)
+{
+	unregister_command(&cmd_blkbench);
+}
+
+command_initcall(blkbench_cmd_init);
+command_exitcall(blkbench_cmd_exit);
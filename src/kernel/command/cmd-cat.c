@@ -68,7 +68,7 @@ static int cat_file(const char * filename)
 		return -1;
 	}
 
-	while((n = read(fd, buf, sizeof(buf))) > 0)
+	while((n = read(fd, buf, SZ_512K)) > 0)
 	{
 		for(i = 0; i < n; i++)
 			putchar(buf[i]);
@@ -28,60 +28,91 @@
 
 #include <command/command.h>
 
-#if	0
 static void usage(void)
 {
 	printf("usage:\r\n");
-	printf("    cp ...\r\n");
+	printf("    cp SOURCE DEST\r\n");
 }
 
 static int do_cp(int argc, char ** argv)
 {
-	//FIXME
-	/*
-	s8_t buf[128];
-	s32_t fd1, fd2;
-	s64_t done, wrote;
+	char path[MAX_PATH];
+	char * src, * dest, * p;
+	struct stat st1, st2;
+	int ifd, ofd;
+	loff_t n, l = 0;
+	ktime_t t;
+	u64_t us;
 
 	if(argc != 3)
 	{
-		printf("usage:\r\n    cp SOURCE DEST\r\n");
+		usage();
 		return -1;
 	}
 
-    if(access((const char *)argv[1], F_OK) != 0)
-    {
-    	printf("1\r\n");
-    }
+	src = (char *)argv[1];
+	dest = (char *)argv[2];
 
-    if(access((const char *)argv[2], F_OK) != 0)
-    {
-    	printf("2\r\n");
-    }
+	/* check if source exists and it's regular file. */
+	if(stat((const char *)src, &st1) != 0)
+	{
+		printf("cp: cannot access %s: No such file or directory\r\n", src);
+		return -1;
+	}
 
-    fd1 = open((const char *)argv[1], O_RDONLY);
-    if(fd1 < 0)
-    	printf("3\r\n");
+	if(!S_ISREG(st1.st_mode))
+	{
+		printf("cp: invalid file type\r\n");
+		return -1;
+	}
 
-    fd2 = open((const char *)argv[2], O_WRONLY|O_CREAT );
-    if( fd2 < 0 )
-    	printf("4\r\n");
+	/* check if target is a directory. */
+	if(!stat((const char *)dest, &st2) && S_ISDIR(st2.st_mode))
+	{
+		p = strrchr(src, '/');
+		p = p ? p + 1 : src;
+		strlcpy(path, dest, sizeof(path));
+		if(strcmp(dest, "/"))
+			strlcat(path, "/", sizeof(path));
+		strlcat(path, p, sizeof(path));
+		dest = path;
+	}
 
-    for(;;)
-    {
-        done = read( fd1, buf, 128);
+	if((ifd = open(src, O_RDONLY, (S_IRUSR|S_IRGRP|S_IROTH))) < 0)
+	{
+		printf("cp: cannot open %s\r\n", src);
+		return -1;
+	}
 
-        if( done == 0 ) break;
+	if((ofd = open(dest, (O_WRONLY|O_CREAT|O_TRUNC), (S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH|S_IWOTH))) < 0)
+	{
+		printf("cp: cannot create %s\r\n", dest);
+		close(ifd);
+		return -1;
+	}
+
+	t = ktime_get();
+	while(l < st1.st_size)
+	{
+		if((n = copy_range(ifd, NULL, ofd, NULL, st1.st_size - l)) <= 0)
+			break;
+		l += n;
+	}
+	us = ktime_us_delta(ktime_get(), t);
+	if(us == 0)
+		us = 1;
 
-        wrote = write( fd2, buf, done );
+	close(ifd);
+	close(ofd);
 
-        if( wrote != done )
-        	break;
-    }
+	if(l != st1.st_size)
+	{
+		printf("cp: failed to copy file %s to %s\r\n", src, dest);
+		return -1;
+	}
 
-    close( fd1 );
-    close( fd2 );
-*/
+	printf("copyed %s -> %s, %lld bytes, %lld.%06llds, %lld KB/s\r\n", src, dest, l,
+		us / 1000000, us % 1000000, (l * 1000000ULL / us) / SZ_1K);
 	return 0;
 }
 
@@ -104,5 +135,3 @@ static __exit void cp_cmd_exit(void)
 
 command_initcall(cp_cmd_init);
 command_exitcall(cp_cmd_exit);
-
-#endif
@@ -40,15 +40,75 @@ static void usage(void)
 	printf("    dcp <input@offset:size> <output@offset:size>\r\n");
 }
 
+static const void * dcp_map(enum devtype_t type, struct block_t * blk, int fd, u64_t off, u64_t size)
+{
+	const void * p = NULL;
+
+	switch(type)
+	{
+	case DEVTYPE_BLOCK:
+		return block_mmap(blk, off, size);
+	case DEVTYPE_FILE:
+		if((ioctl(fd, VFS_IOCTL_MMAP, &p) == 0) && p)
+			return (const u8_t *)p + off;
+		return NULL;
+	case DEVTYPE_MEM:
+		return (const void *)((virtual_addr_t)off);
+	default:
+		break;
+	}
+	return NULL;
+}
+
+static s64_t dcp_read(enum devtype_t type, struct block_t * blk, int fd, void * buf, u64_t off, u64_t size)
+{
+	switch(type)
+	{
+	case DEVTYPE_BLOCK:
+		return block_read(blk, (u8_t *)buf, off, size);
+	case DEVTYPE_FILE:
+		if(lseek(fd, off, VFS_SEEK_SET) != off)
+			return 0;
+		return read(fd, buf, size);
+	case DEVTYPE_MEM:
+		memcpy(buf, (void *)((virtual_addr_t)off), size);
+		return size;
+	default:
+		break;
+	}
+	return 0;
+}
+
+static s64_t dcp_write(enum devtype_t type, struct block_t * blk, int fd, const void * buf, u64_t off, u64_t size)
+{
+	switch(type)
+	{
+	case DEVTYPE_BLOCK:
+		return block_write(blk, (u8_t *)buf, off, size);
+	case DEVTYPE_FILE:
+		return write(fd, (void *)buf, size);
+	case DEVTYPE_MEM:
+		memcpy((void *)((virtual_addr_t)off), buf, size);
+		return size;
+	default:
+		break;
+	}
+	return 0;
+}
+
 static int do_dcp(int argc, char ** argv)
 {
 	enum devtype_t itype, otype;
 	struct block_t * iblk = NULL, * oblk = NULL;
-	int ifd, ofd;
+	int ifd = -1, ofd = -1;
 	char * iname, * oname;
 	u64_t ioff, isize;
 	u64_t ooff, osize;
 	s64_t n, s, l;
+	loff_t o1, o2;
+	ktime_t t;
+	u64_t us;
+	const void * m;
 	char * buf;
 	char * p, * offset, * size;
 
@@ -169,42 +229,45 @@ static int do_dcp(int argc, char ** argv)
 	if(itype == DEVTYPE_BLOCK)
 		block_sync(iblk);
 
-	while(l < s)
+	t = ktime_get();
+	if((itype == DEVTYPE_BLOCK) && (otype == DEVTYPE_BLOCK))
 	{
-		n = (s - l) < SZ_64K ? (s - l) : SZ_64K;
-
-		switch(itype)
+		l = block_copy(oblk, ooff, iblk, ioff, s);
+	}
+	else if((itype == DEVTYPE_FILE) && (otype == DEVTYPE_FILE))
+	{
+		o1 = ioff;
+		o2 = ooff;
+		while(l < s)
 		{
-		case DEVTYPE_BLOCK:
-			n = block_read(iblk, (u8_t *)buf, ioff + l, n);
-			break;
-		case DEVTYPE_FILE:
-			n = read(ifd, buf, n);
-			break;
-		case DEVTYPE_MEM:
-			memcpy(buf, (void *)((virtual_addr_t)(ioff + l)), n);
-			break;
-		default:
-			break;
+			if((n = copy_range(ifd, &o1, ofd, &o2, s - l)) <= 0)
+				break;
+			l += n;
 		}
-
-		switch(otype)
+	}
+	else if((m = dcp_map(itype, iblk, ifd, ioff, s)))
+	{
+		l = dcp_write(otype, oblk, ofd, m, ooff, s);
+	}
+	else if(otype == DEVTYPE_MEM)
+	{
+		l = dcp_read(itype, iblk, ifd, (void *)((virtual_addr_t)ooff), ioff, s);
+	}
+	else
+	{
+		while(l < s)
 		{
-		case DEVTYPE_BLOCK:
-			block_write(oblk, (u8_t *)buf, ooff + l, n);
-			break;
-		case DEVTYPE_FILE:
-			write(ofd, buf, n);
-			break;
-		case DEVTYPE_MEM:
-			memcpy((void *)((virtual_addr_t)(ooff + l)), buf, n);
-			break;
-		default:
-			break;
+			n = (s - l) < SZ_64K ? (s - l) : SZ_64K;
+			if((n = dcp_read(itype, iblk, ifd, buf, ioff + l, n)) <= 0)
+				break;
+			if((n = dcp_write(otype, oblk, ofd, buf, ooff + l, n)) <= 0)
+				break;
+			l += n;
 		}
-
-		l += n;
 	}
+	us = ktime_us_delta(ktime_get(), t);
+	if(us == 0)
+		us = 1;
 
 	if(itype == DEVTYPE_FILE)
 		close(ifd);
@@ -214,7 +277,8 @@ static int do_dcp(int argc, char ** argv)
 		block_sync(oblk);
 	free(buf);
 
-	printf("copyed %s@0x%llx:0x%llx -> %s@0x%llx:0x%llx\r\n", iname ? iname : "", ioff, s, oname ? oname : "", ooff, s);
+	printf("copyed %s@0x%llx:0x%llx -> %s@0x%llx:0x%llx, %lld.%06llds, %lld KB/s\r\n", iname ? iname : "", ioff, l, oname ? oname : "", ooff, l,
+		us / 1000000, us % 1000000, (l * 1000000ULL / us) / SZ_1K);
 	return 0;
 }
 
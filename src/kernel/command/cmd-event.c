@@ -93,6 +93,10 @@ static int do_event(int argc, char ** argv)
 				printf("[%s]: [TouchEnd] [%d][%d][%d]\r\n", input->name, e.e.touch_end.x, e.e.touch_end.y, e.e.touch_end.id);
 				break;
 
+			case EVENT_TYPE_AIO_COMPLETE:
+				printf("[aio]: [AioComplete] [%d][%d][%lld]\r\n", e.e.aio_complete.id, e.e.aio_complete.error, e.e.aio_complete.count);
+				break;
+
 			default:
 				printf("[%s]: [Unkown]\r\n", input->name);
 				break;
@@ -0,0 +1,108 @@
+/*
+ * kernel/command/cmd-trace.c
+ *
+ * Copyright(c) 2007-2018 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <command/command.h>
+
+static void usage(void)
+{
+	printf("usage:\r\n");
+	printf("    trace [-j] [file]\r\n");
+}
+
+static int do_trace(int argc, char ** argv)
+{
+	bool_t json = FALSE;
+	char * file = NULL;
+	char * buf;
+	int fd, size, len, i;
+
+	for(i = 1; i < argc; i++)
+	{
+		if(!strcmp(argv[i], "-j"))
+			json = TRUE;
+		else if(!file)
+			file = argv[i];
+		else
+		{
+			usage();
+			return -1;
+		}
+	}
+
+	/* running spans may grow a few digits between the two passes */
+	size = tracer_format(NULL, 0, json) + 256;
+	buf = malloc(size);
+	if(!buf)
+	{
+		printf("trace: Can not alloc memory\r\n");
+		return -1;
+	}
+	len = tracer_format(buf, size, json);
+	if(len >= size)
+		len = size - 1;
+
+	if(file)
+	{
+		fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, (S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH|S_IWOTH));
+		if(fd < 0)
+		{
+			printf("trace: Can not open '%s'\r\n", file);
+			free(buf);
+			return -1;
+		}
+		write(fd, buf, len);
+		close(fd);
+	}
+	else
+	{
+		for(i = 0; i < len; i++)
+			putchar(buf[i]);
+	}
+	free(buf);
+	return 0;
+}
+
+static struct command_t cmd_trace = {
+	.name	= "trace",
+	.desc	= "show boot time spans, as a table or chrome trace json",
+	.usage	= usage,
+	.exec	= do_trace,
+};
+
+static __init void trace_cmd_init(void)
+{
+	register_command(&cmd_trace);
+}
+
+static __exit void trace_cmd_exit(void)
+{
+	unregister_command(&cmd_trace);
+}
+
+command_initcall(trace_cmd_init);
+command_exitcall(trace_cmd_exit);
@@ -27,6 +27,7 @@
  */
 
 #include <xboot/driver.h>
+#include <init.h>
 
 static struct hlist_head __driver_hash[CONFIG_DRIVER_HASH_SIZE];
 static spinlock_t __driver_lock = SPIN_LOCK_INIT();
@@ -50,31 +51,482 @@ static struct kobj_t * search_class_driver_kobj(void)
 	return kobj_search_directory_with_create(kclass, "driver");
 }
 
-static ssize_t driver_write_probe(struct kobj_t * kobj, void * buf, size_t size)
+/*
+ * Probe pass over a dt object. Nodes are probed in file order, but a node
+ * waits for the nodes providing what it references, a clk, regulator or
+ * device name, or a gpio, interrupt or reset number inside their range.
+ * A driver may return PROBE_DEFER, the node is then retried once others
+ * made progress or its delay expired, independent nodes go on meanwhile.
+ * A graph left waiting only for delays is kept with its dt object and
+ * resumed by probe_schedule() from the event pump, nothing spins on it.
+ */
+enum probe_space_t {
+	PROBE_SPACE_NAME		= 0,
+	PROBE_SPACE_GPIO		= 1,
+	PROBE_SPACE_INTERRUPT	= 2,
+	PROBE_SPACE_RESET		= 3,
+};
+
+enum probe_state_t {
+	PROBE_STATE_PENDING		= 0,
+	PROBE_STATE_DONE		= 1,
+	PROBE_STATE_FAILED		= 2,
+};
+
+struct probe_node_t {
+	struct dtnode_t dt;
+	struct driver_t * drv;
+	enum probe_state_t state;
+	int * deps;
+	int ndeps;
+	int deferred;
+	int stage;
+	ktime_t expires;
+	ktime_t timeout;
+	ktime_t elapsed;
+};
+
+struct probe_provider_t {
+	enum probe_space_t space;
+	const char * name;
+	int base;
+	int count;
+	int node;
+	int next;
+};
+
+struct probe_graph_t {
+	struct list_head entry;
+	struct json_value_t * json;
+	ktime_t next;
+	int force;
+	struct probe_node_t * nodes;
+	int nnodes;
+	struct probe_provider_t * providers;
+	int nproviders;
+	int hash[CONFIG_DRIVER_HASH_SIZE];
+};
+
+static struct list_head __probe_list = {
+	.next = &__probe_list,
+	.prev = &__probe_list,
+};
+static struct probe_node_t * __probe_current = NULL;
+static int __probe_busy = 0;
+
+static unsigned int probe_hash(const char * name)
 {
-	struct driver_t * drv = (struct driver_t *)kobj->priv;
-	struct dtnode_t n;
-	struct json_value_t * v;
+	unsigned char * p = (unsigned char *)name;
+	unsigned int seed = 131;
+	unsigned int hash = 0;
+
+	while(*p)
+	{
+		hash = hash * seed + (*p++);
+	}
+	return hash % CONFIG_DRIVER_HASH_SIZE;
+}
+
+static enum probe_space_t probe_key_space(const char * key)
+{
+	int len = key ? strlen(key) : 0;
+
+	if((len >= 4) && !strcmp(&key[len - 4], "gpio"))
+		return PROBE_SPACE_GPIO;
+	if(((len >= 9) && !strcmp(&key[len - 9], "interrupt")) || ((len >= 3) && !strcmp(&key[len - 3], "irq")) || (key && !strcmp(key, "interrupt-parent")))
+		return PROBE_SPACE_INTERRUPT;
+	if((len >= 5) && !strcmp(&key[len - 5], "reset"))
+		return PROBE_SPACE_RESET;
+	return PROBE_SPACE_NAME;
+}
+
+static void probe_add_provider(struct probe_graph_t * g, enum probe_space_t space, const char * name, int base, int count, int node)
+{
+	struct probe_provider_t * p = &g->providers[g->nproviders++];
+
+	p->space = space;
+	p->name = name;
+	p->base = base;
+	p->count = count;
+	p->node = node;
+	p->next = -1;
+	if(space == PROBE_SPACE_NAME)
+	{
+		p->next = g->hash[probe_hash(name)];
+		g->hash[probe_hash(name)] = g->nproviders - 1;
+	}
+}
+
+static void probe_add_dep(struct probe_graph_t * g, int node, int dep)
+{
+	struct probe_node_t * n = &g->nodes[node];
+	int * deps;
+	int i;
+
+	if(node == dep)
+		return;
+	for(i = 0; i < n->ndeps; i++)
+	{
+		if(n->deps[i] == dep)
+			return;
+	}
+	if((n->ndeps & 0x7) == 0)
+	{
+		deps = realloc(n->deps, sizeof(int) * (n->ndeps + 8));
+		if(!deps)
+			return;
+		n->deps = deps;
+	}
+	n->deps[n->ndeps++] = dep;
+}
+
+static void probe_add_refs(struct probe_graph_t * g, int node, const char * key, struct json_value_t * v, int top)
+{
+	struct probe_provider_t * p;
+	enum probe_space_t space;
+	int i;
+
+	switch(v->type)
+	{
+	case JSON_OBJECT:
+		for(i = 0; i < v->u.object.length; i++)
+		{
+			if(top && !strcmp(v->u.object.values[i].name, "name"))
+				continue;
+			probe_add_refs(g, node, v->u.object.values[i].name, v->u.object.values[i].value, 0);
+		}
+		break;
+
+	case JSON_ARRAY:
+		for(i = 0; i < v->u.array.length; i++)
+			probe_add_refs(g, node, key, v->u.array.values[i], 0);
+		break;
+
+	case JSON_STRING:
+		for(i = g->hash[probe_hash(v->u.string.ptr)]; i >= 0; i = p->next)
+		{
+			p = &g->providers[i];
+			if(!strcmp(p->name, v->u.string.ptr))
+				probe_add_dep(g, node, p->node);
+		}
+		break;
+
+	case JSON_INTEGER:
+		space = probe_key_space(key);
+		if((space == PROBE_SPACE_NAME) || (v->u.integer < 0))
+			break;
+		for(i = 0; i < g->nproviders; i++)
+		{
+			p = &g->providers[i];
+			if((p->space == space) && (v->u.integer >= p->base) && (v->u.integer < p->base + p->count))
+				probe_add_dep(g, node, p->node);
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+static bool_t probe_build_graph(struct probe_graph_t * g, struct json_value_t * v, struct driver_t * drv)
+{
+	static const char * spaces[] = { "gpio", "interrupt", "reset" };
+	struct probe_node_t * n;
+	char buf[256];
 	char * p;
+	int base, i, j;
+
+	memset(g, 0, sizeof(struct probe_graph_t));
+	for(i = 0; i < ARRAY_SIZE(g->hash); i++)
+		g->hash[i] = -1;
+	g->nodes = malloc(sizeof(struct probe_node_t) * v->u.object.length);
+	g->providers = malloc(sizeof(struct probe_provider_t) * v->u.object.length * 5);
+	if(!g->nodes || !g->providers)
+		return FALSE;
+
+	for(i = 0; i < v->u.object.length; i++)
+	{
+		p = (char *)(v->u.object.values[i].name);
+		n = &g->nodes[g->nnodes];
+		n->dt.name = strsep(&p, "@");
+		n->dt.addr = p ? strtoull(p, NULL, 0) : 0;
+		n->dt.value = (struct json_value_t *)(v->u.object.values[i].value);
+		if(drv && strcmp(drv->name, n->dt.name))
+			continue;
+		n->drv = drv ? drv : search_driver(n->dt.name);
+		n->state = PROBE_STATE_PENDING;
+		n->deps = NULL;
+		n->ndeps = 0;
+		n->deferred = 0;
+		n->stage = 0;
+		n->expires = ktime_set(0, 0);
+		n->timeout = ktime_set(0, 0);
+		n->elapsed = ktime_set(0, 0);
+
+		if((p = dt_read_string(&n->dt, "name", NULL)))
+			probe_add_provider(g, PROBE_SPACE_NAME, p, 0, 0, g->nnodes);
+		/* the usual device name, a base of -1 marks the copy as owned */
+		snprintf(buf, sizeof(buf), "%s.%d", n->dt.name, dt_read_id(&n->dt));
+		if((p = strdup(buf)))
+			probe_add_provider(g, PROBE_SPACE_NAME, p, -1, 0, g->nnodes);
+		for(j = 0; j < ARRAY_SIZE(spaces); j++)
+		{
+			snprintf(buf, sizeof(buf), "%s-base", spaces[j]);
+			if((base = dt_read_int(&n->dt, buf, -1)) >= 0)
+			{
+				snprintf(buf, sizeof(buf), "%s-count", spaces[j]);
+				probe_add_provider(g, PROBE_SPACE_GPIO + j, NULL, base, dt_read_int(&n->dt, buf, 0), g->nnodes);
+			}
+		}
+		g->nnodes++;
+	}
+
+	for(i = 0; i < g->nnodes; i++)
+	{
+		if(g->nodes[i].dt.value)
+			probe_add_refs(g, i, NULL, g->nodes[i].dt.value, 1);
+	}
+	return TRUE;
+}
+
+static void probe_free_graph(struct probe_graph_t * g)
+{
 	int i;
 
-	if(buf && (size > 0))
+	for(i = 0; i < g->nproviders; i++)
 	{
-		v = json_parse(buf, size, 0);
-		if(v && (v->type == JSON_OBJECT))
+		if(g->providers[i].base < 0)
+			free((void *)g->providers[i].name);
+	}
+	for(i = 0; i < g->nnodes; i++)
+		free(g->nodes[i].deps);
+	free(g->providers);
+	free(g->nodes);
+	json_free(g->json);
+	free(g);
+}
+
+/*
+ * Undo the earlier stages of a node that is given up on
+ */
+static void probe_cancel(struct probe_node_t * n)
+{
+	if(n->drv && n->drv->cancel && (n->stage > 0))
+	{
+		__probe_current = n;
+		n->drv->cancel(n->drv, &n->dt);
+		__probe_current = NULL;
+	}
+}
+
+static int probe_node(struct probe_node_t * n)
+{
+	struct device_t * dev;
+	ktime_t begin, now;
+	int id;
+
+	if(!n->drv)
+	{
+		LOG("Fail to probe device with %s", n->dt.name);
+		n->state = PROBE_STATE_FAILED;
+		return 1;
+	}
+
+	id = tracer_begin(TRACE_TYPE_PROBE, "%s@0x%llx", n->dt.name, (unsigned long long)n->dt.addr);
+	begin = ktime_get();
+	n->expires = begin;
+	__probe_current = n;
+	dev = n->drv->probe(n->drv, &n->dt);
+	__probe_current = NULL;
+	tracer_end(id);
+	now = ktime_get();
+	n->elapsed = ktime_add(n->elapsed, ktime_sub(now, begin));
+
+	if(dev == PROBE_DEFER)
+	{
+		if(!n->deferred)
+		{
+			n->deferred = 1;
+			n->timeout = ktime_add_ms(begin, CONFIG_DRIVER_PROBE_TIMEOUT);
+		}
+		if(ktime_before(n->timeout, now))
+		{
+			LOG("Fail to probe device with %s, timed out", n->drv->name);
+			probe_cancel(n);
+			n->state = PROBE_STATE_FAILED;
+			return 1;
+		}
+		return 0;
+	}
+	else if(dev)
+	{
+		LOG("Probe device '%s' with %s (%lld us)", dev->name, n->drv->name, ktime_to_us(n->elapsed));
+		n->state = PROBE_STATE_DONE;
+		if(n->deferred)
+			do_showlogo_device(dev);
+	}
+	else
+	{
+		LOG("Fail to probe device with %s (%lld us)", n->drv->name, ktime_to_us(n->elapsed));
+		n->state = PROBE_STATE_FAILED;
+	}
+	return 1;
+}
+
+/*
+ * Probe until every node is settled, or nothing but delayed nodes is left,
+ * then return FALSE with the nearest expiry in g->next.
+ */
+static bool_t probe_run(struct probe_graph_t * g)
+{
+	struct probe_node_t * n;
+	ktime_t now;
+	int pending, progress, waiting;
+	int i, j;
+
+	do {
+		now = ktime_get();
+		pending = 0;
+		waiting = 0;
+		progress = 0;
+
+		for(i = 0; i < g->nnodes; i++)
 		{
-			for(i = 0; i < v->u.object.length; i++)
+			n = &g->nodes[i];
+			if(n->state != PROBE_STATE_PENDING)
+				continue;
+			for(j = 0; !g->force && (j < n->ndeps); j++)
+			{
+				if(g->nodes[n->deps[j]].state == PROBE_STATE_PENDING)
+					break;
+			}
+			if(!g->force && (j < n->ndeps))
+			{
+				pending++;
+				continue;
+			}
+			if(!ktime_after(n->expires, now) && probe_node(n))
 			{
-				p = (char *)(v->u.object.values[i].name);
-				n.name = strsep(&p, "@");
-				n.addr = p ? strtoull(p, NULL, 0) : 0;
-				n.value = (struct json_value_t *)(v->u.object.values[i].value);
+				progress++;
+				continue;
+			}
+			if(ktime_after(n->expires, ktime_get()))
+			{
+				if(!waiting || ktime_before(n->expires, g->next))
+					g->next = n->expires;
+				waiting++;
+			}
+			pending++;
+		}
+
+		if(progress)
+			g->force = 0;
+		else if(pending > 0)
+		{
+			/*
+			 * nothing moved, come back for the nearest delayed node, or else
+			 * ignore the graph once, in case a reference is not a dependency
+			 */
+			if(waiting)
+				return FALSE;
+			else if(!g->force)
+				g->force = 1;
+			else
+				break;
+		}
+	} while(pending > 0);
+
+	return TRUE;
+}
+
+static void probe_finish(struct probe_graph_t * g)
+{
+	struct probe_node_t * n;
+	ktime_t total;
+	int i, j, count;
+
+	for(i = 0; i < g->nnodes; i++)
+	{
+		n = &g->nodes[i];
+		if(n->state == PROBE_STATE_PENDING)
+		{
+			LOG("Fail to probe device with %s, dependency not ready", n->dt.name);
+			probe_cancel(n);
+		}
+	}
 
-				if(strcmp(drv->name, n.name) == 0)
-					drv->probe(drv, &n);
+	/*
+	 * per driver probe time, including deferred attempts
+	 */
+	for(i = 0; i < g->nnodes; i++)
+	{
+		if(!g->nodes[i].drv)
+			continue;
+		for(j = 0; j < i; j++)
+		{
+			if(g->nodes[j].drv == g->nodes[i].drv)
+				break;
+		}
+		if(j < i)
+			continue;
+		total = ktime_set(0, 0);
+		for(j = i, count = 0; j < g->nnodes; j++)
+		{
+			if(g->nodes[j].drv == g->nodes[i].drv)
+			{
+				total = ktime_add(total, g->nodes[j].elapsed);
+				count++;
 			}
 		}
+		LOG("Driver %s probed %d node(s) in %lld us", g->nodes[i].drv->name, count, ktime_to_us(total));
+	}
+
+	probe_free_graph(g);
+}
+
+/*
+ * Takes over the dt object, which is freed once all its nodes are settled
+ */
+static void probe_object(struct json_value_t * v, struct driver_t * drv)
+{
+	struct probe_graph_t * g;
+
+	g = malloc(sizeof(struct probe_graph_t));
+	if(!g)
+	{
+		json_free(v);
+		return;
+	}
+	if(!probe_build_graph(g, v, drv))
+	{
+		free(g->providers);
+		free(g->nodes);
+		free(g);
 		json_free(v);
+		return;
+	}
+	g->json = v;
+
+	__probe_busy++;
+	if(probe_run(g))
+		probe_finish(g);
+	else
+		list_add_tail(&g->entry, &__probe_list);
+	__probe_busy--;
+}
+
+static ssize_t driver_write_probe(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct driver_t * drv = (struct driver_t *)kobj->priv;
+	struct json_value_t * v;
+
+	if(buf && (size > 0))
+	{
+		v = json_parse(buf, size, 0);
+		if(v && (v->type == JSON_OBJECT))
+			probe_object(v, drv);
+		else
+			json_free(v);
 	}
 	return size;
 }
@@ -141,35 +593,56 @@ bool_t unregister_driver(struct driver_t * drv)
 	return TRUE;
 }
 
+struct device_t * probe_defer(int ms)
+{
+	if(__probe_current && (ms > 0))
+	{
+		__probe_current->expires = ktime_add_ms(ktime_get(), ms);
+		__probe_current->stage++;
+	}
+	return PROBE_DEFER;
+}
+
+int probe_stage(void)
+{
+	return __probe_current ? __probe_current->stage : 0;
+}
+
+void probe_schedule(void)
+{
+	struct probe_graph_t * pos, * n;
+	ktime_t now;
+
+	if(__probe_busy || list_empty(&__probe_list))
+		return;
+	__probe_busy++;
+
+	now = ktime_get();
+	list_for_each_entry_safe(pos, n, &__probe_list, entry)
+	{
+		if(ktime_after(pos->next, now))
+			continue;
+		if(probe_run(pos))
+		{
+			list_del(&pos->entry);
+			probe_finish(pos);
+		}
+	}
+
+	__probe_busy--;
+}
+
 void probe_device(const char * json, int length)
 {
-	struct driver_t * drv;
-	struct device_t * dev;
-	struct dtnode_t n;
 	struct json_value_t * v;
-	char * p;
-	int i;
 
 	if(json && (length > 0))
 	{
 		v = json_parse(json, length, 0);
 		if(v && (v->type == JSON_OBJECT))
-		{
-			for(i = 0; i < v->u.object.length; i++)
-			{
-				p = (char *)(v->u.object.values[i].name);
-				n.name = strsep(&p, "@");
-				n.addr = p ? strtoull(p, NULL, 0) : 0;
-				n.value = (struct json_value_t *)(v->u.object.values[i].value);
-
-				drv = search_driver(n.name);
-				if(drv && (dev = drv->probe(drv, &n)))
-					LOG("Probe device '%s' with %s", dev->name, drv->name);
-				else
-					LOG("Fail to probe device with %s", n.name);
-			}
-		}
-		json_free(v);
+			probe_object(v, NULL);
+		else
+			json_free(v);
 	}
 }
 
@@ -29,6 +29,7 @@
 #include <fifo.h>
 #include <spinlock.h>
 #include <xboot/event.h>
+#include <fs/aio.h>
 
 static struct event_base_t __event_base = {
 	.entry = {
@@ -283,6 +284,18 @@ void push_event_joystick_button_up(void * device, u32_t button)
 	push_event(&event);
 }
 
+void push_event_aio_complete(void * device, u32_t id, s32_t error, s64_t count)
+{
+	struct event_t event;
+
+	event.device = device;
+	event.type = EVENT_TYPE_AIO_COMPLETE;
+	event.e.aio_complete.id = id;
+	event.e.aio_complete.error = error;
+	event.e.aio_complete.count = count;
+	push_event(&event);
+}
+
 bool_t pump_event(struct event_base_t * eb, struct event_t * event)
 {
 	irq_flags_t flags;
@@ -291,6 +304,12 @@ bool_t pump_event(struct event_base_t * eb, struct event_t * event)
 	if(!eb || !event)
 		return FALSE;
 
+	/* move pending file i/o one chunk forward */
+	aio_schedule();
+
+	/* resume deferred probes whose delay expired */
+	probe_schedule();
+
 	spin_lock_irqsave(&__event_base_lock, flags);
 	ret = (fifo_get(eb->fifo, (u8_t *)event, sizeof(struct event_t)) == sizeof(struct event_t));
 	spin_unlock_irqrestore(&__event_base_lock, flags);
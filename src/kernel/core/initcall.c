@@ -37,11 +37,14 @@ extern exitcall_t __exitcall_end[];
 void do_initcalls(void)
 {
 	initcall_t * call;
+	int id;
 
 	call =  &(*__initcall_start);
 	while(call < &(*__initcall_end))
 	{
+		id = tracer_begin(TRACE_TYPE_INITCALL, "%p", *call);
 		(*call)();
+		tracer_end(id);
 		call++;
 	}
 }
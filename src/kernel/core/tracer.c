@@ -0,0 +1,179 @@
+/*
+ * kernel/core/tracer.c
+ *
+ * Copyright(c) 2007-2018 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <xboot.h>
+#include <xboot/tracer.h>
+
+/*
+ * Boot spans kept in a static ring, usable before the heap is up. An id is
+ * the sequence number of the span, the oldest spans are overwritten once
+ * the ring is full and ending an overwritten span does nothing.
+ */
+static struct trace_span_t __tracer_span[CONFIG_TRACER_SPAN_COUNT];
+static int __tracer_seq = 0;
+static spinlock_t __tracer_lock = SPIN_LOCK_INIT();
+
+static const char * __tracer_type[] = {
+	[TRACE_TYPE_BOOT]		= "boot",
+	[TRACE_TYPE_INITCALL]	= "initcall",
+	[TRACE_TYPE_PROBE]		= "probe",
+	[TRACE_TYPE_MOUNT]		= "mount",
+	[TRACE_TYPE_LUA]		= "lua",
+};
+
+int tracer_begin(enum trace_type_t type, const char * fmt, ...)
+{
+	struct trace_span_t * s;
+	irq_flags_t flags;
+	va_list ap;
+	int id;
+
+	spin_lock_irqsave(&__tracer_lock, flags);
+	id = __tracer_seq++;
+	s = &__tracer_span[id % CONFIG_TRACER_SPAN_COUNT];
+	s->type = type;
+	s->id = id;
+	s->end = 0;
+	va_start(ap, fmt);
+	vsnprintf(s->name, sizeof(s->name), fmt, ap);
+	va_end(ap);
+	s->begin = ktime_to_ns(ktime_get());
+	spin_unlock_irqrestore(&__tracer_lock, flags);
+
+	return id;
+}
+
+void tracer_end(int id)
+{
+	struct trace_span_t * s;
+	irq_flags_t flags;
+	uint64_t now;
+
+	if(id < 0)
+		return;
+	now = ktime_to_ns(ktime_get());
+	spin_lock_irqsave(&__tracer_lock, flags);
+	s = &__tracer_span[id % CONFIG_TRACER_SPAN_COUNT];
+	if((s->id == id) && (s->end == 0))
+		s->end = (now > s->begin) ? now : s->begin + 1;
+	spin_unlock_irqrestore(&__tracer_lock, flags);
+}
+
+static int tracer_escape(char * buf, size_t size, const char * s)
+{
+	int len = 0;
+
+	for(; *s; s++)
+	{
+		if((*s == '"') || (*s == '\\'))
+			len += snprintf(buf + len, (size > len) ? size - len : 0, "\\%c", *s);
+		else if((unsigned char)*s < 0x20)
+			len += snprintf(buf + len, (size > len) ? size - len : 0, "\\u%04x", *s);
+		else
+			len += snprintf(buf + len, (size > len) ? size - len : 0, "%c", *s);
+	}
+	return len;
+}
+
+/*
+ * Format the spans in time order, as a table or as chrome trace events
+ * for chrome://tracing. Spans still open are reported up to now. Returns
+ * the length of the whole output, which may exceed size.
+ */
+int tracer_format(char * buf, size_t size, bool_t json)
+{
+	struct trace_span_t * s;
+	uint64_t now = ktime_to_ns(ktime_get());
+	uint64_t end;
+	int first, i, n;
+	int len = 0;
+
+	first = (__tracer_seq > CONFIG_TRACER_SPAN_COUNT) ? __tracer_seq - CONFIG_TRACER_SPAN_COUNT : 0;
+	if(!buf)
+		size = 0;
+
+	if(json)
+		len += snprintf(buf + len, (size > len) ? size - len : 0, "{\"traceEvents\":[");
+	else
+	{
+		if(first > 0)
+			len += snprintf(buf + len, (size > len) ? size - len : 0, " %d spans dropped\r\n", first);
+		len += snprintf(buf + len, (size > len) ? size - len : 0, " %-9s %12s %12s  %s\r\n", "type", "begin(us)", "time(us)", "name");
+	}
+
+	for(i = first, n = 0; i < __tracer_seq; i++)
+	{
+		s = &__tracer_span[i % CONFIG_TRACER_SPAN_COUNT];
+		if(s->id != i)
+			continue;
+		end = s->end ? s->end : now;
+		if(json)
+		{
+			len += snprintf(buf + len, (size > len) ? size - len : 0, "%s{\"name\":\"", n++ ? "," : "");
+			len += tracer_escape(buf + len, (size > len) ? size - len : 0, s->name);
+			len += snprintf(buf + len, (size > len) ? size - len : 0, "\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%llu.%03llu,\"dur\":%llu.%03llu,\"pid\":0,\"tid\":0}",
+				__tracer_type[s->type],
+				(unsigned long long)(s->begin / 1000), (unsigned long long)(s->begin % 1000),
+				(unsigned long long)((end - s->begin) / 1000), (unsigned long long)((end - s->begin) % 1000));
+		}
+		else
+		{
+			len += snprintf(buf + len, (size > len) ? size - len : 0, " %-9s %12llu %12llu  %s%s\r\n",
+				__tracer_type[s->type],
+				(unsigned long long)(s->begin / 1000),
+				(unsigned long long)((end - s->begin) / 1000),
+				s->name, s->end ? "" : " (running)");
+		}
+	}
+
+	if(json)
+		len += snprintf(buf + len, (size > len) ? size - len : 0, "],\"displayTimeUnit\":\"ms\"}\r\n");
+	return len;
+}
+
+static ssize_t tracer_read_table(struct kobj_t * kobj, void * buf, size_t size)
+{
+	int len = tracer_format(buf, size, FALSE);
+	return (len < size) ? len : size;
+}
+
+static ssize_t tracer_read_json(struct kobj_t * kobj, void * buf, size_t size)
+{
+	int len = tracer_format(buf, size, TRUE);
+	return (len < size) ? len : size;
+}
+
+static __init void tracer_pure_init(void)
+{
+	struct kobj_t * kclass = kobj_search_directory_with_create(kobj_get_root(), "class");
+	struct kobj_t * kobj = kobj_search_directory_with_create(kclass, "tracer");
+
+	kobj_add_regular(kobj, "table", tracer_read_table, NULL, NULL);
+	kobj_add_regular(kobj, "json", tracer_read_json, NULL, NULL);
+}
+pure_initcall(tracer_pure_init);
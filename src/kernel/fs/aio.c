@@ -0,0 +1,153 @@
+/*
+ * kernel/fs/aio.c
+ *
+ * Copyright(c) 2007-2018 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <xboot.h>
+#include <errno.h>
+#include <xboot/event.h>
+#include <fs/aio.h>
+
+/*
+ * pending requests, served in order of submission. each call of
+ * aio_schedule() moves one chunk, so the caller's loop keeps running
+ * while storage is busy.
+ */
+static LIST_HEAD(__aio_list);
+static u32_t __aio_id = 0;
+static int __aio_busy = 0;
+
+struct aio_t * aio_submit(enum aio_type_t type, int fd, void * buf, loff_t offset, loff_t size, void (*complete)(struct aio_t *, void *), void * data)
+{
+	struct aio_t * aio;
+
+	if((fd < 0) || (size < 0))
+		return NULL;
+	if((type != AIO_TYPE_FSYNC) && !buf)
+		return NULL;
+
+	aio = malloc(sizeof(struct aio_t));
+	if(!aio)
+		return NULL;
+
+	if(++__aio_id == 0)
+		__aio_id = 1;
+	aio->id = __aio_id;
+	aio->type = type;
+	aio->fd = fd;
+	aio->buf = buf;
+	aio->offset = offset;
+	aio->size = size;
+	aio->count = 0;
+	aio->error = 0;
+	aio->complete = complete;
+	aio->data = data;
+	list_add_tail(&aio->entry, &__aio_list);
+
+	return aio;
+}
+
+bool_t aio_cancel(struct aio_t * aio)
+{
+	struct aio_t * pos, * n;
+
+	list_for_each_entry_safe(pos, n, &__aio_list, entry)
+	{
+		if(pos == aio)
+		{
+			list_del(&pos->entry);
+			free(pos);
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+bool_t aio_pending(void)
+{
+	return list_empty(&__aio_list) ? FALSE : TRUE;
+}
+
+static int aio_step(struct aio_t * aio)
+{
+	struct file_t * fp;
+	loff_t n, org, bytes;
+	int err;
+
+	if((fp = get_fp(aio->fd)) == NULL)
+		return EBADF;
+
+	if(aio->type == AIO_TYPE_FSYNC)
+		return sys_fsync(fp);
+
+	n = aio->size - aio->count;
+	if(n > CONFIG_AIO_CHUNK_SIZE)
+		n = CONFIG_AIO_CHUNK_SIZE;
+	if(n <= 0)
+		return 0;
+
+	/*
+	 * a negative offset means the current file position
+	 */
+	if((aio->offset >= 0) && ((err = sys_lseek(fp, aio->offset + aio->count, VFS_SEEK_SET, &org)) != 0))
+		return err;
+
+	if(aio->type == AIO_TYPE_READ)
+		err = sys_read(fp, (u8_t *)aio->buf + aio->count, n, &bytes);
+	else
+		err = sys_write(fp, (u8_t *)aio->buf + aio->count, n, &bytes);
+	if(err != 0)
+		return err;
+
+	aio->count += bytes;
+	if(bytes != n)
+		return 0;
+
+	return (aio->count < aio->size) ? EAGAIN : 0;
+}
+
+void aio_schedule(void)
+{
+	struct aio_t * aio;
+	int err;
+
+	if(__aio_busy || list_empty(&__aio_list))
+		return;
+	__aio_busy = 1;
+
+	aio = list_first_entry(&__aio_list, struct aio_t, entry);
+	if((err = aio_step(aio)) != EAGAIN)
+	{
+		list_del(&aio->entry);
+		aio->error = err;
+		if(aio->complete)
+			aio->complete(aio, aio->data);
+		push_event_aio_complete(NULL, aio->id, aio->error, aio->count);
+		free(aio);
+	}
+
+	__aio_busy = 0;
+}
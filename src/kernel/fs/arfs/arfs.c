@@ -144,7 +144,7 @@ static s32_t arfs_read(struct vnode_t * node, struct file_t * fp, void * buf, lo
 		size = node->v_size - fp->f_offset;
 
 	off = (loff_t)((s32_t)(node->v_data));
-	len = block_read(dev, (u8_t *)buf, (off + fp->f_offset), size);
+	len = block_read_ahead(dev, &fp->f_ra, (u8_t *)buf, (off + fp->f_offset), size);
 
 	fp->f_offset += len;
 	*result = len;
@@ -219,7 +219,7 @@ static s32_t cpiofs_read(struct vnode_t * node, struct file_t * fp, void * buf,
 		size = node->v_size - fp->f_offset;
 
 	off = (loff_t)((s32_t)(node->v_data));
-	len = block_read(dev, (u8_t *)buf, (off + fp->f_offset), size);
+	len = block_read_ahead(dev, &fp->f_ra, (u8_t *)buf, (off + fp->f_offset), size);
 
 	fp->f_offset += len;
 	*result = len;
@@ -227,6 +227,47 @@ static s32_t cpiofs_read(struct vnode_t * node, struct file_t * fp, void * buf,
 	return 0;
 }
 
+/*
+ * segments are read as one batch, so the block layer can merge them into
+ * a single transfer straight into caller buffers.
+ */
+static s32_t cpiofs_readv(struct vnode_t * node, struct file_t * fp, const struct iovec * iov, int iovcnt, loff_t * result)
+{
+	struct block_t * dev = (struct block_t *)node->v_mount->m_dev;
+	struct block_segment_t seg[8];
+	loff_t off, size, len;
+	int i;
+
+	*result = 0;
+	if(node->v_type == VDIR)
+		return EISDIR;
+	if(node->v_type != VREG)
+		return EINVAL;
+
+	off = (loff_t)((s32_t)(node->v_data));
+	while((iovcnt > 0) && (fp->f_offset < node->v_size))
+	{
+		for(i = 0, size = 0; (i < ARRAY_SIZE(seg)) && (iovcnt > 0) && (fp->f_offset + size < node->v_size); i++, iov++, iovcnt--)
+		{
+			len = iov->iov_len;
+			if(node->v_size - fp->f_offset - size < len)
+				len = node->v_size - fp->f_offset - size;
+			seg[i].buf = (u8_t *)iov->iov_base;
+			seg[i].offset = off + fp->f_offset + size;
+			seg[i].count = len;
+			size += len;
+		}
+
+		len = block_read_batch(dev, &fp->f_ra, seg, i);
+		fp->f_offset += len;
+		*result += len;
+		if(len != size)
+			break;
+	}
+
+	return 0;
+}
+
 static s32_t cpiofs_write(struct vnode_t * node , struct file_t * fp, void * buf, loff_t size, loff_t * result)
 {
 	return -1;
@@ -242,6 +283,24 @@ static s32_t cpiofs_seek(struct vnode_t * node, struct file_t * fp, loff_t off1,
 
 static s32_t cpiofs_ioctl(struct vnode_t * node, struct file_t * fp, int cmd, void * arg)
 {
+	struct block_t * dev = (struct block_t *)node->v_mount->m_dev;
+	const void * addr;
+
+	switch(cmd)
+	{
+	case VFS_IOCTL_MMAP:
+		if(node->v_type != VREG)
+			return EINVAL;
+		addr = block_mmap(dev, (loff_t)((s32_t)(node->v_data)), node->v_size);
+		if(!addr)
+			return ENOSYS;
+		*((const void **)arg) = addr;
+		return 0;
+
+	default:
+		break;
+	}
+
 	return -1;
 }
 
@@ -472,6 +531,7 @@ static struct vnops_t cpiofs_vnops = {
 	.vop_setattr	= cpiofs_setattr,
 	.vop_inactive	= cpiofs_inactive,
 	.vop_truncate	= cpiofs_truncate,
+	.vop_readv		= cpiofs_readv,
 };
 
 /*
@@ -2,8 +2,8 @@
  * kernel/fs/fatfs/fatfs.c
  *
  * Copyright(c) 2007-2018 Jianjun Jiang <8192542@qq.com>
- * Official site: http://xboot.org
- * Mobile phone: +86-18665388956
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
  * QQ: 8192542
  *
  * Permission is hereby granted, free of charge, to any person obtaining a copy
@@ -31,13 +31,13 @@
 #include <ctype.h>
 #include <stdarg.h>
 #include <malloc.h>
+#include <errno.h>
+#include <log2.h>
 #include <xboot/initcall.h>
 #include <block/block.h>
-#include <xboot/device.h>
 #include <fs/vfs/vfs.h>
 #include <fs/fs.h>
 
-#if 0
 /*
  * fat attribute
  */
@@ -48,9 +48,17 @@
 #define FAT_ATTR_SUBDIR			(0x10)
 #define FAT_ATTR_ARCH			(0x20)
 #define FFAT_ATTR_DEVICE		(0x40)
+#define FAT_ATTR_LFN			(0x0f)
+
+/*
+ * fat name case flags
+ */
+#define FAT_CASE_LOWER_BASE		(0x08)
+#define FAT_CASE_LOWER_EXT		(0x10)
 
 #define IS_DIR(de)				(((de)->attr) & FAT_ATTR_SUBDIR)
 #define IS_VOL(de)				(((de)->attr) & FAT_ATTR_VOLID)
+#define IS_LFN(de)				((((de)->attr) & 0x3f) == FAT_ATTR_LFN)
 #define IS_FILE(de)				(!IS_DIR(de) && !IS_VOL(de))
 #define IS_DELETED(de)  		((de)->name[0] == 0xe5)
 #define IS_EMPTY(de)    		((de)->name[0] == 0)
@@ -60,7 +68,7 @@
  */
 struct fat_boot_sector {
 	/*
-	 * jump instruction and oem name
+	 * jump instruction and oem name
 	 */
 	u8_t	jmp_instruction[3];
 	u8_t	oem_name[8];
@@ -82,7 +90,7 @@ struct fat_boot_sector {
 	u8_t	big_total_sectors[4];
 
 	/*
-	 * the last part of fat12, fat16 and fat32
+	 * the last part of fat12, fat16 and fat32
 	 */
 	union {
 		u8_t code[474];
@@ -130,7 +138,7 @@ struct fat_boot_sector {
 	} x;
 
 	/*
-	 * the signature 0x55, 0xaa
+	 * the signature 0x55, 0xaa
 	 */
 	u8_t	signature[2];
 } __attribute__ ((packed));
@@ -141,24 +149,100 @@ struct fat_boot_sector {
 struct fat_dirent {
 	u8_t	name[11];
 	u8_t	attr;
-	u8_t	reserve[10];
+	u8_t	ntres;
+	u8_t	reserve[7];
+	u8_t	cluster_hi[2];
 	u8_t	time[2];
 	u8_t	date[2];
 	u8_t	cluster[2];
 	u8_t	size[4];
 } __attribute__ ((packed));
 
+/*
+ * fat long file name entry
+ */
+struct fat_lfn_dirent {
+	u8_t	ord;
+	u8_t	name1[10];
+	u8_t	attr;
+	u8_t	type;
+	u8_t	chksum;
+	u8_t	name2[12];
+	u8_t	cluster[2];
+	u8_t	name3[4];
+} __attribute__ ((packed));
+
+#define FAT_LFN_LAST			(0x40)
+#define FAT_LFN_SLOTS			(20)
+#define FAT_LFN_MAX				(255)
+
+/*
+ * directory entry with long name assembled
+ */
+struct fat_entry {
+	struct fat_dirent	dirent;		/* copy of short entry */
+	u32_t				slot;		/* slot of short entry */
+	u32_t				nlfn;		/* number of long name slots before it */
+	u32_t				sector;		/* sector of short entry */
+	u32_t				offset;		/* offset of short entry in sector */
+	char				sname[13];	/* short name */
+	char				lname[FAT_LFN_MAX + 1];	/* long name in utf-8, empty for none */
+};
+
+/*
+ * name in directory hash index
+ */
+struct fat_index_entry {
+	struct hlist_node	node;		/* link to hash bucket */
+	u32_t				hash;		/* hash of name */
+	u32_t				slot;		/* slot of short entry */
+	u32_t				nlfn;		/* number of long name slots before it */
+	char *				name;		/* short or long name */
+	struct fat_index_entry *	alias;	/* the other name of the same slot, if any */
+};
+
+/*
+ * hash index of directory, keyed by the first cluster of directory
+ */
+struct fat_index {
+	struct list_head	entry;		/* link to index list, most recent first */
+	u32_t				cluster;	/* first cluster of directory, zero for fixed root */
+	u32_t				count;		/* number of names */
+	u32_t				size;		/* number of buckets, power of 2 */
+	u32_t				free;		/* first slot which may be free */
+	struct hlist_head *	hash;		/* hash buckets */
+};
+
+/*
+ * contiguous run of clusters in a cluster chain
+ */
+struct fat_extent {
+	u32_t	index;		/* cluster index in file */
+	u32_t	cluster;	/* first cluster on disk */
+	u32_t	count;		/* number of contiguous clusters */
+};
+
 /*
  * file / directory node
  */
 struct fat_node {
+	struct list_head	entry;		/* link to active node list */
 	struct fat_dirent	dirent;		/* copy of directory entry */
 	u32_t				sector;		/* sector for directory entry */
 	u32_t				offset;		/* offset of directory entry in sector */
+	u32_t				slot;		/* slot of directory entry in parent */
+	u32_t				nlfn;		/* number of long name slots before entry */
+	u32_t				cluster;	/* first cluster, zero for empty file or fixed root */
+	struct fat_extent *	extent;		/* cached extents of cluster chain */
+	u32_t				nextent;	/* number of cached extents */
+	u32_t				mextent;	/* allocated extent slots */
+	bool_t				mapped;		/* the whole chain has been cached */
+	bool_t				dirty;		/* directory entry need write back */
+	bool_t				root;		/* root directory without entry */
 };
 
 /*
- * fat filesystem type
+ * fat filesystem type
  */
 enum fat_type {
 	FAT_TYPE_FAT12,
@@ -167,7 +251,17 @@ enum fat_type {
 };
 
 /*
- * fatfs mount data
+ * cached window of fat table
+ */
+struct fat_cache {
+	u32_t	index;		/* window index in fat, 0xffffffff for unused */
+	u32_t	stamp;		/* last access stamp for lru */
+	bool_t	dirty;		/* window need write back */
+	u8_t *	buf;		/* window data */
+};
+
+/*
+ * fatfs mount data
  */
 struct fatfs_mount_data {
 	/* fat type */
@@ -185,9 +279,18 @@ struct fatfs_mount_data {
 	/* start sector for fat entries */
 	u32_t fat_start;
 
+	/* sectors per fat */
+	u32_t fat_sectors;
+
+	/* number of fats */
+	u32_t num_of_fats;
+
 	/* start sector for root directory */
 	u32_t root_start;
 
+	/* first cluster of root directory, fat32 only */
+	u32_t root_cluster;
+
 	/* start sector for data */
 	u32_t data_start;
 
@@ -197,348 +300,929 @@ struct fatfs_mount_data {
 	/* start cluster to free search */
 	u32_t free_scan;
 
+	/* bitmap of used clusters, built on first allocation */
+	u32_t * free_map;
+
+	/* number of free clusters, valid with bitmap */
+	u32_t free_count;
+
 	/* mask for cluster */
 	u32_t fat_mask;
 
 	/* id of end cluster */
 	u32_t fat_eof;
 
-	/* vnode for root */
-	struct vnode_t * root_vnode;
+	/* cached windows of fat table */
+	struct fat_cache fat_cache[CONFIG_FATFS_FAT_CACHE_COUNT];
 
-	/* local data buffer */
-	char * io_buf;
+	/* bytes per fat window */
+	u32_t fat_window;
+
+	/* access stamp of fat cache */
+	u32_t fat_stamp;
+
+	/* active nodes */
+	struct list_head nodes;
+
+	/* directory hash indexes */
+	struct list_head indexes;
+
+	/* number of directory hash indexes */
+	u32_t nindex;
 
-	/* buffer for fat entry */
-	char * fat_buf;
+	/* zero filled buffer of one cluster */
+	char * io_buf;
 
 	/* buffer for directory entry */
 	char * dir_buf;
 
+	/* sector in directory buffer */
+	u32_t dir_sector;
+
 	/* mounted block device */
-	struct blkdev_t * blk;
+	struct block_t * blk;
 };
 
-/*
- * filesystem operations
- */
-static s32_t fatfs_mount(struct mount_t * m, char * dev, s32_t flag)
+static inline u16_t fat_get16(u8_t * p)
 {
-	struct fatfs_mount_data * md;
-	struct blkdev_t * blk;
-	struct fat_boot_sector fbs;
-	u32_t sector_size;
-	u32_t tmp;
-
-	if(dev == NULL)
-		return EINVAL;
-
-	blk = (struct blkdev_t *)m->m_dev;
-	if(!blk || !blk->info)
-		return ENODEV;
+	return (p[1] << 8) | (p[0] << 0);
+}
 
-	if(get_blkdev_total_size(blk) <= sizeof(struct fat_boot_sector))
-		return EINTR;
+static inline u32_t fat_get32(u8_t * p)
+{
+	return (p[3] << 24) | (p[2] << 16) | (p[1] << 8) | (p[0] << 0);
+}
 
-	if(block_read(blk, (u8_t *)(&fbs), 0, sizeof(struct fat_boot_sector)) != sizeof(struct fat_boot_sector))
-		return EIO;
+static inline void fat_put16(u8_t * p, u16_t v)
+{
+	p[0] = (v >> 0) & 0xff;
+	p[1] = (v >> 8) & 0xff;
+}
 
-	/*
-	 * check both signature (0x55, 0xaa)
-	 */
-	if((fbs.signature[0] != 0x55) || fbs.signature[1] != 0xaa)
-		return EINVAL;
+static inline void fat_put32(u8_t * p, u32_t v)
+{
+	p[0] = (v >> 0) & 0xff;
+	p[1] = (v >> 8) & 0xff;
+	p[2] = (v >> 16) & 0xff;
+	p[3] = (v >> 24) & 0xff;
+}
 
-	/* the logical sector size (bytes 11-12) is a power of two, at least 512 */
-	sector_size = (fbs.bytes_per_sector[1] << 8) | fbs.bytes_per_sector[0];
-	if( (sector_size < 512) || (!is_power_of_2(sector_size)) )
-		return EINVAL;
+static inline bool_t fat_valid_cluster(struct fatfs_mount_data * md, u32_t cl)
+{
+	return ((cl >= 2) && (cl < md->last_cluster)) ? TRUE : FALSE;
+}
 
-	/* the cluster size (byte 13) is a power of two */
-	if(! is_power_of_2(fbs.sectors_per_cluster))
-		return EINVAL;
+static inline bool_t fat_eof_cluster(struct fatfs_mount_data * md, u32_t cl)
+{
+	return (cl >= (md->fat_mask & ~0x7)) ? TRUE : FALSE;
+}
 
-	/* the number of reserved sectors (bytes 14-15) is nonzero */
-	tmp = (fbs.reserved_sectors[1] << 8) | fbs.reserved_sectors[0];
-	if(tmp == 0)
-		return EINVAL;
+static inline u32_t fat_cluster_sector(struct fatfs_mount_data * md, u32_t cl)
+{
+	return md->data_start + (cl - 2) * md->sectors_per_cluster;
+}
 
-	/* the number of fats (byte 16) is nonzero */
-	if(fbs.num_of_fats == 0x00)
-		return EINVAL;
+static inline u64_t fat_cluster_offset(struct fatfs_mount_data * md, u32_t cl)
+{
+	return (u64_t)fat_cluster_sector(md, cl) * md->sector_size;
+}
 
-	/* the number of root directory entries (bytes 17-18) must be sector aligned */
-	tmp = (fbs.root_entries[1] << 8) | fbs.root_entries[0];
-	if(tmp % (sector_size / sizeof(struct fat_dirent)) != 0)
-		return EINVAL;
+/*
+ * fat table cache, written back to every fat copy on eviction and sync.
+ */
+static u32_t fat_cache_length(struct fatfs_mount_data * md, u32_t index)
+{
+	u32_t size = md->fat_sectors * md->sector_size;
+	u32_t off = index * md->fat_window;
 
-	/* the sector per track (byte 24-25) is nonzero */
-	tmp = (fbs.sectors_per_track[1] << 8) | fbs.sectors_per_track[0];
-	if(tmp == 0)
-		return EINVAL;
+	return (size - off < md->fat_window) ? (size - off) : md->fat_window;
+}
 
-	/* the number of heads (byte 26-27) is nonzero */
-	tmp = (fbs.num_of_heads[1] << 8) | fbs.num_of_heads[0];
-	if(tmp == 0)
-		return EINVAL;
+static s32_t fat_cache_writeback(struct fatfs_mount_data * md, struct fat_cache * c)
+{
+	u64_t off, len;
+	u32_t i;
 
-	md = malloc(sizeof(struct fatfs_mount_data));
-	if(!md)
-		return ENOMEM;
+	if(!c->dirty)
+		return 0;
 
-	/* determine the type of fat */
-	if( strncmp((const s8_t *)fbs.x.fat12.fs_type, (const s8_t *)"FAT12   ", 8) == 0 )
+	len = fat_cache_length(md, c->index);
+	for(i = 0; i < md->num_of_fats; i++)
 	{
-		md->type = FAT_TYPE_FAT12;
+		off = (u64_t)(md->fat_start + i * md->fat_sectors) * md->sector_size + (u64_t)c->index * md->fat_window;
+		if(block_write(md->blk, c->buf, off, len) != len)
+			return EIO;
 	}
-	else if( strncmp((const s8_t *)fbs.x.fat16.fs_type, (const s8_t *)"FAT16   ", 8) == 0 )
+	c->dirty = FALSE;
+
+	return 0;
+}
+
+static s32_t fat_cache_flush(struct fatfs_mount_data * md)
+{
+	s32_t i, err = 0;
+
+	for(i = 0; i < CONFIG_FATFS_FAT_CACHE_COUNT; i++)
 	{
-		md->type = FAT_TYPE_FAT16;
+		if(fat_cache_writeback(md, &md->fat_cache[i]) != 0)
+			err = EIO;
 	}
-	else if( strncmp((const s8_t *)fbs.x.fat32.fs_type, (const s8_t *)"FAT32   ", 8) == 0 )
+	return err;
+}
+
+static u8_t * fat_cache_get(struct fatfs_mount_data * md, u32_t offset, bool_t write)
+{
+	struct fat_cache * c, * lru = NULL;
+	u32_t index = offset / md->fat_window;
+	u64_t off, len;
+	s32_t i;
+
+	for(i = 0; i < CONFIG_FATFS_FAT_CACHE_COUNT; i++)
 	{
-		md->type = FAT_TYPE_FAT32;
+		c = &md->fat_cache[i];
+		if(c->index == index)
+			goto found;
+		if(!lru || (c->stamp < lru->stamp))
+			lru = c;
 	}
-	else
+
+	c = lru;
+	if(fat_cache_writeback(md, c) != 0)
+		return NULL;
+	if(!c->buf)
 	{
-		free(md);
-		return EINVAL;
+		c->buf = malloc(md->fat_window);
+		if(!c->buf)
+			return NULL;
 	}
+	c->index = 0xffffffff;
+	off = (u64_t)md->fat_start * md->sector_size + (u64_t)index * md->fat_window;
+	len = fat_cache_length(md, index);
+	if(block_read(md->blk, c->buf, off, len) != len)
+		return NULL;
+	c->index = index;
+
+found:
+	c->stamp = ++md->fat_stamp;
+	if(write)
+		c->dirty = TRUE;
+	return c->buf + (offset - index * md->fat_window);
+}
+
+/*
+ * read the fat entry for specified cluster.
+ */
+static s32_t fat_get_entry(struct fatfs_mount_data * md, u32_t cl, u32_t * val)
+{
+	u8_t * p;
+	u32_t v;
 
-	/* build mount data */
 	switch(md->type)
 	{
 	case FAT_TYPE_FAT12:
-		md->sector_size = sector_size;
-		md->sectors_per_cluster = fbs.sectors_per_cluster;
-		md->cluster_size = md->sectors_per_cluster * md->sector_size;
-		tmp = ((fbs.hidden_sectors[3] << 24) | (fbs.hidden_sectors[2] << 16) | (fbs.hidden_sectors[1] << 8) | (fbs.hidden_sectors[0] << 0));
-		md->fat_start = tmp + ((fbs.reserved_sectors[1] << 8) | (fbs.reserved_sectors[0] << 0));
-		md->root_start = md->fat_start + (fbs.num_of_fats * ((fbs.sectors_per_fat[1] << 8) | (fbs.sectors_per_fat[0] << 0)));
-		md->data_start = md->root_start + ( ((fbs.root_entries[1] << 8) | (fbs.root_entries[0] << 0)) / (sector_size / sizeof(struct fat_dirent)) );
-
-		tmp = ((fbs.total_sectors[1] << 8) | (fbs.total_sectors[0] << 0));
-		if(tmp == 0)
-			tmp = ((fbs.big_total_sectors[3] << 24) | (fbs.big_total_sectors[2] << 16) | (fbs.big_total_sectors[1] << 8) | (fbs.big_total_sectors[0] << 0));
-
-		if(tmp == 0)
-		{
-			free(md);
-			return EINVAL;
-		}
-
-		md->last_cluster = (tmp - md->data_start) / md->sectors_per_cluster + 2;
-		md->free_scan = 2;
-		md->fat_mask = 0x00000fff;
-		md->fat_eof = 0xffffffff & 0x00000fff;
+		if(!(p = fat_cache_get(md, cl + (cl >> 1), FALSE)))
+			return EIO;
+		v = (p[1] << 8) | (p[0] << 0);
+		v = (cl & 0x1) ? (v >> 4) : (v & 0xfff);
 		break;
 
 	case FAT_TYPE_FAT16:
-		md->sector_size = sector_size;
-		md->sectors_per_cluster = fbs.sectors_per_cluster;
-		md->cluster_size = md->sectors_per_cluster * md->sector_size;
-		tmp = ((fbs.hidden_sectors[3] << 24) | (fbs.hidden_sectors[2] << 16) | (fbs.hidden_sectors[1] << 8) | (fbs.hidden_sectors[0] << 0));
-		md->fat_start = tmp + ((fbs.reserved_sectors[1] << 8) | (fbs.reserved_sectors[0] << 0));
-		md->root_start = md->fat_start + (fbs.num_of_fats * ((fbs.sectors_per_fat[1] << 8) | (fbs.sectors_per_fat[0] << 0)));
-		md->data_start = md->root_start + ( ((fbs.root_entries[1] << 8) | (fbs.root_entries[0] << 0)) / (sector_size / sizeof(struct fat_dirent)) );
-
-		tmp = ((fbs.total_sectors[1] << 8) | (fbs.total_sectors[0] << 0));
-		if(tmp == 0)
-			tmp = ((fbs.big_total_sectors[3] << 24) | (fbs.big_total_sectors[2] << 16) | (fbs.big_total_sectors[1] << 8) | (fbs.big_total_sectors[0] << 0));
-
-		if(tmp == 0)
-		{
-			free(md);
-			return EINVAL;
-		}
-
-		md->last_cluster = (tmp - md->data_start) / md->sectors_per_cluster + 2;
-		md->free_scan = 2;
-		md->fat_mask = 0x0000ffff;
-		md->fat_eof = 0xffffffff & 0x0000ffff;
+		if(!(p = fat_cache_get(md, cl << 1, FALSE)))
+			return EIO;
+		v = fat_get16(p);
 		break;
 
 	case FAT_TYPE_FAT32:
-		md->sector_size = sector_size;
-		md->sectors_per_cluster = fbs.sectors_per_cluster;
-		md->cluster_size = md->sectors_per_cluster * md->sector_size;
-		tmp = ((fbs.hidden_sectors[3] << 24) | (fbs.hidden_sectors[2] << 16) | (fbs.hidden_sectors[1] << 8) | (fbs.hidden_sectors[0] << 0));
-		md->fat_start = tmp + ((fbs.reserved_sectors[1] << 8) | (fbs.reserved_sectors[0] << 0));
-		md->root_start = md->fat_start + (fbs.num_of_fats * ((fbs.x.fat32.sectors_per_fat_32[3] << 24) | (fbs.x.fat32.sectors_per_fat_32[2] << 16) | (fbs.x.fat32.sectors_per_fat_32[1] << 8) | (fbs.x.fat32.sectors_per_fat_32[0] << 0)));
-
-		md->data_start = md->root_start + 1;
-
+		if(!(p = fat_cache_get(md, cl << 2, FALSE)))
+			return EIO;
+		v = fat_get32(p) & 0x0fffffff;
 		break;
 
 	default:
-		free(md);
 		return EINVAL;
 	}
 
-	md->io_buf = malloc(md->cluster_size);
-	if(!md->io_buf)
-	{
-		free(md);
-		return ENOMEM;
-	}
-
-	md->fat_buf = malloc(md->sector_size * 2);
-	if(!md->fat_buf)
-	{
-		free(md->io_buf);
-		free(md);
-		return ENOMEM;
-	}
-
-	md->dir_buf = malloc(md->sector_size);
-	if(!md->dir_buf)
-	{
-		free(md->fat_buf);
-		free(md->io_buf);
-		free(md);
-		return ENOMEM;
-	}
+	*val = v;
+	return 0;
+}
 
-	md->blk = blk;
-	m->m_flags = flag & MOUNT_MASK;
-	m->m_data = md;
+/*
+ * write the fat entry for specified cluster.
+ */
+static s32_t fat_set_entry(struct fatfs_mount_data * md, u32_t cl, u32_t val)
+{
+	u8_t * p;
 
-	// for debug
 	switch(md->type)
 	{
 	case FAT_TYPE_FAT12:
+		if(!(p = fat_cache_get(md, cl + (cl >> 1), TRUE)))
+			return EIO;
+		if(cl & 0x1)
+		{
+			p[0] = (p[0] & 0x0f) | ((val << 4) & 0xf0);
+			p[1] = (val >> 4) & 0xff;
+		}
+		else
+		{
+			p[0] = val & 0xff;
+			p[1] = (p[1] & 0xf0) | ((val >> 8) & 0x0f);
+		}
 		break;
+
 	case FAT_TYPE_FAT16:
+		if(!(p = fat_cache_get(md, cl << 1, TRUE)))
+			return EIO;
+		fat_put16(p, val);
 		break;
+
 	case FAT_TYPE_FAT32:
+		if(!(p = fat_cache_get(md, cl << 2, TRUE)))
+			return EIO;
+		fat_put32(p, (fat_get32(p) & 0xf0000000) | (val & 0x0fffffff));
 		break;
+
 	default:
-		break;
+		return EINVAL;
 	}
 
-	LOG("sector size: %ld\r\n", md->sector_size);
-	LOG("sectors per cluster: %ld\r\n", md->sectors_per_cluster);
-	LOG("cluster size: %ld\r\n", md->cluster_size);
-
-	LOG("fat start: %ld\r\n", md->fat_start);
-	LOG("root start: %ld\r\n", md->root_start);
-	LOG("data start: %ld\r\n", md->data_start);
-
-	LOG("last cluster: %ld\r\n", md->last_cluster);
-	LOG("free scan: %ld\r\n", md->free_scan);
-
-	LOG("fat mask: 0x%08x\r\n", md->fat_mask);
-	LOG("fat eof: 0x%08x\r\n", md->fat_eof);
-
 	return 0;
 }
 
-static s32_t fatfs_unmount(struct mount_t * m)
+/*
+ * free cluster bitmap, a set bit means the cluster is in use.
+ */
+static inline bool_t fat_map_used(struct fatfs_mount_data * md, u32_t cl)
 {
-	struct fatfs_mount_data * md = m->m_data;
-
-	free(m->m_root->v_data);
-
-	free(md->dir_buf);
-	free(md->fat_buf);
-	free(md->io_buf);
-
-	free(md);
+	return (md->free_map[cl >> 5] & (1 << (cl & 0x1f))) ? TRUE : FALSE;
+}
 
-	return 0;
+static inline void fat_map_set(struct fatfs_mount_data * md, u32_t cl)
+{
+	md->free_map[cl >> 5] |= (1 << (cl & 0x1f));
 }
 
-static s32_t fatfs_sync(struct mount_t * m)
+static inline void fat_map_clear(struct fatfs_mount_data * md, u32_t cl)
 {
-	return 0;
+	md->free_map[cl >> 5] &= ~(1 << (cl & 0x1f));
 }
 
-static s32_t fatfs_vget(struct mount_t * m, struct vnode_t * node)
+/*
+ * build the free cluster bitmap on first use, which is the only full scan of fat.
+ */
+static s32_t fat_build_map(struct fatfs_mount_data * md)
 {
-	struct fat_node * n;
+	u32_t cl, val;
+	s32_t err;
 
-	n = malloc(sizeof(struct fat_node));
-	if(!n)
+	if(md->free_map)
+		return 0;
+
+	md->free_map = malloc(((md->last_cluster + 31) >> 5) * sizeof(u32_t));
+	if(!md->free_map)
 		return ENOMEM;
-	node->v_data = n;
+	memset(md->free_map, 0, ((md->last_cluster + 31) >> 5) * sizeof(u32_t));
+	md->free_count = 0;
+
+	fat_map_set(md, 0);
+	fat_map_set(md, 1);
+	for(cl = 2; cl < md->last_cluster; cl++)
+	{
+		if((err = fat_get_entry(md, cl, &val)) != 0)
+		{
+			free(md->free_map);
+			md->free_map = NULL;
+			return err;
+		}
+		if(val != 0)
+			fat_map_set(md, cl);
+		else
+			md->free_count++;
+	}
 
 	return 0;
 }
 
-static s32_t fatfs_statfs(struct mount_t * m, struct statfs * stat)
+/*
+ * length of the free run beginning at cl, at most max clusters.
+ */
+static u32_t fat_free_run(struct fatfs_mount_data * md, u32_t cl, u32_t max)
 {
-	return -1;
+	u32_t n = 0;
+
+	while((n < max) && (cl < md->last_cluster))
+	{
+		if(((cl & 0x1f) == 0) && (md->free_map[cl >> 5] == 0) && (cl + 32 <= md->last_cluster))
+		{
+			n += 32;
+			cl += 32;
+			continue;
+		}
+		if(fat_map_used(md, cl))
+			break;
+		n++;
+		cl++;
+	}
+
+	return (n < max) ? n : max;
 }
 
 /*
- * convert file name to 8.3 format ("foo.bar" => "foo     bar")
+ * find the first free run of want clusters from the search hint, or the longest one.
  */
-static void fat_convert_name(u8_t * org, u8_t * name)
+static bool_t fat_find_run(struct fatfs_mount_data * md, u32_t want, u32_t * start, u32_t * count)
 {
-	s32_t i;
-
-	memset(name, ' ', 11);
+	u32_t best = 0, best_start = 0;
+	u32_t total = md->last_cluster - 2;
+	u32_t scanned = 0;
+	u32_t cl = md->free_scan;
+	u32_t n;
 
-	for(i = 0; i <= 11; i++)
+	while(scanned < total)
 	{
-		if(!*org)
-			break;
-		if(*org == '/')
-			break;
-		if(*org == '.')
+		if(!fat_valid_cluster(md, cl))
+			cl = 2;
+		if(((cl & 0x1f) == 0) && (md->free_map[cl >> 5] == 0xffffffff))
+		{
+			cl += 32;
+			scanned += 32;
+			continue;
+		}
+		if(fat_map_used(md, cl))
 		{
-			i = 7;
-			org++;
+			cl++;
+			scanned++;
 			continue;
 		}
 
-		*(name + i) = *org;
-		org++;
+		n = fat_free_run(md, cl, want);
+		if(n >= want)
+		{
+			*start = cl;
+			*count = want;
+			return TRUE;
+		}
+		if(n > best)
+		{
+			best = n;
+			best_start = cl;
+		}
+		cl += n;
+		scanned += n;
 	}
+
+	if(best == 0)
+		return FALSE;
+	*start = best_start;
+	*count = best;
+	return TRUE;
 }
 
 /*
- * restore file name to normal format ("foo     bar" => "foo.bar")
+ * allocate a run of up to want contiguous clusters and link it after prev cluster.
+ * growing in place right after prev is preferred, so files stay contiguous.
  */
-static void fat_restore_name(u8_t * org, u8_t * name)
+static s32_t fat_alloc_run(struct fatfs_mount_data * md, u32_t prev, u32_t want, u32_t * start, u32_t * count)
 {
-	s32_t i;
+	u32_t cl, n, i;
+	s32_t err;
 
-	memset(name, 0, 13);
+	if((err = fat_build_map(md)) != 0)
+		return err;
+	if((md->free_count == 0) || (want == 0))
+		return ENOSPC;
 
-	for(i = 0; i < 8; i++)
+	if(prev && (n = fat_free_run(md, prev + 1, want)) > 0)
+		cl = prev + 1;
+	else if(!fat_find_run(md, want, &cl, &n))
+		return ENOSPC;
+
+	for(i = 0; i < n; i++)
 	{
-		if(*org != ' ')
-			*name++ = *org;
-		org++;
+		if((err = fat_set_entry(md, cl + i, (i + 1 < n) ? (cl + i + 1) : md->fat_eof)) != 0)
+			return err;
+		fat_map_set(md, cl + i);
 	}
+	if(prev && (err = fat_set_entry(md, prev, cl)) != 0)
+		return err;
 
-	if(*org != ' ')
-		*name++ = '.';
-	for(i = 0; i < 3; i++)
+	md->free_count -= n;
+	md->free_scan = cl + n;
+	*start = cl;
+	*count = n;
+
+	return 0;
+}
+
+/*
+ * release the cluster chain starting at cl.
+ */
+static s32_t fat_free_chain(struct fatfs_mount_data * md, u32_t cl)
+{
+	u32_t next;
+	s32_t err;
+
+	while(fat_valid_cluster(md, cl))
 	{
-		if(*org != ' ')
-			*name++ = *org;
-		org++;
+		if((err = fat_get_entry(md, cl, &next)) != 0)
+			return err;
+		if((err = fat_set_entry(md, cl, 0)) != 0)
+			return err;
+		if(md->free_map && fat_map_used(md, cl))
+		{
+			fat_map_clear(md, cl);
+			md->free_count++;
+		}
+		cl = next;
 	}
+
+	return 0;
 }
 
 /*
- * compare tow file names
+ * cluster chain extent cache.
  */
-static bool_t fat_compare_name(u8_t * n1, u8_t * n2)
+static void fat_extent_reset(struct fat_node * np)
 {
-	s32_t i;
+	np->nextent = 0;
+	np->mapped = FALSE;
+}
+
+static u32_t fat_extent_clusters(struct fat_node * np)
+{
+	struct fat_extent * e;
+
+	if(np->nextent == 0)
+		return 0;
+	e = &np->extent[np->nextent - 1];
+	return e->index + e->count;
+}
+
+static s32_t fat_extent_append(struct fat_node * np, u32_t cl, u32_t count)
+{
+	struct fat_extent * e;
+	u32_t index = 0;
+	u32_t n;
 
-	for(i = 0; i < 11; i++, n1++, n2++)
+	if(np->nextent > 0)
 	{
-		if(toupper(*n1) != toupper(*n2))
-			return FALSE;
+		e = &np->extent[np->nextent - 1];
+		if(e->cluster + e->count == cl)
+		{
+			e->count += count;
+			return 0;
+		}
+		index = e->index + e->count;
+	}
+
+	if(np->nextent >= np->mextent)
+	{
+		n = np->mextent ? np->mextent * 2 : 4;
+		e = realloc(np->extent, n * sizeof(struct fat_extent));
+		if(!e)
+			return ENOMEM;
+		np->extent = e;
+		np->mextent = n;
+	}
+
+	e = &np->extent[np->nextent++];
+	e->index = index;
+	e->cluster = cl;
+	e->count = count;
+
+	return 0;
+}
+
+/*
+ * walk the fat chain until cluster index last is cached, or the chain ends.
+ */
+static s32_t fat_map_chain(struct fatfs_mount_data * md, struct fat_node * np, u32_t last)
+{
+	struct fat_extent * e;
+	u32_t cl, next;
+	s32_t err;
+
+	if(np->mapped)
+		return 0;
+
+	if(np->nextent == 0)
+	{
+		if(np->cluster == 0)
+		{
+			np->mapped = TRUE;
+			return 0;
+		}
+		if(!fat_valid_cluster(md, np->cluster))
+			return EIO;
+		if((err = fat_extent_append(np, np->cluster, 1)) != 0)
+			return err;
+	}
+
+	while(1)
+	{
+		e = &np->extent[np->nextent - 1];
+		if(e->index + e->count > last)
+			break;
+		if(e->index + e->count >= md->last_cluster)
+			return EIO;
+		cl = e->cluster + e->count - 1;
+		if((err = fat_get_entry(md, cl, &next)) != 0)
+			return err;
+		if(fat_eof_cluster(md, next))
+		{
+			np->mapped = TRUE;
+			break;
+		}
+		if(!fat_valid_cluster(md, next))
+			return EIO;
+		if((err = fat_extent_append(np, next, 1)) != 0)
+			return err;
+	}
+
+	return 0;
+}
+
+/*
+ * map cluster index in file to disk cluster, returning the contiguous run length.
+ */
+static s32_t fat_map_cluster(struct fatfs_mount_data * md, struct fat_node * np, u32_t index, u32_t last, u32_t * cl, u32_t * run)
+{
+	struct fat_extent * e;
+	u32_t lo, hi, mid;
+	s32_t err;
+
+	if((err = fat_map_chain(md, np, last)) != 0)
+		return err;
+
+	lo = 0;
+	hi = np->nextent;
+	while(lo < hi)
+	{
+		mid = (lo + hi) >> 1;
+		e = &np->extent[mid];
+		if(index < e->index)
+			hi = mid;
+		else if(index >= e->index + e->count)
+			lo = mid + 1;
+		else
+		{
+			*cl = e->cluster + (index - e->index);
+			*run = e->count - (index - e->index);
+			return 0;
+		}
+	}
+
+	return ENOENT;
+}
+
+/*
+ * set first cluster of node.
+ */
+static void fat_node_set_cluster(struct fatfs_mount_data * md, struct fat_node * np, u32_t cl)
+{
+	np->cluster = cl;
+	fat_put16(np->dirent.cluster, cl & 0xffff);
+	if(md->type == FAT_TYPE_FAT32)
+		fat_put16(np->dirent.cluster_hi, (cl >> 16) & 0xffff);
+	np->dirty = TRUE;
+}
+
+/*
+ * append count clusters to the chain of node.
+ */
+static s32_t fat_extend(struct fatfs_mount_data * md, struct fat_node * np, u32_t count)
+{
+	struct fat_extent * e;
+	u32_t prev = 0, cl, n;
+	s32_t err;
+
+	if((err = fat_map_chain(md, np, 0xffffffff)) != 0)
+		return err;
+
+	if(np->nextent > 0)
+	{
+		e = &np->extent[np->nextent - 1];
+		prev = e->cluster + e->count - 1;
+	}
+
+	while(count > 0)
+	{
+		if((err = fat_alloc_run(md, prev, count, &cl, &n)) != 0)
+			return err;
+		if((err = fat_extent_append(np, cl, n)) != 0)
+		{
+			if(prev)
+				fat_set_entry(md, prev, md->fat_eof);
+			fat_free_chain(md, cl);
+			return err;
+		}
+		if(prev == 0)
+			fat_node_set_cluster(md, np, cl);
+		prev = cl + n - 1;
+		count -= n;
+	}
+
+	return 0;
+}
+
+/*
+ * keep the first count clusters of node and free the rest.
+ */
+static s32_t fat_shrink(struct fatfs_mount_data * md, struct fat_node * np, u32_t count)
+{
+	struct fat_extent * e;
+	u32_t cl, run, next;
+	s32_t err;
+
+	if(count == 0)
+	{
+		cl = np->cluster;
+		fat_node_set_cluster(md, np, 0);
+		fat_extent_reset(np);
+		np->mapped = TRUE;
+		return fat_free_chain(md, cl);
+	}
+
+	if((err = fat_map_cluster(md, np, count - 1, count - 1, &cl, &run)) != 0)
+		return err;
+	if((err = fat_get_entry(md, cl, &next)) != 0)
+		return err;
+	if((err = fat_set_entry(md, cl, md->fat_eof)) != 0)
+		return err;
+
+	while(np->nextent > 0)
+	{
+		e = &np->extent[np->nextent - 1];
+		if(e->index < count)
+		{
+			e->count = count - e->index;
+			break;
+		}
+		np->nextent--;
+	}
+	np->mapped = TRUE;
+
+	if(fat_eof_cluster(md, next))
+		return 0;
+	return fat_free_chain(md, next);
+}
+
+/*
+ * read or write a byte range of node from or to caller segments, pieces of
+ * contiguous runs are handed to block layer as one batch.
+ */
+static loff_t fat_node_rwv(struct fatfs_mount_data * md, struct fat_node * np, struct block_readahead_t * ra, const struct iovec * iov, int iovcnt, loff_t off, loff_t size, bool_t write)
+{
+	struct block_segment_t seg[8];
+	const struct iovec * v;
+	loff_t done = 0, skip = 0, vs, len, n;
+	u32_t cl, run;
+	int i, vn;
+
+	while(size > 0)
+	{
+		v = iov;
+		vn = iovcnt;
+		vs = skip;
+		i = 0;
+		n = 0;
+		while((i < ARRAY_SIZE(seg)) && (n < size) && (vn > 0))
+		{
+			if(vs >= (loff_t)v->iov_len)
+			{
+				v++;
+				vn--;
+				vs = 0;
+				continue;
+			}
+			if(fat_map_cluster(md, np, (off + n) / md->cluster_size, (off + size - 1) / md->cluster_size, &cl, &run) != 0)
+				break;
+			len = (loff_t)run * md->cluster_size - ((off + n) % md->cluster_size);
+			if(len > size - n)
+				len = size - n;
+			if(len > (loff_t)v->iov_len - vs)
+				len = (loff_t)v->iov_len - vs;
+			seg[i].buf = (u8_t *)v->iov_base + vs;
+			seg[i].offset = fat_cluster_offset(md, cl) + ((off + n) % md->cluster_size);
+			seg[i].count = len;
+			i++;
+			n += len;
+			vs += len;
+		}
+		if(i == 0)
+			break;
+
+		if(write)
+			len = block_write_batch(md->blk, seg, i);
+		else
+			len = block_read_batch(md->blk, ra, seg, i);
+
+		off += len;
+		size -= len;
+		done += len;
+		if(len != n)
+			break;
+		iov = v;
+		iovcnt = vn;
+		skip = vs;
+	}
+
+	return done;
+}
+
+static loff_t fat_node_rw(struct fatfs_mount_data * md, struct fat_node * np, struct block_readahead_t * ra, u8_t * buf, loff_t off, loff_t size, bool_t write)
+{
+	struct iovec iov;
+
+	iov.iov_base = buf;
+	iov.iov_len = size;
+	return fat_node_rwv(md, np, ra, &iov, 1, off, size, write);
+}
+
+/*
+ * fill a byte range of node with zero.
+ */
+static s32_t fat_node_zero(struct fatfs_mount_data * md, struct fat_node * np, loff_t off, loff_t size)
+{
+	loff_t len;
+
+	while(size > 0)
+	{
+		len = (size > md->cluster_size) ? md->cluster_size : size;
+		if(fat_node_rw(md, np, NULL, (u8_t *)md->io_buf, off, len, TRUE) != len)
+			return EIO;
+		off += len;
+		size -= len;
 	}
+	return 0;
+}
+
+/*
+ * read directory entry to buffer, with cache.
+ */
+static bool_t fat_read_dirent(struct fatfs_mount_data * md, u32_t sector)
+{
+	u64_t off = (u64_t)sector * md->sector_size;
+	u64_t size = md->sector_size;
+
+	if(md->dir_sector == sector)
+		return TRUE;
+
+	md->dir_sector = 0xffffffff;
+	if(block_read(md->blk, (u8_t *)(md->dir_buf), off, size) != size)
+		return FALSE;
+	md->dir_sector = sector;
+
+	return TRUE;
+}
+
+/*
+ * write directory entry from buffer.
+ */
+static bool_t fat_write_dirent(struct fatfs_mount_data * md, u32_t sector)
+{
+	u64_t off = (u64_t)sector * md->sector_size;
+	u64_t size = md->sector_size;
+
+	md->dir_sector = 0xffffffff;
+	if(block_write(md->blk, (u8_t *)(md->dir_buf), off, size) != size)
+		return FALSE;
+	md->dir_sector = sector;
 
 	return TRUE;
 }
 
+/*
+ * write back directory entry of node.
+ */
+static s32_t fat_write_node(struct fatfs_mount_data * md, struct fat_node * np)
+{
+	if(!np->dirty || np->root)
+		return 0;
+
+	if(fat_read_dirent(md, np->sector) != TRUE)
+		return EIO;
+	memcpy(md->dir_buf + np->offset, &np->dirent, sizeof(struct fat_dirent));
+	if(fat_write_dirent(md, np->sector) != TRUE)
+		return EIO;
+	np->dirty = FALSE;
+
+	return 0;
+}
+
+static void fat_free_node(struct fat_node * np)
+{
+	if(np->entry.next)
+		list_del(&np->entry);
+	free(np->extent);
+	free(np);
+}
+
+/*
+ * fill a whole cluster with zero.
+ */
+static s32_t fat_zero_cluster(struct fatfs_mount_data * md, u32_t cl)
+{
+	u64_t off = fat_cluster_offset(md, cl);
+
+	md->dir_sector = 0xffffffff;
+	if(block_write(md->blk, (u8_t *)md->io_buf, off, md->cluster_size) != md->cluster_size)
+		return EIO;
+	return 0;
+}
+
+/*
+ * convert file name to 8.3 format ("foo.bar" => "FOO     BAR")
+ */
+static void fat_convert_name(u8_t * org, u8_t * name)
+{
+	s32_t i;
+
+	memset(name, ' ', 11);
+
+	if((org[0] == '.') && ((org[1] == '\0') || ((org[1] == '.') && (org[2] == '\0'))))
+	{
+		memcpy(name, org, strlen((const char *)org));
+		return;
+	}
+
+	for(i = 0; *org && (*org != '/') && (*org != '.'); org++)
+	{
+		if(i < 8)
+			name[i++] = toupper(*org);
+	}
+
+	if(*org == '.')
+	{
+		for(i = 8, org++; *org && (*org != '/'); org++)
+		{
+			if(i < 11)
+				name[i++] = toupper(*org);
+		}
+	}
+}
+
+/*
+ * get the case flags of file name, lower case base and extension are kept.
+ */
+static u8_t fat_name_case(u8_t * org)
+{
+	bool_t lower = FALSE, upper = FALSE;
+	u8_t ntres = 0;
+
+	for(; *org && (*org != '.'); org++)
+	{
+		if(islower(*org))
+			lower = TRUE;
+		else if(isupper(*org))
+			upper = TRUE;
+	}
+	if(lower && !upper)
+		ntres |= FAT_CASE_LOWER_BASE;
+
+	if(*org == '.')
+	{
+		lower = upper = FALSE;
+		for(org++; *org; org++)
+		{
+			if(islower(*org))
+				lower = TRUE;
+			else if(isupper(*org))
+				upper = TRUE;
+		}
+		if(lower && !upper)
+			ntres |= FAT_CASE_LOWER_EXT;
+	}
+
+	return ntres;
+}
+
+/*
+ * restore file name to normal format ("foo     bar" => "foo.bar")
+ */
+static void fat_restore_name(u8_t * org, u8_t * name, u8_t ntres)
+{
+	s32_t i;
+
+	memset(name, 0, 13);
+
+	for(i = 0; i < 8; i++)
+	{
+		if(*org != ' ')
+			*name++ = (ntres & FAT_CASE_LOWER_BASE) ? tolower(*org) : *org;
+		org++;
+	}
+
+	if(*org != ' ')
+		*name++ = '.';
+	for(i = 0; i < 3; i++)
+	{
+		if(*org != ' ')
+			*name++ = (ntres & FAT_CASE_LOWER_EXT) ? tolower(*org) : *org;
+		org++;
+	}
+}
+
 /*
  * check specified name is valid as fat file name.
  */
@@ -556,229 +1240,948 @@ static bool_t fat_valid_name(u8_t * name)
 		return(*(name + 1) == '\0') ? TRUE : FALSE;
 	}
 
-	/* first char must be alphabet or numeric */
-	if(!isalnum(*name))
-		return FALSE;
+	/* first char must be alphabet or numeric */
+	if(!isalnum(*name))
+		return FALSE;
+
+	while(*name != '\0')
+	{
+		if(strchr((const char *)invalid_char, *name))
+			return FALSE;
+		if(*name == '.')
+			break;
+		if(++len > 8)
+			return FALSE;
+		name++;
+	}
+
+	if(*name == '\0')
+		return TRUE;
+	name++;
+
+	if(*name == '\0')
+		return TRUE;
+	len = 0;
+	while(*name != '\0')
+	{
+		if(strchr((const char *)invalid_char, *name))
+			return FALSE;
+		if(*name == '.')
+			return FALSE;
+		if(++len > 3)
+			return FALSE;
+		name++;
+	}
+
+	return TRUE;
+}
+
+/*
+ * get sector of directory by sector index.
+ */
+static s32_t fat_dir_sector(struct fatfs_mount_data * md, struct fat_node * dp, u32_t index, u32_t * sec)
+{
+	u32_t cl, run;
+	s32_t err;
+
+	if(dp->cluster == 0)
+	{
+		/* fixed root directory of fat12 and fat16 */
+		if(index >= md->data_start - md->root_start)
+			return ENOENT;
+		*sec = md->root_start + index;
+		return 0;
+	}
+
+	err = fat_map_cluster(md, dp, index / md->sectors_per_cluster, index / md->sectors_per_cluster, &cl, &run);
+	if(err != 0)
+		return err;
+	*sec = fat_cluster_sector(md, cl) + (index % md->sectors_per_cluster);
+
+	return 0;
+}
+
+/*
+ * get directory entry by slot index, the sector is loaded into directory buffer.
+ */
+static s32_t fat_get_dirent(struct fatfs_mount_data * md, struct fat_node * dp, u32_t slot, struct fat_dirent ** de, u32_t * sec)
+{
+	u32_t num = md->sector_size / sizeof(struct fat_dirent);
+	s32_t err;
+
+	if((err = fat_dir_sector(md, dp, slot / num, sec)) != 0)
+		return err;
+	if(fat_read_dirent(md, *sec) != TRUE)
+		return EIO;
+	*de = (struct fat_dirent *)md->dir_buf + (slot % num);
+
+	return 0;
+}
+
+/*
+ * checksum of short name, stored in each of its long name slots.
+ */
+static u8_t fat_lfn_chksum(u8_t * name)
+{
+	u8_t sum = 0;
+	s32_t i;
+
+	for(i = 0; i < 11; i++)
+		sum = ((sum & 0x1) << 7) + (sum >> 1) + name[i];
+	return sum;
+}
+
+/*
+ * convert ucs-2 long name to utf-8.
+ */
+static bool_t fat_lfn_to_utf8(u16_t * ucs, u32_t n, char * buf, u32_t size)
+{
+	u32_t i, len = 0;
+	u16_t c;
+
+	for(i = 0; i < n; i++)
+	{
+		c = ucs[i];
+		if((c == 0x0000) || (c == 0xffff))
+			break;
+		if(c < 0x80)
+		{
+			if(len + 1 >= size)
+				return FALSE;
+			buf[len++] = c;
+		}
+		else if(c < 0x800)
+		{
+			if(len + 2 >= size)
+				return FALSE;
+			buf[len++] = 0xc0 | (c >> 6);
+			buf[len++] = 0x80 | (c & 0x3f);
+		}
+		else
+		{
+			if(len + 3 >= size)
+				return FALSE;
+			buf[len++] = 0xe0 | (c >> 12);
+			buf[len++] = 0x80 | ((c >> 6) & 0x3f);
+			buf[len++] = 0x80 | (c & 0x3f);
+		}
+	}
+	buf[len] = '\0';
+
+	return (len > 0) ? TRUE : FALSE;
+}
+
+static void fat_lfn_collect(struct fat_lfn_dirent * lde, u16_t * ucs)
+{
+	u16_t * p = ucs + ((lde->ord & 0x1f) - 1) * 13;
+	s32_t i;
+
+	for(i = 0; i < 5; i++)
+		*p++ = fat_get16(&lde->name1[i * 2]);
+	for(i = 0; i < 6; i++)
+		*p++ = fat_get16(&lde->name2[i * 2]);
+	for(i = 0; i < 2; i++)
+		*p++ = fat_get16(&lde->name3[i * 2]);
+}
+
+/*
+ * get the next visible entry from slot, with its long name. slot is advanced past it.
+ */
+static s32_t fat_next_entry(struct fatfs_mount_data * md, struct fat_node * dp, u32_t * slot, struct fat_entry * fe)
+{
+	struct fat_lfn_dirent * lde;
+	struct fat_dirent * de;
+	u16_t ucs[FAT_LFN_SLOTS * 13];
+	u32_t s, sec, ord = 0, nlfn = 0;
+	u8_t chksum = 0;
+	s32_t err;
+
+	for(s = *slot; ; s++)
+	{
+		if((err = fat_get_dirent(md, dp, s, &de, &sec)) != 0)
+			return err;
+		if(IS_EMPTY(de))
+			return ENOENT;
+
+		if(IS_DELETED(de))
+		{
+			ord = 0;
+			continue;
+		}
+
+		if(IS_LFN(de))
+		{
+			lde = (struct fat_lfn_dirent *)de;
+			if(lde->ord & FAT_LFN_LAST)
+			{
+				ord = lde->ord & 0x1f;
+				if((ord == 0) || (ord > FAT_LFN_SLOTS))
+				{
+					ord = 0;
+					continue;
+				}
+				chksum = lde->chksum;
+				nlfn = 1;
+				memset(ucs, 0xff, sizeof(ucs));
+				fat_lfn_collect(lde, ucs);
+			}
+			else if((ord > 1) && (lde->ord == ord - 1) && (lde->chksum == chksum))
+			{
+				ord--;
+				nlfn++;
+				fat_lfn_collect(lde, ucs);
+			}
+			else
+			{
+				ord = 0;
+			}
+			continue;
+		}
+
+		if(IS_VOL(de))
+		{
+			ord = 0;
+			continue;
+		}
+
+		memcpy(&fe->dirent, de, sizeof(struct fat_dirent));
+		fe->slot = s;
+		fe->sector = sec;
+		fe->offset = (u8_t *)de - (u8_t *)md->dir_buf;
+		fat_restore_name(de->name, (u8_t *)fe->sname, de->ntres);
+		fe->lname[0] = '\0';
+		fe->nlfn = 0;
+		if((ord == 1) && (chksum == fat_lfn_chksum(de->name)) && fat_lfn_to_utf8(ucs, nlfn * 13, fe->lname, sizeof(fe->lname)))
+			fe->nlfn = nlfn;
+		*slot = s + 1;
+		return 0;
+	}
+}
+
+/*
+ * directory hash index, lookups probe a bucket instead of reading every sector.
+ */
+static u32_t fat_name_hash(const char * name)
+{
+	u32_t val = 0;
+
+	while(*name)
+		val = ((val << 5) + val) + toupper(*name++);
+	return val;
+}
+
+static s32_t fat_index_resize(struct fat_index * idx, u32_t size)
+{
+	struct hlist_head * hash;
+	struct fat_index_entry * e;
+	struct hlist_node * n;
+	u32_t i;
+
+	hash = malloc(size * sizeof(struct hlist_head));
+	if(!hash)
+		return ENOMEM;
+	for(i = 0; i < size; i++)
+		init_hlist_head(&hash[i]);
+
+	for(i = 0; i < idx->size; i++)
+	{
+		hlist_for_each_entry_safe(e, n, &idx->hash[i], node)
+		{
+			hlist_del(&e->node);
+			hlist_add_head(&e->node, &hash[e->hash & (size - 1)]);
+		}
+	}
+	free(idx->hash);
+	idx->hash = hash;
+	idx->size = size;
+
+	return 0;
+}
+
+static struct fat_index_entry * fat_index_insert(struct fat_index * idx, const char * name, u32_t slot, u32_t nlfn)
+{
+	struct fat_index_entry * e;
+	u32_t len = strlen(name);
+
+	if((idx->count >= idx->size * 2) && (fat_index_resize(idx, idx->size * 4) != 0))
+		return NULL;
+
+	e = malloc(sizeof(struct fat_index_entry) + len + 1);
+	if(!e)
+		return NULL;
+	e->name = (char *)(e + 1);
+	memcpy(e->name, name, len + 1);
+	e->hash = fat_name_hash(name);
+	e->slot = slot;
+	e->nlfn = nlfn;
+	e->alias = NULL;
+	hlist_add_head(&e->node, &idx->hash[e->hash & (idx->size - 1)]);
+	idx->count++;
+
+	return e;
+}
+
+/*
+ * remove the entry by its short name, the long name goes with it as alias.
+ */
+static void fat_index_remove(struct fat_index * idx, const char * name, u32_t slot)
+{
+	struct fat_index_entry * e;
+	u32_t hash = fat_name_hash(name);
+
+	hlist_for_each_entry(e, &idx->hash[hash & (idx->size - 1)], node)
+	{
+		if((e->slot == slot) && (e->hash == hash) && (strcasecmp(e->name, name) == 0))
+		{
+			if(e->alias)
+			{
+				hlist_del(&e->alias->node);
+				free(e->alias);
+				idx->count--;
+			}
+			hlist_del(&e->node);
+			free(e);
+			idx->count--;
+			return;
+		}
+	}
+}
+
+static void fat_index_free(struct fatfs_mount_data * md, struct fat_index * idx)
+{
+	struct fat_index_entry * e;
+	struct hlist_node * n;
+	u32_t i;
+
+	for(i = 0; i < idx->size; i++)
+	{
+		hlist_for_each_entry_safe(e, n, &idx->hash[i], node)
+		{
+			hlist_del(&e->node);
+			free(e);
+		}
+	}
+	list_del(&idx->entry);
+	md->nindex--;
+	free(idx->hash);
+	free(idx);
+}
+
+static struct fat_index * fat_index_find(struct fatfs_mount_data * md, u32_t cluster)
+{
+	struct fat_index * idx;
+
+	list_for_each_entry(idx, &md->indexes, entry)
+	{
+		if(idx->cluster == cluster)
+		{
+			list_move(&idx->entry, &md->indexes);
+			return idx;
+		}
+	}
+	return NULL;
+}
+
+static void fat_index_drop(struct fatfs_mount_data * md, u32_t cluster)
+{
+	struct fat_index * idx = fat_index_find(md, cluster);
+
+	if(idx)
+		fat_index_free(md, idx);
+}
+
+/*
+ * get the hash index of directory, built by one scan on first use.
+ */
+static struct fat_index * fat_index_get(struct fatfs_mount_data * md, struct fat_node * dp)
+{
+	struct fat_index * idx;
+	struct fat_index_entry * e, * a;
+	struct fat_entry fe;
+	u32_t slot = 0, last = 0;
+	s32_t err;
+
+	if((idx = fat_index_find(md, dp->cluster)) != NULL)
+		return idx;
+
+	if(md->nindex >= CONFIG_FATFS_DIR_INDEX_COUNT)
+		fat_index_free(md, list_last_entry(&md->indexes, struct fat_index, entry));
+
+	idx = malloc(sizeof(struct fat_index));
+	if(!idx)
+		return NULL;
+	memset(idx, 0, sizeof(struct fat_index));
+	idx->cluster = dp->cluster;
+	idx->free = 0xffffffff;
+	list_add(&idx->entry, &md->indexes);
+	md->nindex++;
+	if(fat_index_resize(idx, 16) != 0)
+	{
+		fat_index_free(md, idx);
+		return NULL;
+	}
+
+	while((err = fat_next_entry(md, dp, &slot, &fe)) == 0)
+	{
+		if((idx->free == 0xffffffff) && (fe.slot - fe.nlfn > last))
+			idx->free = last;
+		last = slot;
+
+		if((e = fat_index_insert(idx, fe.sname, fe.slot, fe.nlfn)) == NULL)
+			break;
+		if((fe.lname[0] != '\0') && (strcasecmp(fe.lname, fe.sname) != 0))
+		{
+			if((a = fat_index_insert(idx, fe.lname, fe.slot, fe.nlfn)) == NULL)
+				break;
+			e->alias = a;
+			a->alias = e;
+		}
+	}
+	if(err != ENOENT)
+	{
+		fat_index_free(md, idx);
+		return NULL;
+	}
+	if(idx->free == 0xffffffff)
+		idx->free = last;
+
+	return idx;
+}
+
+/*
+ * find directory entry for specified name in directory.
+ */
+static s32_t fat_lookup_node(struct vnode_t * dnode, char * name, struct fat_node * np)
+{
+	struct fatfs_mount_data * md;
+	struct fat_node * dp;
+	struct fat_index * idx;
+	struct fat_index_entry * e;
+	struct fat_dirent * de;
+	struct fat_entry fe;
+	u32_t slot, sec, hash;
+	s32_t err;
+
+	if(name == NULL)
+		return ENOENT;
+
+	md = (struct fatfs_mount_data *)dnode->v_mount->m_data;
+	dp = dnode->v_data;
+
+	idx = fat_index_get(md, dp);
+	if(idx)
+	{
+		hash = fat_name_hash(name);
+		hlist_for_each_entry(e, &idx->hash[hash & (idx->size - 1)], node)
+		{
+			if((e->hash == hash) && (strcasecmp(e->name, name) == 0))
+			{
+				if((err = fat_get_dirent(md, dp, e->slot, &de, &sec)) != 0)
+					return err;
+				memcpy(&np->dirent, de, sizeof(struct fat_dirent));
+				np->sector = sec;
+				np->offset = (u8_t *)de - (u8_t *)md->dir_buf;
+				np->slot = e->slot;
+				np->nlfn = e->nlfn;
+				return 0;
+			}
+		}
+		return ENOENT;
+	}
+
+	/* no index, scan the whole directory */
+	slot = 0;
+	while((err = fat_next_entry(md, dp, &slot, &fe)) == 0)
+	{
+		if((strcasecmp(fe.sname, name) == 0) || ((fe.lname[0] != '\0') && (strcasecmp(fe.lname, name) == 0)))
+		{
+			memcpy(&np->dirent, &fe.dirent, sizeof(struct fat_dirent));
+			np->sector = fe.sector;
+			np->offset = fe.offset;
+			np->slot = fe.slot;
+			np->nlfn = fe.nlfn;
+			return 0;
+		}
+	}
+
+	return err;
+}
+
+/*
+ * add directory entry to directory, growing it when full.
+ */
+static s32_t fat_add_dirent(struct fatfs_mount_data * md, struct fat_node * dp, struct fat_dirent * entry, struct fat_node * np)
+{
+	struct fat_index * idx;
+	struct fat_dirent * de;
+	u32_t slot, sec, cl;
+	char name[13];
+	s32_t err;
+
+	idx = fat_index_find(md, dp->cluster);
+	for(slot = idx ? idx->free : 0; ; slot++)
+	{
+		err = fat_get_dirent(md, dp, slot, &de, &sec);
+		if(err == ENOENT)
+		{
+			if(dp->cluster == 0)
+				return ENOSPC;
+			if((err = fat_extend(md, dp, 1)) != 0)
+				return err;
+			cl = dp->extent[dp->nextent - 1].cluster + dp->extent[dp->nextent - 1].count - 1;
+			if((err = fat_zero_cluster(md, cl)) != 0)
+				return err;
+			err = fat_get_dirent(md, dp, slot, &de, &sec);
+		}
+		if(err != 0)
+			return err;
+		if(IS_EMPTY(de) || IS_DELETED(de))
+			break;
+	}
+
+	memcpy(de, entry, sizeof(struct fat_dirent));
+	if(np)
+	{
+		np->sector = sec;
+		np->offset = (u8_t *)de - (u8_t *)md->dir_buf;
+		np->slot = slot;
+		np->nlfn = 0;
+	}
+	if(fat_write_dirent(md, sec) != TRUE)
+		return EIO;
+
+	if(idx)
+	{
+		idx->free = slot + 1;
+		fat_restore_name(entry->name, (u8_t *)name, entry->ntres);
+		if(!fat_index_insert(idx, name, slot, 0))
+			fat_index_free(md, idx);
+	}
+
+	return 0;
+}
+
+/*
+ * mark directory entry and its long name slots as deleted.
+ */
+static s32_t fat_del_dirent(struct fatfs_mount_data * md, struct fat_node * dp, u32_t slot, u32_t nlfn)
+{
+	struct fat_index * idx;
+	struct fat_dirent * de;
+	char name[13];
+	u32_t s, sec;
+	s32_t err;
+
+	for(s = slot - nlfn; s <= slot; s++)
+	{
+		if((err = fat_get_dirent(md, dp, s, &de, &sec)) != 0)
+			return err;
+		if(s == slot)
+			fat_restore_name(de->name, (u8_t *)name, de->ntres);
+		de->name[0] = 0xe5;
+		if(fat_write_dirent(md, sec) != TRUE)
+			return EIO;
+	}
+
+	if((idx = fat_index_find(md, dp->cluster)) != NULL)
+	{
+		fat_index_remove(idx, name, slot);
+		if(slot - nlfn < idx->free)
+			idx->free = slot - nlfn;
+	}
+
+	return 0;
+}
+
+/*
+ * filesystem operations
+ */
+static s32_t fatfs_mount(struct mount_t * m, char * dev, s32_t flag)
+{
+	struct fatfs_mount_data * md;
+	struct fat_node * root;
+	struct block_t * blk;
+	struct fat_boot_sector fbs;
+	u32_t sector_size, reserved, root_sectors, fat_sectors, total, clusters, entries;
+	u32_t tmp;
+	s32_t i;
+
+	if(dev == NULL)
+		return EINVAL;
+
+	blk = (struct block_t *)m->m_dev;
+	if(!blk)
+		return EINVAL;
+
+	if(block_capacity(blk) <= sizeof(struct fat_boot_sector))
+		return EINTR;
+
+	if(block_read(blk, (u8_t *)(&fbs), 0, sizeof(struct fat_boot_sector)) != sizeof(struct fat_boot_sector))
+		return EIO;
+
+	/*
+	 * check both signature (0x55, 0xaa)
+	 */
+	if((fbs.signature[0] != 0x55) || fbs.signature[1] != 0xaa)
+		return EINVAL;
+
+	/* the logical sector size (bytes 11-12) is a power of two, at least 512 */
+	sector_size = (fbs.bytes_per_sector[1] << 8) | fbs.bytes_per_sector[0];
+	if( (sector_size < 512) || (!is_power_of_2(sector_size)) )
+		return EINVAL;
+
+	/* the cluster size (byte 13) is a power of two */
+	if(! is_power_of_2(fbs.sectors_per_cluster))
+		return EINVAL;
+
+	/* the number of reserved sectors (bytes 14-15) is nonzero */
+	reserved = (fbs.reserved_sectors[1] << 8) | fbs.reserved_sectors[0];
+	if(reserved == 0)
+		return EINVAL;
+
+	/* the number of fats (byte 16) is nonzero */
+	if(fbs.num_of_fats == 0x00)
+		return EINVAL;
+
+	/* the number of root directory entries (bytes 17-18) must be sector aligned */
+	tmp = (fbs.root_entries[1] << 8) | fbs.root_entries[0];
+	if(tmp % (sector_size / sizeof(struct fat_dirent)) != 0)
+		return EINVAL;
+	root_sectors = tmp / (sector_size / sizeof(struct fat_dirent));
+
+	/* the sectors per fat, fat32 keeps it in extended bios parameter block */
+	fat_sectors = (fbs.sectors_per_fat[1] << 8) | fbs.sectors_per_fat[0];
+	if(fat_sectors == 0)
+		fat_sectors = fat_get32(fbs.x.fat32.sectors_per_fat_32);
+	if(fat_sectors == 0)
+		return EINVAL;
+
+	/* the total sectors of volume */
+	total = (fbs.total_sectors[1] << 8) | fbs.total_sectors[0];
+	if(total == 0)
+		total = fat_get32(fbs.big_total_sectors);
+	if(total > block_capacity(blk) / sector_size)
+		return EINVAL;
+
+	tmp = reserved + fbs.num_of_fats * fat_sectors + root_sectors;
+	if(total <= tmp)
+		return EINVAL;
+	clusters = (total - tmp) / fbs.sectors_per_cluster;
+
+	md = malloc(sizeof(struct fatfs_mount_data));
+	if(!md)
+		return ENOMEM;
+	memset(md, 0, sizeof(struct fatfs_mount_data));
+
+	/* determine the type of fat by the count of clusters */
+	if(clusters < 4085)
+	{
+		md->type = FAT_TYPE_FAT12;
+		md->fat_mask = 0x00000fff;
+		entries = fat_sectors * sector_size * 2 / 3;
+	}
+	else if(clusters < 65525)
+	{
+		md->type = FAT_TYPE_FAT16;
+		md->fat_mask = 0x0000ffff;
+		entries = fat_sectors * sector_size / 2;
+	}
+	else
+	{
+		if(root_sectors != 0)
+		{
+			free(md);
+			return EINVAL;
+		}
+		md->type = FAT_TYPE_FAT32;
+		md->fat_mask = 0x0fffffff;
+		entries = fat_sectors * sector_size / 4;
+	}
+
+	/* build mount data */
+	md->sector_size = sector_size;
+	md->sectors_per_cluster = fbs.sectors_per_cluster;
+	md->cluster_size = md->sectors_per_cluster * md->sector_size;
+	md->fat_start = reserved;
+	md->fat_sectors = fat_sectors;
+	md->num_of_fats = fbs.num_of_fats;
+	md->root_start = md->fat_start + md->num_of_fats * md->fat_sectors;
+	md->data_start = md->root_start + root_sectors;
+	md->root_cluster = (md->type == FAT_TYPE_FAT32) ? fat_get32(fbs.x.fat32.root_clus) : 0;
+	md->last_cluster = (clusters + 2 < entries) ? clusters + 2 : entries;
+	md->free_scan = 2;
+	md->fat_eof = 0xffffffff & md->fat_mask;
+	md->dir_sector = 0xffffffff;
+	init_list_head(&md->nodes);
+	init_list_head(&md->indexes);
+	md->nindex = 0;
+
+	/* fat12 entries may cross sectors, so cache the whole table in one window */
+	if(md->type == FAT_TYPE_FAT12)
+		md->fat_window = md->fat_sectors * md->sector_size;
+	else
+		md->fat_window = (CONFIG_FATFS_FAT_CACHE_SIZE > md->sector_size) ? (CONFIG_FATFS_FAT_CACHE_SIZE & ~(md->sector_size - 1)) : md->sector_size;
+	for(i = 0; i < CONFIG_FATFS_FAT_CACHE_COUNT; i++)
+		md->fat_cache[i].index = 0xffffffff;
+
+	if((md->type == FAT_TYPE_FAT32) && !fat_valid_cluster(md, md->root_cluster))
+	{
+		free(md);
+		return EINVAL;
+	}
+
+	md->io_buf = malloc(md->cluster_size);
+	if(!md->io_buf)
+	{
+		free(md);
+		return ENOMEM;
+	}
+	memset(md->io_buf, 0, md->cluster_size);
+
+	md->dir_buf = malloc(md->sector_size);
+	if(!md->dir_buf)
+	{
+		free(md->io_buf);
+		free(md);
+		return ENOMEM;
+	}
+
+	md->blk = blk;
+	m->m_flags = flag & MOUNT_MASK;
+	m->m_data = md;
+
+	root = m->m_root->v_data;
+	root->root = TRUE;
+	root->cluster = md->root_cluster;
+	m->m_root->v_blkno = md->root_cluster;
+
+	LOG("sector size: %ld", md->sector_size);
+	LOG("sectors per cluster: %ld", md->sectors_per_cluster);
+	LOG("cluster size: %ld", md->cluster_size);
 
-	while(*name != '\0')
-	{
-		if(strchr((const s8_t *)invalid_char, *name))
-			return FALSE;
-		if(*name == '.')
-			break;
-		if(++len > 8)
-			return FALSE;
-		name++;
-	}
+	LOG("fat start: %ld", md->fat_start);
+	LOG("root start: %ld", md->root_start);
+	LOG("data start: %ld", md->data_start);
 
-	if(*name == '\0')
-		return TRUE;
-	name++;
+	LOG("last cluster: %ld", md->last_cluster);
+	LOG("free scan: %ld", md->free_scan);
 
-	if(*name == '\0')
-		return TRUE;
-	len = 0;
-	while(*name != '\0')
-	{
-		if(strchr((const s8_t *)invalid_char, *name))
-			return FALSE;
-		if(*name == '.')
-			return FALSE;
-		if(++len > 3)
-			return FALSE;
-		name++;
-	}
+	LOG("fat mask: 0x%08x", md->fat_mask);
+	LOG("fat eof: 0x%08x", md->fat_eof);
 
-	return TRUE;
+	return 0;
 }
 
-/*
- * read the fat entry for specified cluster.
- */
-static bool_t read_fat_entry(struct fatfs_mount_data * md, u32_t cl)
+static s32_t fatfs_sync(struct mount_t * m)
 {
-	return FALSE;
+	struct fatfs_mount_data * md = m->m_data;
+	struct list_head * pos;
+	struct fat_node * np;
+	s32_t err = 0;
+
+	list_for_each(pos, &md->nodes)
+	{
+		np = list_entry(pos, struct fat_node, entry);
+		if(fat_write_node(md, np) != 0)
+			err = EIO;
+	}
+	if(fat_cache_flush(md) != 0)
+		err = EIO;
+
+	return err;
 }
 
-/*
- * get next cluster number of fat chain.
- */
-static s32_t fat_next_cluster(struct fatfs_mount_data * md, u32_t cl, u32_t * next)
+static s32_t fatfs_unmount(struct mount_t * m)
 {
-	u32_t offset;
-	u32_t val;
+	struct fatfs_mount_data * md = m->m_data;
+	struct fat_node * root = m->m_root->v_data;
+	s32_t i;
 
-	if(read_fat_entry(md, cl) != TRUE)
-		return EIO;
+	if(!list_empty(&md->nodes))
+		return EBUSY;
 
-	switch(md->type)
-	{
-	case FAT_TYPE_FAT12:
-		offset = (cl * 3 / 2) % md->sector_size;
-		val = (md->fat_buf[offset + 1] << 8) | (md->fat_buf[offset + 0] << 0);
-		if(cl & 0x1)
-			val >>= 4;
-		else
-			val &= 0xfff;
-		break;
+	fatfs_sync(m);
 
-	case FAT_TYPE_FAT16:
-		offset = (cl * 2) % md->sector_size;
-		val = (md->fat_buf[offset + 1] << 8) | (md->fat_buf[offset + 0] << 0);
-		break;
+	free(root->extent);
+	free(root);
 
-	case FAT_TYPE_FAT32:
-		offset = (cl * 4) % md->sector_size;
-		val = (md->fat_buf[offset + 3] << 24) | (md->fat_buf[offset + 2] << 16) | (md->fat_buf[offset + 1] << 8) | (md->fat_buf[offset + 0] << 0);
-		break;
+	while(!list_empty(&md->indexes))
+		fat_index_free(md, list_first_entry(&md->indexes, struct fat_index, entry));
 
-	default:
-		return EINVAL;
-	}
+	for(i = 0; i < CONFIG_FATFS_FAT_CACHE_COUNT; i++)
+		free(md->fat_cache[i].buf);
+	free(md->free_map);
+	free(md->dir_buf);
+	free(md->io_buf);
+
+	free(md);
 
-	*next = val;
 	return 0;
 }
 
-/*
- * read directory entry to buffer, with cache.
- */
-static bool_t fat_read_dirent(struct fatfs_mount_data * md, u32_t sector)
+static s32_t fatfs_vget(struct mount_t * m, struct vnode_t * node)
 {
-	loff_t off = sector * md->sector_size;
-	loff_t size = md->sector_size;
+	struct fat_node * np;
 
-	if(block_read(md->blk, (u8_t *)(md->dir_buf), off, size) != size)
-		return FALSE;
+	np = malloc(sizeof(struct fat_node));
+	if(!np)
+		return ENOMEM;
+	memset(np, 0, sizeof(struct fat_node));
+	node->v_data = np;
 
-	return TRUE;
+	return 0;
 }
 
-/*
- * write directory entry from buffer.
- */
-static bool_t fat_write_dirent(struct fatfs_mount_data * md, u32_t sector)
+static s32_t fatfs_statfs(struct mount_t * m, struct statfs * stat)
 {
-	loff_t off = sector * md->sector_size;
-	loff_t size = md->sector_size;
+	struct fatfs_mount_data * md = m->m_data;
+	s32_t err;
 
-	if(block_write(md->blk, (const u8_t *)(md->dir_buf), off, size) != size)
-		return FALSE;
+	if((err = fat_build_map(md)) != 0)
+		return err;
 
-	return TRUE;
+	stat->f_flags = m->m_flags;
+	stat->f_bsize = md->cluster_size;
+	stat->f_blocks = md->last_cluster - 2;
+	stat->f_bfree = md->free_count;
+	stat->f_bavail = md->free_count;
+	stat->f_namelen = 12;
+
+	return 0;
 }
 
 /*
- * find directory entry in specified sector.
+ * vnode operations
  */
-static s32_t fat_lookup_dirent(struct fatfs_mount_data * md, u32_t sec, u8_t * name, struct fat_node * np)
+static s32_t fatfs_open(struct vnode_t * node, s32_t flag)
 {
-	struct fat_dirent * de;
-	s32_t i, num;
-
-	if(fat_read_dirent(md, sec) != TRUE)
-		return EIO;
-
-	de = (struct fat_dirent *)md->dir_buf;
-	num = md->sector_size / sizeof(struct fat_dirent);
+	return 0;
+}
 
-	for(i = 0; i < num; i++)
-	{
-		if(IS_EMPTY(de))
-			return ENOENT;
+static s32_t fatfs_close(struct vnode_t * node, struct file_t * fp)
+{
+	struct fatfs_mount_data * md = node->v_mount->m_data;
+	s32_t err;
 
-		if(!IS_VOL(de) && !fat_compare_name(de->name, name))
-		{
-			*(&np->dirent) = *de;
-			np->sector = sec;
-			np->offset = sizeof(struct fat_dirent) * i;
-			return 0;
-		}
+	if((err = fat_write_node(md, node->v_data)) != 0)
+		return err;
+	return fat_cache_flush(md);
+}
 
-		de++;
-	}
+static loff_t fat_iov_length(const struct iovec * iov, int iovcnt)
+{
+	loff_t size = 0;
 
-	return EAGAIN;
+	for(; iovcnt > 0; iovcnt--, iov++)
+		size += iov->iov_len;
+	return size;
 }
 
-/*
- * find directory entry for specified name in directory.
- */
-static s32_t fat_lookup_node(struct vnode_t * dnode, u8_t * name, struct fat_node * np)
+static s32_t fatfs_readv(struct vnode_t * node, struct file_t * fp, const struct iovec * iov, int iovcnt, loff_t * result)
 {
-	struct fatfs_mount_data * md;
-	u8_t fat_name[12];
-	u32_t cl, sec;
-	s32_t i, err;
+	struct fatfs_mount_data * md = node->v_mount->m_data;
+	loff_t off, size = fat_iov_length(iov, iovcnt);
 
-	if(name == NULL)
-		return ENOENT;
+	*result = 0;
+	if(node->v_type == VDIR)
+		return EISDIR;
+	if(node->v_type != VREG)
+		return EINVAL;
 
-	fat_convert_name(name, fat_name);
-	*(fat_name + 11) = '\0';
+	off = fp->f_offset;
+	if(off >= node->v_size)
+		return 0;
 
-	md = (struct fatfs_mount_data *)dnode->v_mount->m_data;
-	cl = dnode->v_blkno;
-	if(cl == 0)
-	{
-		/* search entry in root directory */
-		for(sec = md->root_start; sec < md->data_start; sec++)
-		{
-			err = fat_lookup_dirent(md, sec, fat_name, np);
-			if(err != EAGAIN)
-				return err;
-		}
-	}
-	else
-	{
-#if 0
-		/* search entry in sub directory */
-		while(! (((cl) & 0xfffffff8) == ((md)->fat_mask & 0xfffffff8)) )
-		{
-            sec = (md->data_start + (cl - 2) * md->sectors_per_cluster);
+	if(node->v_size - off < size)
+		size = node->v_size - off;
+	if(size == 0)
+		return 0;
 
-			for(i = 0; i < md->sectors_per_cluster; i++)
-			{
-				err = fat_lookup_dirent(md, sec, fat_name, np);
-				if(err != EAGAIN)
-					return err;
-				sec++;
-			}
-			err = fat_next_cluster(md, cl, &cl);
-			if(err)
-				return err;
-		}
-#endif
-	}
+	*result = fat_node_rwv(md, node->v_data, &fp->f_ra, iov, iovcnt, off, size, FALSE);
+	fp->f_offset += *result;
 
-	return ENOENT;
+	return (*result > 0) ? 0 : EIO;
 }
 
-/*
- * vnode operations
- */
-static s32_t fatfs_open(struct vnode_t * node, s32_t flag)
+static s32_t fatfs_read(struct vnode_t * node, struct file_t * fp, void * buf, loff_t size, loff_t * result)
 {
-	return 0;
-}
+	struct iovec iov;
 
-static s32_t fatfs_close(struct vnode_t * node, struct file_t * fp)
-{
-	return 0;
+	iov.iov_base = buf;
+	iov.iov_len = size;
+	return fatfs_readv(node, fp, &iov, 1, result);
 }
 
-static s32_t fatfs_read(struct vnode_t * node, struct file_t * fp, void * buf, loff_t size, loff_t * result)
+static s32_t fatfs_writev(struct vnode_t * node , struct file_t * fp, const struct iovec * iov, int iovcnt, loff_t * result)
 {
-	return -1;
+	struct fatfs_mount_data * md = node->v_mount->m_data;
+	struct fat_node * np = node->v_data;
+	loff_t size = fat_iov_length(iov, iovcnt);
+	loff_t pos, end;
+	u32_t need, have;
+	s32_t err;
+
+	*result = 0;
+	if(node->v_type == VDIR)
+		return EISDIR;
+	if(node->v_type != VREG)
+		return EINVAL;
+
+	if(size == 0)
+		return 0;
+
+	pos = (fp->f_flags & O_APPEND) ? node->v_size : fp->f_offset;
+	end = pos + size;
+	if(end > 0xffffffffLL)
+		return EOVERFLOW;
+
+	/* allocate the whole range up front, so runs stay as long as possible */
+	if((err = fat_map_chain(md, np, 0xffffffff)) != 0)
+		return err;
+	need = (end + md->cluster_size - 1) / md->cluster_size;
+	have = fat_extent_clusters(np);
+	if((need > have) && (err = fat_extend(md, np, need - have)) != 0)
+		return err;
+
+	if(pos > node->v_size)
+	{
+		if((err = fat_node_zero(md, np, node->v_size, pos - node->v_size)) != 0)
+			return err;
+		node->v_size = pos;
+	}
+
+	*result = fat_node_rwv(md, np, NULL, iov, iovcnt, pos, size, TRUE);
+	fp->f_offset = pos + *result;
+
+	if(pos + *result > node->v_size)
+	{
+		node->v_size = pos + *result;
+		fat_put32(np->dirent.size, node->v_size);
+		np->dirty = TRUE;
+	}
+	if(!(np->dirent.attr & FAT_ATTR_ARCH))
+	{
+		np->dirent.attr |= FAT_ATTR_ARCH;
+		np->dirty = TRUE;
+	}
+
+	return (*result > 0) ? 0 : EIO;
 }
 
 static s32_t fatfs_write(struct vnode_t * node , struct file_t * fp, void * buf, loff_t size, loff_t * result)
 {
-	return -1;
+	struct iovec iov;
+
+	iov.iov_base = buf;
+	iov.iov_len = size;
+	return fatfs_writev(node, fp, &iov, 1, result);
 }
 
 static s32_t fatfs_seek(struct vnode_t * node, struct file_t * fp, loff_t off1, loff_t off2)
 {
+	if((node->v_type == VREG) && (off2 > 0xffffffffLL))
+		return -1;
+
 	return 0;
 }
 
@@ -789,37 +2192,46 @@ static s32_t fatfs_ioctl(struct vnode_t * node, struct file_t * fp, int cmd, voi
 
 static s32_t fatfs_fsync(struct vnode_t * node, struct file_t * fp)
 {
+	struct fatfs_mount_data * md = node->v_mount->m_data;
+	s32_t err;
+
+	if((err = fat_write_node(md, node->v_data)) != 0)
+		return err;
+	if((err = fat_cache_flush(md)) != 0)
+		return err;
+	block_sync(md->blk);
+
 	return 0;
 }
 
 static s32_t fatfs_readdir(struct vnode_t * node, struct file_t * fp, struct dirent_t * dir)
 {
-	struct fatfs_mount_data * md;
-	struct fat_node np;
-	struct fat_dirent * de;
+	struct fatfs_mount_data * md = node->v_mount->m_data;
+	struct fat_entry fe;
+	u32_t slot = fp->f_offset;
+	char * name;
 	s32_t err;
 
-	LOG("%s\r\n", __FUNCTION__);
-
-	md = node->v_mount->m_data;
-//TODO
-//	err = fatfs_get_node(node, fp->f_offset, &np);
-	if(err != 0)
+	if((err = fat_next_entry(md, node->v_data, &slot, &fe)) != 0)
 		return err;
 
-	de = &np.dirent;
-	fat_restore_name((u8_t *)&de->name, (u8_t *)dir->d_name);
+	/* long name when it fits, the short alias otherwise */
+	if((fe.lname[0] != '\0') && (strlen(fe.lname) < sizeof(dir->d_name)))
+		name = fe.lname;
+	else
+		name = fe.sname;
+	strlcpy(dir->d_name, name, sizeof(dir->d_name));
 
-	if(IS_DIR(de))
+	if(IS_DIR(&fe.dirent))
 		dir->d_type = DT_DIR;
-	else if(IS_FILE(de))
+	else if(IS_FILE(&fe.dirent))
 		dir->d_type = DT_REG;
 	else
 		dir->d_type = DT_UNKNOWN;
 
-	dir->d_fileno = fp->f_offset;
-	dir->d_namlen = strlen((const s8_t *)dir->d_name);
-	fp->f_offset++;
+	dir->d_fileno = fe.slot;
+	dir->d_namlen = strlen((const char *)dir->d_name);
+	fp->f_offset = slot;
 
 	return 0;
 }
@@ -831,51 +2243,207 @@ static s32_t fatfs_lookup(struct vnode_t * dnode, char * name, struct vnode_t *
 	struct fat_dirent * de;
 	s32_t err;
 
-	LOG("%s\r\n", __FUNCTION__);
-
 	if(*name == '\0')
 		return ENOENT;
 
 	md = node->v_mount->m_data;
 
 	np = node->v_data;
-	err = fat_lookup_node(dnode, (u8_t *)name, np);
+	err = fat_lookup_node(dnode, name, np);
 	if(err != 0)
 		return err;
 
 	de = &np->dirent;
+	np->cluster = fat_get16(de->cluster);
+	if(md->type == FAT_TYPE_FAT32)
+		np->cluster |= fat_get16(de->cluster_hi) << 16;
+
+	/* the parent of first level directory points to root */
+	if(IS_DIR(de) && (np->cluster == 0))
+	{
+		np->cluster = md->root_cluster;
+		np->root = TRUE;
+	}
+	list_add(&np->entry, &md->nodes);
+
 	node->v_type = IS_DIR(de) ? VDIR : VREG;
-//	fat_attr_to_mode(de->attr, &vp->v_mode);
 	node->v_mode = S_IRWXU | S_IRWXG | S_IRWXO;
-	node->v_size = de->size;
-	node->v_blkno = de->cluster;
+	if(de->attr & FAT_ATTR_RDONLY)
+		node->v_mode &= ~(S_IWUSR | S_IWGRP | S_IWOTH);
+	node->v_size = IS_DIR(de) ? 0 : fat_get32(de->size);
+	node->v_blkno = np->cluster;
 
 	return 0;
 }
 
+static s32_t fat_make_node(struct vnode_t * dnode, char * name, u8_t attr, u32_t cl)
+{
+	struct fatfs_mount_data * md = dnode->v_mount->m_data;
+	struct fat_dirent de;
+
+	if(!fat_valid_name((u8_t *)name) || (*name == '.'))
+		return EINVAL;
+
+	memset(&de, 0, sizeof(struct fat_dirent));
+	fat_convert_name((u8_t *)name, de.name);
+	de.attr = attr;
+	de.ntres = fat_name_case((u8_t *)name);
+	fat_put16(de.cluster, cl & 0xffff);
+	if(md->type == FAT_TYPE_FAT32)
+		fat_put16(de.cluster_hi, (cl >> 16) & 0xffff);
+
+	return fat_add_dirent(md, dnode->v_data, &de, NULL);
+}
+
 static s32_t fatfs_create(struct vnode_t * node, char * name, u32_t mode)
 {
-	return -1;
+	if(!S_ISREG(mode))
+		return EINVAL;
+
+	return fat_make_node(node, name, FAT_ATTR_ARCH, 0);
 }
 
 static s32_t fatfs_remove(struct vnode_t * dnode, struct vnode_t * node, char * name)
 {
-	return -1;
+	struct fatfs_mount_data * md = node->v_mount->m_data;
+	struct fat_node * np = node->v_data;
+	s32_t err;
+
+	/* the entry goes first, a crash leaks clusters instead of sharing them */
+	err = fat_del_dirent(md, dnode->v_data, np->slot, np->nlfn);
+	if(IS_DIR(&np->dirent) && (np->cluster != 0))
+		fat_index_drop(md, np->cluster);
+	if(err == 0)
+		err = fat_free_chain(md, np->cluster);
+
+	/* vnode is dropped by vgone without inactive */
+	fat_free_node(np);
+	node->v_data = NULL;
+
+	return err;
 }
 
 static s32_t fatfs_rename(struct vnode_t * dnode1, struct vnode_t * node1, char * name1, struct vnode_t *dnode2, struct vnode_t * node2, char * name2)
 {
-	return -1;
+	struct fatfs_mount_data * md = node1->v_mount->m_data;
+	struct fat_node * np = node1->v_data;
+	struct fat_node * dp2 = dnode2->v_data;
+	struct fat_node * tp;
+	struct fat_node old;
+	struct fat_dirent * de;
+	struct fat_dirent entry;
+	u32_t sec, cl;
+	s32_t err;
+
+	if(!fat_valid_name((u8_t *)name2) || (*name2 == '.'))
+		return EINVAL;
+
+	if(node2)
+	{
+		/* remove destination file, first */
+		tp = node2->v_data;
+		if((err = fat_del_dirent(md, dp2, tp->slot, tp->nlfn)) != 0)
+			return err;
+		if(IS_DIR(&tp->dirent) && (tp->cluster != 0))
+			fat_index_drop(md, tp->cluster);
+		if((err = fat_free_chain(md, tp->cluster)) != 0)
+			return err;
+		fat_node_set_cluster(md, tp, 0);
+		fat_extent_reset(tp);
+		tp->dirty = FALSE;
+	}
+
+	memcpy(&entry, &np->dirent, sizeof(struct fat_dirent));
+	fat_convert_name((u8_t *)name2, entry.name);
+	entry.ntres = fat_name_case((u8_t *)name2);
+
+	/*
+	 * a new short entry replaces the old one with its long name slots,
+	 * also within the same directory, which keeps the hash index exact
+	 */
+	old = *np;
+	if((err = fat_add_dirent(md, dp2, &entry, np)) != 0)
+		return err;
+	if((err = fat_del_dirent(md, dnode1->v_data, old.slot, old.nlfn)) != 0)
+		return err;
+	memcpy(&np->dirent, &entry, sizeof(struct fat_dirent));
+	np->dirty = FALSE;
+
+	if(dnode1 == dnode2)
+		return 0;
+
+	/* update the parent link of moved directory */
+	if(IS_DIR(&entry) && (np->cluster != 0))
+	{
+		if((err = fat_get_dirent(md, np, 1, &de, &sec)) != 0)
+			return err;
+		cl = dp2->root ? 0 : dp2->cluster;
+		fat_put16(de->cluster, cl & 0xffff);
+		if(md->type == FAT_TYPE_FAT32)
+			fat_put16(de->cluster_hi, (cl >> 16) & 0xffff);
+		if(fat_write_dirent(md, sec) != TRUE)
+			return EIO;
+	}
+
+	return 0;
 }
 
 static s32_t fatfs_mkdir(struct vnode_t * node, char * name, u32_t mode)
 {
-	return -1;
+	struct fatfs_mount_data * md = node->v_mount->m_data;
+	struct fat_node * dp = node->v_data;
+	struct fat_dirent * de;
+	u32_t cl, n, parent;
+	s32_t err;
+
+	if(!S_ISDIR(mode))
+		return EINVAL;
+
+	if((err = fat_alloc_run(md, 0, 1, &cl, &n)) != 0)
+		return err;
+	if((err = fat_zero_cluster(md, cl)) != 0)
+		goto fail;
+
+	/* the dot and dotdot entries */
+	if(fat_read_dirent(md, fat_cluster_sector(md, cl)) != TRUE)
+	{
+		err = EIO;
+		goto fail;
+	}
+	parent = dp->root ? 0 : dp->cluster;
+	de = (struct fat_dirent *)md->dir_buf;
+	memset(de[0].name, ' ', 11);
+	de[0].name[0] = '.';
+	de[0].attr = FAT_ATTR_SUBDIR;
+	fat_put16(de[0].cluster, cl & 0xffff);
+	memset(de[1].name, ' ', 11);
+	de[1].name[0] = '.';
+	de[1].name[1] = '.';
+	de[1].attr = FAT_ATTR_SUBDIR;
+	fat_put16(de[1].cluster, parent & 0xffff);
+	if(md->type == FAT_TYPE_FAT32)
+	{
+		fat_put16(de[0].cluster_hi, (cl >> 16) & 0xffff);
+		fat_put16(de[1].cluster_hi, (parent >> 16) & 0xffff);
+	}
+	if(fat_write_dirent(md, fat_cluster_sector(md, cl)) != TRUE)
+	{
+		err = EIO;
+		goto fail;
+	}
+
+	if((err = fat_make_node(node, name, FAT_ATTR_SUBDIR, cl)) != 0)
+		goto fail;
+	return 0;
+
+fail:
+	fat_free_chain(md, cl);
+	return err;
 }
 
 static s32_t fatfs_rmdir(struct vnode_t * dnode, struct vnode_t * node, char * name)
 {
-	return -1;
+	return fatfs_remove(dnode, node, name);
 }
 
 static s32_t fatfs_getattr(struct vnode_t * node, struct vattr_t * attr)
@@ -890,12 +2458,59 @@ static s32_t fatfs_setattr(struct vnode_t * node, struct vattr_t * attr)
 
 static s32_t fatfs_inactive(struct vnode_t * node)
 {
-	return -1;
+	struct fatfs_mount_data * md = node->v_mount->m_data;
+	struct fat_node * np = node->v_data;
+
+	if(np)
+	{
+		fat_write_node(md, np);
+		fat_free_node(np);
+		node->v_data = NULL;
+	}
+
+	return 0;
 }
 
 static s32_t fatfs_truncate(struct vnode_t * node, loff_t length)
 {
-	return -1;
+	struct fatfs_mount_data * md = node->v_mount->m_data;
+	struct fat_node * np = node->v_data;
+	u32_t need, have;
+	s32_t err;
+
+	if(node->v_type == VDIR)
+		return EISDIR;
+	if(length > 0xffffffffLL)
+		return EOVERFLOW;
+
+	need = (length + md->cluster_size - 1) / md->cluster_size;
+	if((err = fat_map_chain(md, np, 0xffffffff)) != 0)
+		return err;
+	have = fat_extent_clusters(np);
+
+	if(need < have)
+	{
+		if((err = fat_shrink(md, np, need)) != 0)
+			return err;
+	}
+	else if(need > have)
+	{
+		if((err = fat_extend(md, np, need - have)) != 0)
+			return err;
+	}
+
+	if(length > node->v_size)
+	{
+		if((err = fat_node_zero(md, np, node->v_size, length - node->v_size)) != 0)
+			return err;
+	}
+
+	node->v_size = length;
+	fat_put32(np->dirent.size, length);
+	np->dirent.attr |= FAT_ATTR_ARCH;
+	np->dirty = TRUE;
+
+	return 0;
 }
 
 /*
@@ -920,6 +2535,8 @@ static struct vnops_t fatfs_vnops = {
 	.vop_setattr	= fatfs_setattr,
 	.vop_inactive	= fatfs_inactive,
 	.vop_truncate	= fatfs_truncate,
+	.vop_readv		= fatfs_readv,
+	.vop_writev		= fatfs_writev,
 };
 
 /*
@@ -935,7 +2552,7 @@ static struct vfsops_t fatfs_vfsops = {
 };
 
 /*
- * fatfs filesystem
+ * fatfs filesystem
  */
 static struct filesystem_t fatfs = {
 	.name		= "fatfs",
@@ -954,5 +2571,3 @@ static __exit void filesystem_fatfs_exit(void)
 
 core_initcall(filesystem_fatfs_init);
 core_exitcall(filesystem_fatfs_exit);
-
-#endif
@@ -40,12 +40,15 @@
 int mount(const char * dev, const char * dir, const char * fs, u32_t flags)
 {
 	char dir_path[MAX_PATH];
-	int err;
+	int id, err;
 
 	if((err = vfs_path_conv(dir, dir_path)) != 0)
 		return err;
 
-	return sys_mount((char *)dev, dir_path, (char *)fs, flags);
+	id = tracer_begin(TRACE_TYPE_MOUNT, "%s %s", fs, dir_path);
+	err = sys_mount((char *)dev, dir_path, (char *)fs, flags);
+	tracer_end(id);
+	return err;
 }
 
 /*
@@ -542,44 +545,62 @@ int truncate(const char * path, loff_t length)
 	return sys_truncate(buf, length);
 }
 
+/*
+ * read from file into multiple buffers
+ */
 ssize_t readv(int fd, const struct iovec * iov, int iovcnt)
 {
-	ssize_t count = 0;
-	ssize_t bytes;
+	struct file_t * fp;
+	loff_t bytes;
 
-	while(iovcnt-- > 0)
-	{
-		bytes = read(fd, iov->iov_base, iov->iov_len);
-		if(bytes < 0)
-			return (-1);
+	if(fd < 0)
+		return -1;
 
-		count += bytes;
-		if (bytes != iov->iov_len)
-			break;
+	if((fp = get_fp(fd)) == NULL)
+		return -1;
 
-		iov++;
-	}
+	if(sys_readv(fp, iov, iovcnt, &bytes) != 0)
+		return -1;
 
-	return (count);
+	return bytes;
 }
 
+/*
+ * write to file from multiple buffers
+ */
 ssize_t writev(int fd, const struct iovec * iov, int iovcnt)
 {
-	ssize_t count = 0;
-	ssize_t bytes;
+	struct file_t * fp;
+	loff_t bytes;
 
-	while(iovcnt-- > 0)
-	{
-		bytes = write(fd, iov->iov_base, iov->iov_len);
-		if (bytes < 0)
-			return (-1);
+	if(fd < 0)
+		return -1;
 
-		count += bytes;
-		if (bytes != iov->iov_len)
-			break;
+	if((fp = get_fp(fd)) == NULL)
+		return -1;
 
-		iov++;
-	}
+	if(sys_writev(fp, iov, iovcnt, &bytes) != 0)
+		return -1;
+
+	return bytes;
+}
 
-	return (count);
+/*
+ * copy a range of data from one file to another
+ */
+loff_t copy_range(int ifd, loff_t * ioff, int ofd, loff_t * ooff, loff_t len)
+{
+	struct file_t * ifp, * ofp;
+	loff_t bytes;
+
+	if((ifd < 0) || (ofd < 0))
+		return -1;
+
+	if(((ifp = get_fp(ifd)) == NULL) || ((ofp = get_fp(ofd)) == NULL))
+		return -1;
+
+	if(sys_copy_range(ifp, ioff, ofp, ooff, len, &bytes) != 0)
+		return -1;
+
+	return bytes;
 }
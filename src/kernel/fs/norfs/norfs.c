@@ -0,0 +1,2006 @@
+/*
+ * kernel/fs/norfs/norfs.c
+ *
+ * Copyright(c) 2007-2018 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <xboot.h>
+#include <crc32.h>
+#include <block/block.h>
+#include <fs/vfs/vfs.h>
+#include <fs/fs.h>
+
+/*
+ * NORFS - Log Structured File System For Nor Flash
+ *
+ * Every erase block of the device is a filesystem block. Blocks 0 and 1 hold
+ * the superblock, which points to the root directory.
+ *
+ * A directory is a pair of blocks. Each block starts with a revision count,
+ * followed by commits appended to the log. A commit is a run of records
+ * (name, delete, inline data, file head, directory pair) closed by a crc.
+ * Appending a commit to an erased tail costs a page program. Fetching
+ * replays the block with the newest revision, and a torn commit fails its
+ * crc and is dropped. When a block is full, the live records are compacted
+ * into the other block of the pair with the next revision. Every few
+ * hundred compactions the pair moves to a newly allocated block.
+ *
+ * Small files live inline in their directory. Larger files are copy on
+ * write chains of blocks. Block n of a chain stores ctz(n) + 1 back pointers,
+ * so a seek follows at most log(n) pointers. Appends fill the erased tail of
+ * the last block in place. All other writes go to new blocks, and nothing is
+ * visible until the directory commit that follows.
+ *
+ * No free space map is stored. The allocator scans the tree for used blocks
+ * in a lookahead window, and the window walks around the device from a
+ * random start at mount. Mounting only reads the superblock and the root.
+ *
+ * Appends to a directory log or to the last block of a file go through
+ * block_program, so the committed part of the block is never erased. Whole
+ * blocks are written with block_write, which erases them first. Devices
+ * without a program callback are mounted read only.
+ *
+ * A power cut inside a rename across directories can leave the entry under
+ * both names. Both names still refer to valid blocks.
+ */
+
+#define NORFS_MAGIC			(0x5346524e)
+#define NORFS_VERSION		(0x00010000)
+#define NORFS_NULL			(0xffffffff)
+#define NORFS_NAME_MAX		(MAX_NAME - 1)
+#define NORFS_DEPTH_MAX		(MAX_PATH / 2)
+
+enum norfs_type_t {
+	NORFS_TYPE_SUPER	= 0x0001,
+	NORFS_TYPE_REG		= 0x0010,
+	NORFS_TYPE_DIR		= 0x0011,
+	NORFS_TYPE_DELETE	= 0x0020,
+	NORFS_TYPE_INLINE	= 0x0030,
+	NORFS_TYPE_CTZ		= 0x0031,
+	NORFS_TYPE_PAIR		= 0x0032,
+	NORFS_TYPE_CRC		= 0x00f0,
+};
+
+enum {
+	NORFS_NODE_INLINE	= (1 << 0),
+	NORFS_NODE_DIRTY	= (1 << 1),
+	NORFS_NODE_WRITING	= (1 << 2),
+};
+
+struct norfs_super_t {
+	u32_t magic;
+	u32_t version;
+	u32_t blksz;
+	u32_t blkcnt;
+	u32_t name_max;
+	u32_t inline_max;
+};
+
+struct norfs_tag_t {
+	u16_t type;
+	u16_t id;
+	u32_t len;
+};
+
+struct norfs_attr_t {
+	u16_t type;
+	u16_t id;
+	u32_t len;
+	const void * data;
+};
+
+struct norfs_entry_t {
+	u32_t name;
+	u32_t data;
+};
+
+struct norfs_mdir_t {
+	u32_t pair[2];
+	u32_t rev;
+	u32_t off;
+	u32_t crc;
+	bool_t erased;
+};
+
+struct norfs_node_t {
+	struct list_head entry;
+	u32_t pair[2];			/* metadata pair of directory */
+	u32_t ppair[2];			/* metadata pair of parent directory */
+	u32_t gpair[2];			/* metadata pair of the parent's parent */
+	u16_t id;				/* entry id in parent directory */
+	u16_t pid;				/* entry id of parent directory */
+	u32_t flags;
+	u32_t head;				/* last block of committed chain */
+	u32_t size;				/* size of committed chain or inline data */
+	u8_t * idata;			/* inline data */
+	u32_t block;			/* block being written */
+	u32_t off;				/* offset in block being written */
+	u32_t prog;				/* bytes of block already on flash, zero for a new block */
+	u32_t pos;				/* file position of write cursor */
+	u8_t * cache;			/* data of block being written */
+};
+
+struct norfs_mount_data_t {
+	struct block_t * blk;
+	u32_t blksz;
+	u32_t blkcnt;
+	u32_t inline_max;
+	struct norfs_node_t * root;
+	struct list_head nodes;
+
+	u8_t * mbuf;
+	u8_t * cbuf;
+	u8_t * tbuf;
+	struct norfs_entry_t * ents;
+	u32_t nents;
+	u32_t nids;
+
+	u8_t * la_map;
+	u32_t la_max;
+	u32_t la_start;
+	u32_t la_size;
+	u32_t la_next;
+	u32_t la_ack;
+};
+
+typedef void (*norfs_traverse_cb_t)(struct norfs_mount_data_t * md, u32_t block, void * data);
+
+static const u32_t norfs_super_pair[2] = { 0, 1 };
+
+static s32_t norfs_alloc(struct norfs_mount_data_t * md, u32_t * block);
+
+static inline u32_t norfs_align(u32_t len)
+{
+	return (len + 3) & ~3;
+}
+
+static inline u32_t norfs_min(u32_t a, u32_t b)
+{
+	return (a < b) ? a : b;
+}
+
+static inline struct norfs_tag_t * norfs_tag(u8_t * buf, u32_t off)
+{
+	return (struct norfs_tag_t *)(buf + off);
+}
+
+static inline void * norfs_payload(u8_t * buf, u32_t off)
+{
+	return buf + off + sizeof(struct norfs_tag_t);
+}
+
+static inline u32_t norfs_record_size(u32_t len)
+{
+	return sizeof(struct norfs_tag_t) + norfs_align(len);
+}
+
+static inline bool_t norfs_is_name(u16_t type)
+{
+	return (type == NORFS_TYPE_SUPER) || (type == NORFS_TYPE_REG) || (type == NORFS_TYPE_DIR);
+}
+
+static inline bool_t norfs_is_struct(u16_t type)
+{
+	return (type == NORFS_TYPE_INLINE) || (type == NORFS_TYPE_CTZ) || (type == NORFS_TYPE_PAIR);
+}
+
+static inline bool_t norfs_pair_equal(const u32_t * a, const u32_t * b)
+{
+	return ((a[0] == b[0]) && (a[1] == b[1])) || ((a[0] == b[1]) && (a[1] == b[0]));
+}
+
+static inline void norfs_pair_copy(u32_t * dst, const u32_t * src)
+{
+	dst[0] = src[0];
+	dst[1] = src[1];
+}
+
+static bool_t norfs_blank(const u8_t * buf, u32_t len)
+{
+	while(len--)
+	{
+		if(*buf++ != 0xff)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+static s32_t norfs_bread(struct norfs_mount_data_t * md, u32_t block, u32_t off, void * buf, u32_t len)
+{
+	if((block >= md->blkcnt) || (off + len > md->blksz))
+		return EIO;
+	if(block_read(md->blk, buf, (u64_t)block * md->blksz + off, len) != len)
+		return EIO;
+	return 0;
+}
+
+static s32_t norfs_bprog(struct norfs_mount_data_t * md, u32_t block, void * buf)
+{
+	if(block >= md->blkcnt)
+		return EIO;
+	if(block_write(md->blk, buf, (u64_t)block * md->blksz, md->blksz) != md->blksz)
+		return EIO;
+	return 0;
+}
+
+/*
+ * program the erased tail of a block, the part before it is left untouched
+ */
+static s32_t norfs_bappend(struct norfs_mount_data_t * md, u32_t block, u32_t off, void * buf, u32_t len)
+{
+	if((block >= md->blkcnt) || (off + len > md->blksz))
+		return EIO;
+	if((len > 0) && (block_program(md->blk, buf, (u64_t)block * md->blksz + off, len) != len))
+		return EIO;
+	return 0;
+}
+
+/*
+ * read from the write cache of node, if the block is still being written
+ */
+static s32_t norfs_node_bread(struct norfs_mount_data_t * md, struct norfs_node_t * np, u32_t block, u32_t off, void * buf, u32_t len)
+{
+	if(np && (np->flags & NORFS_NODE_WRITING) && (np->block == block))
+	{
+		memcpy(buf, np->cache + off, len);
+		return 0;
+	}
+	return norfs_bread(md, block, off, buf, len);
+}
+
+/*
+ * metadata pair
+ */
+static bool_t norfs_mdir_parse(struct norfs_mount_data_t * md, u32_t block, u8_t * buf, struct norfs_mdir_t * m)
+{
+	struct norfs_tag_t * t;
+	u32_t off, len, crc;
+
+	if(norfs_bread(md, block, 0, buf, md->blksz) != 0)
+		return FALSE;
+
+	m->rev = *((u32_t *)buf);
+	m->off = 0;
+	crc = crc32_sum(0, buf, sizeof(u32_t));
+	off = sizeof(u32_t);
+
+	while(off + sizeof(struct norfs_tag_t) <= md->blksz)
+	{
+		t = norfs_tag(buf, off);
+		if((t->type == 0xffff) || (t->len > md->blksz))
+			break;
+		len = norfs_record_size(t->len);
+		if(off + len > md->blksz)
+			break;
+
+		if(t->type == NORFS_TYPE_CRC)
+		{
+			if(t->len != sizeof(u32_t))
+				break;
+			crc = crc32_sum(crc, buf + off, sizeof(struct norfs_tag_t));
+			if(*((u32_t *)norfs_payload(buf, off)) != crc)
+				break;
+			crc = crc32_sum(crc, norfs_payload(buf, off), sizeof(u32_t));
+			m->off = off + len;
+			m->crc = crc;
+		}
+		else
+		{
+			crc = crc32_sum(crc, buf + off, len);
+		}
+		off += len;
+	}
+
+	if(m->off == 0)
+		return FALSE;
+	m->erased = norfs_blank(buf + m->off, md->blksz - m->off);
+	return TRUE;
+}
+
+static s32_t norfs_mdir_fetch(struct norfs_mount_data_t * md, const u32_t * pair, struct norfs_mdir_t * m, u8_t * buf)
+{
+	u32_t rev[2];
+	int i, first;
+
+	for(i = 0; i < 2; i++)
+	{
+		if(norfs_bread(md, pair[i], 0, &rev[i], sizeof(u32_t)) != 0)
+			return EIO;
+	}
+
+	/* the newer revision first, the other one if the compaction was torn */
+	first = ((s32_t)(rev[1] - rev[0]) > 0) ? 1 : 0;
+	for(i = 0; i < 2; i++)
+	{
+		if(norfs_mdir_parse(md, pair[first ^ i], buf, m))
+		{
+			m->pair[0] = pair[first ^ i];
+			m->pair[1] = pair[first ^ i ^ 1];
+			return 0;
+		}
+	}
+	return EIO;
+}
+
+/*
+ * find the live name and data record of every id in the fetched block
+ */
+static void norfs_mdir_scan(struct norfs_mount_data_t * md, struct norfs_mdir_t * m, u8_t * buf)
+{
+	struct norfs_entry_t * e;
+	struct norfs_tag_t * t;
+	u32_t off;
+
+	memset(md->ents, 0, sizeof(struct norfs_entry_t) * md->nents);
+	md->nids = 0;
+
+	for(off = sizeof(u32_t); off < m->off; off += norfs_record_size(t->len))
+	{
+		t = norfs_tag(buf, off);
+		if(t->id >= md->nents)
+			continue;
+		e = &md->ents[t->id];
+
+		if(norfs_is_name(t->type))
+		{
+			/* a name for a live id is a rename */
+			if(!e->name)
+				e->data = 0;
+			e->name = off;
+		}
+		else if(t->type == NORFS_TYPE_DELETE)
+		{
+			e->name = 0;
+			e->data = 0;
+		}
+		else if(norfs_is_struct(t->type))
+		{
+			e->data = off;
+		}
+		else
+		{
+			continue;
+		}
+		if(t->id >= md->nids)
+			md->nids = t->id + 1;
+	}
+}
+
+static s32_t norfs_mdir_find(struct norfs_mount_data_t * md, u8_t * buf, const char * name, u16_t * id)
+{
+	struct norfs_tag_t * t;
+	u32_t len = strlen(name);
+	u32_t i;
+
+	for(i = 0; i < md->nids; i++)
+	{
+		if(!md->ents[i].name)
+			continue;
+		t = norfs_tag(buf, md->ents[i].name);
+		if(((t->type == NORFS_TYPE_REG) || (t->type == NORFS_TYPE_DIR)) && (t->len == len) && (memcmp(norfs_payload(buf, md->ents[i].name), name, len) == 0))
+		{
+			*id = i;
+			return 0;
+		}
+	}
+	return ENOENT;
+}
+
+static s32_t norfs_mdir_free_id(struct norfs_mount_data_t * md, u16_t * id)
+{
+	u32_t i;
+
+	for(i = 0; i < md->nents; i++)
+	{
+		if(!md->ents[i].name)
+		{
+			*id = i;
+			return 0;
+		}
+	}
+	return ENOSPC;
+}
+
+static u32_t norfs_emit(u8_t * buf, u32_t off, u16_t type, u16_t id, u32_t len, const void * data)
+{
+	struct norfs_tag_t * t = norfs_tag(buf, off);
+
+	t->type = type;
+	t->id = id;
+	t->len = len;
+	if(len > 0)
+		memcpy(norfs_payload(buf, off), data, len);
+	if(norfs_align(len) > len)
+		memset((u8_t *)norfs_payload(buf, off) + len, 0, norfs_align(len) - len);
+	return off + norfs_record_size(len);
+}
+
+static u32_t norfs_seal(u8_t * buf, u32_t off, u32_t * crc)
+{
+	struct norfs_tag_t * t = norfs_tag(buf, off);
+
+	t->type = NORFS_TYPE_CRC;
+	t->id = 0xffff;
+	t->len = sizeof(u32_t);
+	*crc = crc32_sum(*crc, buf + off, sizeof(struct norfs_tag_t));
+	*((u32_t *)norfs_payload(buf, off)) = *crc;
+	*crc = crc32_sum(*crc, norfs_payload(buf, off), sizeof(u32_t));
+	return off + norfs_record_size(sizeof(u32_t));
+}
+
+/*
+ * update the pair of open nodes after a directory moved
+ */
+static void norfs_relocate(struct norfs_mount_data_t * md, const u32_t * old, const u32_t * pair)
+{
+	struct norfs_node_t * np;
+
+	np = md->root;
+	if(norfs_pair_equal(np->pair, old))
+		norfs_pair_copy(np->pair, pair);
+
+	list_for_each_entry(np, &md->nodes, entry)
+	{
+		if(norfs_pair_equal(np->pair, old))
+			norfs_pair_copy(np->pair, pair);
+		if(norfs_pair_equal(np->ppair, old))
+			norfs_pair_copy(np->ppair, pair);
+		if((np->gpair[0] != NORFS_NULL) && norfs_pair_equal(np->gpair, old))
+			norfs_pair_copy(np->gpair, pair);
+	}
+}
+
+static s32_t norfs_commit(struct norfs_mount_data_t * md, const u32_t * pair, u32_t * ppair, u16_t pid, const struct norfs_attr_t * attrs, int n);
+
+/*
+ * write the live records and the new ones into the other block of the pair,
+ * or into a new block when the pair has been erased often enough.
+ */
+static s32_t norfs_mdir_compact(struct norfs_mount_data_t * md, struct norfs_mdir_t * m, u32_t * ppair, u16_t pid, const struct norfs_attr_t * attrs, int n)
+{
+	const struct norfs_attr_t * name, * data;
+	struct norfs_attr_t a;
+	struct norfs_tag_t * t;
+	u8_t * out = md->cbuf;
+	u32_t old[2], rev, off, crc, len, nb, used = 0;
+	bool_t drop, relocate;
+	u8_t * tmp;
+	s32_t err;
+	u32_t id;
+	int i;
+
+	norfs_mdir_scan(md, m, md->mbuf);
+	memset(out, 0xff, md->blksz);
+	rev = m->rev + 1;
+	*((u32_t *)out) = rev;
+	off = sizeof(u32_t);
+
+	for(id = 0; id < md->nids; id++)
+	{
+		if(!md->ents[id].name)
+			continue;
+
+		name = NULL;
+		data = NULL;
+		drop = FALSE;
+		for(i = 0; i < n; i++)
+		{
+			if(attrs[i].id != id)
+				continue;
+			if(attrs[i].type == NORFS_TYPE_DELETE)
+				drop = TRUE;
+			else if(norfs_is_name(attrs[i].type))
+				name = &attrs[i];
+			else if(norfs_is_struct(attrs[i].type))
+				data = &attrs[i];
+			used |= 1 << i;
+		}
+		if(drop)
+			continue;
+
+		len = name ? norfs_record_size(name->len) : norfs_record_size(norfs_tag(md->mbuf, md->ents[id].name)->len);
+		if(data)
+			len += norfs_record_size(data->len);
+		else if(md->ents[id].data)
+			len += norfs_record_size(norfs_tag(md->mbuf, md->ents[id].data)->len);
+		if(off + len + norfs_record_size(sizeof(u32_t)) > md->blksz)
+			return ENOSPC;
+
+		if(name)
+		{
+			off = norfs_emit(out, off, name->type, name->id, name->len, name->data);
+		}
+		else
+		{
+			t = norfs_tag(md->mbuf, md->ents[id].name);
+			memcpy(out + off, t, norfs_record_size(t->len));
+			off += norfs_record_size(t->len);
+		}
+		if(data)
+		{
+			off = norfs_emit(out, off, data->type, data->id, data->len, data->data);
+		}
+		else if(md->ents[id].data)
+		{
+			t = norfs_tag(md->mbuf, md->ents[id].data);
+			memcpy(out + off, t, norfs_record_size(t->len));
+			off += norfs_record_size(t->len);
+		}
+	}
+
+	for(i = 0; i < n; i++)
+	{
+		if((used & (1 << i)) || (attrs[i].type == NORFS_TYPE_DELETE))
+			continue;
+		if(off + norfs_record_size(attrs[i].len) + norfs_record_size(sizeof(u32_t)) > md->blksz)
+			return ENOSPC;
+		off = norfs_emit(out, off, attrs[i].type, attrs[i].id, attrs[i].len, attrs[i].data);
+	}
+	crc = crc32_sum(0, out, off);
+	off = norfs_seal(out, off, &crc);
+
+	/* wear leveling, move the pair away from blocks that have been erased a lot */
+	relocate = (ppair != NULL) && ((rev % CONFIG_NORFS_BLOCK_CYCLES) == 0) && (norfs_alloc(md, &nb) == 0);
+	if(!relocate)
+		nb = m->pair[1];
+
+	block_sync(md->blk);
+	if(norfs_bprog(md, nb, out) != 0)
+		return EIO;
+	block_sync(md->blk);
+
+	tmp = md->mbuf;
+	md->mbuf = md->cbuf;
+	md->cbuf = tmp;
+	old[0] = m->pair[0];
+	old[1] = m->pair[1];
+	m->pair[0] = nb;
+	m->pair[1] = old[0];
+	m->rev = rev;
+	m->off = off;
+	m->crc = crc;
+	m->erased = TRUE;
+
+	if(relocate)
+	{
+		a.type = NORFS_TYPE_PAIR;
+		a.id = pid;
+		a.len = sizeof(u32_t) * 2;
+		a.data = m->pair;
+		if((err = norfs_commit(md, ppair, NULL, 0, &a, 1)) != 0)
+			return err;
+		norfs_relocate(md, old, m->pair);
+	}
+	return 0;
+}
+
+/*
+ * append a commit to the fetched block, or compact it when full
+ */
+static s32_t norfs_mdir_commit(struct norfs_mount_data_t * md, struct norfs_mdir_t * m, u32_t * ppair, u16_t pid, const struct norfs_attr_t * attrs, int n)
+{
+	u8_t * buf = md->mbuf;
+	u32_t off, len, crc;
+	int i;
+
+	len = norfs_record_size(sizeof(u32_t));
+	for(i = 0; i < n; i++)
+		len += norfs_record_size(attrs[i].len);
+
+	if(!m->erased || (m->off + len > md->blksz))
+		return norfs_mdir_compact(md, m, ppair, pid, attrs, n);
+
+	off = m->off;
+	for(i = 0; i < n; i++)
+		off = norfs_emit(buf, off, attrs[i].type, attrs[i].id, attrs[i].len, attrs[i].data);
+	crc = crc32_sum(m->crc, buf + m->off, off - m->off);
+	off = norfs_seal(buf, off, &crc);
+
+	/* the data blocks must be on flash before the commit referencing them */
+	block_sync(md->blk);
+	if(norfs_bappend(md, m->pair[0], m->off, buf + m->off, off - m->off) != 0)
+		return EIO;
+	block_sync(md->blk);
+
+	m->off = off;
+	m->crc = crc;
+	return 0;
+}
+
+static s32_t norfs_commit(struct norfs_mount_data_t * md, const u32_t * pair, u32_t * ppair, u16_t pid, const struct norfs_attr_t * attrs, int n)
+{
+	struct norfs_mdir_t m;
+	s32_t err;
+
+	if((err = norfs_mdir_fetch(md, pair, &m, md->mbuf)) != 0)
+		return err;
+	return norfs_mdir_commit(md, &m, ppair, pid, attrs, n);
+}
+
+/*
+ * write the first revision of a new metadata pair. the revision follows
+ * whatever is left in the other block, so a stale log there never wins.
+ */
+static s32_t norfs_mdir_create(struct norfs_mount_data_t * md, const u32_t * pair, const struct norfs_attr_t * attrs, int n)
+{
+	struct norfs_mdir_t m;
+
+	if(norfs_bread(md, pair[1], 0, &m.rev, sizeof(u32_t)) != 0)
+		return EIO;
+	m.pair[0] = pair[1];
+	m.pair[1] = pair[0];
+	m.off = sizeof(u32_t);
+	m.crc = 0;
+	m.erased = FALSE;
+
+	return norfs_mdir_compact(md, &m, NULL, 0, attrs, n);
+}
+
+/*
+ * skip list of file blocks
+ */
+static u32_t norfs_ctz_index(struct norfs_mount_data_t * md, u32_t * off)
+{
+	u32_t size = *off;
+	u32_t b = md->blksz - sizeof(u32_t) * 2;
+	u32_t i = size / b;
+
+	if(i == 0)
+		return 0;
+	i = (size - sizeof(u32_t) * (__builtin_popcount(i - 1) + 2)) / b;
+	*off = size - b * i - sizeof(u32_t) * __builtin_popcount(i);
+	return i;
+}
+
+static s32_t norfs_ctz_find(struct norfs_mount_data_t * md, struct norfs_node_t * np, u32_t head, u32_t size, u32_t pos, u32_t * block, u32_t * off)
+{
+	u32_t current, target, skip;
+	u32_t last = size - 1;
+
+	current = norfs_ctz_index(md, &last);
+	target = norfs_ctz_index(md, &pos);
+
+	while(current > target)
+	{
+		skip = norfs_min(fls(current - target) - 1, __ffs(current));
+		if(norfs_node_bread(md, np, head, sizeof(u32_t) * skip, &head, sizeof(u32_t)) != 0)
+			return EIO;
+		current -= 1 << skip;
+	}
+
+	*block = head;
+	*off = pos;
+	return 0;
+}
+
+static s32_t norfs_ctz_read(struct norfs_mount_data_t * md, u32_t head, u32_t size, u32_t pos, u8_t * buf, u32_t len)
+{
+	u32_t block, off, n;
+	s32_t err;
+
+	while(len > 0)
+	{
+		if((err = norfs_ctz_find(md, NULL, head, size, pos, &block, &off)) != 0)
+			return err;
+		n = norfs_min(len, md->blksz - off);
+		if((err = norfs_bread(md, block, off, buf, n)) != 0)
+			return err;
+		pos += n;
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static s32_t norfs_ctz_traverse(struct norfs_mount_data_t * md, struct norfs_node_t * np, u32_t head, u32_t size, norfs_traverse_cb_t cb, void * data)
+{
+	u32_t heads[2];
+	u32_t index, count;
+	u32_t last = size - 1;
+
+	if(size == 0)
+		return 0;
+
+	index = norfs_ctz_index(md, &last);
+	while(1)
+	{
+		cb(md, head, data);
+		if(index == 0)
+			return 0;
+
+		/* odd blocks have one pointer, even ones at least two */
+		count = 2 - (index & 1);
+		if(norfs_node_bread(md, np, head, 0, heads, sizeof(u32_t) * count) != 0)
+			return EIO;
+		if(count == 2)
+			cb(md, heads[0], data);
+		head = heads[count - 1];
+		index -= count;
+	}
+}
+
+/*
+ * walk every block in use
+ */
+static bool_t norfs_record_live(u8_t * buf, u32_t off, u32_t end)
+{
+	struct norfs_tag_t * t = norfs_tag(buf, off);
+	u16_t id = t->id;
+
+	for(off += norfs_record_size(t->len); off < end; off += norfs_record_size(t->len))
+	{
+		t = norfs_tag(buf, off);
+		if((t->id == id) && ((t->type == NORFS_TYPE_DELETE) || norfs_is_struct(t->type)))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+static s32_t norfs_traverse_dir(struct norfs_mount_data_t * md, const u32_t * pair, u32_t depth, norfs_traverse_cb_t cb, void * data)
+{
+	struct norfs_mdir_t m;
+	struct norfs_tag_t * t;
+	u32_t off = sizeof(u32_t);
+	u32_t v[2];
+	s32_t err;
+
+	if(depth > NORFS_DEPTH_MAX)
+		return EIO;
+	cb(md, pair[0], data);
+	cb(md, pair[1], data);
+
+	/*
+	 * the buffer is shared with subdirectories, fetch again after each one
+	 */
+	while(1)
+	{
+		if((err = norfs_mdir_fetch(md, pair, &m, md->tbuf)) != 0)
+			return err;
+
+		for(; off < m.off; off += norfs_record_size(t->len))
+		{
+			t = norfs_tag(md->tbuf, off);
+			if(((t->type == NORFS_TYPE_CTZ) || (t->type == NORFS_TYPE_PAIR)) && norfs_record_live(md->tbuf, off, m.off))
+				break;
+		}
+		if(off >= m.off)
+			return 0;
+
+		memcpy(v, norfs_payload(md->tbuf, off), sizeof(v));
+		off += norfs_record_size(t->len);
+		if(t->type == NORFS_TYPE_CTZ)
+			err = norfs_ctz_traverse(md, NULL, v[0], v[1], cb, data);
+		else
+			err = norfs_traverse_dir(md, v, depth + 1, cb, data);
+		if(err != 0)
+			return err;
+	}
+}
+
+static s32_t norfs_traverse(struct norfs_mount_data_t * md, norfs_traverse_cb_t cb, void * data, bool_t nodes)
+{
+	struct norfs_node_t * np;
+	s32_t err;
+
+	cb(md, norfs_super_pair[0], data);
+	cb(md, norfs_super_pair[1], data);
+	if((err = norfs_traverse_dir(md, md->root->pair, 0, cb, data)) != 0)
+		return err;
+
+	if(!nodes)
+		return 0;
+
+	/* blocks of open files that are not committed yet */
+	list_for_each_entry(np, &md->nodes, entry)
+	{
+		if(!(np->flags & NORFS_NODE_INLINE) && (np->flags & NORFS_NODE_DIRTY))
+		{
+			if((err = norfs_ctz_traverse(md, NULL, np->head, np->size, cb, data)) != 0)
+				return err;
+		}
+		if(np->flags & NORFS_NODE_WRITING)
+		{
+			cb(md, np->block, data);
+			if((err = norfs_ctz_traverse(md, np, np->block, np->pos, cb, data)) != 0)
+				return err;
+		}
+	}
+	return 0;
+}
+
+/*
+ * block allocator
+ */
+static void norfs_lookahead_mark(struct norfs_mount_data_t * md, u32_t block, void * data)
+{
+	u32_t off = (block + md->blkcnt - md->la_start) % md->blkcnt;
+
+	if(off < md->la_size)
+		md->la_map[off / 8] |= 1 << (off % 8);
+}
+
+static void norfs_count_mark(struct norfs_mount_data_t * md, u32_t block, void * data)
+{
+	(*((u32_t *)data))++;
+}
+
+/*
+ * everything allocated so far is referenced by a commit or an open node,
+ * so the allocator may look at the whole device again
+ */
+static void norfs_alloc_ack(struct norfs_mount_data_t * md)
+{
+	md->la_ack = md->blkcnt;
+}
+
+static s32_t norfs_alloc(struct norfs_mount_data_t * md, u32_t * block)
+{
+	u32_t i;
+	s32_t err;
+
+	while(1)
+	{
+		while(md->la_next < md->la_size)
+		{
+			i = md->la_next++;
+			md->la_ack--;
+			if(!(md->la_map[i / 8] & (1 << (i % 8))))
+			{
+				*block = (md->la_start + i) % md->blkcnt;
+				return 0;
+			}
+		}
+
+		/* no block is visited twice until the next ack */
+		if(md->la_ack == 0)
+			return ENOSPC;
+
+		md->la_start = (md->la_start + md->la_size) % md->blkcnt;
+		md->la_size = norfs_min(md->la_max, md->la_ack);
+		md->la_next = 0;
+		memset(md->la_map, 0, (md->la_max + 7) / 8);
+		if((err = norfs_traverse(md, norfs_lookahead_mark, NULL, TRUE)) != 0)
+		{
+			md->la_size = 0;
+			return err;
+		}
+	}
+}
+
+/*
+ * file data
+ */
+static inline u32_t norfs_file_size(struct norfs_node_t * np)
+{
+	if((np->flags & NORFS_NODE_WRITING) && (np->pos > np->size))
+		return np->pos;
+	return np->size;
+}
+
+/*
+ * set up the write cache to continue the chain ending at head with
+ * size bytes. the last block is filled in place if its tail is still
+ * erased and no commit refers to anything beyond size.
+ */
+static s32_t norfs_file_extend(struct norfs_mount_data_t * md, struct norfs_node_t * np, u32_t head, u32_t size, bool_t append)
+{
+	u32_t nb, index, skips, noff, ptr, i;
+	s32_t err;
+
+	if(size == 0)
+	{
+		if((err = norfs_alloc(md, &nb)) != 0)
+			return err;
+		memset(np->cache, 0xff, md->blksz);
+		np->block = nb;
+		np->off = 0;
+		np->prog = 0;
+		return 0;
+	}
+
+	noff = size - 1;
+	index = norfs_ctz_index(md, &noff);
+	noff += 1;
+
+	if(noff < md->blksz)
+	{
+		if((err = norfs_bread(md, head, 0, np->cache, md->blksz)) != 0)
+			return err;
+		if(append && norfs_blank(np->cache + noff, md->blksz - noff))
+		{
+			nb = head;
+			np->prog = noff;
+		}
+		else
+		{
+			if((err = norfs_alloc(md, &nb)) != 0)
+				return err;
+			memset(np->cache + noff, 0xff, md->blksz - noff);
+			np->prog = 0;
+		}
+		np->block = nb;
+		np->off = noff;
+		return 0;
+	}
+
+	if((err = norfs_alloc(md, &nb)) != 0)
+		return err;
+	memset(np->cache, 0xff, md->blksz);
+
+	index += 1;
+	skips = __ffs(index) + 1;
+	ptr = head;
+	for(i = 0; i < skips; i++)
+	{
+		((u32_t *)np->cache)[i] = ptr;
+		if((i != skips - 1) && (norfs_bread(md, ptr, sizeof(u32_t) * i, &ptr, sizeof(u32_t)) != 0))
+			return EIO;
+	}
+	np->block = nb;
+	np->off = sizeof(u32_t) * skips;
+	np->prog = 0;
+	return 0;
+}
+
+/*
+ * put the block being written on flash, a block continued in place only
+ * has the bytes after its programmed part appended
+ */
+static s32_t norfs_file_prog(struct norfs_mount_data_t * md, struct norfs_node_t * np)
+{
+	s32_t err;
+
+	if(np->prog > 0)
+		err = norfs_bappend(md, np->block, np->prog, np->cache + np->prog, np->off - np->prog);
+	else
+		err = norfs_bprog(md, np->block, np->cache);
+	if(err != 0)
+		return err;
+	np->prog = np->off;
+	return 0;
+}
+
+static s32_t norfs_file_start(struct norfs_mount_data_t * md, struct norfs_node_t * np, u32_t pos)
+{
+	u32_t block, off;
+	s32_t err;
+
+	if(!np->cache && !(np->cache = malloc(md->blksz)))
+		return ENOMEM;
+
+	if(pos == 0)
+	{
+		err = norfs_file_extend(md, np, NORFS_NULL, 0, FALSE);
+	}
+	else
+	{
+		if((err = norfs_ctz_find(md, NULL, np->head, np->size, pos - 1, &block, &off)) != 0)
+			return err;
+		err = norfs_file_extend(md, np, block, pos, (pos == np->size) && !(np->flags & NORFS_NODE_DIRTY));
+	}
+	if(err != 0)
+		return err;
+
+	np->pos = pos;
+	np->flags |= NORFS_NODE_WRITING;
+	return 0;
+}
+
+static s32_t norfs_file_next(struct norfs_mount_data_t * md, struct norfs_node_t * np)
+{
+	s32_t err;
+
+	if(np->off < md->blksz)
+		return 0;
+	if((err = norfs_file_prog(md, np)) != 0)
+		return err;
+	return norfs_file_extend(md, np, np->block, np->pos, FALSE);
+}
+
+static s32_t norfs_file_put(struct norfs_mount_data_t * md, struct norfs_node_t * np, const u8_t * buf, u32_t len)
+{
+	u32_t n;
+	s32_t err;
+
+	while(len > 0)
+	{
+		if((err = norfs_file_next(md, np)) != 0)
+			return err;
+		n = norfs_min(len, md->blksz - np->off);
+		memcpy(np->cache + np->off, buf, n);
+		np->off += n;
+		np->pos += n;
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/*
+ * finish the chain being written, the rest of the old file is copied after it
+ */
+static s32_t norfs_file_flush(struct norfs_mount_data_t * md, struct norfs_node_t * np)
+{
+	u32_t n;
+	s32_t err;
+
+	if(!(np->flags & NORFS_NODE_WRITING))
+		return 0;
+
+	while(np->pos < np->size)
+	{
+		if((err = norfs_file_next(md, np)) != 0)
+			return err;
+		n = norfs_min(np->size - np->pos, md->blksz - np->off);
+		if((err = norfs_ctz_read(md, np->head, np->size, np->pos, np->cache + np->off, n)) != 0)
+			return err;
+		np->off += n;
+		np->pos += n;
+	}
+	if((err = norfs_file_prog(md, np)) != 0)
+		return err;
+
+	np->head = np->block;
+	np->size = np->pos;
+	np->flags &= ~NORFS_NODE_WRITING;
+	np->flags |= NORFS_NODE_DIRTY;
+	return 0;
+}
+
+static s32_t norfs_file_sync(struct norfs_mount_data_t * md, struct norfs_node_t * np)
+{
+	struct norfs_attr_t a;
+	u32_t v[2];
+	s32_t err;
+
+	if((err = norfs_file_flush(md, np)) != 0)
+		return err;
+	if(!(np->flags & NORFS_NODE_DIRTY))
+		return 0;
+
+	a.id = np->id;
+	if(np->flags & NORFS_NODE_INLINE)
+	{
+		a.type = NORFS_TYPE_INLINE;
+		a.len = np->size;
+		a.data = np->idata;
+	}
+	else
+	{
+		v[0] = np->head;
+		v[1] = np->size;
+		a.type = NORFS_TYPE_CTZ;
+		a.len = sizeof(v);
+		a.data = v;
+	}
+	if((err = norfs_commit(md, np->ppair, (np->gpair[0] != NORFS_NULL) ? np->gpair : NULL, np->pid, &a, 1)) != 0)
+		return err;
+
+	np->flags &= ~NORFS_NODE_DIRTY;
+	return 0;
+}
+
+static s32_t norfs_file_write(struct norfs_mount_data_t * md, struct norfs_node_t * np, u32_t pos, const u8_t * buf, u32_t len)
+{
+	u8_t zero[64];
+	u32_t size, n;
+	s32_t err;
+
+	/* fill the hole with zeros */
+	size = norfs_file_size(np);
+	if(pos > size)
+	{
+		memset(zero, 0, sizeof(zero));
+		while(size < pos)
+		{
+			n = norfs_min(sizeof(zero), pos - size);
+			if((err = norfs_file_write(md, np, size, zero, n)) != 0)
+				return err;
+			size += n;
+		}
+	}
+
+	if((np->flags & NORFS_NODE_WRITING) && (pos != np->pos))
+	{
+		if((err = norfs_file_flush(md, np)) != 0)
+			return err;
+	}
+
+	if(np->flags & NORFS_NODE_INLINE)
+	{
+		if(pos + len <= md->inline_max)
+		{
+			if(!np->idata && !(np->idata = malloc(md->inline_max)))
+				return ENOMEM;
+			memcpy(np->idata + pos, buf, len);
+			if(pos + len > np->size)
+				np->size = pos + len;
+			np->flags |= NORFS_NODE_DIRTY;
+			return 0;
+		}
+
+		/* move inline data out to a chain */
+		size = np->size;
+		np->flags &= ~NORFS_NODE_INLINE;
+		np->head = NORFS_NULL;
+		np->size = 0;
+		if((err = norfs_file_start(md, np, 0)) != 0)
+			return err;
+		if((size > 0) && (err = norfs_file_put(md, np, np->idata, size)) != 0)
+			return err;
+		free(np->idata);
+		np->idata = NULL;
+		np->flags |= NORFS_NODE_DIRTY;
+		if((pos != np->pos) && (err = norfs_file_flush(md, np)) != 0)
+			return err;
+	}
+
+	if(!(np->flags & NORFS_NODE_WRITING))
+	{
+		if((err = norfs_file_start(md, np, pos)) != 0)
+			return err;
+	}
+	return norfs_file_put(md, np, buf, len);
+}
+
+static s32_t norfs_file_read(struct norfs_mount_data_t * md, struct norfs_node_t * np, u32_t pos, u8_t * buf, u32_t len)
+{
+	s32_t err;
+
+	if((err = norfs_file_flush(md, np)) != 0)
+		return err;
+
+	if(np->flags & NORFS_NODE_INLINE)
+	{
+		if(np->idata)
+			memcpy(buf, np->idata + pos, len);
+		else
+			memset(buf, 0, len);
+		return 0;
+	}
+	return norfs_ctz_read(md, np->head, np->size, pos, buf, len);
+}
+
+static s32_t norfs_file_truncate(struct norfs_mount_data_t * md, struct norfs_node_t * np, u32_t length)
+{
+	u32_t block, off;
+	s32_t err;
+
+	if(length > norfs_file_size(np))
+	{
+		if((err = norfs_file_write(md, np, length, NULL, 0)) != 0)
+			return err;
+		return norfs_file_flush(md, np);
+	}
+
+	if((err = norfs_file_flush(md, np)) != 0)
+		return err;
+	if(length == np->size)
+		return 0;
+
+	if(!(np->flags & NORFS_NODE_INLINE))
+	{
+		if(length <= md->inline_max)
+		{
+			if(!np->idata && !(np->idata = malloc(md->inline_max)))
+				return ENOMEM;
+			if((err = norfs_ctz_read(md, np->head, np->size, 0, np->idata, length)) != 0)
+				return err;
+			np->head = NORFS_NULL;
+			np->flags |= NORFS_NODE_INLINE;
+		}
+		else
+		{
+			/* a prefix of the chain is a chain */
+			if((err = norfs_ctz_find(md, NULL, np->head, np->size, length - 1, &block, &off)) != 0)
+				return err;
+			np->head = block;
+		}
+	}
+	np->size = length;
+	np->flags |= NORFS_NODE_DIRTY;
+	return 0;
+}
+
+static void norfs_free_node(struct norfs_node_t * np)
+{
+	if(np)
+	{
+		list_del_init(&np->entry);
+		free(np->idata);
+		free(np->cache);
+		free(np);
+	}
+}
+
+/*
+ * directory helpers
+ */
+static s32_t norfs_make_entry(struct vnode_t * dnode, char * name, u16_t type, const u32_t * pair)
+{
+	struct norfs_mount_data_t * md = dnode->v_mount->m_data;
+	struct norfs_node_t * dp = dnode->v_data;
+	struct norfs_attr_t a[2];
+	struct norfs_mdir_t m;
+	u16_t id;
+	s32_t err;
+
+	if((err = norfs_mdir_fetch(md, dp->pair, &m, md->mbuf)) != 0)
+		return err;
+	norfs_mdir_scan(md, &m, md->mbuf);
+	if(norfs_mdir_find(md, md->mbuf, name, &id) == 0)
+		return EEXIST;
+	if((err = norfs_mdir_free_id(md, &id)) != 0)
+		return err;
+
+	a[0].type = type;
+	a[0].id = id;
+	a[0].len = strlen(name);
+	a[0].data = name;
+	a[1].type = NORFS_TYPE_PAIR;
+	a[1].id = id;
+	a[1].len = sizeof(u32_t) * 2;
+	a[1].data = pair;
+
+	return norfs_mdir_commit(md, &m, dp->ppair, dp->id, a, pair ? 2 : 1);
+}
+
+static bool_t norfs_valid_name(char * name)
+{
+	u32_t len = strlen(name);
+
+	return (len > 0) && (len <= NORFS_NAME_MAX) && !strchr(name, '/');
+}
+
+static s32_t norfs_format(struct norfs_mount_data_t * md)
+{
+	struct norfs_super_t sb;
+	struct norfs_attr_t a[2];
+	u32_t root[2] = { 2, 3 };
+	s32_t err;
+	int i;
+
+	/* refuse to format anything but an erased device */
+	for(i = 0; i < 2; i++)
+	{
+		if(norfs_bread(md, norfs_super_pair[i], 0, md->mbuf, md->blksz) != 0)
+			return EIO;
+		if(!norfs_blank(md->mbuf, md->blksz))
+			return EINVAL;
+	}
+
+	if((err = norfs_mdir_create(md, root, NULL, 0)) != 0)
+		return err;
+
+	sb.magic = NORFS_MAGIC;
+	sb.version = NORFS_VERSION;
+	sb.blksz = md->blksz;
+	sb.blkcnt = md->blkcnt;
+	sb.name_max = NORFS_NAME_MAX;
+	sb.inline_max = md->inline_max;
+	a[0].type = NORFS_TYPE_SUPER;
+	a[0].id = 0;
+	a[0].len = sizeof(struct norfs_super_t);
+	a[0].data = &sb;
+	a[1].type = NORFS_TYPE_PAIR;
+	a[1].id = 0;
+	a[1].len = sizeof(u32_t) * 2;
+	a[1].data = root;
+
+	return norfs_mdir_create(md, norfs_super_pair, a, 2);
+}
+
+/*
+ * filesystem operations
+ */
+static s32_t norfs_mount(struct mount_t * m, char * dev, s32_t flag)
+{
+	struct norfs_mount_data_t * md;
+	struct norfs_node_t * root;
+	struct norfs_super_t sb;
+	struct norfs_mdir_t sm, rm;
+	struct norfs_entry_t * e;
+	struct norfs_tag_t * t;
+	struct block_t * blk;
+	u32_t pair[2];
+	s32_t err;
+
+	if(dev == NULL)
+		return EINVAL;
+
+	blk = (struct block_t *)m->m_dev;
+	if(!blk)
+		return EINVAL;
+
+	if((block_size(blk) < 512) || (block_size(blk) > SZ_256K) || (block_count(blk) < 4) || (block_count(blk) >= NORFS_NULL))
+		return EINVAL;
+
+	/* appends would erase committed data without program, never write then */
+	if(!blk->program && !(flag & MOUNT_RDONLY))
+	{
+		LOG("Block '%s' can't program without erase, mount norfs read only", blk->name);
+		flag |= MOUNT_RDONLY;
+	}
+
+	md = malloc(sizeof(struct norfs_mount_data_t));
+	if(!md)
+		return ENOMEM;
+	memset(md, 0, sizeof(struct norfs_mount_data_t));
+
+	md->blk = blk;
+	md->blksz = block_size(blk);
+	md->blkcnt = block_count(blk);
+	md->inline_max = md->blksz / 8;
+	md->nents = (md->blksz - sizeof(u32_t)) / sizeof(struct norfs_tag_t);
+	md->la_max = norfs_min(CONFIG_NORFS_LOOKAHEAD, md->blkcnt);
+	init_list_head(&md->nodes);
+
+	md->mbuf = malloc(md->blksz);
+	md->cbuf = malloc(md->blksz);
+	md->tbuf = malloc(md->blksz);
+	md->ents = malloc(sizeof(struct norfs_entry_t) * md->nents);
+	md->la_map = malloc((md->la_max + 7) / 8);
+	if(!md->mbuf || !md->cbuf || !md->tbuf || !md->ents || !md->la_map)
+	{
+		err = ENOMEM;
+		goto fail;
+	}
+
+	if(norfs_mdir_fetch(md, norfs_super_pair, &sm, md->mbuf) != 0)
+	{
+		if((flag & MOUNT_RDONLY) || (norfs_format(md) != 0) || (norfs_mdir_fetch(md, norfs_super_pair, &sm, md->mbuf) != 0))
+		{
+			err = EINVAL;
+			goto fail;
+		}
+	}
+
+	norfs_mdir_scan(md, &sm, md->mbuf);
+	e = &md->ents[0];
+	t = norfs_tag(md->mbuf, e->name);
+	if(!e->name || !e->data || (t->type != NORFS_TYPE_SUPER) || (t->len != sizeof(struct norfs_super_t)))
+	{
+		err = EINVAL;
+		goto fail;
+	}
+	memcpy(&sb, norfs_payload(md->mbuf, e->name), sizeof(struct norfs_super_t));
+	t = norfs_tag(md->mbuf, e->data);
+	if((sb.magic != NORFS_MAGIC) || (sb.version != NORFS_VERSION) || (sb.blksz != md->blksz) || (sb.blkcnt > md->blkcnt) || (t->type != NORFS_TYPE_PAIR))
+	{
+		err = EINVAL;
+		goto fail;
+	}
+	memcpy(pair, norfs_payload(md->mbuf, e->data), sizeof(pair));
+	md->blkcnt = sb.blkcnt;
+	md->inline_max = sb.inline_max;
+	md->la_max = norfs_min(md->la_max, md->blkcnt);
+
+	if(norfs_mdir_fetch(md, pair, &rm, md->mbuf) != 0)
+	{
+		err = EIO;
+		goto fail;
+	}
+
+	root = m->m_root->v_data;
+	norfs_pair_copy(root->pair, pair);
+	norfs_pair_copy(root->ppair, norfs_super_pair);
+	root->gpair[0] = root->gpair[1] = NORFS_NULL;
+	root->id = 0;
+	md->root = root;
+
+	/* start allocating somewhere else on every mount */
+	md->la_start = (sm.crc ^ rm.rev ^ rm.crc) % md->blkcnt;
+	md->la_size = 0;
+	md->la_next = 0;
+	md->la_ack = 0;
+
+	m->m_flags = flag & MOUNT_MASK;
+	m->m_data = md;
+
+	return 0;
+
+fail:
+	free(md->la_map);
+	free(md->ents);
+	free(md->tbuf);
+	free(md->cbuf);
+	free(md->mbuf);
+	free(md);
+	return err;
+}
+
+static s32_t norfs_sync(struct mount_t * m)
+{
+	struct norfs_mount_data_t * md = m->m_data;
+	struct norfs_node_t * np;
+	s32_t err = 0;
+
+	norfs_alloc_ack(md);
+	list_for_each_entry(np, &md->nodes, entry)
+	{
+		if(norfs_file_sync(md, np) != 0)
+			err = EIO;
+	}
+	block_sync(md->blk);
+
+	return err;
+}
+
+static s32_t norfs_unmount(struct mount_t * m)
+{
+	struct norfs_mount_data_t * md = m->m_data;
+
+	if(!list_empty(&md->nodes))
+		return EBUSY;
+
+	block_sync(md->blk);
+
+	free(md->root->idata);
+	free(md->root->cache);
+	free(md->root);
+	free(md->la_map);
+	free(md->ents);
+	free(md->tbuf);
+	free(md->cbuf);
+	free(md->mbuf);
+	free(md);
+
+	return 0;
+}
+
+static s32_t norfs_vget(struct mount_t * m, struct vnode_t * node)
+{
+	struct norfs_node_t * np;
+
+	np = malloc(sizeof(struct norfs_node_t));
+	if(!np)
+		return ENOMEM;
+	memset(np, 0, sizeof(struct norfs_node_t));
+	init_list_head(&np->entry);
+	np->head = NORFS_NULL;
+	np->gpair[0] = np->gpair[1] = NORFS_NULL;
+	node->v_data = np;
+
+	return 0;
+}
+
+static s32_t norfs_statfs(struct mount_t * m, struct statfs * stat)
+{
+	struct norfs_mount_data_t * md = m->m_data;
+	u32_t used = 0;
+	s32_t err;
+
+	if((err = norfs_traverse(md, norfs_count_mark, &used, FALSE)) != 0)
+		return err;
+
+	stat->f_flags = m->m_flags;
+	stat->f_bsize = md->blksz;
+	stat->f_blocks = md->blkcnt;
+	stat->f_bfree = (used < md->blkcnt) ? md->blkcnt - used : 0;
+	stat->f_bavail = stat->f_bfree;
+	stat->f_namelen = NORFS_NAME_MAX;
+
+	return 0;
+}
+
+/*
+ * vnode operations
+ */
+static s32_t norfs_open(struct vnode_t * node, s32_t flag)
+{
+	return 0;
+}
+
+static s32_t norfs_close(struct vnode_t * node, struct file_t * fp)
+{
+	struct norfs_mount_data_t * md = node->v_mount->m_data;
+
+	if(node->v_type != VREG)
+		return 0;
+
+	norfs_alloc_ack(md);
+	return norfs_file_sync(md, node->v_data);
+}
+
+static s32_t norfs_read(struct vnode_t * node, struct file_t * fp, void * buf, loff_t size, loff_t * result)
+{
+	struct norfs_mount_data_t * md = node->v_mount->m_data;
+	loff_t off;
+	s32_t err;
+
+	*result = 0;
+	if(node->v_type == VDIR)
+		return EISDIR;
+	if(node->v_type != VREG)
+		return EINVAL;
+
+	off = fp->f_offset;
+	if(off >= node->v_size)
+		return 0;
+
+	if(node->v_size - off < size)
+		size = node->v_size - off;
+
+	norfs_alloc_ack(md);
+	if((err = norfs_file_read(md, node->v_data, off, buf, size)) != 0)
+		return err;
+
+	*result = size;
+	fp->f_offset += size;
+
+	return 0;
+}
+
+static s32_t norfs_write(struct vnode_t * node , struct file_t * fp, void * buf, loff_t size, loff_t * result)
+{
+	struct norfs_mount_data_t * md = node->v_mount->m_data;
+	loff_t pos;
+	s32_t err;
+
+	*result = 0;
+	if(node->v_type == VDIR)
+		return EISDIR;
+	if(node->v_type != VREG)
+		return EINVAL;
+
+	pos = (fp->f_flags & O_APPEND) ? node->v_size : fp->f_offset;
+	if(pos + size > 0xffffffffLL)
+		return EOVERFLOW;
+
+	norfs_alloc_ack(md);
+	if((err = norfs_file_write(md, node->v_data, pos, buf, size)) != 0)
+		return err;
+
+	*result = size;
+	fp->f_offset = pos + size;
+	if(fp->f_offset > node->v_size)
+		node->v_size = fp->f_offset;
+
+	return 0;
+}
+
+static s32_t norfs_seek(struct vnode_t * node, struct file_t * fp, loff_t off1, loff_t off2)
+{
+	if((node->v_type == VREG) && (off2 > 0xffffffffLL))
+		return -1;
+
+	return 0;
+}
+
+static s32_t norfs_ioctl(struct vnode_t * node, struct file_t * fp, int cmd, void * arg)
+{
+	return -1;
+}
+
+static s32_t norfs_fsync(struct vnode_t * node, struct file_t * fp)
+{
+	struct norfs_mount_data_t * md = node->v_mount->m_data;
+	s32_t err;
+
+	if(node->v_type != VREG)
+		return 0;
+
+	norfs_alloc_ack(md);
+	if((err = norfs_file_sync(md, node->v_data)) != 0)
+		return err;
+	block_sync(md->blk);
+
+	return 0;
+}
+
+static s32_t norfs_readdir(struct vnode_t * node, struct file_t * fp, struct dirent_t * dir)
+{
+	struct norfs_mount_data_t * md = node->v_mount->m_data;
+	struct norfs_node_t * dp = node->v_data;
+	struct norfs_mdir_t m;
+	struct norfs_tag_t * t;
+	u32_t id;
+	s32_t err;
+
+	if(fp->f_offset == 0)
+	{
+		dir->d_type = DT_DIR;
+		strlcpy((char *)&dir->d_name, ".", sizeof(dir->d_name));
+		id = 0;
+	}
+	else if(fp->f_offset == 1)
+	{
+		dir->d_type = DT_DIR;
+		strlcpy((char *)&dir->d_name, "..", sizeof(dir->d_name));
+		id = 1;
+	}
+	else
+	{
+		if((err = norfs_mdir_fetch(md, dp->pair, &m, md->mbuf)) != 0)
+			return err;
+		norfs_mdir_scan(md, &m, md->mbuf);
+
+		for(id = fp->f_offset - 2; id < md->nids; id++)
+		{
+			if(md->ents[id].name)
+				break;
+		}
+		if(id >= md->nids)
+			return ENOENT;
+
+		t = norfs_tag(md->mbuf, md->ents[id].name);
+		dir->d_type = (t->type == NORFS_TYPE_DIR) ? DT_DIR : DT_REG;
+		memcpy(dir->d_name, norfs_payload(md->mbuf, md->ents[id].name), t->len);
+		dir->d_name[t->len] = '\0';
+		id += 2;
+	}
+
+	dir->d_fileno = id;
+	dir->d_namlen = (u16_t)strlen(dir->d_name);
+	fp->f_offset = id + 1;
+
+	return 0;
+}
+
+static s32_t norfs_lookup(struct vnode_t * dnode, char * name, struct vnode_t * node)
+{
+	struct norfs_mount_data_t * md = node->v_mount->m_data;
+	struct norfs_node_t * dp = dnode->v_data;
+	struct norfs_node_t * np = node->v_data;
+	struct norfs_entry_t * e;
+	struct norfs_tag_t * t;
+	struct norfs_mdir_t m;
+	u32_t * v;
+	u16_t id;
+	s32_t err;
+
+	if(*name == '\0')
+		return ENOENT;
+
+	if((err = norfs_mdir_fetch(md, dp->pair, &m, md->mbuf)) != 0)
+		return err;
+	norfs_mdir_scan(md, &m, md->mbuf);
+	if((err = norfs_mdir_find(md, md->mbuf, name, &id)) != 0)
+		return err;
+	e = &md->ents[id];
+
+	norfs_pair_copy(np->ppair, dp->pair);
+	norfs_pair_copy(np->gpair, dp->ppair);
+	np->pid = dp->id;
+	np->id = id;
+
+	t = e->data ? norfs_tag(md->mbuf, e->data) : NULL;
+	if(norfs_tag(md->mbuf, e->name)->type == NORFS_TYPE_DIR)
+	{
+		if(!t || (t->type != NORFS_TYPE_PAIR))
+			return EIO;
+		norfs_pair_copy(np->pair, norfs_payload(md->mbuf, e->data));
+		node->v_type = VDIR;
+		node->v_size = 0;
+	}
+	else
+	{
+		if(!t || (t->type == NORFS_TYPE_INLINE))
+		{
+			np->flags = NORFS_NODE_INLINE;
+			np->size = t ? t->len : 0;
+			if(np->size > md->inline_max)
+				return EIO;
+			if(np->size > 0)
+			{
+				if(!(np->idata = malloc(md->inline_max)))
+					return ENOMEM;
+				memcpy(np->idata, norfs_payload(md->mbuf, e->data), np->size);
+			}
+		}
+		else if(t->type == NORFS_TYPE_CTZ)
+		{
+			v = norfs_payload(md->mbuf, e->data);
+			np->head = v[0];
+			np->size = v[1];
+		}
+		else
+		{
+			return EIO;
+		}
+		node->v_type = VREG;
+		node->v_size = np->size;
+	}
+	node->v_mode = S_IRWXU | S_IRWXG | S_IRWXO;
+	list_add(&np->entry, &md->nodes);
+
+	return 0;
+}
+
+static s32_t norfs_create(struct vnode_t * node, char * name, u32_t mode)
+{
+	struct norfs_mount_data_t * md = node->v_mount->m_data;
+
+	if(!S_ISREG(mode))
+		return EINVAL;
+	if(!norfs_valid_name(name))
+		return (strlen(name) > NORFS_NAME_MAX) ? ENAMETOOLONG : EINVAL;
+
+	norfs_alloc_ack(md);
+	return norfs_make_entry(node, name, NORFS_TYPE_REG, NULL);
+}
+
+static s32_t norfs_remove(struct vnode_t * dnode, struct vnode_t * node, char * name)
+{
+	struct norfs_mount_data_t * md = node->v_mount->m_data;
+	struct norfs_node_t * np = node->v_data;
+	struct norfs_attr_t a;
+	s32_t err;
+
+	/* blocks of the entry are free once the delete is committed */
+	norfs_alloc_ack(md);
+	a.type = NORFS_TYPE_DELETE;
+	a.id = np->id;
+	a.len = 0;
+	a.data = NULL;
+	err = norfs_commit(md, np->ppair, (np->gpair[0] != NORFS_NULL) ? np->gpair : NULL, np->pid, &a, 1);
+
+	/* vnode is dropped by vgone without inactive */
+	norfs_free_node(np);
+	node->v_data = NULL;
+
+	return err;
+}
+
+static s32_t norfs_rename(struct vnode_t * dnode1, struct vnode_t * node1, char * name1, struct vnode_t * dnode2, struct vnode_t * node2, char * name2)
+{
+	struct norfs_mount_data_t * md = node1->v_mount->m_data;
+	struct norfs_node_t * dp1 = dnode1->v_data;
+	struct norfs_node_t * dp2 = dnode2->v_data;
+	struct norfs_node_t * np = node1->v_data;
+	struct norfs_node_t * tp = node2 ? node2->v_data : NULL;
+	struct norfs_node_t * cp;
+	struct norfs_attr_t a[3];
+	struct norfs_mdir_t m;
+	u32_t v[2];
+	u16_t id;
+	s32_t err;
+	int n = 0;
+
+	if(!norfs_valid_name(name2))
+		return (strlen(name2) > NORFS_NAME_MAX) ? ENAMETOOLONG : EINVAL;
+
+	norfs_alloc_ack(md);
+	if((node1->v_type == VREG) && (err = norfs_file_flush(md, np)) != 0)
+		return err;
+
+	if((err = norfs_mdir_fetch(md, dp2->pair, &m, md->mbuf)) != 0)
+		return err;
+	norfs_mdir_scan(md, &m, md->mbuf);
+
+	if(norfs_pair_equal(dp1->pair, dp2->pair))
+		id = np->id;
+	else if((err = norfs_mdir_free_id(md, &id)) != 0)
+		return err;
+
+	if(tp)
+	{
+		a[n].type = NORFS_TYPE_DELETE;
+		a[n].id = tp->id;
+		a[n].len = 0;
+		a[n].data = NULL;
+		n++;
+	}
+
+	a[n].type = (node1->v_type == VDIR) ? NORFS_TYPE_DIR : NORFS_TYPE_REG;
+	a[n].id = id;
+	a[n].len = strlen(name2);
+	a[n].data = name2;
+	n++;
+
+	/* the data record goes along, it may carry uncommitted changes */
+	a[n].id = id;
+	if(node1->v_type == VDIR)
+	{
+		a[n].type = NORFS_TYPE_PAIR;
+		a[n].len = sizeof(u32_t) * 2;
+		a[n].data = np->pair;
+	}
+	else if(np->flags & NORFS_NODE_INLINE)
+	{
+		a[n].type = NORFS_TYPE_INLINE;
+		a[n].len = np->size;
+		a[n].data = np->idata;
+	}
+	else
+	{
+		v[0] = np->head;
+		v[1] = np->size;
+		a[n].type = NORFS_TYPE_CTZ;
+		a[n].len = sizeof(v);
+		a[n].data = v;
+	}
+	n++;
+
+	if((err = norfs_mdir_commit(md, &m, dp2->ppair, dp2->id, a, n)) != 0)
+		return err;
+
+	if(!norfs_pair_equal(dp1->pair, dp2->pair))
+	{
+		a[0].type = NORFS_TYPE_DELETE;
+		a[0].id = np->id;
+		a[0].len = 0;
+		a[0].data = NULL;
+		if((err = norfs_commit(md, dp1->pair, dp1->ppair, dp1->id, a, 1)) != 0)
+			return err;
+
+		norfs_pair_copy(np->ppair, dp2->pair);
+		norfs_pair_copy(np->gpair, dp2->ppair);
+		np->pid = dp2->id;
+		np->id = id;
+
+		/* open entries below a moved directory have a new grandparent */
+		if(node1->v_type == VDIR)
+		{
+			list_for_each_entry(cp, &md->nodes, entry)
+			{
+				if(norfs_pair_equal(cp->ppair, np->pair))
+				{
+					norfs_pair_copy(cp->gpair, dp2->pair);
+					cp->pid = id;
+				}
+			}
+		}
+	}
+	np->flags &= ~NORFS_NODE_DIRTY;
+
+	/* the replaced entry is gone, nothing of it is written back */
+	if(tp)
+		tp->flags &= ~(NORFS_NODE_DIRTY | NORFS_NODE_WRITING);
+
+	return 0;
+}
+
+static s32_t norfs_mkdir(struct vnode_t * node, char * name, u32_t mode)
+{
+	struct norfs_mount_data_t * md = node->v_mount->m_data;
+	u32_t pair[2];
+	s32_t err;
+
+	if(!S_ISDIR(mode))
+		return EINVAL;
+	if(!norfs_valid_name(name))
+		return (strlen(name) > NORFS_NAME_MAX) ? ENAMETOOLONG : EINVAL;
+
+	/* an unreferenced pair is free again, if anything below fails */
+	norfs_alloc_ack(md);
+	if((err = norfs_alloc(md, &pair[0])) != 0)
+		return err;
+	if((err = norfs_alloc(md, &pair[1])) != 0)
+		return err;
+	if((err = norfs_mdir_create(md, pair, NULL, 0)) != 0)
+		return err;
+
+	return norfs_make_entry(node, name, NORFS_TYPE_DIR, pair);
+}
+
+static s32_t norfs_rmdir(struct vnode_t * dnode, struct vnode_t * node, char * name)
+{
+	return norfs_remove(dnode, node, name);
+}
+
+static s32_t norfs_getattr(struct vnode_t * node, struct vattr_t * attr)
+{
+	return -1;
+}
+
+static s32_t norfs_setattr(struct vnode_t * node, struct vattr_t * attr)
+{
+	return -1;
+}
+
+static s32_t norfs_inactive(struct vnode_t * node)
+{
+	struct norfs_mount_data_t * md = node->v_mount->m_data;
+	struct norfs_node_t * np = node->v_data;
+
+	if(np)
+	{
+		if(node->v_type == VREG)
+		{
+			norfs_alloc_ack(md);
+			norfs_file_sync(md, np);
+		}
+		norfs_free_node(np);
+		node->v_data = NULL;
+	}
+
+	return 0;
+}
+
+static s32_t norfs_truncate(struct vnode_t * node, loff_t length)
+{
+	struct norfs_mount_data_t * md = node->v_mount->m_data;
+	s32_t err;
+
+	if(node->v_type == VDIR)
+		return EISDIR;
+	if((length < 0) || (length > 0xffffffffLL))
+		return EOVERFLOW;
+
+	norfs_alloc_ack(md);
+	if((err = norfs_file_truncate(md, node->v_data, length)) != 0)
+		return err;
+	node->v_size = length;
+
+	return 0;
+}
+
+/*
+ * norfs vnode operations
+ */
+static struct vnops_t norfs_vnops = {
+	.vop_open 		= norfs_open,
+	.vop_close		= norfs_close,
+	.vop_read		= norfs_read,
+	.vop_write		= norfs_write,
+	.vop_seek		= norfs_seek,
+	.vop_ioctl		= norfs_ioctl,
+	.vop_fsync		= norfs_fsync,
+	.vop_readdir	= norfs_readdir,
+	.vop_lookup		= norfs_lookup,
+	.vop_create		= norfs_create,
+	.vop_remove		= norfs_remove,
+	.vop_rename		= norfs_rename,
+	.vop_mkdir		= norfs_mkdir,
+	.vop_rmdir		= norfs_rmdir,
+	.vop_getattr	= norfs_getattr,
+	.vop_setattr	= norfs_setattr,
+	.vop_inactive	= norfs_inactive,
+	.vop_truncate	= norfs_truncate,
+};
+
+/*
+ * file system operations
+ */
+static struct vfsops_t norfs_vfsops = {
+	.vfs_mount		= norfs_mount,
+	.vfs_unmount	= norfs_unmount,
+	.vfs_sync		= norfs_sync,
+	.vfs_vget		= norfs_vget,
+	.vfs_statfs		= norfs_statfs,
+	.vfs_vnops		= &norfs_vnops,
+};
+
+/*
+ * norfs filesystem
+ */
+static struct filesystem_t norfs = {
+	.name		= "norfs",
+	.vfsops		= &norfs_vfsops,
+};
+
+static __init void filesystem_norfs_init(void)
+{
+	filesystem_register(&norfs);
+}
+
+static __exit void filesystem_norfs_exit(void)
+{
+	filesystem_unregister(&norfs);
+}
+
+core_initcall(filesystem_norfs_init);
+core_exitcall(filesystem_norfs_exit);
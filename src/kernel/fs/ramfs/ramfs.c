@@ -35,7 +35,11 @@
 #include <fs/fs.h>
 
 
-#define RAMFS_PAGE_SIZE_MASK		(0x00000fff)
+/*
+ * file data is kept in fixed size extents, allocated on first write.
+ * a missing extent is a hole and reads as zeros.
+ */
+#define RAMFS_EXTENT_SIZE			(SZ_4K)
 
 /*
  * file/directory node for ramfs
@@ -47,11 +51,78 @@ struct ramfs_node {
 	u32_t mode;						/* file mode permissions */
 	s8_t * name;					/* name (null-terminated) */
 	s32_t name_len;					/* length of name not including terminator */
-	s8_t * buf;						/* buffer to the file data */
-	loff_t buf_len;					/* allocated buffer size */
+	u8_t ** extents;				/* table of file data extents */
+	u32_t nextents;					/* number of slots in extent table */
 	loff_t size;					/* file size */
 };
 
+/*
+ * release all extents from index, and shrink the extent table.
+ */
+static void ramfs_free_extents(struct ramfs_node * node, u32_t index)
+{
+	u8_t ** table;
+	u32_t i;
+
+	for(i = index; i < node->nextents; i++)
+	{
+		if(node->extents[i])
+		{
+			free(node->extents[i]);
+			node->extents[i] = NULL;
+		}
+	}
+
+	if(index == 0)
+	{
+		free(node->extents);
+		node->extents = NULL;
+		node->nextents = 0;
+	}
+	else if(index < node->nextents / 2)
+	{
+		table = realloc(node->extents, sizeof(u8_t *) * index);
+		if(table)
+		{
+			node->extents = table;
+			node->nextents = index;
+		}
+	}
+}
+
+/*
+ * get the extent of index, allocate it if not exist and create is true.
+ */
+static u8_t * ramfs_get_extent(struct ramfs_node * node, u32_t index, bool_t create)
+{
+	u8_t ** table;
+	u32_t count;
+
+	if(index >= node->nextents)
+	{
+		if(!create)
+			return NULL;
+		count = node->nextents ? node->nextents : 8;
+		while(count <= index)
+			count <<= 1;
+		table = realloc(node->extents, sizeof(u8_t *) * count);
+		if(!table)
+			return NULL;
+		memset(&table[node->nextents], 0, sizeof(u8_t *) * (count - node->nextents));
+		node->extents = table;
+		node->nextents = count;
+	}
+
+	if(!node->extents[index] && create)
+	{
+		node->extents[index] = malloc(RAMFS_EXTENT_SIZE);
+		if(node->extents[index])
+			memset(node->extents[index], 0, RAMFS_EXTENT_SIZE);
+	}
+
+	return node->extents[index];
+}
+
 static struct ramfs_node * ramfs_allocate_node(char * name, enum vnode_type_t type)
 {
 	struct ramfs_node * node;
@@ -75,6 +146,7 @@ static struct ramfs_node * ramfs_allocate_node(char * name, enum vnode_type_t ty
 
 static void ramfs_free_node(struct ramfs_node * node)
 {
+	ramfs_free_extents(node, 0);
 	free(node->name);
 	free(node);
 }
@@ -210,7 +282,8 @@ static s32_t ramfs_close(struct vnode_t * node, struct file_t * fp)
 static s32_t ramfs_read(struct vnode_t * node, struct file_t * fp, void * buf, loff_t size, loff_t * result)
 {
 	struct ramfs_node * n;
-	loff_t off;
+	u8_t * extent;
+	loff_t off, len;
 
 	*result = 0;
 	if(node->v_type == VDIR)
@@ -226,10 +299,20 @@ static s32_t ramfs_read(struct vnode_t * node, struct file_t * fp, void * buf, l
 		size = node->v_size - off;
 
 	n = node->v_data;
-	memcpy(buf, n->buf + off, size);
-
-	fp->f_offset += size;
-	*result = size;
+	while(*result < size)
+	{
+		len = RAMFS_EXTENT_SIZE - (off % RAMFS_EXTENT_SIZE);
+		if(len > size - *result)
+			len = size - *result;
+		extent = ramfs_get_extent(n, off / RAMFS_EXTENT_SIZE, FALSE);
+		if(extent)
+			memcpy((u8_t *)buf + *result, extent + (off % RAMFS_EXTENT_SIZE), len);
+		else
+			memset((u8_t *)buf + *result, 0, len);
+		off += len;
+		*result += len;
+	}
+	fp->f_offset = off;
 
 	return 0;
 }
@@ -237,9 +320,8 @@ static s32_t ramfs_read(struct vnode_t * node, struct file_t * fp, void * buf, l
 static s32_t ramfs_write(struct vnode_t * node , struct file_t * fp, void * buf, loff_t size, loff_t * result)
 {
 	struct ramfs_node * n;
-	loff_t file_pos, end_pos;
-	void * new_buf;
-	loff_t new_size;
+	u8_t * extent;
+	loff_t pos, len;
 
 	*result = 0;
 	if(node->v_type == VDIR)
@@ -248,39 +330,30 @@ static s32_t ramfs_write(struct vnode_t * node , struct file_t * fp, void * buf,
 		return EINVAL;
 
 	n = node->v_data;
+	pos = (fp->f_flags & O_APPEND) ? node->v_size : fp->f_offset;
 
-	/* check if the file position exceeds the end of file. */
-	end_pos = node->v_size;
-	file_pos = (fp->f_flags & O_APPEND) ? end_pos : fp->f_offset;
-
-	if(file_pos + size > (loff_t)end_pos)
+	/* only the extents written to are touched */
+	while(*result < size)
 	{
-		/* expand the file size before writing to it */
-		end_pos = file_pos + size;
-		if(end_pos > (loff_t)n->buf_len)
-		{
-			/* round page */
-			new_size = (((end_pos) + RAMFS_PAGE_SIZE_MASK) & ~RAMFS_PAGE_SIZE_MASK);
-			new_buf = malloc(new_size);
-			if(new_buf == NULL)
-				return ENOMEM;
-			if(n->size != 0)
-			{
-				memcpy(new_buf, n->buf, node->v_size);
-				free(n->buf);
-			}
-			n->buf = new_buf;
-			n->buf_len = new_size;
-		}
-		n->size = end_pos;
-		node->v_size = end_pos;
+		len = RAMFS_EXTENT_SIZE - (pos % RAMFS_EXTENT_SIZE);
+		if(len > size - *result)
+			len = size - *result;
+		extent = ramfs_get_extent(n, pos / RAMFS_EXTENT_SIZE, TRUE);
+		if(!extent)
+			break;
+		memcpy(extent + (pos % RAMFS_EXTENT_SIZE), (u8_t *)buf + *result, len);
+		pos += len;
+		*result += len;
 	}
 
-	memcpy(n->buf + file_pos, buf, size);
-	fp->f_offset += size;
-	*result = size;
+	if(pos > n->size)
+	{
+		n->size = pos;
+		node->v_size = pos;
+	}
+	fp->f_offset = pos;
 
-	return 0;
+	return (*result > 0 || size == 0) ? 0 : ENOMEM;
 }
 
 static s32_t ramfs_seek(struct vnode_t * node, struct file_t * fp, loff_t off1, loff_t off2)
@@ -395,17 +468,7 @@ static s32_t ramfs_create(struct vnode_t * node, char * name, u32_t mode)
 
 static s32_t ramfs_remove(struct vnode_t * dnode, struct vnode_t * node, char * name)
 {
-	struct ramfs_node * n;
-	s32_t error;
-
-	error = ramfs_remove_node(dnode->v_data, node->v_data);
-	if(error != 0)
-		return error;
-
-	n = node->v_data;
-	if(n->buf != NULL)
-		free(n->buf);
-	return 0;
+	return ramfs_remove_node(dnode->v_data, node->v_data);
 }
 
 static s32_t ramfs_rename(struct vnode_t * dnode1, struct vnode_t * node1, char * name1, struct vnode_t *dnode2, struct vnode_t * node2, char * name2)
@@ -439,10 +502,12 @@ static s32_t ramfs_rename(struct vnode_t * dnode1, struct vnode_t * node1, char
 
 		if(node1->v_type == VREG)
 		{
-			/* copy file data */
-			n->buf = old_n->buf;
+			/* move file data */
+			n->extents = old_n->extents;
+			n->nextents = old_n->nextents;
 			n->size = old_n->size;
-			n->buf_len = old_n->buf_len;
+			old_n->extents = NULL;
+			old_n->nextents = 0;
 		}
 
 		/* remove source file */
@@ -491,35 +556,21 @@ static s32_t ramfs_inactive(struct vnode_t * node)
 
 static s32_t ramfs_truncate(struct vnode_t * node, loff_t length)
 {
-	struct ramfs_node *n;
-	void * new_buf;
-	loff_t new_size;
+	struct ramfs_node * n;
+	u8_t * extent;
+	loff_t off;
 
-	n = node->v_data;
+	if(length < 0)
+		return EINVAL;
 
-	if(length == 0)
-	{
-		if(n->buf != NULL)
-		{
-			free(n->buf);
-			n->buf = NULL;
-			n->buf_len = 0;
-		}
-	}
-	else if(length > n->buf_len)
+	n = node->v_data;
+	if(length < n->size)
 	{
-		/* round page */
-		new_size = (((length) + RAMFS_PAGE_SIZE_MASK) & ~RAMFS_PAGE_SIZE_MASK);
-		new_buf = malloc(new_size);
-		if(new_buf == NULL)
-			return ENOMEM;
-		if(n->size != 0)
-		{
-			memcpy(new_buf, n->buf, node->v_size);
-			free(n->buf);
-		}
-		n->buf = new_buf;
-		n->buf_len = new_size;
+		/* give back whole extents, and clear the tail of the last one */
+		ramfs_free_extents(n, (length + RAMFS_EXTENT_SIZE - 1) / RAMFS_EXTENT_SIZE);
+		off = length % RAMFS_EXTENT_SIZE;
+		if(off && (extent = ramfs_get_extent(n, length / RAMFS_EXTENT_SIZE, FALSE)))
+			memset(extent + off, 0, RAMFS_EXTENT_SIZE - off);
 	}
 	n->size = length;
 	node->v_size = length;
@@ -290,6 +290,7 @@ static struct vfsops_t sysfs_vfsops = {
 static struct filesystem_t sysfs = {
 	.name		= "sysfs",
 	.vfsops		= &sysfs_vfsops,
+	.flags		= FILESYSTEM_NOCACHE,
 };
 
 static __init void filesystem_sysfs_init(void)
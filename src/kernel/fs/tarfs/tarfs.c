@@ -103,83 +103,293 @@ struct tar_header
 	s8_t reserver[12];
 } __attribute__ ((packed));
 
-static bool_t get_next_token(const char * path, const char * perfix, char * result)
+/*
+ * in-core entry of archive, built at mount time
+ */
+struct tarfs_node {
+	struct hlist_node node;			/* link to hash bucket */
+	struct tarfs_node * parent;		/* parent directory */
+	struct tarfs_node * child;		/* first child, in archive order */
+	struct tarfs_node * last;		/* last child */
+	struct tarfs_node * next;		/* next sibling */
+	struct tarfs_node ** children;	/* children array for readdir */
+	u32_t nchild;					/* number of children */
+	u32_t hash;						/* hash of parent and name */
+	loff_t offset;					/* offset of file data */
+	loff_t size;					/* file size in bytes */
+	u32_t mode;						/* permission bits */
+	s8_t filetype;					/* file type */
+	char * name;					/* file name */
+};
+
+struct tarfs_mount_data {
+	struct hlist_head * hash;		/* hash buckets, keyed by parent and name */
+	u32_t size;						/* number of buckets, power of 2 */
+	u32_t count;					/* number of entries */
+	u32_t memory;					/* bytes of memory held by index */
+	struct tarfs_node root;			/* root directory */
+};
+
+static u32_t tarfs_hash(struct tarfs_node * parent, const char * name, u32_t len)
 {
-	char full_path[MAX_PATH];
-	char *p, *q;
-	s32_t l;
+	u32_t val = (u32_t)((unsigned long)parent >> 4);
 
-	if(!path || !perfix || !result)
-		return FALSE;
+	while(len--)
+		val = ((val << 5) + val) + *name++;
+	return val;
+}
 
-	full_path[0] = '\0';
+static loff_t tarfs_octal(const s8_t * str, s32_t len)
+{
+	char buf[16];
 
-	if(path[0] != '/')
-		strcpy(full_path, (const char *)("/"));
-	strlcat(full_path, path, sizeof(full_path));
+	memcpy(buf, str, len);
+	buf[len] = '\0';
+	return (loff_t)strtoull(buf, NULL, 8);
+}
 
-	l = strlen(perfix);
-	if(memcmp(full_path, perfix, l) != 0)
-		return FALSE;
+static struct tarfs_node * tarfs_find(struct tarfs_mount_data * md, struct tarfs_node * parent, const char * name, u32_t len)
+{
+	struct tarfs_node * np;
+	u32_t hash = tarfs_hash(parent, name, len);
 
-	p = &full_path[l];
-	if(*p == '\0')
-		return FALSE;
-	if(*p == '/')
-		p++;
-	if(*p == '\0')
+	hlist_for_each_entry(np, &md->hash[hash & (md->size - 1)], node)
+	{
+		if((np->hash == hash) && (np->parent == parent) && (strncmp(np->name, name, len) == 0) && (np->name[len] == '\0'))
+			return np;
+	}
+	return NULL;
+}
+
+static bool_t tarfs_grow(struct tarfs_mount_data * md)
+{
+	struct hlist_head * hash;
+	struct tarfs_node * np;
+	struct hlist_node * n;
+	u32_t size = md->size * 4;
+	u32_t i;
+
+	hash = malloc(size * sizeof(struct hlist_head));
+	if(!hash)
 		return FALSE;
+	for(i = 0; i < size; i++)
+		init_hlist_head(&hash[i]);
 
-	q = strchr(p, '/');
-	if(q)
+	for(i = 0; i < md->size; i++)
 	{
-		if(*(q+1) != '\0')
-			return FALSE;
-		*q = 0;
+		hlist_for_each_entry_safe(np, n, &md->hash[i], node)
+		{
+			hlist_del(&np->node);
+			hlist_add_head(&np->node, &hash[np->hash & (size - 1)]);
+		}
 	}
-
-	strcpy(result, p);
+	free(md->hash);
+	md->memory += (size - md->size) * sizeof(struct hlist_head);
+	md->hash = hash;
+	md->size = size;
 
 	return TRUE;
 }
 
-static bool_t check_path(const char * path, const char * perfix, const char * name)
+static struct tarfs_node * tarfs_alloc(struct tarfs_mount_data * md, struct tarfs_node * parent, const char * name, u32_t len)
 {
-	char path1[MAX_PATH];
-	char path2[MAX_PATH];
-	char *p;
-	s32_t l;
+	struct tarfs_node * np;
+
+	if((md->count >= md->size * 2) && !tarfs_grow(md))
+		return NULL;
+
+	np = malloc(sizeof(struct tarfs_node) + len + 1);
+	if(!np)
+		return NULL;
+	memset(np, 0, sizeof(struct tarfs_node));
+	np->name = (char *)(np + 1);
+	memcpy(np->name, name, len);
+	np->name[len] = '\0';
+	np->parent = parent;
+	np->hash = tarfs_hash(parent, name, len);
+	np->filetype = FILE_TYPE_DIRECTORY;
+	np->mode = 0755;
+
+	if(parent->last)
+		parent->last->next = np;
+	else
+		parent->child = np;
+	parent->last = np;
+	parent->nchild++;
 
-	if(!path || !perfix || !name)
-		return FALSE;
+	hlist_add_head(&np->node, &md->hash[np->hash & (md->size - 1)]);
+	md->count++;
+	md->memory += sizeof(struct tarfs_node) + len + 1;
+
+	return np;
+}
+
+/*
+ * find or create the node of path, creating missing parent directories.
+ */
+static struct tarfs_node * tarfs_insert(struct tarfs_mount_data * md, const char * path)
+{
+	struct tarfs_node * parent = &md->root;
+	struct tarfs_node * np;
+	const char * p = path, * q;
+	u32_t len;
 
-	path1[0] = path2[0] = '\0';
+	while(1)
+	{
+		while(*p == '/')
+			p++;
+		if(*p == '\0')
+			return parent;
+
+		for(q = p; *q && (*q != '/'); q++);
+		len = q - p;
+		if((len == 1) && (p[0] == '.'))
+		{
+			p = q;
+			continue;
+		}
+		if((len == 2) && (p[0] == '.') && (p[1] == '.'))
+			return NULL;
+
+		np = tarfs_find(md, parent, p, len);
+		if(!np)
+			np = tarfs_alloc(md, parent, p, len);
+		if(!np)
+			return NULL;
+
+		while(*q == '/')
+			q++;
+		if(*q == '\0')
+			return np;
+		if(np->filetype != FILE_TYPE_DIRECTORY)
+			return NULL;
+
+		parent = np;
+		p = q;
+	}
+}
 
-	if(path[0] != '/')
-		strcpy(path1, (const char *)("/"));
-	strlcat(path1, path, sizeof(path1));
+static void tarfs_free_index(struct tarfs_mount_data * md)
+{
+	struct tarfs_node * np;
+	struct hlist_node * n;
+	u32_t i;
 
-	if(perfix[0] != '/')
-		strcpy(path2, (const char *)("/"));
-	strlcat(path2, perfix, sizeof(path2));
+	for(i = 0; i < md->size; i++)
+	{
+		hlist_for_each_entry_safe(np, n, &md->hash[i], node)
+		{
+			hlist_del(&np->node);
+			free(np->children);
+			free(np);
+		}
+	}
+	free(md->root.children);
+	free(md->hash);
+	free(md);
+}
 
-	if(path2[strlen(path2) - 1] != '/')
-		strlcat(path2, (const char *)"/", sizeof(path2));
-	strlcat(path2, (const char *)name, sizeof(path2));
+static bool_t tarfs_link_children(struct tarfs_mount_data * md, struct tarfs_node * dp)
+{
+	struct tarfs_node * np;
+	u32_t i = 0;
+
+	if(dp->nchild == 0)
+		return TRUE;
 
-	l = strlen(path2);
-	if(memcmp(path1, path2, l) != 0)
+	dp->children = malloc(dp->nchild * sizeof(struct tarfs_node *));
+	if(!dp->children)
 		return FALSE;
+	for(np = dp->child; np; np = np->next)
+		dp->children[i++] = np;
+	md->memory += dp->nchild * sizeof(struct tarfs_node *);
 
-	p = &path1[l];
-	if(*p == '\0')
-		return TRUE;
-	if(*p == '/')
-		p++;
-	if(*p == '\0')
-		return TRUE;
+	return TRUE;
+}
+
+/*
+ * walk the archive once, indexing every entry by parent and name.
+ */
+static s32_t tarfs_build_index(struct tarfs_mount_data * md, struct block_t * blk)
+{
+	struct tar_header header;
+	struct tarfs_node * np;
+	struct hlist_node * n;
+	char path[MAX_PATH];
+	char longname[MAX_PATH];
+	u64_t capacity = block_capacity(blk);
+	loff_t off = 0, data, size;
+	bool_t haslong = FALSE;
+	u32_t i, l;
+
+	while(off + sizeof(struct tar_header) <= capacity)
+	{
+		if(block_read(blk, (u8_t *)(&header), off, sizeof(struct tar_header)) != sizeof(struct tar_header))
+			return EIO;
+
+		if(strncmp((const char *)(header.magic), (const char *)"ustar", 5) != 0)
+			break;
+
+		size = tarfs_octal(header.size, sizeof(header.size));
+		if(size < 0)
+			break;
+		data = off + sizeof(struct tar_header);
+		off = data + ((size + 511) & ~511);
+
+		/* gnu long name for the next entry, pax headers are skipped */
+		if(header.filetype == 'L')
+		{
+			l = (size < MAX_PATH - 1) ? size : MAX_PATH - 1;
+			if(block_read(blk, (u8_t *)longname, data, l) != l)
+				return EIO;
+			longname[l] = '\0';
+			haslong = TRUE;
+			continue;
+		}
+		if((header.filetype == 'x') || (header.filetype == 'g'))
+			continue;
 
-	return FALSE;
+		if(haslong)
+		{
+			strlcpy(path, longname, sizeof(path));
+			haslong = FALSE;
+		}
+		else
+		{
+			path[0] = '\0';
+			if(header.prefix[0] != '\0')
+			{
+				strncat(path, (const char *)header.prefix, sizeof(header.prefix));
+				strlcat(path, "/", sizeof(path));
+			}
+			strncat(path, (const char *)header.name, sizeof(header.name));
+		}
+		if((header.filetype == '\0') && (path[0] != '\0') && (path[strlen(path) - 1] == '/'))
+			header.filetype = FILE_TYPE_DIRECTORY;
+
+		np = tarfs_insert(md, path);
+		if(!np || (np == &md->root))
+			continue;
+
+		/* a later entry of the same path replaces the earlier one */
+		np->filetype = (header.filetype == '\0') ? FILE_TYPE_NORMAL : header.filetype;
+		np->offset = data;
+		np->size = size;
+		np->mode = tarfs_octal(header.mode, sizeof(header.mode));
+	}
+
+	if(!tarfs_link_children(md, &md->root))
+		return ENOMEM;
+	for(i = 0; i < md->size; i++)
+	{
+		hlist_for_each_entry_safe(np, n, &md->hash[i], node)
+		{
+			if(!tarfs_link_children(md, np))
+				return ENOMEM;
+		}
+	}
+
+	return 0;
 }
 
 /*
@@ -187,8 +397,11 @@ static bool_t check_path(const char * path, const char * perfix, const char * na
  */
 static s32_t tarfs_mount(struct mount_t * m, char * dev, s32_t flag)
 {
+	struct tarfs_mount_data * md;
 	struct block_t * blk;
 	struct tar_header header;
+	u32_t i;
+	s32_t err;
 
 	if(dev == NULL)
 		return EINVAL;
@@ -209,15 +422,39 @@ static s32_t tarfs_mount(struct mount_t * m, char * dev, s32_t flag)
 	if(strncmp((const char *)(header.magic), (const char *)"ustar", 5) != 0)
 		return EINVAL;
 
+	md = malloc(sizeof(struct tarfs_mount_data));
+	if(!md)
+		return ENOMEM;
+	memset(md, 0, sizeof(struct tarfs_mount_data));
+	md->size = 64;
+	md->hash = malloc(md->size * sizeof(struct hlist_head));
+	if(!md->hash)
+	{
+		free(md);
+		return ENOMEM;
+	}
+	for(i = 0; i < md->size; i++)
+		init_hlist_head(&md->hash[i]);
+	md->root.filetype = FILE_TYPE_DIRECTORY;
+	md->root.mode = 0755;
+	md->memory = sizeof(struct tarfs_mount_data) + md->size * sizeof(struct hlist_head);
+
+	if((err = tarfs_build_index(md, blk)) != 0)
+	{
+		tarfs_free_index(md);
+		return err;
+	}
+
 	m->m_flags = (flag & MOUNT_MASK) | MOUNT_RDONLY;
-	m->m_root->v_data = 0;
-	m->m_data = NULL;
+	m->m_root->v_data = &md->root;
+	m->m_data = md;
 
 	return 0;
 }
 
 static s32_t tarfs_unmount(struct mount_t * m)
 {
+	tarfs_free_index(m->m_data);
 	m->m_data = NULL;
 	return 0;
 }
@@ -234,7 +471,19 @@ static s32_t tarfs_vget(struct mount_t * m, struct vnode_t * node)
 
 static s32_t tarfs_statfs(struct mount_t * m, struct statfs * stat)
 {
-	return -1;
+	struct tarfs_mount_data * md = m->m_data;
+
+	stat->f_flags = m->m_flags;
+	stat->f_bsize = 512;
+	stat->f_blocks = block_capacity((struct block_t *)m->m_dev) >> 9;
+	stat->f_bfree = 0;
+	stat->f_bavail = 0;
+	stat->f_files = md->count;
+	stat->f_ffree = 0;
+	stat->f_namelen = MAX_NAME - 1;
+	stat->f_memory = md->memory;
+
+	return 0;
 }
 
 /*
@@ -268,8 +517,8 @@ static s32_t tarfs_read(struct vnode_t * node, struct file_t * fp, void * buf, l
 	if(node->v_size - fp->f_offset < size)
 		size = node->v_size - fp->f_offset;
 
-	off = (loff_t)((s32_t)(node->v_data));
-	len = block_read(dev, (u8_t *)buf, (off + fp->f_offset), size);
+	off = ((struct tarfs_node *)node->v_data)->offset;
+	len = block_read_ahead(dev, &fp->f_ra, (u8_t *)buf, (off + fp->f_offset), size);
 
 	fp->f_offset += len;
 	*result = len;
@@ -302,12 +551,8 @@ static s32_t tarfs_fsync(struct vnode_t * node, struct file_t * fp)
 
 static s32_t tarfs_readdir(struct vnode_t * node, struct file_t * fp, struct dirent_t * dir)
 {
-	struct block_t * dev = (struct block_t *)node->v_mount->m_dev;
-	struct tar_header header;
-	char name[MAX_NAME];
-	loff_t off = 0;
-	loff_t size;
-	s32_t i = 0;
+	struct tarfs_node * dp = node->v_data;
+	struct tarfs_node * np;
 
 	if(fp->f_offset == 0)
 	{
@@ -321,37 +566,15 @@ static s32_t tarfs_readdir(struct vnode_t * node, struct file_t * fp, struct dir
 	}
 	else
 	{
-		while(1)
-		{
-			block_read(dev, (u8_t *)(&header), off, sizeof(struct tar_header));
-
-			if(strncmp((const char *)(header.magic), (const char *)"ustar", 5) != 0)
-				return ENOENT;
-
-			size = strtoll((const char *)(header.size), NULL, 0);
-			if(size < 0)
-				return ENOENT;
-
-			if(size == 0)
-				off += sizeof(struct tar_header);
-			else
-				off += sizeof(struct tar_header) + (((size + 512) >> 9) << 9);
-
-			if(!get_next_token((const char *)header.name, (const char *)node->v_path, name))
-				continue;
-
-			if(i++ == fp->f_offset - 2)
-			{
-				off = 0;
-				break;
-			}
-		}
+		if(fp->f_offset - 2 >= dp->nchild)
+			return ENOENT;
+		np = dp->children[fp->f_offset - 2];
 
-		if(header.filetype == FILE_TYPE_DIRECTORY)
+		if(np->filetype == FILE_TYPE_DIRECTORY)
 			dir->d_type = DT_DIR;
 		else
 			dir->d_type = DT_REG;
-		strlcpy((char *)&dir->d_name, name, sizeof(name));
+		strlcpy((char *)&dir->d_name, np->name, sizeof(dir->d_name));
 	}
 
 	dir->d_fileno = (u32_t)fp->f_offset;
@@ -363,34 +586,15 @@ static s32_t tarfs_readdir(struct vnode_t * node, struct file_t * fp, struct dir
 
 static s32_t tarfs_lookup(struct vnode_t * dnode, char * name, struct vnode_t * node)
 {
-	struct block_t * dev = (struct block_t *)node->v_mount->m_dev;
-	struct tar_header header;
-	loff_t off = 0;
-	loff_t size;
+	struct tarfs_mount_data * md = dnode->v_mount->m_data;
+	struct tarfs_node * np;
 	u32_t mode;
-	s8_t buf[9];
 
-	while(1)
-	{
-		block_read(dev, (u8_t *)(&header), off, sizeof(struct tar_header));
-
-		if(strncmp((const char *)(header.magic), (const char *)"ustar", 5) != 0)
-			return ENOENT;
-
-		size = strtoll((const char *)(header.size), NULL, 0);
-		if(size < 0)
-			return ENOENT;
-
-		if(check_path((const char *)(header.name), (const char *)(dnode->v_path), (const char *)name))
-			break;
+	np = tarfs_find(md, dnode->v_data, name, strlen(name));
+	if(!np)
+		return ENOENT;
 
-		if(size == 0)
-			off += sizeof(struct tar_header);
-		else
-			off += sizeof(struct tar_header) + (((size + 512) >> 9) << 9);
-	}
-
-	switch(header.filetype)
+	switch(np->filetype)
 	{
 	case FILE_TYPE_NORMAL:
 		node->v_type = VREG;
@@ -426,10 +630,7 @@ static s32_t tarfs_lookup(struct vnode_t * dnode, char * name, struct vnode_t *
 		break;
 	}
 
-	buf[8] = '\0';
-	memcpy(buf, (const s8_t *)(header.mode), 8);
-	mode = strtoul((const char *)buf, NULL, 8);
-
+	mode = np->mode;
 	node->v_mode = 0;
 	if(mode & 00400)
 		node->v_mode |= S_IRUSR;
@@ -450,8 +651,8 @@ static s32_t tarfs_lookup(struct vnode_t * dnode, char * name, struct vnode_t *
 	if(mode & 00001)
 		node->v_mode |= S_IXOTH;
 
-	node->v_size = size;
-	node->v_data = (void *)((s32_t)(off+ sizeof(struct tar_header)));
+	node->v_size = (node->v_type == VDIR) ? 0 : np->size;
+	node->v_data = np;
 
 	return 0;
 }
@@ -200,6 +200,9 @@ s32_t sys_umount(char * path)
 			if(m->m_covered == NULL)
 				return EINVAL;
 
+			/* release all unused vnodes */
+			vflush(m);
+
 			err = m->m_fs->vfsops->vfs_unmount(m);
 			if(err != 0)
 				return err;
@@ -209,11 +212,9 @@ s32_t sys_umount(char * path)
 			/* decrement referece count of root vnode */
 			vrele(m->m_covered);
 
-			/* release all vnodes */
-			vflush(m);
-
 			if(m->m_dev)
 			{
+				block_sync((struct block_t *)m->m_dev);
 			}
 
 			free(m);
@@ -232,12 +233,17 @@ s32_t sys_sync(void)
 	struct list_head * pos;
 	struct mount_t * m;
 
+	/* write back all cached pages */
+	page_cache_sync(NULL);
+
 	/* call each mounted file system. */
 	list_for_each(pos, &mount_list)
 	{
 		m = list_entry(pos, struct mount_t, m_link);
 		if(m && m->m_fs->vfsops->vfs_sync)
 			m->m_fs->vfsops->vfs_sync(m);
+		if(m && m->m_dev)
+			block_sync((struct block_t *)m->m_dev);
 	}
 
 	return 0;
@@ -272,6 +278,7 @@ s32_t sys_open(char * path, u32_t flags, u32_t mode, struct file_t ** pfp)
 			mode &= ~S_IFMT;
 			mode |= S_IFREG;
 			err = dvp->v_op->vop_create(dvp, filename, mode);
+			cache_remove(dvp, filename);
 			vput(dvp);
 			if(err)
 				return err;
@@ -326,6 +333,7 @@ s32_t sys_open(char * path, u32_t flags, u32_t mode, struct file_t ** pfp)
 			vput(vp);
 			return EINVAL;
 		}
+		page_cache_purge(vp);
 		if((err = vp->v_op->vop_truncate(vp, 0)) != 0)
 		{
 			vput(vp);
@@ -402,7 +410,10 @@ s32_t sys_read(struct file_t * fp, void * buf, loff_t size, loff_t * count)
 	}
 
 	vp = fp->f_vnode;
-	err = vp->v_op->vop_read(vp, fp, buf, size, count);
+	if(page_cache_enabled(vp))
+		err = page_cache_read(vp, fp, buf, size, count);
+	else
+		err = vp->v_op->vop_read(vp, fp, buf, size, count);
 
 	return err;
 }
@@ -425,7 +436,192 @@ s32_t sys_write(struct file_t * fp, void * buf, loff_t size, loff_t * count)
 	}
 
 	vp = fp->f_vnode;
-	err = vp->v_op->vop_write(vp, fp, buf, size, count);
+	if(page_cache_enabled(vp))
+		err = page_cache_write(vp, fp, buf, size, count);
+	else
+		err = vp->v_op->vop_write(vp, fp, buf, size, count);
+
+	return err;
+}
+
+/*
+ * system readv
+ */
+s32_t sys_readv(struct file_t * fp, const struct iovec * iov, int iovcnt, loff_t * count)
+{
+	struct vnode_t * vp;
+	bool_t cached = FALSE;
+	loff_t bytes;
+	s32_t err = 0;
+
+	if((fp->f_flags & O_RDONLY) == 0)
+		return EBADF;
+
+	*count = 0;
+	if(!iov || (iovcnt <= 0))
+		return 0;
+
+	vp = fp->f_vnode;
+	if(page_cache_enabled(vp))
+		cached = TRUE;
+	else if(vp->v_op->vop_readv)
+		return vp->v_op->vop_readv(vp, fp, iov, iovcnt, count);
+
+	for(; iovcnt > 0; iovcnt--, iov++)
+	{
+		if(iov->iov_len == 0)
+			continue;
+		if(cached)
+			err = page_cache_read(vp, fp, iov->iov_base, iov->iov_len, &bytes);
+		else
+			err = vp->v_op->vop_read(vp, fp, iov->iov_base, iov->iov_len, &bytes);
+		if(err != 0)
+			break;
+		*count += bytes;
+		if(bytes != iov->iov_len)
+			break;
+	}
+
+	return err;
+}
+
+/*
+ * system writev
+ */
+s32_t sys_writev(struct file_t * fp, const struct iovec * iov, int iovcnt, loff_t * count)
+{
+	struct vnode_t * vp;
+	bool_t cached = FALSE;
+	loff_t bytes;
+	s32_t err = 0;
+
+	if((fp->f_flags & O_WRONLY) == 0)
+		return EBADF;
+
+	*count = 0;
+	if(!iov || (iovcnt <= 0))
+		return 0;
+
+	vp = fp->f_vnode;
+	if(page_cache_enabled(vp))
+		cached = TRUE;
+	else if(vp->v_op->vop_writev)
+		return vp->v_op->vop_writev(vp, fp, iov, iovcnt, count);
+
+	for(; iovcnt > 0; iovcnt--, iov++)
+	{
+		if(iov->iov_len == 0)
+			continue;
+		if(cached)
+			err = page_cache_write(vp, fp, iov->iov_base, iov->iov_len, &bytes);
+		else
+			err = vp->v_op->vop_write(vp, fp, iov->iov_base, iov->iov_len, &bytes);
+		if(err != 0)
+			break;
+		*count += bytes;
+		if(bytes != iov->iov_len)
+			break;
+	}
+
+	return err;
+}
+
+/*
+ * system copy range, from one regular file to another. the offsets are
+ * updated if given, otherwise the file offsets are used and advanced.
+ */
+s32_t sys_copy_range(struct file_t * ifp, loff_t * ioff, struct file_t * ofp, loff_t * ooff, loff_t len, loff_t * count)
+{
+	struct vnode_t * ivp, * ovp;
+	loff_t ipos, opos, isave, osave;
+	loff_t size, n, bytes;
+	const void * p = NULL;
+	void * buf;
+	s32_t err;
+
+	*count = 0;
+	if(((ifp->f_flags & O_RDONLY) == 0) || ((ofp->f_flags & O_WRONLY) == 0))
+		return EBADF;
+
+	ivp = ifp->f_vnode;
+	ovp = ofp->f_vnode;
+	if((ivp->v_type != VREG) || (ovp->v_type != VREG))
+		return EINVAL;
+
+	ipos = ioff ? *ioff : ifp->f_offset;
+	opos = ooff ? *ooff : ofp->f_offset;
+	if((ipos < 0) || (opos < 0))
+		return EINVAL;
+	if((len <= 0) || (ipos >= ivp->v_size))
+		return 0;
+	if(len > ivp->v_size - ipos)
+		len = ivp->v_size - ipos;
+	if((ivp == ovp) && (ipos < opos + len) && (opos < ipos + len))
+		return EINVAL;
+
+	isave = ifp->f_offset;
+	osave = ofp->f_offset;
+	ifp->f_offset = ipos;
+	ofp->f_offset = opos;
+
+	/*
+	 * memory addressable source is written straight to destination.
+	 */
+	if((ivp->v_op->vop_ioctl(ivp, ifp, VFS_IOCTL_MMAP, &p) == 0) && p)
+	{
+		err = sys_write(ofp, (u8_t *)p + ipos, len, count);
+	}
+	/*
+	 * copy from the source pages if the range fits in page cache.
+	 */
+	else if(!page_cache_enabled(ivp) || ((err = page_cache_copy(ivp, ifp, ipos, ofp, len, count)) == EAGAIN))
+	{
+		/*
+		 * bounce through the largest buffer the heap can give, aligned
+		 * to source offset, so large reads bypass the caches.
+		 */
+		size = CONFIG_VFS_COPY_SIZE;
+		while(!(buf = malloc(size)) && (size > SZ_4K))
+			size >>= 1;
+		if(!buf)
+			err = ENOMEM;
+		else
+		{
+			*count = 0;
+			err = 0;
+			while(*count < len)
+			{
+				n = size - ((ipos + *count) % size);
+				if(n > len - *count)
+					n = len - *count;
+				if((err = sys_read(ifp, buf, n, &bytes)) != 0)
+					break;
+				if(bytes > 0)
+					err = sys_write(ofp, buf, bytes, &bytes);
+				*count += bytes;
+				if((err != 0) || (bytes != n))
+					break;
+			}
+			free(buf);
+		}
+	}
+
+	if((err != 0) && (*count > 0))
+		err = 0;
+
+	if(ioff)
+	{
+		*ioff = ipos + *count;
+		ifp->f_offset = isave;
+	}
+	else
+		ifp->f_offset = ipos + *count;
+
+	if(ooff)
+	{
+		*ooff = opos + *count;
+		ofp->f_offset = osave;
+	}
 
 	return err;
 }
@@ -510,7 +706,11 @@ s32_t sys_fsync(struct file_t * fp)
 
 	vp = fp->f_vnode;
 
+	if((err = page_cache_sync(vp)) != 0)
+		return err;
 	err = ((vp)->v_op->vop_fsync)(vp, fp);
+	if((err == 0) && vp->v_mount && vp->v_mount->m_dev)
+		block_sync((struct block_t *)vp->v_mount->m_dev);
 
 	return err;
 }
@@ -670,6 +870,7 @@ s32_t sys_mkdir(char * path, u32_t mode)
 	mode &= ~S_IFMT;
 	mode |= S_IFDIR;
 	err = dvp->v_op->vop_mkdir(dvp, name, mode);
+	cache_remove(dvp, name);
 	vput(dvp);
 
 	return err;
@@ -787,6 +988,7 @@ s32_t sys_mknod(char * path, u32_t mode)
 		err = dvp->v_op->vop_mkdir(dvp, name, mode);
 	else
 		err = dvp->v_op->vop_create(dvp, name, mode);
+	cache_remove(dvp, name);
 
 	vput(dvp);
 	return err;
@@ -880,7 +1082,16 @@ s32_t sys_rename(char * src, char * dest)
 		goto err4;
 	}
 
+	/* forget everything cached below the old names */
+	vn_invalidate(vp1->v_mount, vp1->v_path);
+	if(vp2)
+		vn_invalidate(vp2->v_mount, vp2->v_path);
+
 	err = dvp1->v_op->vop_rename(dvp1, vp1, sname, dvp2, vp2, dname);
+	cache_remove(dvp1, sname);
+	cache_remove(dvp2, dname);
+	if((err == 0) && vp2)
+		page_cache_purge(vp2);
 
  err4:
 	vput(dvp2);
@@ -1008,7 +1219,11 @@ s32_t sys_fchdir(struct file_t * fp, char * cwd)
 void do_init_vfs(void)
 {
 	extern void vfs_vnode_init(void);
+	extern void vfs_cache_init(void);
+	extern void vfs_page_init(void);
 	extern void vfs_fd_init(void);
 	vfs_vnode_init();
+	vfs_cache_init();
+	vfs_page_init();
 	vfs_fd_init();
 }
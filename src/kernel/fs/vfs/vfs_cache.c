@@ -0,0 +1,234 @@
+/*
+ * kernel/fs/vfs/vfs_cache.c
+ *
+ * Copyright(c) 2007-2018 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <xboot.h>
+#include <errno.h>
+#include <fs/fs.h>
+#include <fs/vfs/vfs.h>
+
+/* size of name cache hash table, must power 2 */
+#define NCACHE_HASH_SIZE			(64)
+
+/*
+ * name cache entry, maps a component in directory to a vnode.
+ * a null vnode is a negative entry, the name does not exist.
+ */
+struct ncache_t {
+	struct hlist_node node;		/* link for hash list */
+	struct list_head lru;		/* link for lru list */
+	struct list_head dlink;		/* link for names of directory */
+	struct list_head vlink;		/* link for aliases of vnode */
+	struct vnode_t * dvp;		/* directory vnode */
+	struct vnode_t * vp;		/* target vnode, null for negative entry */
+	u32_t hash;					/* hash value of name */
+	char * name;				/* component name */
+};
+
+static struct hlist_head ncache_table[NCACHE_HASH_SIZE];
+static struct list_head ncache_lru;
+static u32_t ncache_count;
+static u32_t ncache_hit;
+static u32_t ncache_negative;
+static u32_t ncache_miss;
+
+static u32_t ncache_hash(struct vnode_t * dvp, char * name)
+{
+	u32_t val = 5381;
+
+	while(*name)
+		val = ((val << 5) + val) + *name++;
+
+	return (val ^ (u32_t)((unsigned long)dvp));
+}
+
+static struct ncache_t * ncache_find(struct vnode_t * dvp, char * name, u32_t hash)
+{
+	struct ncache_t * nc;
+
+	hlist_for_each_entry(nc, &ncache_table[hash & (NCACHE_HASH_SIZE - 1)], node)
+	{
+		if((nc->hash == hash) && (nc->dvp == dvp) && (strcmp(nc->name, name) == 0))
+			return nc;
+	}
+	return NULL;
+}
+
+static void ncache_free(struct ncache_t * nc)
+{
+	hlist_del(&nc->node);
+	list_del(&nc->lru);
+	list_del(&nc->dlink);
+	if(nc->vp)
+		list_del(&nc->vlink);
+	ncache_count--;
+
+	free(nc->name);
+	free(nc);
+}
+
+/*
+ * look up a component of directory in the name cache. returns zero
+ * with a referenced vnode on hit, ENOENT for a negative entry, and
+ * EAGAIN if the name is not cached.
+ */
+s32_t cache_lookup(struct vnode_t * dvp, char * name, struct vnode_t ** vpp)
+{
+	struct ncache_t * nc;
+
+	nc = ncache_find(dvp, name, ncache_hash(dvp, name));
+	if(!nc)
+	{
+		ncache_miss++;
+		return EAGAIN;
+	}
+
+	list_del(&nc->lru);
+	list_add(&nc->lru, &ncache_lru);
+
+	if(!nc->vp)
+	{
+		ncache_negative++;
+		return ENOENT;
+	}
+
+	ncache_hit++;
+	vref(nc->vp);
+	*vpp = nc->vp;
+	return 0;
+}
+
+/*
+ * add a component of directory to the name cache, a null vnode
+ * records that the name does not exist.
+ */
+void cache_enter(struct vnode_t * dvp, char * name, struct vnode_t * vp)
+{
+	struct ncache_t * nc;
+	u32_t hash;
+
+	if(dvp->v_mount->m_fs->flags & FILESYSTEM_NOCACHE)
+		return;
+	if(!dvp->v_cached && (dvp != dvp->v_mount->m_root))
+		return;
+	if(vp && !vp->v_cached)
+		return;
+
+	hash = ncache_hash(dvp, name);
+	if((nc = ncache_find(dvp, name, hash)) != NULL)
+		ncache_free(nc);
+
+	nc = malloc(sizeof(struct ncache_t));
+	if(!nc)
+		return;
+	nc->name = strdup(name);
+	if(!nc->name)
+	{
+		free(nc);
+		return;
+	}
+	nc->dvp = dvp;
+	nc->vp = vp;
+	nc->hash = hash;
+
+	init_hlist_node(&nc->node);
+	hlist_add_head(&nc->node, &ncache_table[hash & (NCACHE_HASH_SIZE - 1)]);
+	list_add(&nc->lru, &ncache_lru);
+	list_add(&nc->dlink, &dvp->v_names);
+	if(vp)
+		list_add(&nc->vlink, &vp->v_aliases);
+	ncache_count++;
+
+	while(ncache_count > CONFIG_VFS_NAME_CACHE_COUNT)
+		ncache_free(list_last_entry(&ncache_lru, struct ncache_t, lru));
+}
+
+/*
+ * drop a component of directory from the name cache.
+ */
+void cache_remove(struct vnode_t * dvp, char * name)
+{
+	struct ncache_t * nc;
+
+	nc = ncache_find(dvp, name, ncache_hash(dvp, name));
+	if(nc)
+		ncache_free(nc);
+}
+
+/*
+ * drop all name cache entries which refer to vnode, both the names
+ * in it as a directory and the names which point to it.
+ */
+void cache_purge(struct vnode_t * vp)
+{
+	struct ncache_t * nc, * n;
+
+	list_for_each_entry_safe(nc, n, &vp->v_names, dlink)
+		ncache_free(nc);
+	list_for_each_entry_safe(nc, n, &vp->v_aliases, vlink)
+		ncache_free(nc);
+}
+
+static ssize_t ncache_read_hit(struct kobj_t * kobj, void * buf, size_t size)
+{
+	return sprintf(buf, "%u", ncache_hit);
+}
+
+static ssize_t ncache_read_negative(struct kobj_t * kobj, void * buf, size_t size)
+{
+	return sprintf(buf, "%u", ncache_negative);
+}
+
+static ssize_t ncache_read_miss(struct kobj_t * kobj, void * buf, size_t size)
+{
+	return sprintf(buf, "%u", ncache_miss);
+}
+
+static ssize_t ncache_read_count(struct kobj_t * kobj, void * buf, size_t size)
+{
+	return sprintf(buf, "%u", ncache_count);
+}
+
+void vfs_cache_init(void)
+{
+	struct kobj_t * kclass = kobj_search_directory_with_create(kobj_get_root(), "class");
+	struct kobj_t * kobj = kobj_search_directory_with_create(kclass, "vfs");
+	int i;
+
+	for(i = 0; i < NCACHE_HASH_SIZE; i++)
+		init_hlist_head(&ncache_table[i]);
+	init_list_head(&ncache_lru);
+	ncache_count = 0;
+	ncache_hit = 0;
+	ncache_negative = 0;
+	ncache_miss = 0;
+
+	kobj_add_regular(kobj, "name-cache-hit", ncache_read_hit, NULL, NULL);
+	kobj_add_regular(kobj, "name-cache-negative", ncache_read_negative, NULL, NULL);
+	kobj_add_regular(kobj, "name-cache-miss", ncache_read_miss, NULL, NULL);
+	kobj_add_regular(kobj, "name-cache-count", ncache_read_count, NULL, NULL);
+}
@@ -43,7 +43,7 @@ s32_t vfs_namei(char * path, struct vnode_t ** vpp)
 	char name[MAX_PATH];
 	struct mount_t * mp;
 	struct vnode_t * dvp, * vp;
-	s32_t error, i;
+	s32_t error, i, len;
 
 	/*
 	 * convert a full path name to its mount point and
@@ -72,6 +72,8 @@ s32_t vfs_namei(char * path, struct vnode_t ** vpp)
 
 	vref(dvp);
 	node[0] = '\0';
+	len = 0;
+	vp = dvp;
 
 	while(*p != '\0')
 	{
@@ -80,8 +82,10 @@ s32_t vfs_namei(char * path, struct vnode_t ** vpp)
 		 */
 		while(*p == '/')
 			p++;
+		if(*p == '\0')
+			break;
 
-		for(i = 0; i < MAX_PATH; i++)
+		for(i = 0; i < MAX_PATH - 1; i++)
 		{
 			if(*p == '\0' || *p == '/')
 				break;
@@ -89,32 +93,62 @@ s32_t vfs_namei(char * path, struct vnode_t ** vpp)
 		}
 		name[i] = '\0';
 
+		if(dvp->v_type != VDIR)
+		{
+			vput(dvp);
+			return ENOTDIR;
+		}
+
 		/*
-		 * get a vnode for the target.
+		 * append the name to the node path.
 		 */
-		strlcat(node, "/", sizeof(node));
-		strlcat(node, name, sizeof(node));
-		vp = vn_lookup(mp, node);
-		if(vp == NULL)
+		if(len + i + 2 > MAX_PATH)
 		{
-			vp = vget(mp, node);
-			if(vp == NULL)
-			{
-				vput(dvp);
-				return ENOMEM;
-			}
+			vput(dvp);
+			return ENAMETOOLONG;
+		}
+		node[len++] = '/';
+		memcpy(&node[len], name, i + 1);
+		len += i;
 
-			/*
-			 * find a vnode in this directory.
-			 */
-			error = dvp->v_op->vop_lookup(dvp, name, vp);
-			if(error || (*p == '/' && vp->v_type != VDIR))
+		/*
+		 * get a vnode for the target, try the name cache first.
+		 */
+		error = cache_lookup(dvp, name, &vp);
+		if(error == ENOENT)
+		{
+			vput(dvp);
+			return error;
+		}
+		else if(error != 0)
+		{
+			vp = vn_lookup(mp, node);
+			if(vp == NULL)
 			{
-				/* not found */
-				vput(vp);
-				vput(dvp);
-				return error;
+				vp = vget(mp, node);
+				if(vp == NULL)
+				{
+					vput(dvp);
+					return ENOMEM;
+				}
+
+				/*
+				 * find a vnode in this directory.
+				 */
+				error = dvp->v_op->vop_lookup(dvp, name, vp);
+				if(error)
+				{
+					/* not found */
+					vput(vp);
+					if(error == ENOENT)
+						cache_enter(dvp, name, NULL);
+					vput(dvp);
+					return error;
+				}
+				if(!(mp->m_fs->flags & FILESYSTEM_NOCACHE))
+					vp->v_cached = TRUE;
 			}
+			cache_enter(dvp, name, vp);
 		}
 
 		vput(dvp);
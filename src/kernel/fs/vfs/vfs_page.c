@@ -0,0 +1,516 @@
+/*
+ * kernel/fs/vfs/vfs_page.c
+ *
+ * Copyright(c) 2007-2018 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <xboot.h>
+#include <errno.h>
+#include <fs/fs.h>
+#include <fs/vfs/vfs.h>
+
+/* size of page hash table, must power 2 */
+#define PAGE_HASH_SIZE				(256)
+
+/*
+ * cached page of regular file, indexed by vnode and page number.
+ */
+struct page_t {
+	struct hlist_node node;		/* link for hash list */
+	struct list_head lru;		/* link for lru list */
+	struct list_head vlink;		/* link for pages of vnode */
+	struct vnode_t * vp;		/* owner vnode */
+	loff_t index;				/* page number in file */
+	bool_t dirty;				/* modified since read from file system */
+	u8_t * data;				/* page data */
+};
+
+static struct hlist_head page_table[PAGE_HASH_SIZE];
+static struct list_head page_lru;
+static size_t page_limit;
+static u32_t page_count;
+static u32_t page_dirty;
+static u32_t page_hit;
+static u32_t page_miss;
+static u32_t page_writeback;
+static struct page_t * page_busy;
+
+static inline u32_t page_hash(struct vnode_t * vp, loff_t index)
+{
+	return ((u32_t)((unsigned long)vp >> 4) ^ (u32_t)index) & (PAGE_HASH_SIZE - 1);
+}
+
+static inline loff_t page_length(struct vnode_t * vp, loff_t index)
+{
+	loff_t off = index * CONFIG_VFS_PAGE_SIZE;
+
+	if(off >= vp->v_size)
+		return 0;
+	if(vp->v_size - off < CONFIG_VFS_PAGE_SIZE)
+		return vp->v_size - off;
+	return CONFIG_VFS_PAGE_SIZE;
+}
+
+static struct page_t * page_find(struct vnode_t * vp, loff_t index)
+{
+	struct page_t * pg;
+
+	hlist_for_each_entry(pg, &page_table[page_hash(vp, index)], node)
+	{
+		if((pg->vp == vp) && (pg->index == index))
+			return pg;
+	}
+	return NULL;
+}
+
+static void page_free(struct page_t * pg)
+{
+	hlist_del(&pg->node);
+	list_del(&pg->lru);
+	list_del(&pg->vlink);
+	if(pg->dirty)
+		page_dirty--;
+	page_count--;
+	free(pg);
+}
+
+/*
+ * write the page back through file system.
+ */
+static s32_t page_flush(struct page_t * pg)
+{
+	struct vnode_t * vp = pg->vp;
+	struct file_t file;
+	loff_t len, count;
+	s32_t err;
+
+	if(!pg->dirty)
+		return 0;
+
+	len = page_length(vp, pg->index);
+	if(len > 0)
+	{
+		memset(&file, 0, sizeof(struct file_t));
+		file.f_flags = O_WRONLY;
+		file.f_offset = pg->index * CONFIG_VFS_PAGE_SIZE;
+		file.f_vnode = vp;
+		file.f_count = 1;
+		if((err = vp->v_op->vop_write(vp, &file, pg->data, len, &count)) != 0)
+			return err;
+		if(count != len)
+			return EIO;
+		page_writeback++;
+	}
+	pg->dirty = FALSE;
+	page_dirty--;
+
+	return 0;
+}
+
+/*
+ * make room for one more page, the heap must keep an eighth of
+ * its size free for others.
+ */
+static bool_t page_reclaim(void)
+{
+	struct page_t * pg, * n;
+	size_t mused, mfree;
+
+	meminfo(&mused, &mfree);
+	if(((page_count + 1) * CONFIG_VFS_PAGE_SIZE <= page_limit) && (mfree > (mused + mfree) / 8))
+		return TRUE;
+
+	list_for_each_entry_safe_reverse(pg, n, &page_lru, lru)
+	{
+		if((pg != page_busy) && (page_flush(pg) == 0))
+		{
+			page_free(pg);
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/*
+ * get the page of file, reading it through file system if not cached.
+ * a page about to be overwritten as a whole is not filled.
+ */
+static struct page_t * page_get(struct vnode_t * vp, struct file_t * fp, loff_t index, bool_t fill, s32_t * err)
+{
+	struct page_t * pg;
+	struct file_t file;
+	loff_t len, count;
+
+	*err = 0;
+	if((pg = page_find(vp, index)) != NULL)
+	{
+		list_del(&pg->lru);
+		list_add(&pg->lru, &page_lru);
+		page_hit++;
+		return pg;
+	}
+	page_miss++;
+
+	if(!page_reclaim())
+		return NULL;
+	if(!(pg = malloc(sizeof(struct page_t) + CONFIG_VFS_PAGE_SIZE)))
+		return NULL;
+	pg->vp = vp;
+	pg->index = index;
+	pg->dirty = FALSE;
+	pg->data = (u8_t *)(pg + 1);
+
+	len = page_length(vp, index);
+	if((len > 0) && fill)
+	{
+		/*
+		 * read with the readahead state of file, so sequential
+		 * access is still detected by the file system.
+		 */
+		memset(&file, 0, sizeof(struct file_t));
+		file.f_flags = O_RDONLY;
+		file.f_offset = index * CONFIG_VFS_PAGE_SIZE;
+		file.f_vnode = vp;
+		file.f_count = 1;
+		if(fp)
+			memcpy(&file.f_ra, &fp->f_ra, sizeof(struct block_readahead_t));
+		*err = vp->v_op->vop_read(vp, &file, pg->data, len, &count);
+		if(fp)
+			memcpy(&fp->f_ra, &file.f_ra, sizeof(struct block_readahead_t));
+		if(*err == 0 && count != len)
+			*err = EIO;
+		if(*err != 0)
+		{
+			free(pg);
+			return NULL;
+		}
+	}
+	if(len < CONFIG_VFS_PAGE_SIZE)
+		memset(pg->data + len, 0, CONFIG_VFS_PAGE_SIZE - len);
+
+	init_hlist_node(&pg->node);
+	hlist_add_head(&pg->node, &page_table[page_hash(vp, index)]);
+	list_add(&pg->lru, &page_lru);
+	list_add(&pg->vlink, &vp->v_pages);
+	page_count++;
+
+	return pg;
+}
+
+/*
+ * copy data just written through file system into the cached pages
+ * it overlaps, dirty pages keep their other modifications.
+ */
+static void page_patch(struct vnode_t * vp, loff_t pos, void * buf, loff_t count)
+{
+	struct page_t * pg;
+	loff_t off, l;
+
+	list_for_each_entry(pg, &vp->v_pages, vlink)
+	{
+		off = pg->index * CONFIG_VFS_PAGE_SIZE;
+		if((off + CONFIG_VFS_PAGE_SIZE <= pos) || (off >= pos + count))
+			continue;
+		if(off < pos)
+		{
+			l = (pos + count < off + CONFIG_VFS_PAGE_SIZE) ? count : off + CONFIG_VFS_PAGE_SIZE - pos;
+			memcpy(pg->data + (pos - off), buf, l);
+		}
+		else
+		{
+			l = (pos + count - off < CONFIG_VFS_PAGE_SIZE) ? pos + count - off : CONFIG_VFS_PAGE_SIZE;
+			memcpy(pg->data, (u8_t *)buf + (off - pos), l);
+		}
+	}
+}
+
+/*
+ * only regular files of file systems without volatile contents
+ * are cached.
+ */
+bool_t page_cache_enabled(struct vnode_t * vp)
+{
+	if(vp->v_type != VREG)
+		return FALSE;
+	if(vp->v_mount->m_fs->flags & FILESYSTEM_NOCACHE)
+		return FALSE;
+	return (page_limit >= CONFIG_VFS_PAGE_SIZE) ? TRUE : FALSE;
+}
+
+s32_t page_cache_read(struct vnode_t * vp, struct file_t * fp, void * buf, loff_t size, loff_t * result)
+{
+	struct page_t * pg;
+	loff_t off, len, n;
+	s32_t err;
+
+	*result = 0;
+	off = fp->f_offset;
+	if(off >= vp->v_size)
+		return 0;
+	len = (vp->v_size - off < size) ? vp->v_size - off : size;
+
+	/*
+	 * reads larger than a quarter of the cache would only evict
+	 * everything else, pass them to file system directly.
+	 */
+	if(len > page_limit / 4)
+	{
+		if((err = page_cache_sync(vp)) != 0)
+			return err;
+		return vp->v_op->vop_read(vp, fp, buf, size, result);
+	}
+
+	while(len > 0)
+	{
+		pg = page_get(vp, fp, off / CONFIG_VFS_PAGE_SIZE, TRUE, &err);
+		if(!pg)
+		{
+			if(err != 0)
+				return (*result > 0) ? 0 : err;
+			/* out of memory, read the rest without cache */
+			if((err = page_cache_sync(vp)) != 0)
+				return err;
+			err = vp->v_op->vop_read(vp, fp, buf, len, &n);
+			*result += n;
+			return err;
+		}
+		n = CONFIG_VFS_PAGE_SIZE - (off % CONFIG_VFS_PAGE_SIZE);
+		if(n > len)
+			n = len;
+		memcpy(buf, pg->data + (off % CONFIG_VFS_PAGE_SIZE), n);
+		buf = (u8_t *)buf + n;
+		off += n;
+		len -= n;
+		*result += n;
+		fp->f_offset = off;
+	}
+
+	return 0;
+}
+
+s32_t page_cache_write(struct vnode_t * vp, struct file_t * fp, void * buf, loff_t size, loff_t * result)
+{
+	struct page_t * pg;
+	loff_t pos, old, off, len, l, index;
+	bool_t full;
+	s32_t err;
+
+	*result = 0;
+	pos = (fp->f_flags & O_APPEND) ? vp->v_size : fp->f_offset;
+
+	/*
+	 * writes that grow the file go straight to file system, which
+	 * stays in charge of the file size. cached pages are updated.
+	 */
+	if(pos + size > vp->v_size)
+	{
+		old = vp->v_size;
+		if((err = vp->v_op->vop_write(vp, fp, buf, size, result)) != 0)
+			return err;
+		list_for_each_entry(pg, &vp->v_pages, vlink)
+		{
+			off = pg->index * CONFIG_VFS_PAGE_SIZE;
+			if((pos > old) && (old >= off) && (old < off + CONFIG_VFS_PAGE_SIZE))
+			{
+				l = ((pos < off + CONFIG_VFS_PAGE_SIZE) ? pos : off + CONFIG_VFS_PAGE_SIZE) - old;
+				memset(pg->data + (old - off), 0, l);
+			}
+		}
+		page_patch(vp, pos, buf, *result);
+		return 0;
+	}
+
+	/*
+	 * like reads, writes larger than a quarter of the cache bypass it,
+	 * cached pages of the range are patched instead of evicted.
+	 */
+	if(size > page_limit / 4)
+	{
+		fp->f_offset = pos;
+		err = vp->v_op->vop_write(vp, fp, buf, size, result);
+		page_patch(vp, pos, buf, *result);
+		return err;
+	}
+
+	off = pos;
+	len = size;
+	while(len > 0)
+	{
+		/* a page written from its start to its end needs no read */
+		index = off / CONFIG_VFS_PAGE_SIZE;
+		full = (((off % CONFIG_VFS_PAGE_SIZE) == 0) && (len >= page_length(vp, index))) ? TRUE : FALSE;
+		pg = page_get(vp, fp, index, !full, &err);
+		if(!pg)
+		{
+			if(err != 0)
+				return (*result > 0) ? 0 : err;
+			/* out of memory, write the rest without cache */
+			fp->f_offset = off;
+			err = vp->v_op->vop_write(vp, fp, buf, len, &l);
+			page_patch(vp, off, buf, l);
+			*result += l;
+			return err;
+		}
+		l = CONFIG_VFS_PAGE_SIZE - (off % CONFIG_VFS_PAGE_SIZE);
+		if(l > len)
+			l = len;
+		memcpy(pg->data + (off % CONFIG_VFS_PAGE_SIZE), buf, l);
+		if(!pg->dirty)
+		{
+			pg->dirty = TRUE;
+			page_dirty++;
+		}
+		buf = (u8_t *)buf + l;
+		off += l;
+		len -= l;
+		*result += l;
+		fp->f_offset = off;
+	}
+
+	return 0;
+}
+
+/*
+ * copy a range of file to another open file straight from the source
+ * pages. returns EAGAIN if the range is too large to go through cache.
+ */
+s32_t page_cache_copy(struct vnode_t * vp, struct file_t * fp, loff_t off, struct file_t * ofp, loff_t len, loff_t * result)
+{
+	struct page_t * pg;
+	loff_t n, count;
+	s32_t err = 0;
+
+	*result = 0;
+	if(off >= vp->v_size)
+		return 0;
+	if(len > vp->v_size - off)
+		len = vp->v_size - off;
+	if(len > page_limit / 4)
+		return EAGAIN;
+
+	while(len > 0)
+	{
+		if(!(pg = page_get(vp, fp, off / CONFIG_VFS_PAGE_SIZE, TRUE, &err)))
+			return (err != 0) ? err : ((*result > 0) ? 0 : EAGAIN);
+		n = CONFIG_VFS_PAGE_SIZE - (off % CONFIG_VFS_PAGE_SIZE);
+		if(n > len)
+			n = len;
+
+		/*
+		 * the destination may need new pages, keep this one
+		 */
+		page_busy = pg;
+		err = sys_write(ofp, pg->data + (off % CONFIG_VFS_PAGE_SIZE), n, &count);
+		page_busy = NULL;
+		*result += count;
+		if(err != 0)
+			return (*result > 0) ? 0 : err;
+		if(count != n)
+			break;
+		off += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/*
+ * write back dirty pages of vnode, or of all vnodes if it is null.
+ */
+s32_t page_cache_sync(struct vnode_t * vp)
+{
+	struct page_t * pg;
+	s32_t err, ret = 0;
+
+	if(page_dirty == 0)
+		return 0;
+
+	if(vp)
+	{
+		list_for_each_entry(pg, &vp->v_pages, vlink)
+		{
+			if((err = page_flush(pg)) != 0)
+				ret = err;
+		}
+	}
+	else
+	{
+		list_for_each_entry(pg, &page_lru, lru)
+		{
+			if((err = page_flush(pg)) != 0)
+				ret = err;
+		}
+	}
+	return ret;
+}
+
+/*
+ * drop all pages of vnode without writing them back.
+ */
+void page_cache_purge(struct vnode_t * vp)
+{
+	struct page_t * pg, * n;
+
+	list_for_each_entry_safe(pg, n, &vp->v_pages, vlink)
+		page_free(pg);
+}
+
+static ssize_t memory_read_pagecache(struct kobj_t * kobj, void * buf, size_t size)
+{
+	char * p = buf;
+	int len = 0;
+
+	len += sprintf((char *)(p + len), " page size: %ld\r\n", (long)CONFIG_VFS_PAGE_SIZE);
+	len += sprintf((char *)(p + len), " page limit: %ld\r\n", (long)page_limit);
+	len += sprintf((char *)(p + len), " page cached: %ld\r\n", (long)page_count * CONFIG_VFS_PAGE_SIZE);
+	len += sprintf((char *)(p + len), " page dirty: %ld\r\n", (long)page_dirty * CONFIG_VFS_PAGE_SIZE);
+	len += sprintf((char *)(p + len), " page hit: %u\r\n", page_hit);
+	len += sprintf((char *)(p + len), " page miss: %u\r\n", page_miss);
+	len += sprintf((char *)(p + len), " page writeback: %u\r\n", page_writeback);
+	return len;
+}
+
+void vfs_page_init(void)
+{
+	struct kobj_t * kclass = kobj_search_directory_with_create(kobj_get_root(), "class");
+	struct kobj_t * kobj = kobj_search_directory_with_create(kclass, "memory");
+	size_t mused, mfree;
+	int i;
+
+	for(i = 0; i < PAGE_HASH_SIZE; i++)
+		init_hlist_head(&page_table[i]);
+	init_list_head(&page_lru);
+
+	meminfo(&mused, &mfree);
+	page_limit = (mused + mfree) / 100 * CONFIG_VFS_PAGE_CACHE_PERCENT;
+	page_limit &= ~((size_t)CONFIG_VFS_PAGE_SIZE - 1);
+	page_count = 0;
+	page_dirty = 0;
+	page_hit = 0;
+	page_miss = 0;
+	page_writeback = 0;
+
+	kobj_add_regular(kobj, "pagecache", memory_read_pagecache, NULL, NULL);
+}
@@ -32,16 +32,26 @@
 #include <fs/vfs/stat.h>
 #include <fs/vfs/vfs.h>
 
-/* size of vnode hash table, must power 2 */
+/* minimum size of vnode hash table, must power 2 */
 #define VNODE_HASH_SIZE				(32)
 
 /*
  * vnode hash table.
  *
  * all opened vnodes are stored on this hash table.
- * they can be accessed by its path name.
+ * they can be accessed by its path name. the table
+ * grows and shrinks with the number of vnodes.
  */
-static struct list_head vnode_table[VNODE_HASH_SIZE];
+static struct list_head * vnode_table;
+static u32_t vnode_hash_size;
+static u32_t vnode_count;
+
+/*
+ * unused vnodes, kept for later lookups and
+ * released in least recently used order.
+ */
+static struct list_head vnode_unused;
+static u32_t vnode_unused_count;
 
 /*
  * get the hash value from the mount point and path name.
@@ -56,7 +66,89 @@ static u32_t vn_hash(struct mount_t * mp, char * path)
 			val = ((val << 5) + val) + *path++;
 	}
 
-	return (val ^ (u32_t)mp) & (VNODE_HASH_SIZE - 1);
+	return (val ^ (u32_t)((unsigned long)mp));
+}
+
+/*
+ * move all vnodes to a new hash table of specified size.
+ */
+static void vn_rehash(u32_t size)
+{
+	struct list_head * table;
+	struct vnode_t * vp, * n;
+	u32_t i;
+
+	table = malloc(size * sizeof(struct list_head));
+	if(!table)
+		return;
+	for(i = 0; i < size; i++)
+		init_list_head(&table[i]);
+
+	for(i = 0; i < vnode_hash_size; i++)
+	{
+		list_for_each_entry_safe(vp, n, &vnode_table[i], v_link)
+		{
+			list_del(&vp->v_link);
+			list_add(&vp->v_link, &table[vn_hash(vp->v_mount, vp->v_path) & (size - 1)]);
+		}
+	}
+	free(vnode_table);
+	vnode_table = table;
+	vnode_hash_size = size;
+}
+
+/*
+ * release vnode and its fs specific data.
+ */
+static void vn_free(struct vnode_t * vp, bool_t inactive)
+{
+	if(vp->v_refcnt <= 0 && !list_empty(&vp->v_lru))
+	{
+		list_del_init(&vp->v_lru);
+		vnode_unused_count--;
+	}
+	cache_purge(vp);
+	list_del(&vp->v_link);
+	vnode_count--;
+
+	/*
+	 * write back cached pages and deallocate fs specific vnode data
+	 */
+	if(inactive)
+		page_cache_sync(vp);
+	page_cache_purge(vp);
+	if(inactive)
+		vp->v_op->vop_inactive(vp);
+	vfs_unbusy(vp->v_mount);
+
+	free(vp->v_path);
+	free(vp);
+
+	if((vnode_hash_size > VNODE_HASH_SIZE) && (vnode_count < vnode_hash_size / 8))
+		vn_rehash(vnode_hash_size / 2);
+}
+
+/*
+ * the last reference is gone, keep vnode as unused or release it.
+ */
+static void vn_release(struct vnode_t * vp)
+{
+	struct vnode_t * old;
+
+	if(!vp->v_cached)
+	{
+		vn_free(vp, TRUE);
+		return;
+	}
+
+	list_add(&vp->v_lru, &vnode_unused);
+	vnode_unused_count++;
+
+	while(vnode_unused_count > CONFIG_VFS_VNODE_CACHE_COUNT)
+	{
+		old = list_last_entry(&vnode_unused, struct vnode_t, v_lru);
+		vn_free(old, TRUE);
+	}
 }
 
 /*
@@ -64,17 +156,15 @@ static u32_t vn_hash(struct mount_t * mp, char * path)
  */
 struct vnode_t * vn_lookup(struct mount_t * mp, char * path)
 {
-	struct list_head * pos;
 	struct list_head * head;
 	struct vnode_t * vp;
 
-	head = &vnode_table[vn_hash(mp, path)];
-	list_for_each(pos, head)
+	head = &vnode_table[vn_hash(mp, path) & (vnode_hash_size - 1)];
+	list_for_each_entry(vp, head, v_link)
 	{
-		vp = list_entry(pos, struct vnode_t, v_link);
 		if( (vp->v_mount == mp) && (!strncmp(vp->v_path, path, MAX_PATH)) )
 		{
-			vp->v_refcnt++;
+			vref(vp);
 			return vp;
 		}
 	}
@@ -104,6 +194,11 @@ struct vnode_t * vget(struct mount_t * mp, char * path)
 	vp->v_mount = mp;
 	vp->v_op = mp->m_fs->vfsops->vfs_vnops;
 	vp->v_refcnt = 1;
+	vp->v_cached = FALSE;
+	init_list_head(&vp->v_lru);
+	init_list_head(&vp->v_names);
+	init_list_head(&vp->v_aliases);
+	init_list_head(&vp->v_pages);
 	strlcpy(vp->v_path, path, len);
 
 	/*
@@ -119,7 +214,10 @@ struct vnode_t * vget(struct mount_t * mp, char * path)
 
 	vfs_busy(vp->v_mount);
 
-	list_add(&vp->v_link, &vnode_table[vn_hash(mp, path)]);
+	if(vnode_count >= vnode_hash_size * 2)
+		vn_rehash(vnode_hash_size * 2);
+	list_add(&vp->v_link, &vnode_table[vn_hash(mp, path) & (vnode_hash_size - 1)]);
+	vnode_count++;
 
 	return vp;
 }
@@ -134,16 +232,7 @@ void vput(struct vnode_t * vp)
 	if(vp->v_refcnt > 0)
 		return;
 
-	list_del(&vp->v_link);
-
-	/*
-	 * deallocate fs specific vnode data
-	 */
-	vp->v_op->vop_inactive(vp);
-	vfs_unbusy(vp->v_mount);
-
-	free(vp->v_path);
-	free(vp);
+	vn_release(vp);
 }
 
 /*
@@ -163,7 +252,11 @@ s32_t vcount(struct vnode_t * vp)
  */
 void vref(struct vnode_t * vp)
 {
-	vp->v_refcnt++;
+	if(vp->v_refcnt++ == 0)
+	{
+		list_del_init(&vp->v_lru);
+		vnode_unused_count--;
+	}
 }
 
 /*
@@ -176,16 +269,7 @@ void vrele(struct vnode_t * vp)
 	if(vp->v_refcnt > 0)
 		return;
 
-	list_del(&vp->v_link);
-
-	/*
-	 * deallocate fs specific vnode data
-	 */
-	vp->v_op->vop_inactive(vp);
-	vfs_unbusy(vp->v_mount);
-
-	free(vp->v_path);
-	free(vp);
+	vn_release(vp);
 }
 
 /*
@@ -193,35 +277,67 @@ void vrele(struct vnode_t * vp)
  */
 void vgone(struct vnode_t * vp)
 {
-	list_del(&vp->v_link);
-	vfs_unbusy(vp->v_mount);
-
-	free(vp->v_path);
-	free(vp);
+	vn_free(vp, FALSE);
 }
 
 /*
- * remove all vnode in the vnode table for unmount.
+ * release unused vnodes of mount point below path, and stop caching
+ * the active ones. a null path matches all vnodes of mount point.
  */
-void vflush(struct mount_t * mp)
+static void vn_flush(struct mount_t * mp, char * path)
 {
-	struct list_head * pos;
-	struct vnode_t * vp;
-	s32_t i;
+	struct vnode_t * vp, * n;
+	s32_t len = path ? strlen(path) : 0;
+	u32_t i;
 
-	for(i = 0; i < VNODE_HASH_SIZE; i++)
+again:
+	for(i = 0; i < vnode_hash_size; i++)
 	{
-		list_for_each(pos, &vnode_table[i])
+		list_for_each_entry_safe(vp, n, &vnode_table[i], v_link)
 		{
-			vp = list_entry(pos, struct vnode_t, v_link);
-			if(vp->v_mount == mp)
+			if(vp->v_mount != mp)
+				continue;
+			if(path && strncmp(vp->v_path, path, len) != 0)
+				continue;
+			if(path && (len > 1) && (vp->v_path[len] != '\0') && (vp->v_path[len] != '/'))
+				continue;
+			if(vp->v_refcnt <= 0)
 			{
-				/* TODO */
+				/*
+				 * the hash table may be resized, so start over
+				 */
+				vn_free(vp, TRUE);
+				goto again;
 			}
+			vp->v_cached = FALSE;
+			cache_purge(vp);
+			page_cache_sync(vp);
+			if(!path)
+				page_cache_purge(vp);
 		}
 	}
 }
 
+/*
+ * release all unused vnodes of mount point, and stop caching the
+ * active ones, so that the file system can be unmounted.
+ */
+void vflush(struct mount_t * mp)
+{
+	vn_flush(mp, NULL);
+}
+
+/*
+ * forget path and everything below it, after it has been renamed.
+ */
+void vn_invalidate(struct mount_t * mp, char * path)
+{
+	char buf[MAX_PATH];
+
+	strlcpy(buf, path, sizeof(buf));
+	vn_flush(mp, buf);
+}
+
 /*
  * get stat on vnode pointer.
  */
@@ -307,10 +423,36 @@ s32_t vn_access(struct vnode_t * vp, u32_t mode)
 	return 0;
 }
 
+static ssize_t vnode_read_count(struct kobj_t * kobj, void * buf, size_t size)
+{
+	return sprintf(buf, "%u", vnode_count);
+}
+
+static ssize_t vnode_read_unused(struct kobj_t * kobj, void * buf, size_t size)
+{
+	return sprintf(buf, "%u", vnode_unused_count);
+}
+
+static ssize_t vnode_read_hash_size(struct kobj_t * kobj, void * buf, size_t size)
+{
+	return sprintf(buf, "%u", vnode_hash_size);
+}
+
 void vfs_vnode_init(void)
 {
+	struct kobj_t * kclass = kobj_search_directory_with_create(kobj_get_root(), "class");
+	struct kobj_t * kobj = kobj_search_directory_with_create(kclass, "vfs");
 	int i;
 
-    for( i = 0; i < VNODE_HASH_SIZE; i++ )
-    	init_list_head(&vnode_table[i]);
+	vnode_table = malloc(VNODE_HASH_SIZE * sizeof(struct list_head));
+	vnode_hash_size = VNODE_HASH_SIZE;
+	vnode_count = 0;
+	for( i = 0; i < VNODE_HASH_SIZE; i++ )
+		init_list_head(&vnode_table[i]);
+	init_list_head(&vnode_unused);
+	vnode_unused_count = 0;
+
+	kobj_add_regular(kobj, "vnode-count", vnode_read_count, NULL, NULL);
+	kobj_add_regular(kobj, "vnode-unused", vnode_read_unused, NULL, NULL);
+	kobj_add_regular(kobj, "vnode-hash-size", vnode_read_hash_size, NULL, NULL);
 }
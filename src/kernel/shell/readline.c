@@ -647,6 +647,11 @@ char * readline(const char * prompt)
 				break;
 			}
 		}
+		else
+		{
+			/* nothing pumps events while waiting at the prompt */
+			probe_schedule();
+		}
 	}
 
 	if(rl->len > 0)
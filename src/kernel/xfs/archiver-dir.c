@@ -237,6 +237,15 @@ static s64_t dir_length(void * f)
 	return 0;
 }
 
+static const void * dir_map(void * f)
+{
+	struct fhandle_dir_t * fh = (struct fhandle_dir_t *)f;
+	const void * addr;
+	if(ioctl(fh->fd, VFS_IOCTL_MMAP, &addr) == 0)
+		return addr;
+	return NULL;
+}
+
 static void dir_close(void * f)
 {
 	struct fhandle_dir_t * fh = (struct fhandle_dir_t *)f;
@@ -258,6 +267,7 @@ static struct xfs_archiver_t archiver_dir = {
 	.write		= dir_write,
 	.seek		= dir_seek,
 	.length		= dir_length,
+	.map		= dir_map,
 	.close		= dir_close,
 };
 
@@ -407,6 +407,15 @@ static s64_t tar_length(void * f)
 	return fh->size;
 }
 
+static const void * tar_map(void * f)
+{
+	struct fhandle_tar_t * fh = (struct fhandle_tar_t *)f;
+	const void * addr;
+	if(ioctl(fh->fd, VFS_IOCTL_MMAP, &addr) == 0)
+		return (const u8_t *)addr + fh->start;
+	return NULL;
+}
+
 static void tar_close(void * f)
 {
 	struct fhandle_tar_t * fh = (struct fhandle_tar_t *)f;
@@ -427,6 +436,7 @@ static struct xfs_archiver_t archiver_tar = {
 	.write		= tar_write,
 	.seek		= tar_seek,
 	.length		= tar_length,
+	.map		= tar_map,
 	.close		= tar_close,
 };
 
@@ -0,0 +1,629 @@
+/*
+ * kernel/xfs/archiver-zip.c
+ *
+ * Copyright(c) 2007-2018 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <zlib.h>
+#include <xfs/archiver.h>
+
+/*
+ * Only the central directory is read at mount. Stored entries are read
+ * and mapped straight from the archive. Deflated entries are inflated on
+ * demand, the last inflated chunk is kept so that short seeks backwards
+ * do not restart the stream.
+ */
+enum {
+	ZIP_METHOD_STORED		= 0,
+	ZIP_METHOD_DEFLATED		= 8,
+};
+
+#define ZIP_SIG_LOCAL			(0x04034b50)
+#define ZIP_SIG_CENTRAL			(0x02014b50)
+#define ZIP_SIG_END				(0x06054b50)
+
+#define ZIP_LOCAL_SIZE			(30)
+#define ZIP_CENTRAL_SIZE		(46)
+#define ZIP_END_SIZE			(22)
+#define ZIP_INPUT_SIZE			(SZ_4K)
+
+struct mhandle_zip_t {
+	struct list_head list;
+	struct hlist_head * hash;
+	int hsize;
+	int fd;
+};
+
+struct entry_zip_t {
+	struct list_head head;
+	struct hlist_node node;
+	char * name;
+	int64_t local;
+	int64_t start;
+	int64_t csize;
+	int64_t size;
+	int method;
+	int isdir;
+};
+
+struct fhandle_zip_t {
+	struct entry_zip_t * e;
+	int64_t offset;
+	int fd;
+
+	/* inflate state, only for deflated entries */
+	z_stream z;
+	int64_t zin;
+	int64_t zout;
+	unsigned char * ibuf;
+	unsigned char * win;
+	int64_t wstart;
+	int64_t wlen;
+};
+
+static inline uint32_t zip_get16(const unsigned char * p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t zip_get32(const unsigned char * p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static struct hlist_head * entry_hash(struct mhandle_zip_t * m, const char * name)
+{
+	unsigned char * p = (unsigned char *)name;
+	unsigned int seed = 131;
+	unsigned int hash = 0;
+
+	while(*p)
+	{
+		hash = hash * seed + (*p++);
+	}
+	return &m->hash[hash % m->hsize];
+}
+
+static struct entry_zip_t * search_entry(struct mhandle_zip_t * m, const char * name)
+{
+	struct entry_zip_t * pos;
+	struct hlist_node * n;
+
+	if(!name)
+		return NULL;
+
+	hlist_for_each_entry_safe(pos, n, entry_hash(m, name), node)
+	{
+		if((strcmp(pos->name, name) == 0))
+			return pos;
+	}
+	return NULL;
+}
+
+static struct entry_zip_t * add_entry(struct mhandle_zip_t * m, const char * name, int isdir)
+{
+	struct entry_zip_t * e;
+
+	e = malloc(sizeof(struct entry_zip_t));
+	if(!e)
+		return NULL;
+	e->name = strdup(name);
+	if(!e->name)
+	{
+		free(e);
+		return NULL;
+	}
+	e->local = 0;
+	e->start = -1;
+	e->csize = 0;
+	e->size = 0;
+	e->method = ZIP_METHOD_STORED;
+	e->isdir = isdir;
+	init_list_head(&e->head);
+	list_add_tail(&e->head, &m->list);
+	init_hlist_node(&e->node);
+	hlist_add_head(&e->node, entry_hash(m, e->name));
+	return e;
+}
+
+/*
+ * archives often leave out the directories, make up the missing parents
+ */
+static void add_parents(struct mhandle_zip_t * m, char * name)
+{
+	struct entry_zip_t * e;
+	char * p;
+
+	for(p = strchr(name, '/'); p; p = strchr(p + 1, '/'))
+	{
+		*p = '\0';
+		e = search_entry(m, name);
+		if(!e)
+			add_entry(m, name, TRUE);
+		*p = '/';
+	}
+}
+
+static void free_mhandle(struct mhandle_zip_t * m)
+{
+	struct entry_zip_t * pos, * n;
+
+	if(m)
+	{
+		list_for_each_entry_safe(pos, n, &m->list, head)
+		{
+			list_del(&pos->head);
+			hlist_del(&pos->node);
+			free(pos->name);
+			free(pos);
+		}
+		free(m->hash);
+		free(m);
+	}
+}
+
+static int64_t find_end(int fd, unsigned char * end)
+{
+	unsigned char * buf;
+	int64_t size, off;
+	int len, i;
+
+	size = lseek(fd, 0, SEEK_END);
+	if(size < ZIP_END_SIZE)
+		return -1;
+
+	/* the end record is followed by a comment of up to 64k */
+	len = (size < ZIP_END_SIZE + 0xffff) ? size : ZIP_END_SIZE + 0xffff;
+	off = size - len;
+	buf = malloc(len);
+	if(!buf)
+		return -1;
+	lseek(fd, off, SEEK_SET);
+	if(read(fd, buf, len) != len)
+	{
+		free(buf);
+		return -1;
+	}
+	for(i = len - ZIP_END_SIZE; i >= 0; i--)
+	{
+		if((zip_get32(&buf[i]) == ZIP_SIG_END) && (i + ZIP_END_SIZE + zip_get16(&buf[i + 20]) <= len))
+		{
+			memcpy(end, &buf[i], ZIP_END_SIZE);
+			free(buf);
+			return off + i;
+		}
+	}
+	free(buf);
+	return -1;
+}
+
+static struct mhandle_zip_t * alloc_mhandle(int fd)
+{
+	struct mhandle_zip_t * m;
+	struct entry_zip_t * e;
+	unsigned char end[ZIP_END_SIZE];
+	unsigned char * cd, * p;
+	int64_t eoff, cdoff, cdsize, csize, size;
+	uint32_t count, nlen, method, i;
+	char name[MAX_PATH];
+	int l;
+
+	eoff = find_end(fd, end);
+	if(eoff < 0)
+		return NULL;
+
+	/* single disk archives, no zip64 */
+	count = zip_get16(&end[10]);
+	cdsize = zip_get32(&end[12]);
+	cdoff = zip_get32(&end[16]);
+	if((zip_get16(&end[4]) != 0) || (zip_get16(&end[6]) != 0) || (count != zip_get16(&end[8])))
+		return NULL;
+	if((count == 0xffff) || (cdoff == 0xffffffff) || (cdoff + cdsize > eoff))
+		return NULL;
+
+	cd = malloc(cdsize);
+	if(!cd)
+		return NULL;
+	lseek(fd, cdoff, SEEK_SET);
+	if(read(fd, cd, cdsize) != cdsize)
+	{
+		free(cd);
+		return NULL;
+	}
+
+	m = malloc(sizeof(struct mhandle_zip_t));
+	if(!m)
+	{
+		free(cd);
+		return NULL;
+	}
+	m->hsize = (count > 8) ? count * 2 : 16;
+	m->fd = fd;
+	m->hash = malloc(sizeof(struct hlist_head) * m->hsize);
+	if(!m->hash)
+	{
+		free(cd);
+		free(m);
+		return NULL;
+	}
+	init_list_head(&m->list);
+	for(i = 0; i < m->hsize; i++)
+		init_hlist_head(&m->hash[i]);
+
+	for(i = 0, p = cd; i < count; i++)
+	{
+		if((p + ZIP_CENTRAL_SIZE > cd + cdsize) || (zip_get32(p) != ZIP_SIG_CENTRAL))
+			break;
+		nlen = zip_get16(&p[28]);
+		method = zip_get16(&p[10]);
+		csize = zip_get32(&p[20]);
+		size = zip_get32(&p[24]);
+		if(p + ZIP_CENTRAL_SIZE + nlen > cd + cdsize)
+			break;
+
+		/* skip encrypted entries, unknown methods and names too long */
+		if(!(zip_get16(&p[8]) & 0x1) && ((method == ZIP_METHOD_DEFLATED) || ((method == ZIP_METHOD_STORED) && (csize == size))) && (nlen < sizeof(name)))
+		{
+			memcpy(name, &p[ZIP_CENTRAL_SIZE], nlen);
+			name[nlen] = '\0';
+			l = nlen;
+			while((l > 0) && (name[l - 1] == '/'))
+				name[--l] = '\0';
+
+			if((l > 0) && !search_entry(m, name))
+			{
+				add_parents(m, name);
+				e = add_entry(m, name, (l < nlen) ? TRUE : FALSE);
+				if(!e)
+					break;
+				e->method = method;
+				e->csize = csize;
+				e->size = size;
+				e->local = zip_get32(&p[42]);
+			}
+		}
+		p += ZIP_CENTRAL_SIZE + nlen + zip_get16(&p[30]) + zip_get16(&p[32]);
+	}
+	free(cd);
+
+	if(list_empty(&m->list))
+	{
+		free_mhandle(m);
+		return NULL;
+	}
+	return m;
+}
+
+/*
+ * the local header may have another extra field than the central one,
+ * so the data offset is only known after reading it.
+ */
+static int64_t entry_start(int fd, struct entry_zip_t * e)
+{
+	unsigned char buf[ZIP_LOCAL_SIZE];
+
+	if(e->start < 0)
+	{
+		lseek(fd, e->local, SEEK_SET);
+		if((read(fd, buf, ZIP_LOCAL_SIZE) != ZIP_LOCAL_SIZE) || (zip_get32(buf) != ZIP_SIG_LOCAL))
+			return -1;
+		e->start = e->local + ZIP_LOCAL_SIZE + zip_get16(&buf[26]) + zip_get16(&buf[28]);
+	}
+	return e->start;
+}
+
+static void * zip_mount(const char * path, int * writable)
+{
+	struct mhandle_zip_t * m;
+	struct stat st;
+	int fd;
+
+	if((stat(path, &st) != 0) || !S_ISREG(st.st_mode))
+		return NULL;
+
+	fd = open(path, O_RDONLY, (S_IRUSR|S_IRGRP|S_IROTH));
+	if(fd < 0)
+		return NULL;
+
+	m = alloc_mhandle(fd);
+	if(!m)
+	{
+		close(fd);
+		return NULL;
+	}
+
+	if(writable)
+		*writable = 0;
+	return m;
+}
+
+static void zip_umount(void * m)
+{
+	struct mhandle_zip_t * mh = (struct mhandle_zip_t *)m;
+
+	if(mh)
+	{
+		close(mh->fd);
+		free_mhandle(mh);
+	}
+}
+
+static void zip_walk(void * m, const char * name, xfs_walk_callback_t cb, void * data)
+{
+	struct mhandle_zip_t * mh = (struct mhandle_zip_t *)m;
+	struct entry_zip_t * e = search_entry(mh, name);
+	struct entry_zip_t * pos, * n;
+	char * p;
+	int l = strlen(name);
+
+	if((l != 0) && (!e || !e->isdir))
+		return;
+
+	list_for_each_entry_safe(pos, n, &mh->list, head)
+	{
+		if(l == 0)
+		{
+			if(!strchr(pos->name, '/'))
+				cb(name, pos->name, data);
+		}
+		else if((strncmp(name, pos->name, l) == 0) && (pos->name[l] == '/'))
+		{
+			p = &pos->name[l + 1];
+			if(!strchr(p, '/'))
+				cb(name, p, data);
+		}
+	}
+}
+
+static bool_t zip_isdir(void * m, const char * name)
+{
+	struct mhandle_zip_t * mh = (struct mhandle_zip_t *)m;
+	struct entry_zip_t * e;
+
+	if(name && (*name == '\0'))
+		return TRUE;
+	e = search_entry(mh, name);
+	return (e && e->isdir) ? TRUE : FALSE;
+}
+
+static bool_t zip_isfile(void * m, const char * name)
+{
+	struct mhandle_zip_t * mh = (struct mhandle_zip_t *)m;
+	struct entry_zip_t * e = search_entry(mh, name);
+	return (e && !e->isdir) ? TRUE : FALSE;
+}
+
+static bool_t zip_mkdir(void * m, const char * name)
+{
+	return FALSE;
+}
+
+static bool_t zip_remove(void * m, const char * name)
+{
+	return FALSE;
+}
+
+static void * zip_open(void * m, const char * name, int mode)
+{
+	struct mhandle_zip_t * mh = (struct mhandle_zip_t *)m;
+	struct fhandle_zip_t * fh;
+	struct entry_zip_t * e;
+
+	if(mode != XFS_OPEN_MODE_READ)
+		return NULL;
+	e = search_entry(mh, name);
+	if(!e || e->isdir)
+		return NULL;
+	if(entry_start(mh->fd, e) < 0)
+		return NULL;
+
+	fh = malloc(sizeof(struct fhandle_zip_t));
+	if(!fh)
+		return NULL;
+	memset(fh, 0, sizeof(struct fhandle_zip_t));
+	fh->e = e;
+	fh->fd = mh->fd;
+
+	if(e->method == ZIP_METHOD_DEFLATED)
+	{
+		fh->ibuf = malloc(ZIP_INPUT_SIZE);
+		fh->win = malloc(CONFIG_XFS_ZIP_WINDOW_SIZE);
+		if(!fh->ibuf || !fh->win || (inflateInit2(&fh->z, -MAX_WBITS) != Z_OK))
+		{
+			free(fh->ibuf);
+			free(fh->win);
+			free(fh);
+			return NULL;
+		}
+	}
+	return ((void *)fh);
+}
+
+/*
+ * inflate the next chunk of the entry into the window
+ */
+static bool_t zip_inflate(struct fhandle_zip_t * fh)
+{
+	struct entry_zip_t * e = fh->e;
+	int64_t n;
+	int ret;
+
+	fh->z.next_out = fh->win;
+	fh->z.avail_out = CONFIG_XFS_ZIP_WINDOW_SIZE;
+	fh->wstart = fh->zout;
+	fh->wlen = 0;
+
+	while(fh->z.avail_out > 0)
+	{
+		if((fh->z.avail_in == 0) && (fh->zin < e->csize))
+		{
+			n = e->csize - fh->zin;
+			if(n > ZIP_INPUT_SIZE)
+				n = ZIP_INPUT_SIZE;
+			lseek(fh->fd, e->start + fh->zin, SEEK_SET);
+			if(read(fh->fd, fh->ibuf, n) != n)
+				break;
+			fh->zin += n;
+			fh->z.next_in = fh->ibuf;
+			fh->z.avail_in = n;
+		}
+		ret = inflate(&fh->z, Z_NO_FLUSH);
+		if((ret != Z_OK) || ((fh->z.avail_in == 0) && (fh->zin >= e->csize)))
+			break;
+	}
+	fh->wlen = CONFIG_XFS_ZIP_WINDOW_SIZE - fh->z.avail_out;
+	fh->zout += fh->wlen;
+	return (fh->wlen > 0) ? TRUE : FALSE;
+}
+
+static void zip_rewind(struct fhandle_zip_t * fh)
+{
+	inflateReset(&fh->z);
+	fh->z.avail_in = 0;
+	fh->zin = 0;
+	fh->zout = 0;
+	fh->wstart = 0;
+	fh->wlen = 0;
+}
+
+static s64_t zip_read(void * f, void * buf, s64_t size)
+{
+	struct fhandle_zip_t * fh = (struct fhandle_zip_t *)f;
+	struct entry_zip_t * e = fh->e;
+	unsigned char * p = buf;
+	s64_t len = 0, n;
+
+	if(size > e->size - fh->offset)
+		size = e->size - fh->offset;
+	if(size <= 0)
+		return 0;
+
+	if(e->method == ZIP_METHOD_STORED)
+	{
+		lseek(fh->fd, e->start + fh->offset, SEEK_SET);
+		len = read(fh->fd, buf, size);
+		if(len > 0)
+			fh->offset += len;
+		return (len > 0) ? len : 0;
+	}
+
+	while(len < size)
+	{
+		if((fh->offset >= fh->wstart) && (fh->offset < fh->wstart + fh->wlen))
+		{
+			n = fh->wstart + fh->wlen - fh->offset;
+			if(n > size - len)
+				n = size - len;
+			memcpy(p + len, fh->win + (fh->offset - fh->wstart), n);
+			fh->offset += n;
+			len += n;
+			continue;
+		}
+		if(fh->offset < fh->wstart)
+			zip_rewind(fh);
+		if(!zip_inflate(fh))
+			break;
+	}
+	return len;
+}
+
+static s64_t zip_write(void * f, void * buf, s64_t size)
+{
+	return 0;
+}
+
+static s64_t zip_seek(void * f, s64_t offset)
+{
+	struct fhandle_zip_t * fh = (struct fhandle_zip_t *)f;
+
+	if(offset < 0)
+		fh->offset = 0;
+	else if(offset > fh->e->size)
+		fh->offset = fh->e->size;
+	else
+		fh->offset = offset;
+	return fh->offset;
+}
+
+static s64_t zip_length(void * f)
+{
+	struct fhandle_zip_t * fh = (struct fhandle_zip_t *)f;
+	return fh->e->size;
+}
+
+static const void * zip_map(void * f)
+{
+	struct fhandle_zip_t * fh = (struct fhandle_zip_t *)f;
+	const void * addr;
+
+	if(fh->e->method != ZIP_METHOD_STORED)
+		return NULL;
+	if(ioctl(fh->fd, VFS_IOCTL_MMAP, &addr) == 0)
+		return (const u8_t *)addr + fh->e->start;
+	return NULL;
+}
+
+static void zip_close(void * f)
+{
+	struct fhandle_zip_t * fh = (struct fhandle_zip_t *)f;
+
+	if(fh->e->method == ZIP_METHOD_DEFLATED)
+	{
+		inflateEnd(&fh->z);
+		free(fh->ibuf);
+		free(fh->win);
+	}
+	free(fh);
+}
+
+static struct xfs_archiver_t archiver_zip = {
+	.name		= "zip",
+	.mount		= zip_mount,
+	.umount 	= zip_umount,
+	.walk		= zip_walk,
+	.isdir		= zip_isdir,
+	.isfile		= zip_isfile,
+	.mkdir		= zip_mkdir,
+	.remove		= zip_remove,
+	.open		= zip_open,
+	.read		= zip_read,
+	.write		= zip_write,
+	.seek		= zip_seek,
+	.length		= zip_length,
+	.map		= zip_map,
+	.close		= zip_close,
+};
+
+static __init void archiver_zip_init(void)
+{
+	register_archiver(&archiver_zip);
+}
+
+static __exit void archiver_zip_exit(void)
+{
+	unregister_archiver(&archiver_zip);
+}
+
+core_initcall(archiver_zip_init);
+core_exitcall(archiver_zip_exit);
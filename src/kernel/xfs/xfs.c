@@ -68,6 +68,161 @@ static char * normal_path(const char * path)
 	return buf;
 }
 
+static u32_t xfs_index_hash(const char * path)
+{
+	u32_t val = 5381;
+
+	while(*path)
+		val = ((val << 5) + val) + *path++;
+
+	return val;
+}
+
+/*
+ * the index lists are only walked and changed with ctx->lock held
+ */
+static struct xfs_index_t * xfs_index_find(struct xfs_context_t * ctx, const char * path, u32_t hash)
+{
+	struct xfs_index_t * idx;
+
+	hlist_for_each_entry(idx, &ctx->index[hash & (XFS_INDEX_HASH_SIZE - 1)], node)
+	{
+		if((idx->hash == hash) && (strcmp(idx->path, path) == 0))
+			return idx;
+	}
+	return NULL;
+}
+
+static void xfs_index_unlink(struct xfs_context_t * ctx, struct xfs_index_t * idx)
+{
+	hlist_del(&idx->node);
+	list_del(&idx->lru);
+	ctx->index_count--;
+}
+
+static void xfs_index_free(struct xfs_index_t * idx)
+{
+	if(idx)
+	{
+		free(idx->path);
+		free(idx);
+	}
+}
+
+/*
+ * get the index entry of a normalized path, a new entry knows nothing
+ * yet. returns null if out of memory, the caller then asks the mounts.
+ */
+static struct xfs_index_t * xfs_index_get(struct xfs_context_t * ctx, const char * path)
+{
+	struct xfs_index_t * idx, * old = NULL;
+	irq_flags_t flags;
+	u32_t hash = xfs_index_hash(path);
+
+	spin_lock_irqsave(&ctx->lock, flags);
+	idx = xfs_index_find(ctx, path, hash);
+	if(idx)
+		list_move(&idx->lru, &ctx->index_lru);
+	spin_unlock_irqrestore(&ctx->lock, flags);
+	if(idx)
+		return idx;
+
+	idx = malloc(sizeof(struct xfs_index_t));
+	if(!idx)
+		return NULL;
+	idx->path = strdup(path);
+	if(!idx->path)
+	{
+		free(idx);
+		return NULL;
+	}
+	idx->hash = hash;
+	idx->isdir = -1;
+	idx->isfile = -1;
+	idx->file = NULL;
+
+	spin_lock_irqsave(&ctx->lock, flags);
+	if(ctx->index_count >= CONFIG_XFS_INDEX_COUNT)
+	{
+		old = list_last_entry(&ctx->index_lru, struct xfs_index_t, lru);
+		xfs_index_unlink(ctx, old);
+	}
+	hlist_add_head(&idx->node, &ctx->index[hash & (XFS_INDEX_HASH_SIZE - 1)]);
+	list_add(&idx->lru, &ctx->index_lru);
+	ctx->index_count++;
+	spin_unlock_irqrestore(&ctx->lock, flags);
+	xfs_index_free(old);
+
+	return idx;
+}
+
+/*
+ * forget a path changed through a writable mount
+ */
+static void xfs_index_drop(struct xfs_context_t * ctx, const char * path)
+{
+	struct xfs_index_t * idx;
+	irq_flags_t flags;
+
+	spin_lock_irqsave(&ctx->lock, flags);
+	idx = xfs_index_find(ctx, path, xfs_index_hash(path));
+	if(idx)
+		xfs_index_unlink(ctx, idx);
+	spin_unlock_irqrestore(&ctx->lock, flags);
+	xfs_index_free(idx);
+}
+
+/*
+ * forget everything, the set of mounts has changed
+ */
+static void xfs_index_flush(struct xfs_context_t * ctx)
+{
+	struct xfs_index_t * idx;
+	irq_flags_t flags;
+
+	do
+	{
+		idx = NULL;
+		spin_lock_irqsave(&ctx->lock, flags);
+		if(!list_empty(&ctx->index_lru))
+		{
+			idx = list_first_entry(&ctx->index_lru, struct xfs_index_t, lru);
+			xfs_index_unlink(ctx, idx);
+		}
+		spin_unlock_irqrestore(&ctx->lock, flags);
+		xfs_index_free(idx);
+	} while(idx);
+}
+
+static struct xfs_path_t * xfs_search_file(struct xfs_context_t * ctx, const char * path)
+{
+	struct xfs_path_t * pos, * n;
+	struct xfs_index_t * idx;
+
+	idx = xfs_index_get(ctx, path);
+	if(idx && (idx->isfile >= 0))
+		return idx->file;
+
+	list_for_each_entry_safe_reverse(pos, n, &ctx->mounts.list, list)
+	{
+		if(pos->archiver->isfile(pos->mhandle, path))
+		{
+			if(idx)
+			{
+				idx->isfile = 1;
+				idx->file = pos;
+			}
+			return pos;
+		}
+	}
+	if(idx)
+	{
+		idx->isfile = 0;
+		idx->file = NULL;
+	}
+	return NULL;
+}
+
 bool_t xfs_mount(struct xfs_context_t * ctx, const char * path, int writable)
 {
 	struct xfs_path_t * pos, * n;
@@ -101,6 +256,7 @@ bool_t xfs_mount(struct xfs_context_t * ctx, const char * path, int writable)
 	init_list_head(&p->list);
 	list_add_tail(&p->list, &ctx->mounts.list);
 	spin_unlock_irqrestore(&ctx->lock, flags);
+	xfs_index_flush(ctx);
 
 	return TRUE;
 }
@@ -120,6 +276,7 @@ bool_t xfs_umount(struct xfs_context_t * ctx, const char * path)
 			spin_lock_irqsave(&ctx->lock, flags);
 			list_del(&pos->list);
 			spin_unlock_irqrestore(&ctx->lock, flags);
+			xfs_index_flush(ctx);
 
 			pos->archiver->umount(pos->mhandle);
 			free(pos->path);
@@ -150,37 +307,47 @@ void xfs_walk(struct xfs_context_t * ctx, const char * name, xfs_walk_callback_t
 bool_t xfs_isdir(struct xfs_context_t * ctx, const char * name)
 {
 	struct xfs_path_t * pos, * n;
+	struct xfs_index_t * idx;
 	char * path;
+	int ret = FALSE;
 
 	path = normal_path(name);
 	if(!path)
 		return FALSE;
 
+	idx = xfs_index_get(ctx, path);
+	if(idx && (idx->isdir >= 0))
+	{
+		free(path);
+		return idx->isdir;
+	}
+
 	list_for_each_entry_safe_reverse(pos, n, &ctx->mounts.list, list)
 	{
 		if(pos->archiver->isdir(pos->mhandle, path))
-			return TRUE;
+		{
+			ret = TRUE;
+			break;
+		}
 	}
+	if(idx)
+		idx->isdir = ret;
 	free(path);
-	return FALSE;
+	return ret;
 }
 
 bool_t xfs_isfile(struct xfs_context_t * ctx, const char * name)
 {
-	struct xfs_path_t * pos, * n;
 	char * path;
+	int ret;
 
 	path = normal_path(name);
 	if(!path)
 		return FALSE;
 
-	list_for_each_entry_safe_reverse(pos, n, &ctx->mounts.list, list)
-	{
-		if(pos->archiver->isfile(pos->mhandle, path))
-			return TRUE;
-	}
+	ret = xfs_search_file(ctx, path) ? TRUE : FALSE;
 	free(path);
-	return FALSE;
+	return ret;
 }
 
 bool_t xfs_mkdir(struct xfs_context_t * ctx, const char * name)
@@ -201,6 +368,7 @@ bool_t xfs_mkdir(struct xfs_context_t * ctx, const char * name)
 			break;
 		}
 	}
+	xfs_index_drop(ctx, path);
 	free(path);
 	return ret;
 }
@@ -223,6 +391,7 @@ bool_t xfs_remove(struct xfs_context_t * ctx, const char * name)
 			break;
 		}
 	}
+	xfs_index_drop(ctx, path);
 	free(path);
 	return ret;
 }
@@ -232,24 +401,35 @@ struct xfs_file_t * xfs_open_read(struct xfs_context_t * ctx, const char * name)
 	struct xfs_path_t * pos, * n;
 	struct xfs_file_t * file = NULL;
 	char * path;
-	void * f;
+	void * f = NULL;
 
 	path = normal_path(name);
 	if(!path)
 		return NULL;
 
-	list_for_each_entry_safe_reverse(pos, n, &ctx->mounts.list, list)
+	pos = xfs_search_file(ctx, path);
+	if(pos)
 	{
 		f = pos->archiver->open(pos->mhandle, path, XFS_OPEN_MODE_READ);
-		if(f)
+		if(!f)
 		{
-			file = malloc(sizeof(struct xfs_file_t));
-			file->ctx = ctx;
-			file->path = pos;
-			file->fhandle = f;
-			break;
+			/* the index is stale, ask every mount again */
+			xfs_index_drop(ctx, path);
+			list_for_each_entry_safe_reverse(pos, n, &ctx->mounts.list, list)
+			{
+				f = pos->archiver->open(pos->mhandle, path, XFS_OPEN_MODE_READ);
+				if(f)
+					break;
+			}
 		}
 	}
+	if(f)
+	{
+		file = malloc(sizeof(struct xfs_file_t));
+		file->ctx = ctx;
+		file->path = pos;
+		file->fhandle = f;
+	}
 	free(path);
 	return file;
 }
@@ -280,6 +460,7 @@ struct xfs_file_t * xfs_open_write(struct xfs_context_t * ctx, const char * name
 			}
 		}
 	}
+	xfs_index_drop(ctx, path);
 	free(path);
 	return file;
 }
@@ -310,6 +491,7 @@ struct xfs_file_t * xfs_open_append(struct xfs_context_t * ctx, const char * nam
 			}
 		}
 	}
+	xfs_index_drop(ctx, path);
 	free(path);
 	return file;
 }
@@ -342,6 +524,13 @@ s64_t xfs_length(struct xfs_file_t * file)
 	return 0;
 }
 
+const void * xfs_map(struct xfs_file_t * file)
+{
+	if(file && file->path->archiver->map)
+		return file->path->archiver->map(file->fhandle);
+	return NULL;
+}
+
 void xfs_close(struct xfs_file_t * file)
 {
 	if(file)
@@ -358,12 +547,16 @@ struct xfs_context_t * __xfs_alloc(const char * path)
 	char fpath[MAX_PATH];
 	char userdata[256];
 	uint8_t digest[20];
+	int i;
 
 	ctx = malloc(sizeof(struct xfs_context_t));
 	if(!ctx)
 		return NULL;
 	memset(ctx, 0, sizeof(struct xfs_context_t));
 	init_list_head(&ctx->mounts.list);
+	for(i = 0; i < XFS_INDEX_HASH_SIZE; i++)
+		init_hlist_head(&ctx->index[i]);
+	init_list_head(&ctx->index_lru);
 	spin_lock_init(&ctx->lock);
 
 	if(path && vfs_path_conv(path, fpath) >= 0)
@@ -388,6 +581,7 @@ void __xfs_free(struct xfs_context_t * ctx)
 	if(!ctx)
 		return;
 
+	xfs_index_flush(ctx);
 	list_for_each_entry_safe(pos, n, &ctx->mounts.list, list)
 	{
 		spin_lock_irqsave(&ctx->lock, flags);
@@ -842,6 +842,12 @@ void free(void * ptr)
 }
 EXPORT_SYMBOL(free);
 
+void meminfo(size_t * mused, size_t * mfree)
+{
+	mm_info(mm_get(__heap_pool), mused, mfree);
+}
+EXPORT_SYMBOL(meminfo);
+
 static struct kobj_t * search_class_memory_kobj(void)
 {
 	struct kobj_t * kclass = kobj_search_directory_with_create(kobj_get_root(), "class");
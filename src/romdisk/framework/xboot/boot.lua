@@ -3,6 +3,7 @@
 --
 Json = require "builtin.json"
 Stopwatch = require "builtin.stopwatch"
+Aio = require "builtin.aio"
 Base64 = require "builtin.base64"
 Matrix = require "builtin.matrix"
 Easing = require "builtin.easing"